@@ -761,9 +761,19 @@ int main(int argc, char *argv[])
 		fr_schedule_config_t *schedule;
 
 		schedule = talloc_zero(global_ctx, fr_schedule_config_t);
-		schedule->max_workers = config->max_networks;
-		schedule->max_networks = config->max_workers;
+		schedule->max_networks = config->max_networks;
+		schedule->max_workers = config->max_workers;
+		schedule->scale_max_workers = config->scale_max_workers;
+		schedule->scale_interval = config->scale_interval;
 		schedule->stats_interval = config->stats_interval;
+		schedule->network_cpus = config->network_cpus;
+		schedule->worker_cpus = config->worker_cpus;
+		schedule->network_numa_nodes = config->network_numa_nodes;
+		schedule->worker_numa_nodes = config->worker_numa_nodes;
+		schedule->work_stealing = config->work_stealing;
+		schedule->source_affinity = config->source_affinity;
+		schedule->spin_time = config->spin_time;
+		schedule->timer_resolution = config->timer_resolution;
 
 		/*
 		 *	Single server mode: use the global event list.
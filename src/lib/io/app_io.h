@@ -47,6 +47,8 @@ typedef struct {
 	fr_io_set_fd_t			fd_set;		//!< Set the file descriptor to the instance.
 
 	fr_io_data_read_t		read;		//!< Read from a socket to a data buffer
+	fr_io_data_pending_t		pending;	//!< Are there packets which have been read, but
+							//!< not yet returned by read()?
 	fr_io_data_write_t		write;		//!< Write from a data buffer to a socket
 
 	fr_io_data_inject_t		inject;		//!< Inject a packet into a socket.
@@ -56,7 +58,8 @@ typedef struct {
 	fr_io_decode_t			decode;		//!< Translate raw bytes into VALUE_PAIRs and metadata.
 	fr_io_encode_t			encode;		//!< Pack VALUE_PAIRs back into a byte array.
 
-	fr_io_signal_t			flush;		//!< Flush the data when the socket is ready for writing.
+	fr_io_signal_t			flush;		//!< Write any packets which were queued by write().
+							//!< Called by the network after each batch of replies.
 
 	fr_io_signal_t			error;		//!< There was an error on the socket.
 	fr_io_close_t			close;		//!< Close the transport.
@@ -70,6 +73,7 @@ typedef struct {
 	 *	Either in a buffer, or in a newly-allocated memory.
 	 */
 	fr_io_data_cmp_t		compare;	//!< compare two packets
+	fr_io_data_hash_t		hash;		//!< hash a packet, consistently with compare
 
 	fr_io_connection_set_t		connection_set;	//!< set src/dst IP/port of a connection
 	fr_io_network_get_t		network_get;	//!< get dynamic network information
@@ -88,6 +88,23 @@ typedef void (*fr_app_entry_point_set_t)(void const *instance, REQUEST *request)
  */
 typedef int (*fr_app_priority_get_t)(void const *instance, uint8_t const *buffer, size_t buflen);
 
+/** Get the affinity key of a packet
+ *
+ * Packets which return the same key are part of the same conversation
+ * (e.g. the rounds of an EAP exchange), and should preferably be
+ * processed by the same worker.
+ *
+ * @param[in] instance		of the #fr_app_t.
+ * @param[in] packet_ctx	from the #fr_app_io_t read() routine.
+ * @param[in] buffer		raw packet
+ * @param[in] buflen		length of the packet
+ * @return
+ *	0  - the packet has no affinity
+ *	*  - the affinity key of this packet
+ */
+typedef uint32_t (*fr_app_affinity_get_t)(void const *instance, void const *packet_ctx,
+					  uint8_t const *buffer, size_t buflen);
+
 /** Called by the network thread to pass an event list for the module to use for timer events
  */
 typedef void (*fr_app_event_list_set_t)(fr_listen_t *li, fr_event_list_t *el, void *nr);
@@ -131,6 +148,9 @@ typedef struct {
 							///< change based on the packet we received.
 
 	fr_app_priority_get_t		priority;	//!< Assign a priority to the packet.
+
+	fr_app_affinity_get_t		affinity;	//!< Return a key used to send related packets
+							///< to the same worker.  May be NULL.
 } fr_app_t;
 
 /** Public structure describing an application (protocol) specialisation
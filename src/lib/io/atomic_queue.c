@@ -224,6 +224,29 @@ bool fr_atomic_queue_pop(fr_atomic_queue_t *aq, void **p_data)
 	return true;
 }
 
+/** Check if there's data in the queue, without removing it.
+ *
+ *  This is cheaper than a pop, as it doesn't need to write to shared
+ *  memory.  It's intended for readers which are polling the queue.
+ *
+ * @param[in] aq	the atomic queue to check.
+ * @return
+ *	- true if a pop would succeed.
+ *	- false on queue empty
+ */
+bool fr_atomic_queue_ready(fr_atomic_queue_t *aq)
+{
+	int64_t tail, seq;
+	fr_atomic_queue_entry_t *entry;
+
+	tail = load(aq->tail);
+
+	entry = &aq->entry[ tail % aq->size ];
+	seq = aquire(entry->seq);
+
+	return (seq >= (tail + 1));
+}
+
 #ifndef NDEBUG
 
 #if 0
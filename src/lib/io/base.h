@@ -177,6 +177,22 @@ typedef size_t (*fr_io_nak_t)(fr_listen_t *li, void *packet_ctx, uint8_t *const
  */
 typedef ssize_t (*fr_io_data_read_t)(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time, uint8_t *buffer, size_t buffer_len, size_t *leftover, uint32_t *priority, bool *dup);
 
+/** Check if a reader has packets which it has already received, but not yet returned.
+ *
+ *  Datagram readers may read many packets from the socket in one
+ *  system call, and then return them one at a time from read().  The
+ *  socket may then not be readable, even though the reader still has
+ *  packets to return.  The network side calls this function after
+ *  read(), and keeps calling read() until there are no more pending
+ *  packets.
+ *
+ * @param[in] li		the listener for this socket
+ * @return
+ *	- 0 if there are no pending packets.
+ *	- >0 the number of pending packets.
+ */
+typedef int (*fr_io_data_pending_t)(fr_listen_t *li);
+
 /** Write a socket.
  *
  *  If the socket is a datagram socket, then the function can read or
@@ -265,9 +281,8 @@ typedef void (*fr_io_data_vnode_t)(fr_listen_t *li, uint32_t fflags);
  * at a time.  If the field is different, return the result from that
  * field.
  *
- * The comparison order of the fields should be "very different" to
- * "much the same".  The packets are put into an rbtree, so having a
- * large fanout at the top is useful.
+ * The packets are put into a hash table, so the fields compared should
+ * be the same as those hashed by #fr_io_data_hash_t.
  *
  * Note that this function should not check if the packets are
  * completely identical.  Instead, if checks whether or not the
@@ -285,6 +300,23 @@ typedef void (*fr_io_data_vnode_t)(fr_listen_t *li, uint32_t fflags);
  */
 typedef int (*fr_io_data_cmp_t)(void const *instance, void *thread_instance, RADCLIENT *client, void const *packet1, void const *packet2);
 
+/** Hash a packet for the dedup table
+ *
+ * Packets which compare as equal with #fr_io_data_cmp_t MUST have the
+ * same hash.  So the hash should only include the fields which the
+ * comparison function looks at.
+ *
+ * The packets come from the network, so use a seeded hash such as
+ * #fr_hash_seeded.
+ *
+ * @param[in] instance		the context for this function
+ * @param[in] thread_instance	the thread instance for this function
+ * @param[in] client		the client associated with this packet
+ * @param[in] packet		to hash
+ * @return the hash of the packet.
+ */
+typedef uint32_t (*fr_io_data_hash_t)(void const *instance, void *thread_instance, RADCLIENT *client, void const *packet);
+
 /**  Handle an error on the socket.
  *
  *  In general, the only thing to do on errors is to close the
@@ -120,6 +120,7 @@ typedef struct {
 
 	bool			must_signal;	//!< we need to signal the other end
 
+	atomic_bool		signal_pending;	//!< the other end hasn't yet seen our last signal.
 
 	uint64_t		sequence;	//!< Sequence number for this channel.
 	uint64_t		ack;		//!< Sequence number of the other end.
@@ -241,11 +242,13 @@ fr_channel_t *fr_channel_create(TALLOC_CTX *ctx, fr_control_t *requestor, fr_con
 	ch->end[TO_RESPONDER].stats.last_read_other = now;
 	ch->end[TO_RESPONDER].stats.last_sent_signal = now;
 	atomic_store(&ch->end[TO_RESPONDER].active, true);
+	atomic_init(&ch->end[TO_RESPONDER].signal_pending, false);
 
 	ch->end[TO_REQUESTOR].stats.last_write = now;
 	ch->end[TO_REQUESTOR].stats.last_read_other = now;
 	ch->end[TO_REQUESTOR].stats.last_sent_signal = now;
 	atomic_store(&ch->end[TO_REQUESTOR].active, true);
+	atomic_init(&ch->end[TO_REQUESTOR].signal_pending, false);
 
 	return ch;
 }
@@ -263,6 +266,11 @@ fr_channel_t *fr_channel_create(TALLOC_CTX *ctx, fr_control_t *requestor, fr_con
  * end[1].  We also send which end in 'which' (0, 1) to further help
  * the recipient.
  *
+ * If the other end hasn't yet processed our previous signal, we don't
+ * send another one.  It will drain the queue when it gets the first
+ * signal, and will see the new data then.  This coalesces the signals
+ * for a batch of messages into one.
+ *
  * @param[in] ch	the channel.
  * @param[in] when	the data was ready.  Typically taken from the message.
  * @param[in] end	of the channel that the message was written to.
@@ -273,8 +281,17 @@ fr_channel_t *fr_channel_create(TALLOC_CTX *ctx, fr_control_t *requestor, fr_con
  */
 static int fr_channel_data_ready(fr_channel_t *ch, fr_time_t when, fr_channel_end_t *end, fr_channel_signal_t which)
 {
+	int rcode;
 	fr_channel_control_t cc;
 
+	if (atomic_exchange(&end->signal_pending, true)) {
+		MPRINT("Coalescing signal to %s\n",
+		       fr_table_str_by_value(channel_direction, end->direction, "<INVALID>"));
+		end->stats.coalesced++;
+		end->must_signal = false;
+		return 0;
+	}
+
 	end->stats.last_sent_signal = when;
 	end->stats.signals++;
 	end->must_signal = false;
@@ -287,7 +304,15 @@ static int fr_channel_data_ready(fr_channel_t *ch, fr_time_t when, fr_channel_en
 	       fr_table_str_by_value(channel_direction, end->direction, "<INVALID>"),
 	       fr_table_str_by_value(channel_signals, which, "<INVALID>"));
 
-	return fr_control_message_send(end->control, end->rb, FR_CONTROL_ID_CHANNEL, &cc, sizeof(cc));
+	rcode = fr_control_message_send(end->control, end->rb, FR_CONTROL_ID_CHANNEL, &cc, sizeof(cc));
+
+	/*
+	 *	The signal was lost, so the next message has to try
+	 *	again.
+	 */
+	if (rcode < 0) atomic_store(&end->signal_pending, false);
+
+	return rcode;
 }
 
 #define IALPHA (8)
@@ -689,9 +714,7 @@ int fr_channel_responder_sleeping(fr_channel_t *ch)
 fr_channel_event_t fr_channel_service_message(fr_time_t when, fr_channel_t **p_channel, void const *data, size_t data_size)
 {
 	int rcode;
-#if ENABLE_SKIPS
 	uint64_t ack;
-#endif
 	fr_channel_control_t cc;
 	fr_channel_signal_t cs;
 	fr_channel_event_t ce = FR_CHANNEL_ERROR;
@@ -702,11 +725,28 @@ fr_channel_event_t fr_channel_service_message(fr_time_t when, fr_channel_t **p_c
 	memcpy(&cc, data, data_size);
 
 	cs = cc.signal;
-#if ENABLE_SKIPS
 	ack = cc.ack;
-#endif
 	*p_channel = ch = cc.ch;
 
+	/*
+	 *	Allow the sender to signal us again.  This MUST be
+	 *	done before the caller drains the queue, otherwise
+	 *	data written after the drain would never be signalled.
+	 */
+	switch (cs) {
+	case FR_CHANNEL_SIGNAL_DATA_TO_RESPONDER:
+		atomic_store(&ch->end[TO_RESPONDER].signal_pending, false);
+		break;
+
+	case FR_CHANNEL_SIGNAL_DATA_TO_REQUESTOR:
+	case FR_CHANNEL_SIGNAL_DATA_DONE_RESPONDER:
+		atomic_store(&ch->end[TO_REQUESTOR].signal_pending, false);
+		break;
+
+	default:
+		break;
+	}
+
 	switch (cs) {
 	/*
 	 *	These all have the same numbers as the channel
@@ -745,6 +785,17 @@ fr_channel_event_t fr_channel_service_message(fr_time_t when, fr_channel_t **p_c
 	 *	to wake up.
 	 */
 	requestor = &ch->end[TO_RESPONDER];
+
+	/*
+	 *	The responder has read everything we sent, so there's
+	 *	nothing for it to do.  Any new request will signal it.
+	 */
+	if (ack == requestor->sequence) {
+		MPRINT("REQUESTOR SKIPS signal, responder has seen sequence %"PRIu64"\n", ack);
+		requestor->stats.coalesced++;
+		return ce;
+	}
+
 #if ENABLE_SKIPS
 	if (!requestor->must_signal && (ack == requestor->sequence)) {
 		MPRINT("REQUESTOR SKIPS signal AFTER CE %d num_outstanding %"PRIu64"\n", cs, requestor->stats.outstanding);
@@ -969,6 +1020,7 @@ void fr_channel_stats_log(fr_channel_t const *ch, fr_log_t const *log, char cons
 	fr_log(log, L_INFO, file, line, "requestor\n");
 	fr_log(log, L_INFO, file, line, "\tsignals sent = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.signals);
 	fr_log(log, L_INFO, file, line, "\tsignals re-sent = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.resignals);
+	fr_log(log, L_INFO, file, line, "\tsignals coalesced = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.coalesced);
 	fr_log(log, L_INFO, file, line, "\tkevents checked = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.kevents);
 	fr_log(log, L_INFO, file, line, "\toutstanding = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.outstanding);
 	fr_log(log, L_INFO, file, line, "\tpackets processed = %" PRIu64 "\n", ch->end[TO_RESPONDER].stats.packets);
@@ -979,6 +1031,7 @@ void fr_channel_stats_log(fr_channel_t const *ch, fr_log_t const *log, char cons
 
 	fr_log(log, L_INFO, file, line, "responder\n");
 	fr_log(log, L_INFO, file, line, "\tsignals sent = %" PRIu64"\n", ch->end[TO_REQUESTOR].stats.signals);
+	fr_log(log, L_INFO, file, line, "\tsignals coalesced = %" PRIu64 "\n", ch->end[TO_REQUESTOR].stats.coalesced);
 	fr_log(log, L_INFO, file, line, "\tkevents checked = %" PRIu64 "\n", ch->end[TO_REQUESTOR].stats.kevents);
 	fr_log(log, L_INFO, file, line, "\tpackets processed = %" PRIu64 "\n", ch->end[TO_REQUESTOR].stats.packets);
 	fr_log(log, L_INFO, file, line, "\tmessage interval (RTT) = %" PRIu64 "\n", ch->end[TO_REQUESTOR].stats.message_interval);
@@ -80,6 +80,7 @@ typedef struct {
 	uint64_t       		outstanding; 	//!< Number of outstanding requests with no reply.
 	uint64_t		signals;	//!< Number of kevent signals we've sent.
 	uint64_t		resignals;	//!< Number of signals resent.
+	uint64_t		coalesced;	//!< Number of signals we didn't need to send.
 
 	uint64_t		packets;	//!< Number of actual data packets.
 
@@ -34,8 +34,32 @@ RCSID("$Id$")
 #include <string.h>
 #include <sys/event.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/*
+ *	On Linux, we use an eventfd instead of a pipe.  It's one file
+ *	descriptor instead of two, and multiple signals are coalesced
+ *	into one counter instead of filling up the pipe.
+ */
+#ifdef __linux__
+#  include <sys/eventfd.h>
+#  define WITH_EVENTFD (1)
+#endif
+
 #define FR_CONTROL_MAX_TYPES	(32)
 
+/*
+ *	How often we check the clock while spinning.
+ */
+#define FR_CONTROL_SPIN_CHECK	(64)
+
+#define IALPHA (8)
+#define RTT(_old, _new) ((_new + ((IALPHA - 1) * _old)) / IALPHA)
+
 /*
  *	Debugging, mainly for channel_test
  */
@@ -80,32 +104,52 @@ struct fr_control_s {
 
 	fr_atomic_queue_t	*aq;			//!< destination AQ
 
-	int			pipe[2];       		//!< our pipes
+	int			pipe[2];       		//!< our pipes.  Both are the same eventfd on Linux.
 
 	bool			same_thread;		//!< are the two ends in the same thread
 
+	atomic_bool		awake;			//!< the receiver will check the queue, so
+							///< senders don't need to signal it.
+
+	fr_time_delta_t		spin_max;		//!< maximum time to spin before sleeping.
+	fr_time_t		last_message;		//!< when we last received a message.
+	fr_time_delta_t		message_interval;	//!< average interval between messages.
+
+	atomic_uint_fast64_t	signals;		//!< wakeups sent by the senders.
+	atomic_uint_fast64_t	signals_avoided;	//!< wakeups skipped because we were awake.
+	uint64_t		wakeups;		//!< times we were woken up by the event loop.
+	uint64_t		spin_hits;		//!< times a message arrived while spinning.
+
 	fr_control_ctx_t 	type[FR_CONTROL_MAX_TYPES];	//!< callbacks
 };
 
-static void pipe_read(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, void *uctx)
+/** Pop all messages from the queue, and call the callbacks
+ *
+ * @param[in] c the control structure
+ * @return the number of messages which were processed.
+ */
+static int control_drain(fr_control_t *c)
 {
-	fr_control_t *c = talloc_get_type_abort(uctx, fr_control_t);
-	ssize_t i, num;
-	fr_time_t now;
-	char read_buffer[256];
+	int num = 0;
+	fr_time_t now = 0;
 	uint8_t	data[256];
 
-	num = read(fd, read_buffer, sizeof(read_buffer));
-	if (num <= 0) return;
-
-	now = fr_time();
-
-	for (i = 0; i < num; i++) {
+	while (true) {
 		uint32_t id = 0;
-		size_t message_size;
+		ssize_t message_size;
 
 		message_size = fr_control_message_pop(c->aq, &id, data, sizeof(data));
-		if (!message_size) return;
+		if (!message_size) break;
+
+		if (!num) {
+			now = fr_time();
+
+			if (c->last_message) c->message_interval = RTT(c->message_interval, now - c->last_message);
+			c->last_message = now;
+		}
+		num++;
+
+		if (message_size < 0) continue;
 
 		if (id >= FR_CONTROL_MAX_TYPES) continue;
 
@@ -113,6 +157,39 @@ static void pipe_read(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, void
 
 		c->type[id].callback(c->type[id].ctx, data, message_size, now);
 	}
+
+	return num;
+}
+
+static void pipe_read(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, void *uctx)
+{
+	fr_control_t *c = talloc_get_type_abort(uctx, fr_control_t);
+	ssize_t num;
+	char read_buffer[256];
+
+	num = read(fd, read_buffer, sizeof(read_buffer));
+	if (num <= 0) return;
+
+	c->wakeups++;
+
+	/*
+	 *	Senders which see "awake" will skip the signal, so we
+	 *	have to clear it before looking at the queue.
+	 */
+	atomic_store(&c->awake, false);
+
+	(void) control_drain(c);
+}
+
+/** Close the file descriptors used for signaling
+ *
+ */
+static void control_fd_close(fr_control_t *c)
+{
+	(void) fr_event_fd_delete(c->el, c->pipe[0], FR_EVENT_FILTER_IO);
+
+	close(c->pipe[0]);
+	if (c->pipe[1] != c->pipe[0]) close(c->pipe[1]);
 }
 
 /** Free a control structure
@@ -125,10 +202,7 @@ static int _control_free(fr_control_t *c)
 {
 	(void) talloc_get_type_abort(c, fr_control_t);
 
-	(void) fr_event_fd_delete(c->el, c->pipe[0], FR_EVENT_FILTER_IO);
-
-	close(c->pipe[0]);
-	close(c->pipe[1]);
+	control_fd_close(c);
 
 	return 0;
 }
@@ -153,7 +227,19 @@ fr_control_t *fr_control_create(TALLOC_CTX *ctx, fr_event_list_t *el, fr_atomic_
 	}
 	c->el = el;
 	c->aq = aq;
+	atomic_init(&c->awake, false);
+	atomic_init(&c->signals, 0);
+	atomic_init(&c->signals_avoided, 0);
 
+#ifdef WITH_EVENTFD
+	c->pipe[0] = c->pipe[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (c->pipe[0] < 0) {
+		talloc_free(c);
+		fr_strerror_printf("Failed opening eventfd for control socket: %s", fr_syserror(errno));
+		return NULL;
+	}
+	talloc_set_destructor(c, _control_free);
+#else
 	if (pipe((int *) &c->pipe) < 0) {
 		talloc_free(c);
 		fr_strerror_printf("Failed opening pipe for control socket: %s", fr_syserror(errno));
@@ -166,6 +252,7 @@ fr_control_t *fr_control_create(TALLOC_CTX *ctx, fr_event_list_t *el, fr_atomic_
 	 */
 	(void) fcntl(c->pipe[0], F_SETFL, O_NONBLOCK | FD_CLOEXEC);
 	(void) fcntl(c->pipe[1], F_SETFL, O_NONBLOCK | FD_CLOEXEC);
+#endif
 
 	if (fr_event_fd_insert(c, el, c->pipe[0], pipe_read, NULL, NULL, c) < 0) {
 		talloc_free(c);
@@ -345,9 +432,32 @@ int fr_control_message_send(fr_control_t *c, fr_ring_buffer_t *rb, uint32_t id,
 
 	if (fr_control_message_push(c, rb, id, data, data_size) < 0) return -1;
 
+	/*
+	 *	The receiver is awake, or someone else has already
+	 *	signalled it.  Either way, it will look at the queue
+	 *	before going to sleep, so we don't need to make a
+	 *	system call.
+	 */
+	if (atomic_exchange(&c->awake, true)) {
+		atomic_fetch_add_explicit(&c->signals_avoided, 1, memory_order_relaxed);
+		return 0;
+	}
+
+	atomic_fetch_add_explicit(&c->signals, 1, memory_order_relaxed);
+
+#ifdef WITH_EVENTFD
+	{
+		uint64_t value = 1;
+
+		while (write(c->pipe[1], &value, sizeof(value)) == 0) {
+			/* nothing */
+		}
+	}
+#else
 	while (write(c->pipe[1], ".", 1) == 0) {
 		/* nothing */
 	}
+#endif
 
 	return 0;
 }
@@ -460,12 +570,94 @@ int fr_control_callback_delete(fr_control_t *c, uint32_t id)
 	return 0;
 }
 
+/** Set the maximum time the receiver will spin before sleeping
+ *
+ * @param[in] c the control structure
+ * @param[in] spin_max the maximum time to spin, or 0 to never spin.
+ */
+void fr_control_spin_set(fr_control_t *c, fr_time_delta_t spin_max)
+{
+	(void) talloc_get_type_abort(c, fr_control_t);
+
+	c->spin_max = spin_max;
+}
+
+/** Poll the control plane for a while before going to sleep
+ *
+ *  This function is called ONLY from the receiving thread, when it
+ *  has nothing else to do.
+ *
+ *  Sleeping and being woken up again costs two system calls, plus a
+ *  context switch.  When messages arrive faster than that, it's
+ *  cheaper to poll the queue for a short while.  We only spin when
+ *  the average interval between messages is less than the configured
+ *  maximum, and never for more than twice that interval.
+ *
+ *  Senders don't signal us while we're spinning.  So we always
+ *  check the queue once more after saying we're going to sleep.
+ *
+ * @param[in] c the control structure
+ * @return
+ *	- 0 if the caller should go to sleep.
+ *	- >0 the number of messages which were processed.
+ */
+int fr_control_spin(fr_control_t *c)
+{
+	int		num, i = 0;
+	fr_time_t	start;
+	fr_time_delta_t	limit;
+
+	if (c->same_thread || !c->spin_max) return 0;
+
+	if (!c->last_message || (c->message_interval > c->spin_max)) return 0;
+
+	limit = c->message_interval * 2;
+	if (!limit || (limit > c->spin_max)) limit = c->spin_max;
+
+	/*
+	 *	A signal is pending, so we will be woken up
+	 *	immediately anyways.
+	 */
+	if (atomic_exchange(&c->awake, true)) return 0;
+
+	start = fr_time();
+
+	while (true) {
+		if (fr_atomic_queue_ready(c->aq)) {
+			c->spin_hits++;
+			break;
+		}
+
+		if ((++i % FR_CONTROL_SPIN_CHECK) != 0) continue;
+
+		if ((fr_time() - start) >= limit) break;
+	}
+
+	atomic_store(&c->awake, false);
+
+	num = control_drain(c);
+	if (num > 0) return num;
+
+	return 0;
+}
+
+/** Get the statistics for a control plane
+ *
+ * @param[in] c the control structure
+ * @param[out] stats where the statistics are written.
+ */
+void fr_control_stats(fr_control_t const *c, fr_control_stats_t *stats)
+{
+	stats->signals = atomic_load_explicit(&c->signals, memory_order_relaxed);
+	stats->signals_avoided = atomic_load_explicit(&c->signals_avoided, memory_order_relaxed);
+	stats->wakeups = c->wakeups;
+	stats->spin_hits = c->spin_hits;
+}
+
 int fr_control_same_thread(fr_control_t *c)
 {
 	c->same_thread = true;
-	(void) fr_event_fd_delete(c->el, c->pipe[0], FR_EVENT_FILTER_IO);
-	close(c->pipe[0]);
-	close(c->pipe[1]);
+	control_fd_close(c);
 
 	/*
 	 *	Nothing more to do now that everything is gone.
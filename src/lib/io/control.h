@@ -44,6 +44,16 @@ extern "C" {
 typedef struct fr_control_s fr_control_t;
 typedef	void (*fr_control_callback_t)(void *ctx, void const *data, size_t data_size, fr_time_t now);
 
+/** Statistics for the control plane
+ *
+ */
+typedef struct {
+	uint64_t		signals;		//!< Number of wakeups sent to the receiver.
+	uint64_t		signals_avoided;	//!< Number of wakeups which weren't needed.
+	uint64_t		wakeups;		//!< Number of times the receiver was woken up.
+	uint64_t		spin_hits;		//!< Number of messages which arrived while spinning.
+} fr_control_stats_t;
+
 /*
  *	A suggestion for max # of messages, and max message size.
  */
@@ -58,6 +68,7 @@ typedef	void (*fr_control_callback_t)(void *ctx, void const *data, size_t data_s
 #define FR_CONTROL_ID_WORKER	(3)
 #define FR_CONTROL_ID_DIRECTORY (4)
 #define FR_CONTROL_ID_INJECT 	(5)
+#define FR_CONTROL_ID_WORKER_DELETE (6)
 
 fr_control_t *fr_control_create(TALLOC_CTX *ctx, fr_event_list_t *el, fr_atomic_queue_t *aq) CC_HINT(nonnull(3));
 
@@ -71,6 +82,10 @@ ssize_t fr_control_message_pop(fr_atomic_queue_t *aq, uint32_t *p_id, void *data
 int fr_control_callback_add(fr_control_t *c, uint32_t id, void *ctx, fr_control_callback_t callback) CC_HINT(nonnull(1,4));
 int fr_control_callback_delete(fr_control_t *c, uint32_t id) CC_HINT(nonnull);
 
+void fr_control_spin_set(fr_control_t *c, fr_time_delta_t spin_max) CC_HINT(nonnull);
+int fr_control_spin(fr_control_t *c) CC_HINT(nonnull);
+void fr_control_stats(fr_control_t const *c, fr_control_stats_t *stats) CC_HINT(nonnull);
+
 int fr_control_same_thread(fr_control_t *c);
 
 #ifdef __cplusplus
@@ -38,6 +38,7 @@ struct fr_listen {
 	CONF_SECTION		*server_cs;		//!< CONF_SECTION of the server
 
 	bool			connected;		//!< is this for a connected socket?
+	bool			reuse_port;		//!< the socket can be opened again in another thread.
 	bool			track_duplicates;	//!< do we track duplicate packets?
 	size_t			default_message_size;	//!< copied from app_io, but may be changed
 	size_t			num_messages;		//!< for the message ring buffer
@@ -61,6 +62,9 @@ struct fr_async_s {
 						//!< and how we'll send the reply.
 	uint32_t		priority;	//!< higher == higher priority
 	bool			fake;		//!< is it a fake request
+
+	void			*stolen;	//!< if we took the request from another worker,
+						//!< how to give the reply back to it.
 };
 
 int fr_io_listen_free(fr_listen_t *li);
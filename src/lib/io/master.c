@@ -100,7 +100,7 @@ struct fr_io_client_s {
 	fr_io_instance_t const		*inst;		//!< parent instance for master IO handler
 	fr_io_thread_t			*thread;
 	fr_event_timer_t const		*ev;		//!< when we clean up the client
-	rbtree_t			*table;		//!< tracking table for packets
+	fr_hash_table_t			*table;		//!< tracking table for packets
 
 	fr_heap_t			*pending;	//!< pending packets for this client
 	fr_hash_table_t			*addresses;	//!< list of src/dst addresses used by this client
@@ -223,18 +223,28 @@ static int8_t address_cmp(void const *one, void const *two)
 	return fr_ipaddr_cmp(&a->dst_ipaddr, &b->dst_ipaddr);
 }
 
-static uint32_t connection_hash(void const *ctx)
+static uint32_t address_hash(fr_io_address_t const *address)
 {
 	uint32_t hash;
-	fr_io_connection_t const *c = ctx;
 
-	hash = fr_hash(&c->address->src_ipaddr, sizeof(c->address->src_ipaddr));
-	hash = fr_hash_update(&c->address->src_port, sizeof(c->address->src_port), hash);
+	/*
+	 *	Clients choose their source address and port,
+	 *	so use the seeded hash.
+	 */
+	hash = fr_hash_seeded(&address->src_ipaddr, sizeof(address->src_ipaddr));
+	hash = fr_hash_seeded_update(&address->src_port, sizeof(address->src_port), hash);
+
+	hash = fr_hash_seeded_update(&address->if_index, sizeof(address->if_index), hash);
 
-	hash = fr_hash_update(&c->address->if_index, sizeof(c->address->if_index), hash);
+	hash = fr_hash_seeded_update(&address->dst_ipaddr, sizeof(address->dst_ipaddr), hash);
+	return fr_hash_seeded_update(&address->dst_port, sizeof(address->dst_port), hash);
+}
+
+static uint32_t connection_hash(void const *ctx)
+{
+	fr_io_connection_t const *c = ctx;
 
-	hash = fr_hash_update(&c->address->dst_ipaddr, sizeof(c->address->dst_ipaddr), hash);
-	return fr_hash_update(&c->address->dst_port, sizeof(c->address->dst_port), hash);
+	return address_hash(c->address);
 }
 
 
@@ -289,6 +299,29 @@ static int track_cmp(void const *one, void const *two)
 						a->packet, b->packet);
 }
 
+/*
+ *	Must hash the same fields as track_cmp() compares.
+ */
+static uint32_t track_hash(void const *one)
+{
+	fr_io_track_t const *a = one;
+	uint32_t hash;
+
+	if (a->client->connection) {
+		return a->client->inst->app_io->hash(a->client->inst->app_io_instance,
+						     a->client->connection->child->thread_instance,
+						     a->client->connection->client->radclient,
+						     a->packet);
+	}
+
+	hash = a->client->inst->app_io->hash(a->client->inst->app_io_instance,
+					     a->client->thread->child->thread_instance,
+					     a->client->radclient,
+					     a->packet);
+
+	return fr_hash_seeded_update(&hash, sizeof(hash), address_hash(a->address));
+}
+
 
 static fr_io_pending_packet_t *pending_packet_pop(fr_io_thread_t *thread)
 {
@@ -499,8 +532,7 @@ static fr_io_connection_t *fr_io_connection_alloc(fr_io_instance_t const *inst,
 	 *	#todo - unify the code with static clients?
 	 */
 	if (inst->app_io->track_duplicates) {
-		MEM(connection->client->table = rbtree_talloc_create(client, track_cmp, fr_io_track_t,
-								     NULL, RBTREE_FLAG_NONE));
+		MEM(connection->client->table = fr_hash_table_create(client, track_hash, track_cmp, NULL));
 	}
 
 	/*
@@ -810,6 +842,27 @@ static RADCLIENT *radclient_alloc(TALLOC_CTX *ctx, int ipproto, fr_io_address_t
 }
 
 
+static void track_free(fr_io_track_t *track)
+{
+	fr_io_thread_t *thread = track->client->thread;
+
+	if (track->ev) (void) fr_event_timer_delete(thread->el, &track->ev);
+
+	talloc_free_children(track);
+
+	/*
+	 *	Keep most recently used elements around.  But
+	 *	limit them to ~1000 entries.
+	 */
+	fr_dlist_insert_head(&thread->track_list, track);
+	if (fr_dlist_num_elements(&thread->track_list) > 1000) {
+		track = fr_dlist_tail(&thread->track_list);
+		fr_dlist_remove(&thread->track_list, track);
+		talloc_free(track);
+	}
+}
+
+
 static fr_io_track_t *fr_io_track_add(fr_io_client_t *client,
 				      fr_io_address_t *address,
 				      uint8_t const *packet, fr_time_t recv_time, bool *is_dup)
@@ -825,7 +878,7 @@ static fr_io_track_t *fr_io_track_add(fr_io_client_t *client,
 	 */
 	memcpy(my_track.packet, packet, sizeof(my_track.packet));
 
-	if (client->inst->app_io->track_duplicates) track = rbtree_finddata(client->table, &my_track);
+	if (client->inst->app_io->track_duplicates) track = fr_hash_table_finddata(client->table, &my_track);
 	if (!track) {
 		track = fr_dlist_head(&client->thread->track_list);
 		if (!track) {
@@ -851,6 +904,12 @@ static fr_io_track_t *fr_io_track_add(fr_io_client_t *client,
 		memcpy(track->packet, packet, sizeof(track->packet));
 		track->timestamp = recv_time;
 		track->packets = 1;
+
+		if (client->inst->app_io->track_duplicates && client->table &&
+		    !fr_hash_table_insert(client->table, track)) {
+			track_free(track);
+			return NULL;
+		}
 		return track;
 	}
 
@@ -912,27 +971,6 @@ static fr_io_track_t *fr_io_track_add(fr_io_client_t *client,
 }
 
 
-static void track_free(fr_io_track_t *track)
-{
-	fr_io_thread_t *thread = track->client->thread;
-
-	if (track->ev) (void) fr_event_timer_delete(thread->el, &track->ev);
-
-	talloc_free_children(track);
-
-	/*
-	 *	Keep most recently used elements around.  But
-	 *	limit them to ~1000 entries.
-	 */
-	fr_dlist_insert_head(&thread->track_list, track);
-	if (fr_dlist_num_elements(&thread->track_list) > 1000) {
-		track = fr_dlist_tail(&thread->track_list);
-		fr_dlist_remove(&thread->track_list, track);
-		talloc_free(track);
-	}
-}
-
-
 static int pending_free(fr_io_pending_packet_t *pending)
 {
 	fr_io_track_t *track = pending->track;
@@ -955,7 +993,7 @@ static int pending_free(fr_io_pending_packet_t *pending)
 	if (track->packets == 0) {
 		if (track->client->inst->app_io->track_duplicates) {
 			rad_assert(track->client->table != NULL);
-			(void) rbtree_deletebydata(track->client->table, track);
+			(void) fr_hash_table_delete(track->client->table, track);
 		}
 
 		track_free(track);
@@ -1402,8 +1440,8 @@ do_read:
 		 */
 		if (inst->app_io->track_duplicates) {
 			rad_assert(inst->app_io->compare != NULL);
-			MEM(client->table = rbtree_talloc_create(client, track_cmp, fr_io_track_t,
-								 NULL, RBTREE_FLAG_NONE));
+			rad_assert(inst->app_io->hash != NULL);
+			MEM(client->table = fr_hash_table_create(client, track_hash, track_cmp, NULL));
 		}
 
 		/*
@@ -1624,6 +1662,38 @@ have_client:
 	return 0;
 }
 
+/** See if the child IO path has more packets from a batched read
+ *
+ */
+static int mod_pending(fr_listen_t *li)
+{
+	fr_io_instance_t const *inst;
+	fr_io_connection_t *connection;
+	fr_listen_t *child;
+
+	get_inst(li, &inst, NULL, &connection, &child);
+
+	if (!child->app_io->pending) return 0;
+
+	return child->app_io->pending(child);
+}
+
+/** Write any packets which the child IO path has queued
+ *
+ */
+static int mod_flush(fr_listen_t *li)
+{
+	fr_io_instance_t const *inst;
+	fr_io_connection_t *connection;
+	fr_listen_t *child;
+
+	get_inst(li, &inst, NULL, &connection, &child);
+
+	if (!child->app_io->flush) return 0;
+
+	return child->app_io->flush(child);
+}
+
 /** Inject a packet to a connection.
  *
  *  Always called in the context of the network.
@@ -1999,7 +2069,7 @@ static void packet_expiry_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
 	track->packets--;
 
 	if (track->packets == 0) {
-		if (inst->app_io->track_duplicates) (void) rbtree_deletebydata(client->table, track);
+		if (inst->app_io->track_duplicates) (void) fr_hash_table_delete(client->table, track);
 
 		track_free(track);
 	} else {
@@ -2104,6 +2174,14 @@ static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, fr_time_t request_ti
 
 		packet_len = inst->app_io->write(child, track, request_time,
 						 buffer, buffer_len, written);
+
+		/*
+		 *	The socket is full.  The network will call us
+		 *	again with the same packet when it's writable,
+		 *	so we keep the tracking entry.
+		 */
+		if ((packet_len < 0) && (errno == EWOULDBLOCK)) return packet_len;
+
 		if (packet_len > 0) {
 			rad_assert(buffer_len == (size_t) packet_len);
 
@@ -2758,24 +2836,31 @@ int fr_io_listen_free(fr_listen_t *li)
 	return 0;
 }
 
-int fr_master_io_listen(TALLOC_CTX *ctx, fr_io_instance_t *inst, fr_schedule_t *sc,
-			size_t default_message_size, size_t num_messages)
+/** Create one master listener, and add it to a network thread
+ *
+ * @param[in] ctx			to allocate the listener in.
+ * @param[in] inst			of the master IO handler.
+ * @param[in] sc			the scheduler.
+ * @param[in] default_message_size	for the message ring buffer.
+ * @param[in] num_messages		for the message ring buffer.
+ * @param[in,out] network		to add the listener to, or -1 for "any".
+ *					Set to the network actually used.
+ * @param[in] clone			whether this is an additional copy of a
+ *					socket which has already been opened.
+ * @param[out] reuse_port		whether the socket can be opened again
+ *					in another network thread.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int master_io_listen_network(TALLOC_CTX *ctx, fr_io_instance_t *inst, fr_schedule_t *sc,
+				    size_t default_message_size, size_t num_messages,
+				    int *network, bool clone, bool *reuse_port)
 {
 	fr_listen_t	*li, *child;
 	fr_io_thread_t	*thread;
 
-	/*
-	 *	No IO paths, so we don't initialize them.
-	 */
-	if (!inst->app_io) {
-		rad_assert(!inst->dynamic_clients);
-		return 0;
-	}
-
-	if (!inst->app_io->thread_inst_size) {
-		fr_strerror_printf("IO modules MUST set 'thread_inst_size' when using the master IO handler.");
-		return -1;
-	}
+	*reuse_port = false;
 
 	/*
 	 *	Build the #fr_listen_t.  This describes the complete
@@ -2891,10 +2976,35 @@ int fr_master_io_listen(TALLOC_CTX *ctx, fr_io_instance_t *inst, fr_schedule_t *
 	}
 	li->name = child->name;
 
+#ifdef SO_REUSEPORT
 	/*
-	 *	Record which socket we opened.
+	 *	If the IO module set SO_REUSEPORT on an unconnected
+	 *	socket, then we can open the same socket again in the
+	 *	other network threads, and let the kernel distribute
+	 *	the packets.  The kernel hashes on the source address,
+	 *	so one client always ends up in the same network
+	 *	thread, and our client / duplicate tracking still
+	 *	works.
 	 */
-	if (child->app_io_addr) {
+	{
+		int		on = 0;
+		socklen_t	len = sizeof(on);
+
+		/*
+		 *	child->fd may not be the socket, so the IO
+		 *	module can also tell us directly.
+		 */
+		if (child->reuse_port ||
+		    ((getsockopt(child->fd, SOL_SOCKET, SO_REUSEPORT, &on, &len) == 0) && on)) *reuse_port = true;
+	}
+#endif
+
+	/*
+	 *	Record which socket we opened.  Clones are bound to
+	 *	the same address as the original, so we don't check
+	 *	them.
+	 */
+	if (child->app_io_addr && !clone) {
 		fr_listen_t *other;
 
 		other = listen_find_any(thread->child);
@@ -2915,7 +3025,7 @@ int fr_master_io_listen(TALLOC_CTX *ctx, fr_io_instance_t *inst, fr_schedule_t *
 	 *	Add the socket to the scheduler, where it might end up
 	 *	in a different thread.
 	 */
-	if (!fr_schedule_listen_add(sc, li)) {
+	if (!fr_schedule_listen_add_to(sc, li, network)) {
 		talloc_free(li);
 		return -1;
 	}
@@ -2923,6 +3033,56 @@ int fr_master_io_listen(TALLOC_CTX *ctx, fr_io_instance_t *inst, fr_schedule_t *
 	return 0;
 }
 
+int fr_master_io_listen(TALLOC_CTX *ctx, fr_io_instance_t *inst, fr_schedule_t *sc,
+			size_t default_message_size, size_t num_messages)
+{
+	int		i, num_networks, first;
+	bool		reuse_port;
+
+	/*
+	 *	No IO paths, so we don't initialize them.
+	 */
+	if (!inst->app_io) {
+		rad_assert(!inst->dynamic_clients);
+		return 0;
+	}
+
+	if (!inst->app_io->thread_inst_size) {
+		fr_strerror_printf("IO modules MUST set 'thread_inst_size' when using the master IO handler.");
+		return -1;
+	}
+
+	num_networks = fr_schedule_num_networks(sc);
+
+	/*
+	 *	Let the scheduler put the first socket into the
+	 *	least loaded network thread.  Sockets which can't be
+	 *	shared (TCP, detail files, etc.) are then spread
+	 *	across all of the network threads.
+	 */
+	first = -1;
+	if (master_io_listen_network(ctx, inst, sc, default_message_size, num_messages,
+				     &first, false, &reuse_port) < 0) return -1;
+
+	if (!reuse_port || (num_networks == 1)) return 0;
+
+	/*
+	 *	The socket can be shared, so open a copy for each of
+	 *	the other network threads.  Each copy has its own
+	 *	fr_io_thread_t, so there's no locking between network
+	 *	threads.
+	 */
+	for (i = 0; i < num_networks; i++) {
+		int network = i;
+
+		if (i == first) continue;
+
+		if (master_io_listen_network(ctx, inst, sc, default_message_size, num_messages,
+					     &network, true, &reuse_port) < 0) return -1;
+	}
+
+	return 0;
+}
 
 fr_app_io_t fr_master_app_io = {
 	.magic			= RLM_MODULE_INIT,
@@ -2935,7 +3095,9 @@ fr_app_io_t fr_master_app_io = {
 	.track_duplicates	= true,
 
 	.read			= mod_read,
+	.pending		= mod_pending,
 	.write			= mod_write,
+	.flush			= mod_flush,
 	.inject			= mod_inject,
 
 	.open			= mod_open,
@@ -28,6 +28,7 @@ RCSID("$Id$")
 
 #include <talloc.h>
 
+#include <freeradius-devel/util/dlist.h>
 #include <freeradius-devel/util/event.h>
 #include <freeradius-devel/util/misc.h>
 #include <freeradius-devel/util/rand.h>
@@ -42,7 +43,18 @@ RCSID("$Id$")
 #include <freeradius-devel/io/ring_buffer.h>
 #include <freeradius-devel/io/worker.h>
 
-#define MAX_WORKERS 64
+/*
+ *	Initial size of the workers array.  It grows if more workers
+ *	are added at run time.
+ */
+#define NUM_WORKERS_INIT	(64)
+
+/*
+ *	How often we check if a worker which is being removed has
+ *	finished its requests, and how long we wait for it to do so.
+ */
+#define CLOSE_CHECK_INTERVAL	fr_time_delta_from_msec(100)
+#define CLOSE_GRACE		fr_time_delta_from_sec(60)
 
 fr_thread_local_setup(fr_ring_buffer_t *, fr_network_rb); /* macro */
 
@@ -53,6 +65,12 @@ typedef struct {
 	fr_time_t	recv_time;
 } fr_network_inject_t;
 
+typedef struct {
+	fr_worker_t			*worker;
+	fr_network_worker_release_t	release;
+	void				*uctx;
+} fr_network_worker_delete_t;
+
 typedef struct {
 	int32_t			heap_id;		//!< workers are in a heap
 	fr_time_t		cpu_time;		//!< how much CPU time this worker has spent
@@ -61,6 +79,14 @@ typedef struct {
 	fr_channel_t		*channel;		//!< channel to the worker
 	fr_worker_t		*worker;		//!< worker pointer
 	fr_io_stats_t		stats;
+
+	bool			closing;		//!< we're removing this worker
+	bool			closed;			//!< the worker has acknowledged the channel close
+	fr_time_t		closing_time;		//!< when we stopped sending packets to the worker
+	fr_dlist_t		entry;			//!< in the list of workers being removed
+
+	fr_network_worker_release_t release;		//!< called when we've stopped using the worker
+	void			*release_uctx;		//!< for release()
 } fr_network_worker_t;
 
 typedef struct {
@@ -83,6 +109,12 @@ typedef struct {
 	fr_channel_data_t	*pending;		//!< the currently pending partial packet
 	fr_heap_t		*waiting;		//!< packets waiting to be written
 	fr_io_stats_t		stats;
+
+	uint64_t		reads;			//!< number of read events which returned packets
+	uint32_t		max_batch;		//!< most packets returned by one read event
+
+	bool			flush;			//!< is it in the flush list?
+	fr_dlist_t		flush_entry;		//!< for the list of sockets with queued writes
 } fr_network_socket_t;
 
 /*
@@ -111,6 +143,7 @@ struct fr_network_s {
 	fr_event_list_t		*el;			//!< our event list
 
 	fr_heap_t		*replies;		//!< replies from the worker, ordered by priority / origin time
+	fr_dlist_head_t		flush;			//!< sockets which have queued writes
 
 	fr_io_stats_t		stats;
 
@@ -121,12 +154,34 @@ struct fr_network_s {
 	int			max_workers;		//!< maximum number of allowed workers
 	int			num_sockets;		//!< actually a counter...
 
-	fr_network_worker_t	*workers[MAX_WORKERS]; 	//!< each worker
+	bool			source_affinity;	//!< send related packets to the same worker.
+	uint64_t		affinity_hit;		//!< packets sent to their preferred worker.
+	uint64_t		affinity_miss;		//!< preferred worker was too busy.
+
+	fr_network_worker_t	**workers; 		//!< each worker
+
+	fr_dlist_head_t		closing;		//!< workers which are being removed
+	fr_event_timer_t const	*ev_closing;		//!< timer for closing workers
 };
 
 static void fr_network_post_event(fr_event_list_t *el, fr_time_t now, void *uctx);
 static int fr_network_pre_event(void *ctx, fr_time_t wake);
 
+/** Remember that a socket may have queued writes
+ *
+ *  The writer may queue packets instead of writing them, so that
+ *  many packets can be written with one system call.  The queued
+ *  packets are written by calling flush() after all of the replies
+ *  have been processed.
+ */
+static inline void fr_network_flush_add(fr_network_t *nr, fr_network_socket_t *s)
+{
+	if (!s->listen->app_io->flush || s->flush) return;
+
+	s->flush = true;
+	fr_dlist_insert_tail(&nr->flush, s);
+}
+
 static int8_t reply_cmp(void const *one, void const *two)
 {
 	fr_channel_data_t const *a = one, *b = two;
@@ -270,12 +325,95 @@ static void fr_network_channel_callback(void *ctx, void const *data, size_t data
 		break;
 
 	case FR_CHANNEL_CLOSE:
+	{
+		fr_network_worker_t *w;
+
+		rad_assert(ch != NULL);
 		DEBUG3("close <--");
-		///
+
+		/*
+		 *	The worker may still have sent us replies.
+		 *	Those are written (or localized) by the post
+		 *	event handler, so we only free the worker's
+		 *	channel on the next closing timer.
+		 */
+		w = fr_channel_requestor_uctx_get(ch);
+		if (w->closing) w->closed = true;
+	}
 		break;
 	}
 }
 
+/** Mix an affinity key with a worker identifier
+ *
+ */
+static inline uint64_t fr_network_affinity_mix(uint32_t key, void const *worker)
+{
+	uint64_t x = ((uint64_t) key << 32) ^ (uint64_t) (uintptr_t) worker;
+
+	x += UINT64_C(0x9e3779b97f4a7c15);
+	x = (x ^ (x >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+	x = (x ^ (x >> 27)) * UINT64_C(0x94d049bb133111eb);
+
+	return x ^ (x >> 31);
+}
+
+/** Pick the preferred worker for a packet with source affinity
+ *
+ *  The preferred worker is chosen via rendezvous hashing, so that all
+ *  network threads agree on it, and so that adding or removing a
+ *  worker only moves the keys which belonged to that worker.
+ *
+ *  If the preferred worker has many more packets outstanding than the
+ *  worker picked by the usual "two choices" algorithm, we use that
+ *  one instead.  The conversation will still work, it just won't be
+ *  as cache-friendly.
+ *
+ * @param nr		the network
+ * @param cd		the message we've received
+ * @param fallback	the worker picked via "two choices"
+ * @return the worker to send the packet to.
+ */
+static fr_network_worker_t *fr_network_affinity_worker(fr_network_t *nr, fr_channel_data_t *cd,
+							fr_network_worker_t *fallback)
+{
+	int			i;
+	uint32_t		key;
+	uint64_t		score, best_score = 0;
+	uint64_t		busy, fallback_busy;
+	fr_network_worker_t	*best = NULL;
+	fr_app_t const		*app = cd->listen->app;
+
+	if (!app || !app->affinity) return fallback;
+
+	key = app->affinity(cd->listen->app_instance, cd->packet_ctx, cd->m.data, cd->m.data_size);
+	if (!key) return fallback;
+
+	for (i = 0; i < nr->num_workers; i++) {
+		score = fr_network_affinity_mix(key, nr->workers[i]->worker);
+		if (!best || (score > best_score)) {
+			best = nr->workers[i];
+			best_score = score;
+		}
+	}
+
+	if (best == fallback) {
+		nr->affinity_hit++;
+		return best;
+	}
+
+	busy = best->stats.in - best->stats.out;
+	fallback_busy = fallback->stats.in - fallback->stats.out;
+
+	if (busy > ((2 * fallback_busy) + 16)) {
+		nr->affinity_miss++;
+		return fallback;
+	}
+
+	nr->affinity_hit++;
+	return best;
+}
+
 /** Send a message on the "best" channel.
  *
  * @param nr the network
@@ -308,6 +446,8 @@ static int fr_network_send_request(fr_network_t *nr, fr_channel_data_t *cd)
 		} else {
 			worker = nr->workers[two];
 		}
+
+		if (nr->source_affinity) worker = fr_network_affinity_worker(nr, cd, worker);
 	}
 
 	(void) talloc_get_type_abort(worker, fr_network_worker_t);
@@ -368,6 +508,17 @@ static void fr_network_socket_dead(fr_network_t *nr, fr_network_socket_t *s)
 }
 
 
+/** Record how many packets one read event returned
+ *
+ */
+static inline void network_read_stats(fr_network_socket_t *s, uint32_t num_read)
+{
+	if (!num_read) return;
+
+	s->reads++;
+	if (num_read > s->max_batch) s->max_batch = num_read;
+}
+
 /** Read a packet from the network.
  *
  * @param[in] el	the event list.
@@ -378,6 +529,7 @@ static void fr_network_socket_dead(fr_network_t *nr, fr_network_socket_t *s)
 static void fr_network_read(UNUSED fr_event_list_t *el, int sockfd, UNUSED int flags, void *ctx)
 {
 	int num_messages = 0;
+	uint32_t num_read = 0;
 	fr_network_socket_t *s = ctx;
 	fr_network_t *nr = s->nr;
 	ssize_t data_size;
@@ -410,7 +562,7 @@ next_message:
 	 */
 	if (num_messages > 16) {
 		s->cd = cd;
-		return;
+		goto done;
 	}
 
 	cd->request.is_dup = false;
@@ -441,7 +593,16 @@ next_message:
 		 *	blocking issues can happen for stream sockets.
 		 */
 		s->cd = cd;
-		return;
+
+		/*
+		 *	The reader discarded a packet, but it still
+		 *	has more packets from a batched read.  The
+		 *	socket may not be readable any more, so we
+		 *	have to go get them now.
+		 */
+		if (s->listen->app_io->pending && (s->listen->app_io->pending(s->listen) > 0)) goto next_message;
+
+		goto done;
 	}
 
 	/*
@@ -449,14 +610,14 @@ next_message:
 	 */
 	if (data_size < 0) {
 //		fr_log(nr->log, L_DBG_ERR, "error from transport read on socket %d", sockfd);
-		fr_network_socket_dead(nr, s);
-		return;
+		goto dead;
 	}
 	s->cd = NULL;
 
 	DEBUG3("Network received packet size %zd", data_size);
 	nr->stats.in++;
 	s->stats.in++;
+	num_read++;
 
 	/*
 	 *	Initialize the rest of the fields of the channel data.
@@ -521,6 +682,33 @@ next_message:
 		num_messages++;
 		goto next_message;
 	}
+
+	/*
+	 *	The reader has more packets from a batched read, e.g.
+	 *	recvmmsg().  Drain them all now, as we won't get
+	 *	another read event for packets which have already
+	 *	been read from the socket.
+	 */
+	if (s->listen->app_io->pending && (s->listen->app_io->pending(s->listen) > 0)) {
+		cd = (fr_channel_data_t *) fr_message_reserve(s->ms, s->listen->default_message_size);
+		if (!cd) {
+			ERROR("Failed allocating message size %zd! - Closing socket",
+			      s->listen->default_message_size);
+			goto dead;
+		}
+		goto next_message;
+	}
+
+done:
+	network_read_stats(s, num_read);
+	return;
+
+	/*
+	 *	Update the stats before the socket goes away.
+	 */
+dead:
+	network_read_stats(s, num_read);
+	fr_network_socket_dead(nr, s);
 }
 
 
@@ -654,6 +842,7 @@ static void fr_network_write(UNUSED fr_event_list_t *el, UNUSED int sockfd, UNUS
 		fr_message_done(&cd->m);
 		nr->stats.out++;
 		s->stats.out++;
+		fr_network_flush_add(nr, s);
 
 		/*
 		 *	As a special case, allow write() to return
@@ -679,6 +868,46 @@ static void fr_network_write(UNUSED fr_event_list_t *el, UNUSED int sockfd, UNUS
 	}
 }
 
+/** Write packets which were queued by the socket, once it is writable again.
+ *
+ * @param el the event list
+ * @param sockfd the socket which is ready to write
+ * @param flags returned by kevent.
+ * @param ctx the network socket context.
+ */
+static void fr_network_flush_write(UNUSED fr_event_list_t *el, UNUSED int sockfd, UNUSED int flags, void *ctx)
+{
+	fr_network_socket_t *s = ctx;
+	fr_listen_t *li = s->listen;
+	fr_network_t *nr = s->nr;
+
+	(void) talloc_get_type_abort(nr, fr_network_t);
+
+	if (li->app_io->flush(li) < 0) {
+		/*
+		 *	Still full.  Leave the write callback in
+		 *	place, and try again later.
+		 */
+		if (errno == EWOULDBLOCK) return;
+
+		PERROR("Failed writing queued packets to socket %d", li->fd);
+		if (li->app_io->error) li->app_io->error(li);
+	}
+
+	/*
+	 *	Everything has been written.  Remove the write
+	 *	callback.
+	 */
+	if (fr_event_fd_insert(nr, nr->el, li->fd,
+			       fr_network_read,
+			       NULL,
+			       fr_network_error,
+			       s) < 0) {
+		PERROR("Failed removing \"write\" callback from event loop");
+		fr_network_socket_dead(nr, s);
+	}
+}
+
 static int _network_socket_free(fr_network_socket_t *s)
 {
 	fr_network_t *nr = s->nr;
@@ -687,6 +916,8 @@ static int _network_socket_free(fr_network_socket_t *s)
 	rbtree_deletebydata(nr->sockets, s);
 	rbtree_deletebydata(nr->sockets_by_num, s);
 
+	if (s->flush) fr_dlist_remove(&nr->flush, s);
+
 	if (s->listen->app_io->close) {
 		s->listen->app_io->close(s->listen);
 	} else {
@@ -862,7 +1093,6 @@ static void fr_network_directory_callback(void *ctx, void const *data, size_t da
  */
 static void fr_network_worker_callback(void *ctx, void const *data, size_t data_size, UNUSED fr_time_t now)
 {
-	int i;
 	fr_network_t *nr = ctx;
 	fr_worker_t *worker;
 	fr_network_worker_t *w;
@@ -884,18 +1114,99 @@ static void fr_network_worker_callback(void *ctx, void const *data, size_t data_
 	/*
 	 *	Insert the worker into the array of workers.
 	 */
-	for (i = 0; i < nr->max_workers; i++) {
-		if (nr->workers[i]) continue;
+	if (nr->num_workers == nr->max_workers) {
+		nr->max_workers *= 2;
+		MEM(nr->workers = talloc_realloc(nr, nr->workers, fr_network_worker_t *, nr->max_workers));
+	}
 
-		nr->workers[i] = w;
-		nr->num_workers++;
-		return;
+	nr->workers[nr->num_workers++] = w;
+}
+
+/** Check if the workers which are being removed can be closed
+ *
+ *  We wait until the worker has replied to all of the packets we
+ *  sent it.  If a reply was suppressed, e.g. because the worker ate
+ *  a duplicate, we'd wait forever, so we give up after a while.  The
+ *  worker stops any requests which are left when the channel closes.
+ */
+static void fr_network_closing_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_network_t		*nr = talloc_get_type_abort(uctx, fr_network_t);
+	fr_network_worker_t	*w, *next;
+
+	for (w = fr_dlist_head(&nr->closing); w != NULL; w = next) {
+		next = fr_dlist_next(&nr->closing, w);
+
+		if (w->closed) {
+			fr_dlist_remove(&nr->closing, w);
+			if (w->release) w->release(w->worker, w->release_uctx);
+			talloc_free(w);
+			continue;
+		}
+
+		if (!fr_channel_active(w->channel)) continue; /* waiting for the ack */
+
+		if ((w->stats.in > w->stats.out) && ((now - w->closing_time) < CLOSE_GRACE)) continue;
+
+		DEBUG2("Closing channel to worker %p", w->worker);
+		fr_channel_signal_responder_close(w->channel);
+	}
+
+	if (!fr_dlist_num_elements(&nr->closing)) return;
+
+	if (fr_event_timer_in(nr, el, &nr->ev_closing, CLOSE_CHECK_INTERVAL, fr_network_closing_timer, nr) < 0) {
+		PERROR("Failed inserting timer for closing workers");
+	}
+}
+
+/** Handle a network control message callback for a worker being removed
+ *
+ *  We stop sending new packets to the worker, and close the channel
+ *  once it's replied to the packets it already has.
+ *
+ * @param[in] ctx the network
+ * @param[in] data the message
+ * @param[in] data_size size of the data
+ * @param[in] now the current time
+ */
+static void fr_network_worker_delete_callback(void *ctx, void const *data, size_t data_size, fr_time_t now)
+{
+	int i;
+	fr_network_t *nr = ctx;
+	fr_network_worker_delete_t my_delete;
+	fr_network_worker_t *w;
+
+	rad_assert(data_size == sizeof(my_delete));
+
+	memcpy(&my_delete, data, data_size);
+
+	for (i = 0; i < nr->num_workers; i++) {
+		if (nr->workers[i]->worker == my_delete.worker) break;
 	}
 
 	/*
-	 *	Run out of room to put workers!
+	 *	Not ours, or it's the last one.  We always need a
+	 *	worker to send packets to.  The scheduler checks this
+	 *	before asking us to remove a worker, so we should
+	 *	never get here.
 	 */
-	rad_assert(0 == 1);
+	if ((i == nr->num_workers) || (nr->num_workers == 1)) {
+		WARN("Ignoring request to remove worker %p - it is %s", my_delete.worker,
+		     (i == nr->num_workers) ? "not one of ours" : "the only worker");
+		return;
+	}
+
+	w = nr->workers[i];
+	nr->workers[i] = nr->workers[--nr->num_workers];
+	nr->workers[nr->num_workers] = NULL;
+
+	w->closing = true;
+	w->closing_time = now;
+	w->release = my_delete.release;
+	w->release_uctx = my_delete.uctx;
+	fr_dlist_insert_tail(&nr->closing, w);
+
+	if (!nr->ev_closing) fr_network_closing_timer(nr->el, now, nr);
 }
 
 
@@ -956,9 +1267,17 @@ fr_network_t *fr_network_create(TALLOC_CTX *ctx, fr_event_list_t *el, fr_log_t c
 	nr->el = el;
 	nr->log = logger;
 	nr->lvl = lvl;
-	nr->max_workers = MAX_WORKERS;
+	nr->max_workers = NUM_WORKERS_INIT;
 	nr->num_workers = 0;
 
+	nr->workers = talloc_zero_array(nr, fr_network_worker_t *, nr->max_workers);
+	if (!nr->workers) {
+		fr_strerror_printf("Failed allocating memory");
+		talloc_free(nr);
+		return NULL;
+	}
+	fr_dlist_init(&nr->closing, fr_network_worker_t, entry);
+
 	nr->aq_control = fr_atomic_queue_create(nr, 1024);
 	if (!nr->aq_control) {
 		talloc_free(nr);
@@ -1012,6 +1331,11 @@ fr_network_t *fr_network_create(TALLOC_CTX *ctx, fr_event_list_t *el, fr_log_t c
 		goto fail2;
 	}
 
+	if (fr_control_callback_add(nr->control, FR_CONTROL_ID_WORKER_DELETE, nr, fr_network_worker_delete_callback) < 0) {
+		fr_strerror_printf_push("Failed adding worker delete callback");
+		goto fail2;
+	}
+
 	/*
 	 *	Create the various heaps.
 	 */
@@ -1033,6 +1357,8 @@ fr_network_t *fr_network_create(TALLOC_CTX *ctx, fr_event_list_t *el, fr_log_t c
 		goto fail2;
 	}
 
+	fr_dlist_init(&nr->flush, fr_network_socket_t, flush_entry);
+
 	if (fr_event_pre_insert(nr->el, fr_network_pre_event, nr) < 0) {
 		fr_strerror_printf("Failed adding pre-check to event list");
 		goto fail2;
@@ -1058,6 +1384,7 @@ int fr_network_destroy(fr_network_t *nr)
 {
 	int i;
 	fr_channel_data_t *cd;
+	fr_network_worker_t *w;
 
 	(void) talloc_get_type_abort(nr, fr_network_t);
 
@@ -1071,6 +1398,15 @@ int fr_network_destroy(fr_network_t *nr)
 		fr_channel_signal_responder_close(worker->channel);
 	}
 
+	/*
+	 *	Including the ones we were already removing.
+	 */
+	for (w = fr_dlist_head(&nr->closing);
+	     w != NULL;
+	     w = fr_dlist_next(&nr->closing, w)) {
+		if (!w->closed) fr_channel_signal_responder_close(w->channel);
+	}
+
 	/*
 	 *	@todo wait for all workers to acknowledge the channel
 	 *	close.
@@ -1125,13 +1461,13 @@ static int fr_network_pre_event(void *ctx, UNUSED fr_time_t wake)
 static void fr_network_post_event(UNUSED fr_event_list_t *el, UNUSED fr_time_t now, void *uctx)
 {
 	fr_channel_data_t *cd;
+	fr_network_socket_t *s;
 	fr_network_t *nr = talloc_get_type_abort(uctx, fr_network_t);
 
 	while ((cd = fr_heap_pop(nr->replies)) != NULL) {
 		ssize_t rcode;
 		fr_listen_t *li;
 		fr_message_t *lm;
-		fr_network_socket_t *s;
 
 		li = cd->listen;
 
@@ -1275,7 +1611,49 @@ static void fr_network_post_event(UNUSED fr_event_list_t *el, UNUSED fr_time_t n
 		 *	As a special case, allow write() to return
 		 *	"0", which means "close the socket".
 		 */
-		if (rcode == 0) fr_network_socket_dead(nr, s);
+		if (rcode == 0) {
+			fr_network_socket_dead(nr, s);
+			continue;
+		}
+
+		fr_network_flush_add(nr, s);
+	}
+
+	/*
+	 *	Write any packets which the sockets have queued.
+	 */
+	while ((s = fr_dlist_head(&nr->flush)) != NULL) {
+		fr_dlist_remove(&nr->flush, s);
+		s->flush = false;
+
+		if (s->dead) continue;
+
+		if (s->listen->app_io->flush(s->listen) < 0) {
+			/*
+			 *	The socket is full, and the packets
+			 *	are still queued.  Write them when the
+			 *	socket becomes writable.  If there's a
+			 *	pending packet, fr_network_write() is
+			 *	already waiting, and it will cause
+			 *	another flush when it's done.
+			 */
+			if (errno == EWOULDBLOCK) {
+				if (s->pending) continue;
+
+				if (fr_event_fd_insert(nr, nr->el, s->listen->fd,
+						       fr_network_read,
+						       fr_network_flush_write,
+						       fr_network_error,
+						       s) < 0) {
+					PERROR("Failed adding write callback to event loop");
+					fr_network_socket_dead(nr, s);
+				}
+				continue;
+			}
+
+			PERROR("Failed writing queued packets to socket %d", s->listen->fd);
+			if (s->listen->app_io->error) s->listen->app_io->error(s->listen);
+		}
 	}
 }
 
@@ -1295,6 +1673,15 @@ void fr_network(fr_network_t *nr)
 		 *	the event loop, but we don't wait for events.
 		 */
 		wait_for_event = (fr_heap_num_elements(nr->replies) == 0);
+
+		/*
+		 *	If replies are arriving quickly, poll for them
+		 *	for a little while, instead of going to sleep
+		 *	and being woken up again.
+		 */
+		if (wait_for_event && (fr_control_spin(nr->control) > 0)) {
+			wait_for_event = (fr_heap_num_elements(nr->replies) == 0);
+		}
 		DEBUG3("Waiting for events %d", wait_for_event);
 
 		/*
@@ -1374,6 +1761,29 @@ int fr_network_directory_add(fr_network_t *nr, fr_listen_t *li)
 	return fr_control_message_send(nr->control, rb, FR_CONTROL_ID_DIRECTORY, &li, sizeof(li));
 }
 
+/** Enable or disable source affinity for a network
+ *
+ *  Must be called from the network thread, before it starts
+ *  processing packets.
+ *
+ * @param nr the network
+ * @param enable whether related packets should be sent to the same worker
+ */
+void fr_network_source_affinity_set(fr_network_t *nr, bool enable)
+{
+	nr->source_affinity = enable;
+}
+
+/** Set how long the network polls for replies before sleeping
+ *
+ * @param nr the network
+ * @param spin_time the maximum time to spin, or 0 to always sleep.
+ */
+void fr_network_spin_set(fr_network_t *nr, fr_time_delta_t spin_time)
+{
+	fr_control_spin_set(nr->control, spin_time);
+}
+
 /** Add a worker to a network
  *
  * @param nr the network
@@ -1392,6 +1802,43 @@ int fr_network_worker_add(fr_network_t *nr, fr_worker_t *worker)
 	return fr_control_message_send(nr->control, rb, FR_CONTROL_ID_WORKER, &worker, sizeof(worker));
 }
 
+/** Remove a worker from a network
+ *
+ *  The network stops sending packets to the worker, and closes its
+ *  channel once the worker has replied to the outstanding packets.
+ *  The worker exits when the channels from all networks are closed.
+ *
+ *  The worker's message sets hold the replies, so it must not be
+ *  freed until release() has been called by every network.
+ *
+ *  The request is ignored if the worker isn't known to the network,
+ *  or if it's the only worker the network has.  The worker then keeps
+ *  its channel, and release() is never called.  The caller must make
+ *  sure that neither is the case before asking for the worker to be
+ *  removed.
+ *
+ * @param nr the network
+ * @param worker the worker
+ * @param release called from the network thread once it has finished with the worker.
+ * @param uctx passed to release().
+ */
+int fr_network_worker_delete(fr_network_t *nr, fr_worker_t *worker, fr_network_worker_release_t release, void *uctx)
+{
+	fr_ring_buffer_t *rb;
+	fr_network_worker_delete_t my_delete;
+
+	rb = fr_network_rb_init();
+	if (!rb) return -1;
+
+	(void) talloc_get_type_abort(nr, fr_network_t);
+
+	my_delete.worker = worker;
+	my_delete.release = release;
+	my_delete.uctx = uctx;
+
+	return fr_control_message_send(nr->control, rb, FR_CONTROL_ID_WORKER_DELETE, &my_delete, sizeof(my_delete));
+}
+
 /** Signal the network to read from a listener
  *
  * @param nr the network
@@ -1471,9 +1918,7 @@ void fr_network_stats_log(fr_network_t const *nr, fr_log_t const *log)
 	/*
 	 *	Dump all of the channel statistics.
 	 */
-	for (i = 0; i < nr->max_workers; i++) {
-		if (!nr->workers[i]) continue;
-
+	for (i = 0; i < nr->num_workers; i++) {
 		fr_channel_stats_log(nr->workers[i]->channel, log, __FILE__, __LINE__);
 	}
 }
@@ -1481,12 +1926,23 @@ void fr_network_stats_log(fr_network_t const *nr, fr_log_t const *log)
 static int cmd_stats_self(FILE *fp, UNUSED FILE *fp_err, void *ctx, UNUSED fr_cmd_info_t const *info)
 {
 	fr_network_t const *nr = ctx;
+	fr_control_stats_t cs;
 
 	fprintf(fp, "count.in\t%" PRIu64 "\n", nr->stats.in);
 	fprintf(fp, "count.out\t%" PRIu64 "\n", nr->stats.out);
 	fprintf(fp, "count.dup\t%" PRIu64 "\n", nr->stats.dup);
 	fprintf(fp, "count.dropped\t%" PRIu64 "\n", nr->stats.dropped);
 	fprintf(fp, "count.sockets\t%u\n", rbtree_num_elements(nr->sockets));
+	if (nr->source_affinity) {
+		fprintf(fp, "count.affinity_hit\t%" PRIu64 "\n", nr->affinity_hit);
+		fprintf(fp, "count.affinity_miss\t%" PRIu64 "\n", nr->affinity_miss);
+	}
+
+	fr_control_stats(nr->control, &cs);
+	fprintf(fp, "control.signals\t%" PRIu64 "\n", cs.signals);
+	fprintf(fp, "control.signals_avoided\t%" PRIu64 "\n", cs.signals_avoided);
+	fprintf(fp, "control.wakeups\t%" PRIu64 "\n", cs.wakeups);
+	fprintf(fp, "control.spin_hits\t%" PRIu64 "\n", cs.spin_hits);
 
 	return 0;
 }
@@ -1530,6 +1986,9 @@ static int cmd_stats_socket(FILE *fp, FILE *fp_err, void *ctx, fr_cmd_info_t con
 	fprintf(fp, "count.out\t%" PRIu64 "\n", s->stats.out);
 	fprintf(fp, "count.dup\t%" PRIu64 "\n", s->stats.dup);
 	fprintf(fp, "count.dropped\t%" PRIu64 "\n", s->stats.dropped);
+	fprintf(fp, "count.reads\t%" PRIu64 "\n", s->reads);
+	fprintf(fp, "batch.max\t%u\n", s->max_batch);
+	if (s->reads) fprintf(fp, "batch.average\t%" PRIu64 "\n", s->stats.in / s->reads);
 
 	return 0;
 }
@@ -42,6 +42,13 @@ typedef struct fr_network_s fr_network_t;
 extern "C" {
 #endif
 
+/** Called when a network has finished with a worker which is being removed
+ *
+ * @param[in] worker	which was removed.
+ * @param[in] uctx	passed to fr_network_worker_delete().
+ */
+typedef void (*fr_network_worker_release_t)(fr_worker_t *worker, void *uctx);
+
 fr_network_t *fr_network_create(TALLOC_CTX *ctx, fr_event_list_t *el, fr_log_t const *logger, fr_log_lvl_t lvl) CC_HINT(nonnull(2,3));
 void fr_network_exit(fr_network_t *nr) CC_HINT(nonnull);
 int fr_network_destroy(fr_network_t *nr) CC_HINT(nonnull);
@@ -51,6 +58,10 @@ int fr_network_listen_add(fr_network_t *nr, fr_listen_t *li) CC_HINT(nonnull);
 int fr_network_socket_delete(fr_network_t *nr, fr_listen_t *li);
 int fr_network_directory_add(fr_network_t *nr, fr_listen_t *li) CC_HINT(nonnull);
 int fr_network_worker_add(fr_network_t *nr, fr_worker_t *worker) CC_HINT(nonnull);
+int fr_network_worker_delete(fr_network_t *nr, fr_worker_t *worker,
+			     fr_network_worker_release_t release, void *uctx) CC_HINT(nonnull(1,2));
+void fr_network_source_affinity_set(fr_network_t *nr, bool enable) CC_HINT(nonnull);
+void fr_network_spin_set(fr_network_t *nr, fr_time_delta_t spin_time) CC_HINT(nonnull);
 void fr_network_listen_read(fr_network_t *nr, fr_listen_t *li) CC_HINT(nonnull);
 int fr_network_listen_inject(fr_network_t *nr, fr_listen_t *li, uint8_t const *packet, size_t packet_len, fr_time_t recv_time);
 int fr_network_stats(fr_network_t const *nr, int num, uint64_t *stats) CC_HINT(nonnull);
@@ -35,6 +35,23 @@ RCSID("$Id$")
 
 #include <pthread.h>
 
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/*
+ *	CPU pinning uses the glibc cpu_set_t API, and the placement
+ *	report reads /proc and /sys, so it's Linux only.
+ */
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP) && defined(__linux__)
+#  define WITH_THREAD_AFFINITY
+#  include <sched.h>
+#  include <dirent.h>
+#  include <sys/syscall.h>
+#endif
+
 /*
  *	Other OS's have sem_init, OS X doesn't.
  */
@@ -63,6 +80,32 @@ RCSID("$Id$")
 
 #define SEM_WAIT_INTR(_x) do {if (sem_wait(_x) == 0) break;} while (errno == EINTR)
 
+/*
+ *	When to grow and shrink the worker pool.  We start a worker
+ *	if the workers are using more than SCALE_UP_BUSY percent of
+ *	their CPU time, or if they have more than SCALE_UP_ACTIVE
+ *	requests in progress each.  We stop a worker when they've
+ *	been mostly idle for SCALE_DOWN_INTERVALS in a row.
+ */
+#define SCALE_UP_BUSY		(80)
+#define SCALE_UP_ACTIVE		(8)
+#define SCALE_DOWN_BUSY		(30)
+#define SCALE_DOWN_INTERVALS	(5)
+
+#define MAX_WORKERS		(1024)
+
+#ifdef WITH_THREAD_AFFINITY
+/**
+ *  Where a child thread should run.
+ */
+typedef struct {
+	bool		pinned;			//!< whether we should set the affinity of the thread
+	int		numa_node;		//!< configured NUMA node, or -1 for "any"
+	cpu_set_t	cpus;			//!< CPUs the thread is allowed to run on
+	pid_t		tid;			//!< kernel thread ID, so we can find it in /proc
+} fr_schedule_affinity_t;
+#endif
+
 /**
  *  Track the child thread status.
  */
@@ -83,15 +126,23 @@ typedef struct {
 	pthread_t	pthread_id;		//!< the thread of this worker
 
 	int		id;			//!< a unique ID
-	int		uses;			//!< how many network threads are using it
+	atomic_int	uses;			//!< how many network threads are using it
 	fr_time_t	cpu_time;		//!< how much CPU time this worker has used
 
+	bool		dynamic;		//!< started at run time, and can be stopped
+	bool		retiring;		//!< the networks have been told to stop using it
+	bool		exited;			//!< the thread has finished, and can be joined
+
 	fr_dlist_t	entry;			//!< our entry into the linked list of workers
 
 	fr_schedule_t	*sc;			//!< the scheduler we are running under
 
 	fr_schedule_child_status_t status;	//!< status of the worker
 	fr_worker_t	*worker;		//!< the worker data structure
+
+#ifdef WITH_THREAD_AFFINITY
+	fr_schedule_affinity_t affinity;	//!< where the worker should run
+#endif
 } fr_schedule_worker_t;
 
 /**
@@ -102,12 +153,22 @@ typedef struct {
 	pthread_t	pthread_id;		//!< the thread of this network
 
 	int		id;			//!< a unique ID
+	unsigned int	num_listeners;		//!< how many listeners have been assigned to this network
+	unsigned int	num_workers;		//!< workers added to this network, and not yet removed
+
+	fr_dlist_t	entry;			//!< our entry into the linked list of networks
+
 	fr_schedule_t	*sc;			//!< the scheduler we are running under
 
 	fr_schedule_child_status_t status;	//!< status of the worker
 	fr_network_t	*nr;			//!< the receive data structure
 
 	fr_event_timer_t const *ev;		//!< timer for stats_interval
+	fr_event_timer_t const *ev_scale;	//!< timer for scale_interval
+
+#ifdef WITH_THREAD_AFFINITY
+	fr_schedule_affinity_t affinity;	//!< where the network should run
+#endif
 } fr_schedule_network_t;
 
 
@@ -130,14 +191,24 @@ struct fr_schedule_s {
 	sem_t		worker_sem;		//!< for inter-thread signaling
 	sem_t		network_sem;		//!< for inter-thread signaling
 
+	pthread_mutex_t	listen_mutex;		//!< protects network listener counts
+	pthread_mutex_t	workers_mutex;		//!< protects the list of workers, and the scaling state
+
+	uint32_t	min_workers;		//!< the pool never shrinks below this
+	uint32_t	max_workers;		//!< the pool never grows above this
+	bool		scaling;		//!< automatically grow and shrink the pool
+	unsigned int	num_idle;		//!< intervals in a row where the workers were mostly idle
+	fr_time_t	scale_time;		//!< when we last measured the load
+
 	fr_schedule_thread_instantiate_t	worker_thread_instantiate;	//!< thread instantiation callback
 
+	fr_worker_steal_t *steal;		//!< workers which take requests from each other
+
 	fr_dlist_head_t	workers;		//!< list of workers
+	fr_dlist_head_t	networks;		//!< list of networks
 
 	fr_network_t	*single_network;	//!< for single-threaded mode
 	fr_worker_t	*single_worker;		//!< for single-threaded mode
-
-	fr_schedule_network_t *sn;		//!< pointer to the (one) network thread
 };
 
 static _Thread_local int worker_id;		//!< Internal ID of the current worker thread.
@@ -151,6 +222,337 @@ int fr_schedule_worker_id(void)
 	return worker_id;
 }
 
+#ifdef WITH_THREAD_AFFINITY
+/** Parse a list of CPUs or NUMA nodes, e.g. "0-3,8,10-11"
+ *
+ * @param[out] set	to add the numbers to.
+ * @param[in] name	of the configuration item, for error messages.
+ * @param[in] str	to parse.
+ * @return
+ *	- <0 on error.
+ *	- the number of entries in the set.
+ */
+static int fr_schedule_cpu_list_parse(cpu_set_t *set, char const *name, char const *str)
+{
+	char const	*p = str;
+	char		*end;
+	unsigned long	start, stop;
+
+	CPU_ZERO(set);
+
+	while (*p) {
+		while (isspace((uint8_t) *p)) p++;
+
+		if (!isdigit((uint8_t) *p)) {
+		invalid:
+			fr_strerror_printf("Invalid value for %s at \"%s\"", name, p);
+			return -1;
+		}
+
+		start = stop = strtoul(p, &end, 10);
+		p = end;
+
+		if (*p == '-') {
+			p++;
+			if (!isdigit((uint8_t) *p)) goto invalid;
+
+			stop = strtoul(p, &end, 10);
+			p = end;
+		}
+
+		if ((stop < start) || (stop >= CPU_SETSIZE)) {
+			fr_strerror_printf("Invalid range %lu-%lu for %s", start, stop, name);
+			return -1;
+		}
+
+		while (start <= stop) CPU_SET(start++, set);
+
+		while (isspace((uint8_t) *p)) p++;
+		if (!*p) break;
+		if (*p != ',') goto invalid;
+		p++;
+	}
+
+	if (CPU_COUNT(set) == 0) {
+		fr_strerror_printf("No entries in %s", name);
+		return -1;
+	}
+
+	return CPU_COUNT(set);
+}
+
+/** Return the n'th entry in a set, wrapping around at the end
+ *
+ */
+static int fr_schedule_cpu_set_nth(cpu_set_t const *set, unsigned int n)
+{
+	int i;
+
+	n %= CPU_COUNT(set);
+
+	for (i = 0; i < CPU_SETSIZE; i++) {
+		if (!CPU_ISSET(i, set)) continue;
+		if (n-- == 0) return i;
+	}
+
+	return -1;
+}
+
+/** Print a set of CPUs in the same format that we parse
+ *
+ */
+static void fr_schedule_cpu_set_print(char *out, size_t outlen, cpu_set_t const *set)
+{
+	int	i, start;
+	char	*p = out, *end = out + outlen;
+
+	*out = '\0';
+
+	for (i = 0; i < CPU_SETSIZE; i++) {
+		if (!CPU_ISSET(i, set)) continue;
+
+		start = i;
+		while (((i + 1) < CPU_SETSIZE) && CPU_ISSET(i + 1, set)) i++;
+
+		if (start == i) {
+			p += snprintf(p, end - p, "%s%d", (p == out) ? "" : ",", i);
+		} else {
+			p += snprintf(p, end - p, "%s%d-%d", (p == out) ? "" : ",", start, i);
+		}
+
+		if (p >= end) {
+			/* ran out of room, mark the output as truncated */
+			if (outlen > 4) strcpy(end - 4, "...");
+			return;
+		}
+	}
+}
+
+/** Find the NUMA node which a CPU belongs to
+ *
+ *  The kernel puts a "nodeN" link into each CPU directory.  Kernels
+ *  without NUMA support don't, in which case everything is node 0.
+ */
+static int fr_schedule_cpu_numa_node(int cpu)
+{
+	char		path[64];
+	DIR		*dir;
+	struct dirent	*dp;
+	int		node = 0;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	dir = opendir(path);
+	if (!dir) return -1;
+
+	while ((dp = readdir(dir)) != NULL) {
+		if ((strncmp(dp->d_name, "node", 4) == 0) && isdigit((uint8_t) dp->d_name[4])) {
+			node = atoi(dp->d_name + 4);
+			break;
+		}
+	}
+	closedir(dir);
+
+	return node;
+}
+
+/** Figure out which CPU a thread last ran on
+ *
+ *  This is field 39 of /proc/self/task/TID/stat.  The second field
+ *  is the command name, which can contain spaces, so we start
+ *  counting after the closing bracket.
+ */
+static int fr_schedule_thread_cpu(pid_t tid)
+{
+	char	path[64], buffer[1024];
+	char	*p;
+	FILE	*fp;
+	int	field;
+
+	snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int) tid);
+	fp = fopen(path, "r");
+	if (!fp) return -1;
+
+	p = fgets(buffer, sizeof(buffer), fp);
+	fclose(fp);
+	if (!p) return -1;
+
+	p = strrchr(buffer, ')');
+	if (!p) return -1;
+
+	for (field = 2; field < 39; field++) {
+		p = strchr(p + 1, ' ');
+		if (!p) return -1;
+	}
+
+	return atoi(p + 1);
+}
+
+/** Decide where a network or worker thread should run
+ *
+ * @param[out] af	where the thread should run.
+ * @param[in] type	"network" or "worker", for error messages.
+ * @param[in] id	of the thread.
+ * @param[in] cpus	configured list of CPUs, or NULL.
+ * @param[in] nodes	configured list of NUMA nodes, or NULL.
+ * @return
+ *	- <0 on error.
+ *	- 0 on success.
+ */
+static int fr_schedule_affinity_init(fr_schedule_affinity_t *af, char const *type, unsigned int id,
+				     char const *cpus, char const *nodes)
+{
+	cpu_set_t	set;
+	char		name[32];
+	char		path[64], buffer[1024];
+	FILE		*fp;
+	char		*p;
+	int		cpu;
+
+	af->pinned = false;
+	af->numa_node = -1;
+	af->tid = -1;
+	CPU_ZERO(&af->cpus);
+
+	if (cpus && nodes) {
+		fr_strerror_printf("Cannot set both %s_cpus and %s_numa_nodes", type, type);
+		return -1;
+	}
+
+	if (cpus) {
+		snprintf(name, sizeof(name), "%s_cpus", type);
+		if (fr_schedule_cpu_list_parse(&set, name, cpus) < 0) return -1;
+
+		cpu = fr_schedule_cpu_set_nth(&set, id);
+		CPU_SET(cpu, &af->cpus);
+		af->numa_node = fr_schedule_cpu_numa_node(cpu);
+		af->pinned = true;
+		return 0;
+	}
+
+	if (!nodes) return 0;
+
+	snprintf(name, sizeof(name), "%s_numa_nodes", type);
+	if (fr_schedule_cpu_list_parse(&set, name, nodes) < 0) return -1;
+
+	af->numa_node = fr_schedule_cpu_set_nth(&set, id);
+
+	snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", af->numa_node);
+	fp = fopen(path, "r");
+	if (!fp) {
+		fr_strerror_printf("Invalid NUMA node %d in %s: %s", af->numa_node, name, fr_syserror(errno));
+		return -1;
+	}
+	p = fgets(buffer, sizeof(buffer), fp);
+	fclose(fp);
+
+	if (!p || !*p || (*p == '\n')) {
+		fr_strerror_printf("NUMA node %d in %s has no CPUs", af->numa_node, name);
+		return -1;
+	}
+
+	p = strchr(buffer, '\n');
+	if (p) *p = '\0';
+
+	if (fr_schedule_cpu_list_parse(&af->cpus, path, buffer) < 0) return -1;
+
+	af->pinned = true;
+	return 0;
+}
+
+/** Move the current thread to where it should run
+ *
+ *  This is called before the thread allocates anything.  Linux
+ *  places pages on the NUMA node of the CPU which first touches
+ *  them, so once we're pinned, the event list, message sets and
+ *  ring buffers of the thread are all allocated from local memory.
+ *
+ *  Failure isn't fatal.  The thread just runs wherever the kernel
+ *  puts it.
+ *
+ * @param[in] af	where the thread should run.
+ * @return
+ *	- 0 on success, or if the thread isn't pinned.
+ *	- -1 on failure, with the reason in fr_strerror().
+ */
+static int fr_schedule_affinity_apply(fr_schedule_affinity_t *af)
+{
+	int ret;
+
+	af->tid = syscall(SYS_gettid);
+
+	if (!af->pinned) return 0;
+
+	ret = pthread_setaffinity_np(pthread_self(), sizeof(af->cpus), &af->cpus);
+	if (ret != 0) {
+		fr_strerror_printf("Failed setting CPU affinity: %s", fr_syserror(ret));
+		af->pinned = false;
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Print where a thread is actually running
+ *
+ */
+static void fr_schedule_affinity_fprint(FILE *fp, char const *type, int id, pthread_t pthread_id,
+					fr_schedule_affinity_t const *af)
+{
+	cpu_set_t	set;
+	char		buffer[256];
+	int		cpu, node;
+
+	if (pthread_getaffinity_np(pthread_id, sizeof(set), &set) == 0) {
+		fr_schedule_cpu_set_print(buffer, sizeof(buffer), &set);
+	} else {
+		strcpy(buffer, "?");
+	}
+
+	cpu = fr_schedule_thread_cpu(af->tid);
+	node = (cpu >= 0) ? fr_schedule_cpu_numa_node(cpu) : -1;
+
+	fprintf(fp, "%s.%d\tpinned %s\tcpus %s\tcpu %d\tnode %d\n",
+		type, id, af->pinned ? "yes" : "no", buffer, cpu, node);
+}
+
+static int cmd_show_thread_affinity(FILE *fp, UNUSED FILE *fp_err, void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	fr_schedule_t		*sc = talloc_get_type_abort(ctx, fr_schedule_t);
+	fr_schedule_network_t	*sn;
+	fr_schedule_worker_t	*sw;
+
+	for (sn = fr_dlist_head(&sc->networks);
+	     sn != NULL;
+	     sn = fr_dlist_next(&sc->networks, sn)) {
+		fr_schedule_affinity_fprint(fp, "network", sn->id, sn->pthread_id, &sn->affinity);
+	}
+
+	pthread_mutex_lock(&sc->workers_mutex);
+	for (sw = fr_dlist_tail(&sc->workers);
+	     sw != NULL;
+	     sw = fr_dlist_prev(&sc->workers, sw)) {
+		if (sw->status != FR_CHILD_RUNNING) continue;
+
+		fr_schedule_affinity_fprint(fp, "worker", sw->id, sw->pthread_id, &sw->affinity);
+	}
+	pthread_mutex_unlock(&sc->workers_mutex);
+
+	return 0;
+}
+#endif
+
+/** Change the status of a worker
+ *
+ *  Workers can be started and stopped at run time, so the status
+ *  is read by other threads.
+ */
+static void fr_schedule_worker_status_set(fr_schedule_worker_t *sw, fr_schedule_child_status_t status)
+{
+	pthread_mutex_lock(&sw->sc->workers_mutex);
+	sw->status = status;
+	pthread_mutex_unlock(&sw->sc->workers_mutex);
+}
+
 /** Entry point for worker threads
  *
  * @param[in] arg	the fr_schedule_worker_t
@@ -166,6 +568,10 @@ static void *fr_schedule_worker_thread(void *arg)
 
 	worker_id = sw->id;		/* Store the current worker ID */
 
+#ifdef WITH_THREAD_AFFINITY
+	if (fr_schedule_affinity_apply(&sw->affinity) < 0) PWARN("Worker %d", sw->id);
+#endif
+
 	sw->ctx = ctx = talloc_init("worker %d", sw->id);
 	if (!ctx) {
 		ERROR("Worker %d - Failed allocating memory", sw->id);
@@ -180,6 +586,12 @@ static void *fr_schedule_worker_thread(void *arg)
 		goto fail;
 	}
 
+	if (sc->config->timer_resolution &&
+	    (fr_event_list_set_timer_wheel(sw->el, sc->config->timer_resolution) < 0)) {
+		ERROR("Worker %d - Failed creating timer wheel: %s", sw->id, fr_strerror());
+		goto fail;
+	}
+
 	snprintf(buffer, sizeof(buffer), "Worker %d", sw->id);
 	sw->worker = fr_worker_create(ctx, buffer, sw->el, sc->log, sc->lvl);
 	if (!sw->worker) {
@@ -187,6 +599,8 @@ static void *fr_schedule_worker_thread(void *arg)
 		goto fail;
 	}
 
+	fr_worker_spin_set(sw->worker, sc->config->spin_time);
+
 	/*
 	 *	@todo make this a registry
 	 */
@@ -204,16 +618,58 @@ static void *fr_schedule_worker_thread(void *arg)
 		}
 	}
 
-	sw->status = FR_CHILD_RUNNING;
+	/*
+	 *	Join the stealing group before the networks know about
+	 *	us.  Once a network has a channel to us, we can't just
+	 *	destroy the worker, so nothing after the adds below is
+	 *	allowed to fail.
+	 *
+	 *	Our backlog is empty until the networks send us
+	 *	packets, so there's nothing for the other workers to
+	 *	take yet.
+	 */
+	if (sc->steal && (fr_worker_steal_join(sc->steal, sw->worker) < 0)) {
+		ERROR("Worker %d - Failed enabling work stealing: %s", sw->id, fr_strerror());
+		goto fail;
+	}
 
-	(void) fr_network_worker_add(sc->sn->nr, sw->worker);
+	/*
+	 *	Every network thread gets a channel to every worker.
+	 *	The list of networks is fixed before any worker is
+	 *	started.  The lock protects the per-network worker
+	 *	counts, and our status.
+	 *
+	 *	We only become RUNNING once the networks have been
+	 *	told about us.  fr_schedule_worker_retire() only picks
+	 *	RUNNING workers, so a network never sees the delete
+	 *	before the add.
+	 */
+	{
+		fr_schedule_network_t *sn;
+
+		pthread_mutex_lock(&sc->workers_mutex);
+		for (sn = fr_dlist_head(&sc->networks);
+		     sn != NULL;
+		     sn = fr_dlist_next(&sc->networks, sn)) {
+			if (fr_network_worker_add(sn->nr, sw->worker) < 0) {
+				ERROR("Worker %d - Failed adding worker to network %d: %s",
+				      sw->id, sn->id, fr_strerror());
+				continue;
+			}
+			atomic_fetch_add(&sw->uses, 1);
+			sn->num_workers++;
+		}
+		sw->status = FR_CHILD_RUNNING;
+		pthread_mutex_unlock(&sc->workers_mutex);
+	}
 
 	DEBUG3("Spawned async worker %d", sw->id);
 
 	/*
 	 *	Tell the originator that the thread has started.
+	 *	Workers started at run time aren't waited for.
 	 */
-	sem_post(&sc->worker_sem);
+	if (!sw->dynamic) sem_post(&sc->worker_sem);
 
 	/*
 	 *	Do all of the work.
@@ -227,9 +683,22 @@ static void *fr_schedule_worker_thread(void *arg)
 	status = FR_CHILD_EXITED;
 
 fail:
-	sw->status = status;
+	fr_schedule_worker_status_set(sw, status);
 
 	if (sw->worker) {
+		/*
+		 *	The networks may still be writing replies
+		 *	which are in our message sets.  Wait until
+		 *	they've all let go of us.
+		 */
+		if (sw->dynamic && (status == FR_CHILD_EXITED)) {
+			while (atomic_load(&sw->uses) > 0) {
+				struct timespec ts = { .tv_sec = 0, .tv_nsec = 10 * 1000 * 1000 };
+
+				nanosleep(&ts, NULL);
+			}
+		}
+
 		fr_worker_destroy(sw->worker);
 		sw->worker = NULL;
 	}
@@ -239,7 +708,13 @@ fail:
 	/*
 	 *	Tell the scheduler we're done.
 	 */
-	sem_post(&sc->worker_sem);
+	if (!sw->dynamic) {
+		sem_post(&sc->worker_sem);
+	} else {
+		pthread_mutex_lock(&sc->workers_mutex);
+		sw->exited = true;
+		pthread_mutex_unlock(&sc->workers_mutex);
+	}
 
 	return NULL;
 }
@@ -254,6 +729,440 @@ static void stats_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
 	(void) fr_event_timer_at(sn, el, &sn->ev, now + sn->sc->config->stats_interval, stats_timer, sn);
 }
 
+/** Called by a network once it has stopped using a worker
+ *
+ */
+static void fr_schedule_worker_release(UNUSED fr_worker_t *worker, void *uctx)
+{
+	fr_schedule_worker_t *sw = uctx;
+
+	atomic_fetch_sub(&sw->uses, 1);
+}
+
+/** How much CPU time a worker thread has used
+ *
+ * @return the CPU time, or 0 if the platform can't tell us.
+ */
+static fr_time_t fr_schedule_worker_cpu_time(fr_schedule_worker_t *sw)
+{
+#if defined(_POSIX_THREAD_CPUTIME) && (_POSIX_THREAD_CPUTIME >= 0)
+	clockid_t	clock_id;
+	struct timespec	ts;
+
+	if (pthread_getcpuclockid(sw->pthread_id, &clock_id) != 0) return 0;
+	if (clock_gettime(clock_id, &ts) < 0) return 0;
+
+	return fr_time_delta_from_timespec(&ts);
+#else
+	return 0;
+#endif
+}
+
+/** Count the workers which are running, or starting
+ *
+ *  Workers which are being stopped don't count.
+ */
+static uint32_t fr_schedule_workers_count(fr_schedule_t *sc)
+{
+	uint32_t		num = 0;
+	fr_schedule_worker_t	*sw;
+
+	for (sw = fr_dlist_head(&sc->workers);
+	     sw != NULL;
+	     sw = fr_dlist_next(&sc->workers, sw)) {
+		if (sw->retiring) continue;
+
+		if ((sw->status == FR_CHILD_INITIALIZING) || (sw->status == FR_CHILD_RUNNING)) num++;
+	}
+
+	return num;
+}
+
+/** Start a worker at run time
+ *
+ *  The worker adds itself to all of the networks.  We don't wait for
+ *  it to start.
+ *
+ *  Must be called with workers_mutex held.
+ */
+static int fr_schedule_worker_start(fr_schedule_t *sc)
+{
+	int			id;
+	fr_schedule_worker_t	*sw;
+
+	/*
+	 *	Re-use the lowest free ID, so that IDs don't grow
+	 *	without bound as workers come and go.
+	 */
+	for (id = sc->min_workers; ; id++) {
+		for (sw = fr_dlist_head(&sc->workers);
+		     sw != NULL;
+		     sw = fr_dlist_next(&sc->workers, sw)) {
+			if (sw->id == id) break;
+		}
+		if (!sw) break;
+	}
+
+	/*
+	 *	Not parented by the scheduler, as talloc isn't
+	 *	thread-safe, and we're not in the main thread.
+	 */
+	sw = talloc_zero(NULL, fr_schedule_worker_t);
+	if (!sw) {
+		ERROR("Worker %d - Failed allocating memory", id);
+		return -1;
+	}
+
+	sw->id = id;
+	sw->sc = sc;
+	sw->status = FR_CHILD_INITIALIZING;
+	sw->dynamic = true;
+
+#ifdef WITH_THREAD_AFFINITY
+	if (fr_schedule_affinity_init(&sw->affinity, "worker", id,
+				      sc->config->worker_cpus, sc->config->worker_numa_nodes) < 0) {
+		ERROR("Worker %d - %s", id, fr_strerror());
+		talloc_free(sw);
+		return -1;
+	}
+#endif
+
+	fr_dlist_insert_head(&sc->workers, sw);
+
+	if (fr_schedule_pthread_create(&sw->pthread_id, fr_schedule_worker_thread, sw) < 0) {
+		ERROR("Failed creating worker %d: %s", id, fr_strerror());
+		fr_dlist_remove(&sc->workers, sw);
+		talloc_free(sw);
+		return -1;
+	}
+
+	return 0;
+}
+
+/** Stop a worker which was started at run time
+ *
+ *  The networks stop sending it packets, and close their channels
+ *  once it has replied to the ones it has.  The worker then exits,
+ *  and is cleaned up by fr_schedule_workers_reap().
+ *
+ *  Must be called with workers_mutex held.
+ */
+static int fr_schedule_worker_retire(fr_schedule_t *sc)
+{
+	fr_schedule_worker_t	*sw, *found = NULL;
+	fr_schedule_network_t	*sn;
+
+	for (sw = fr_dlist_head(&sc->workers);
+	     sw != NULL;
+	     sw = fr_dlist_next(&sc->workers, sw)) {
+		if (!sw->dynamic || sw->retiring || (sw->status != FR_CHILD_RUNNING)) continue;
+
+		if (!found || (sw->id > found->id)) found = sw;
+	}
+	if (!found) return -1;
+
+	/*
+	 *	A network won't remove its last worker, and so would
+	 *	never release this one.  Don't start retiring a
+	 *	worker which we can't finish retiring.
+	 */
+	for (sn = fr_dlist_head(&sc->networks);
+	     sn != NULL;
+	     sn = fr_dlist_next(&sc->networks, sn)) {
+		if (sn->num_workers <= 1) {
+			DEBUG2("Not stopping worker %d - network %d has no other workers", found->id, sn->id);
+			return -1;
+		}
+	}
+
+	INFO("Stopping worker %d", found->id);
+
+	found->retiring = true;
+
+	for (sn = fr_dlist_head(&sc->networks);
+	     sn != NULL;
+	     sn = fr_dlist_next(&sc->networks, sn)) {
+		if (fr_network_worker_delete(sn->nr, found->worker, fr_schedule_worker_release, found) < 0) {
+			ERROR("Worker %d - Failed removing worker from network %d: %s",
+			      found->id, sn->id, fr_strerror());
+			continue;
+		}
+		sn->num_workers--;
+	}
+
+	return 0;
+}
+
+/** Clean up workers which have exited
+ *
+ *  Must be called with workers_mutex held.
+ */
+static void fr_schedule_workers_reap(fr_schedule_t *sc)
+{
+	fr_schedule_worker_t	*sw, *next;
+
+	for (sw = fr_dlist_head(&sc->workers);
+	     sw != NULL;
+	     sw = next) {
+		next = fr_dlist_next(&sc->workers, sw);
+
+		if (!sw->dynamic || !sw->exited) continue;
+
+		fr_dlist_remove(&sc->workers, sw);
+
+		if (pthread_join(sw->pthread_id, NULL) != 0) {
+			ERROR("Failed joining worker %i: %s", sw->id, fr_syserror(errno));
+		} else {
+			DEBUG2("Worker %i exited", sw->id);
+		}
+		talloc_free(sw->ctx);
+		talloc_free(sw);
+	}
+}
+
+/** Grow or shrink the worker pool
+ *
+ *  This runs in the first network thread.  We look at how much CPU
+ *  time the workers used since the last time we checked, and how
+ *  many requests they have in progress.  At most one worker is
+ *  started or stopped each time.
+ */
+static void scale_timer(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_schedule_network_t		*sn = talloc_get_type_abort(uctx, fr_schedule_network_t);
+	fr_schedule_t			*sc = sn->sc;
+	fr_schedule_worker_t		*sw;
+	uint32_t			num = 0, count;
+	uint64_t			active = 0, busy = 0;
+	fr_time_delta_t			cpu_time = 0, elapsed;
+
+	pthread_mutex_lock(&sc->workers_mutex);
+
+	fr_schedule_workers_reap(sc);
+
+	for (sw = fr_dlist_head(&sc->workers);
+	     sw != NULL;
+	     sw = fr_dlist_next(&sc->workers, sw)) {
+		uint64_t	stats[6];
+		fr_time_t	cpu;
+
+		if (sw->retiring || (sw->status != FR_CHILD_RUNNING)) continue;
+
+		num++;
+
+		cpu = fr_schedule_worker_cpu_time(sw);
+		if (cpu > sw->cpu_time) cpu_time += cpu - sw->cpu_time;
+		sw->cpu_time = cpu;
+
+		if (fr_worker_stats(sw->worker, 6, stats) == 6) active += stats[5];
+	}
+
+	elapsed = now - sc->scale_time;
+	sc->scale_time = now;
+
+	if (!sc->scaling || !sc->running || !num || (elapsed <= 0)) goto done;
+
+	busy = (cpu_time * 100) / (elapsed * num);
+	count = fr_schedule_workers_count(sc);
+
+	if ((busy >= SCALE_UP_BUSY) || (active > (num * SCALE_UP_ACTIVE))) {
+		sc->num_idle = 0;
+
+		/*
+		 *	Wait for any new worker to start before
+		 *	deciding if we need another one.
+		 */
+		if ((count > num) || (count >= sc->max_workers)) goto done;
+
+		INFO("Workers are busy (%" PRIu64 "%% CPU, %" PRIu64 " requests in progress) - starting a new worker",
+		     busy, active);
+		(void) fr_schedule_worker_start(sc);
+		goto done;
+	}
+
+	if ((busy >= SCALE_DOWN_BUSY) || (active >= num) || (count <= sc->min_workers)) {
+		sc->num_idle = 0;
+		goto done;
+	}
+
+	/*
+	 *	Other workers may be running requests which they
+	 *	stole from this one, so it can't leave the group.
+	 */
+	if (sc->steal) goto done;
+
+	if (++sc->num_idle < SCALE_DOWN_INTERVALS) goto done;
+
+	sc->num_idle = 0;
+	(void) fr_schedule_worker_retire(sc);
+
+done:
+	pthread_mutex_unlock(&sc->workers_mutex);
+
+	(void) fr_event_timer_at(sn, el, &sn->ev_scale, now + sc->config->scale_interval, scale_timer, sn);
+}
+
+static int cmd_show_thread_workers(FILE *fp, UNUSED FILE *fp_err, void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	fr_schedule_t		*sc = talloc_get_type_abort(ctx, fr_schedule_t);
+	fr_schedule_worker_t	*sw;
+
+	pthread_mutex_lock(&sc->workers_mutex);
+
+	fprintf(fp, "count\t%u\n", fr_schedule_workers_count(sc));
+	fprintf(fp, "min\t%u\n", sc->min_workers);
+	fprintf(fp, "max\t%u\n", sc->max_workers);
+	fprintf(fp, "scaling\t%s\n", sc->scaling ? "yes" : "no");
+
+	for (sw = fr_dlist_tail(&sc->workers);
+	     sw != NULL;
+	     sw = fr_dlist_prev(&sc->workers, sw)) {
+		char const *status;
+
+		switch (sw->status) {
+		case FR_CHILD_INITIALIZING:
+			status = "starting";
+			break;
+
+		case FR_CHILD_RUNNING:
+			status = sw->retiring ? "stopping" : "running";
+			break;
+
+		default:
+			status = "exited";
+			break;
+		}
+
+		fprintf(fp, "worker.%d\t%s\t%s\n", sw->id, sw->dynamic ? "dynamic" : "static", status);
+	}
+
+	pthread_mutex_unlock(&sc->workers_mutex);
+
+	return 0;
+}
+
+static int cmd_set_thread_workers(UNUSED FILE *fp, FILE *fp_err, void *ctx, fr_cmd_info_t const *info)
+{
+	fr_schedule_t	*sc = talloc_get_type_abort(ctx, fr_schedule_t);
+	uint32_t	num = info->box[0]->vb_uint32;
+	uint32_t	count;
+	int		ret = 0;
+
+	if (sc->max_workers == sc->min_workers) {
+		fprintf(fp_err, "The number of workers is fixed.  Set 'max_workers' in the 'thread pool' section.\n");
+		return -1;
+	}
+
+	if ((num < sc->min_workers) || (num > sc->max_workers)) {
+		fprintf(fp_err, "Number of workers must be between %u and %u.\n", sc->min_workers, sc->max_workers);
+		return -1;
+	}
+
+	pthread_mutex_lock(&sc->workers_mutex);
+
+	count = fr_schedule_workers_count(sc);
+	if ((num < count) && sc->steal) {
+		pthread_mutex_unlock(&sc->workers_mutex);
+		fprintf(fp_err, "Workers cannot be stopped when 'work_stealing' is enabled.\n");
+		return -1;
+	}
+
+	/*
+	 *	The administrator knows best.
+	 */
+	sc->scaling = false;
+
+	while ((count < num) && (fr_schedule_worker_start(sc) == 0)) count++;
+	while ((count > num) && (fr_schedule_worker_retire(sc) == 0)) count--;
+
+	if (count != num) {
+		fprintf(fp_err, "Failed changing the number of workers, there are now %u.\n", count);
+		ret = -1;
+	}
+
+	pthread_mutex_unlock(&sc->workers_mutex);
+
+	return ret;
+}
+
+static int cmd_set_thread_scaling(UNUSED FILE *fp, FILE *fp_err, void *ctx, fr_cmd_info_t const *info)
+{
+	fr_schedule_t	*sc = talloc_get_type_abort(ctx, fr_schedule_t);
+	fr_value_box_t	box;
+	fr_type_t	type = FR_TYPE_BOOL;
+
+	if (fr_value_box_from_str(NULL, &box, &type, NULL, info->argv[0], strlen(info->argv[0]), '\0', false) < 0) {
+		fprintf(fp_err, "Failed setting scaling '%s' - %s\n", info->argv[0], fr_strerror());
+		return -1;
+	}
+
+	if (box.vb_bool && (sc->max_workers == sc->min_workers)) {
+		fprintf(fp_err, "The number of workers is fixed.  Set 'max_workers' in the 'thread pool' section.\n");
+		return -1;
+	}
+
+	pthread_mutex_lock(&sc->workers_mutex);
+	sc->scaling = box.vb_bool;
+	sc->num_idle = 0;
+	pthread_mutex_unlock(&sc->workers_mutex);
+
+	return 0;
+}
+
+static fr_cmd_table_t cmd_schedule_table[] = {
+	{
+		.parent = "show",
+		.name = "thread",
+		.help = "Show information about network and worker threads.",
+		.read_only = true
+	},
+
+#ifdef WITH_THREAD_AFFINITY
+	{
+		.parent = "show thread",
+		.name = "affinity",
+		.func = cmd_show_thread_affinity,
+		.help = "Show which CPUs and NUMA nodes the threads are running on.",
+		.read_only = true
+	},
+#endif
+
+	{
+		.parent = "show thread",
+		.name = "workers",
+		.func = cmd_show_thread_workers,
+		.help = "Show the worker threads, and whether the pool is being resized.",
+		.read_only = true
+	},
+
+	{
+		.parent = "set",
+		.name = "thread",
+		.help = "Change network and worker thread settings.",
+		.read_only = false
+	},
+
+	{
+		.parent = "set thread",
+		.name = "workers",
+		.syntax = "INTEGER",
+		.func = cmd_set_thread_workers,
+		.help = "Change the number of worker threads, and stop resizing the pool automatically.",
+		.read_only = false
+	},
+
+	{
+		.parent = "set thread",
+		.name = "scaling",
+		.syntax = "BOOL",
+		.func = cmd_set_thread_scaling,
+		.help = "Enable or disable resizing the worker pool automatically.",
+		.read_only = false
+	},
+
+	CMD_TABLE_END
+};
+
 /** Initialize and run the network thread.
  *
  * @param[in] arg the fr_schedule_network_t
@@ -269,6 +1178,10 @@ static void *fr_schedule_network_thread(void *arg)
 
 	INFO("Network %d starting", sn->id);
 
+#ifdef WITH_THREAD_AFFINITY
+	if (fr_schedule_affinity_apply(&sn->affinity) < 0) PWARN("Network %d", sn->id);
+#endif
+
 	sn->ctx = ctx = talloc_init("network %d", sn->id);
 	if (!ctx) {
 		ERROR("Network %d - Failed allocating memory", sn->id);
@@ -282,12 +1195,21 @@ static void *fr_schedule_network_thread(void *arg)
 		goto fail;
 	}
 
+	if (sc->config->timer_resolution &&
+	    (fr_event_list_set_timer_wheel(el, sc->config->timer_resolution) < 0)) {
+		ERROR("Network %d - Failed creating timer wheel: %s", sn->id, fr_strerror());
+		goto fail;
+	}
+
 	sn->nr = fr_network_create(ctx, el, sc->log, sc->lvl);
 	if (!sn->nr) {
 		ERROR("Network %d - Failed creating network: %s", sn->id, fr_strerror());
 		goto fail;
 	}
 
+	fr_network_source_affinity_set(sn->nr, sc->config->source_affinity);
+	fr_network_spin_set(sn->nr, sc->config->spin_time);
+
 	sn->status = FR_CHILD_RUNNING;
 
 	/*
@@ -295,13 +1217,20 @@ static void *fr_schedule_network_thread(void *arg)
 	 */
 	sem_post(&sc->network_sem);
 
-	DEBUG3("Spawned asycn network 0");
+	DEBUG3("Spawned async network %d", sn->id);
 
 	/*
 	 *	Print out statistics for this network IO handler.
 	 */
 	if (sc->config->stats_interval) (void) fr_event_timer_in(sn, el, &sn->ev, sn->sc->config->stats_interval, stats_timer, sn);
 
+	/*
+	 *	The first network resizes the worker pool.
+	 */
+	if ((sn->id == 0) && (sc->max_workers > sc->min_workers)) {
+		(void) fr_event_timer_in(sn, el, &sn->ev_scale, sc->config->scale_interval, scale_timer, sn);
+	}
+
 	/*
 	 *	Do all of the work.
 	 */
@@ -312,7 +1241,7 @@ static void *fr_schedule_network_thread(void *arg)
 fail:
 	sn->status = status;
 
-	INFO("Network exiting");
+	INFO("Network %d exiting", sn->id);
 
 	/*
 	 *	Tell the scheduler we're done.
@@ -378,6 +1307,7 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 {
 	unsigned int i;
 	fr_schedule_worker_t *sw, *next;
+	fr_schedule_network_t *sn;
 	fr_schedule_t *sc;
 
 	sc = talloc_zero(ctx, fr_schedule_t);
@@ -463,19 +1393,53 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 		MEM(sc->config = talloc_zero(sc, fr_schedule_config_t));
 		sc->config->max_networks = 1;
 		sc->config->max_workers = 4;
+		sc->config->scale_max_workers = 4;
+		sc->config->scale_interval = fr_time_delta_from_sec(1);
 	} else {
 		sc->config = config;
 
-		if (sc->config->max_networks != 1) sc->config->max_networks = 1;
+		if (sc->config->max_networks < 1) sc->config->max_networks = 1;
+		if (sc->config->max_networks > 64) sc->config->max_networks = 64;
 		if (sc->config->max_workers < 1) sc->config->max_workers = 1;
-		if (sc->config->max_workers > 64) sc->config->max_workers = 64;
+		if (sc->config->max_workers > MAX_WORKERS) sc->config->max_workers = MAX_WORKERS;
+
+		if (sc->config->scale_max_workers < sc->config->max_workers) {
+			sc->config->scale_max_workers = sc->config->max_workers;
+		}
+		if (sc->config->scale_max_workers > MAX_WORKERS) sc->config->scale_max_workers = MAX_WORKERS;
+		if (sc->config->scale_interval <= 0) sc->config->scale_interval = fr_time_delta_from_sec(1);
+
+#ifndef WITH_THREAD_AFFINITY
+		if (sc->config->network_cpus || sc->config->worker_cpus ||
+		    sc->config->network_numa_nodes || sc->config->worker_numa_nodes) {
+			WARN("CPU and NUMA affinity are not supported on this platform - ignoring");
+		}
+#endif
+	}
+
+	sc->min_workers = sc->config->max_workers;
+	sc->max_workers = sc->config->scale_max_workers;
+	sc->scaling = (sc->max_workers > sc->min_workers);
+
+	/*
+	 *	Workers started at run time join the group, too.
+	 */
+	if (sc->config->work_stealing && (sc->max_workers > 1)) {
+		if (sc->scaling) WARN("The worker pool will grow, but not shrink, as 'work_stealing' is enabled");
 
+		sc->steal = fr_worker_steal_create(sc, sc->max_workers);
+		if (!sc->steal) {
+			ERROR("Failed creating work stealing group: %s", fr_strerror());
+			talloc_free(sc);
+			return NULL;
+		}
 	}
 
 	/*
-	 *	Create the list which holds the workers.
+	 *	Create the lists which hold the workers and networks.
 	 */
 	fr_dlist_init(&sc->workers, fr_schedule_worker_t, entry);
+	fr_dlist_init(&sc->networks, fr_schedule_network_t, entry);
 
 	memset(&sc->network_sem, 0, sizeof(sc->network_sem));
 	if (sem_init(&sc->network_sem, 0, SEMAPHORE_LOCKED) != 0) {
@@ -484,6 +1448,9 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 		return NULL;
 	}
 
+	pthread_mutex_init(&sc->listen_mutex, NULL);
+	pthread_mutex_init(&sc->workers_mutex, NULL);
+
 	memset(&sc->worker_sem, 0, sizeof(sc->worker_sem));
 	if (sem_init(&sc->worker_sem, 0, SEMAPHORE_LOCKED) != 0) {
 		ERROR("Failed creating semaphore: %s", fr_syserror(errno));
@@ -492,24 +1459,69 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 	}
 
 	/*
-	 *	Create the network thread first.
-	 *	@todo - create multiple network threads
+	 *	Create the network threads first.  The workers add
+	 *	themselves to every network when they start, so all
+	 *	of the networks have to be running before that.
 	 */
-	sc->sn = talloc_zero(sc, fr_schedule_network_t);
-	sc->sn->sc = sc;
-	sc->sn->id = 0;
+	for (i = 0; i < sc->config->max_networks; i++) {
+		DEBUG3("Creating %u/%u networks", i, sc->config->max_networks);
 
-	if (fr_schedule_pthread_create(&sc->sn->pthread_id, fr_schedule_network_thread, sc->sn) < 0) {
-		ERROR("Failed creating network thread %s", fr_strerror());
-		goto fail;
+		sn = talloc_zero(sc, fr_schedule_network_t);
+		if (!sn) {
+			ERROR("Network %u - Failed allocating memory", i);
+			break;
+		}
+
+		sn->id = i;
+		sn->sc = sc;
+		sn->status = FR_CHILD_INITIALIZING;
+
+#ifdef WITH_THREAD_AFFINITY
+		if (fr_schedule_affinity_init(&sn->affinity, "network", i,
+					      sc->config->network_cpus, sc->config->network_numa_nodes) < 0) {
+			ERROR("Network %u - %s", i, fr_strerror());
+			talloc_free(sn);
+			break;
+		}
+#endif
+
+		fr_dlist_insert_tail(&sc->networks, sn);
+
+		if (fr_schedule_pthread_create(&sn->pthread_id, fr_schedule_network_thread, sn) < 0) {
+			ERROR("Failed creating network %u: %s", i, fr_strerror());
+			fr_dlist_remove(&sc->networks, sn);
+			talloc_free(sn);
+			break;
+		}
+	}
+
+	/*
+	 *	Wait for all of the networks to signal us that either
+	 *	they've started, OR there's been a problem and they
+	 *	can't start.
+	 */
+	for (i = 0; i < (unsigned int)fr_dlist_num_elements(&sc->networks); i++) {
+		DEBUG3("Waiting for semaphore from network %u/%u",
+		       i, (unsigned int)fr_dlist_num_elements(&sc->networks));
+		SEM_WAIT_INTR(&sc->network_sem);
 	}
 
-	SEM_WAIT_INTR(&sc->network_sem);
-	if (sc->sn->status != FR_CHILD_RUNNING) {
-	fail:
+	/*
+	 *	Failed to start some networks, refuse to do anything!
+	 *	The destroy function cleans up the ones which did
+	 *	start.
+	 */
+	for (sn = fr_dlist_head(&sc->networks);
+	     sn != NULL;
+	     sn = fr_dlist_next(&sc->networks, sn)) {
+		if (sn->status != FR_CHILD_RUNNING) {
+			fr_schedule_destroy(sc);
+			return NULL;
+		}
+	}
+
+	if ((unsigned int)fr_dlist_num_elements(&sc->networks) < sc->config->max_networks) {
 		fr_schedule_destroy(sc);
-		if (sc->sn->ctx) TALLOC_FREE(sc->sn->ctx);
-		TALLOC_FREE(sc->sn);
 		return NULL;
 	}
 
@@ -531,6 +1543,16 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 		sw->id = i;
 		sw->sc = sc;
 		sw->status = FR_CHILD_INITIALIZING;
+
+#ifdef WITH_THREAD_AFFINITY
+		if (fr_schedule_affinity_init(&sw->affinity, "worker", i,
+					      sc->config->worker_cpus, sc->config->worker_numa_nodes) < 0) {
+			ERROR("Worker %u - %s", i, fr_strerror());
+			talloc_free(sw);
+			break;
+		}
+#endif
+
 		fr_dlist_insert_head(&sc->workers, sw);
 
 		if (fr_schedule_pthread_create(&sw->pthread_id, fr_schedule_worker_thread, sw) < 0) {
@@ -588,13 +1610,26 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
 		}
 	}
 
-	if (fr_command_register_hook(NULL, "0", sc->sn->nr, cmd_network_table) < 0) {
-		ERROR("Failed adding network commands: %s", fr_strerror());
+	for (sn = fr_dlist_head(&sc->networks);
+	     sn != NULL;
+	     sn = fr_dlist_next(&sc->networks, sn)) {
+		char buffer[32];
+
+		snprintf(buffer, sizeof(buffer), "%d", sn->id);
+		if (fr_command_register_hook(NULL, buffer, sn->nr, cmd_network_table) < 0) {
+			ERROR("Failed adding network commands: %s", fr_strerror());
+			goto st_fail;
+		}
+	}
+
+	if (fr_command_register_hook(NULL, NULL, sc, cmd_schedule_table) < 0) {
+		ERROR("Failed adding scheduler commands: %s", fr_strerror());
 		goto st_fail;
 	}
 
 	if (sc) INFO("Scheduler created successfully with %u networks and %u workers",
-		     sc->config->max_networks, (unsigned int)fr_dlist_num_elements(&sc->workers));
+		     (unsigned int)fr_dlist_num_elements(&sc->networks),
+		     (unsigned int)fr_dlist_num_elements(&sc->workers));
 
 	return sc;
 }
@@ -608,8 +1643,9 @@ fr_schedule_t *fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el,
  */
 int fr_schedule_destroy(fr_schedule_t *sc)
 {
-	unsigned int i;
+	unsigned int i, num_static;
 	fr_schedule_worker_t *sw;
+	fr_schedule_network_t *sn;
 
 	sc->running = false;
 
@@ -626,29 +1662,52 @@ int fr_schedule_destroy(fr_schedule_t *sc)
 		goto done;
 	}
 
-	rad_assert(sc->sn);
-	rad_assert(fr_dlist_num_elements(&sc->workers) > 0);
-
 	/*
-	 *	If the network thread is running, tell it to exit, and
-	 *	wait for it to do so.  Once it's exited, we know that
-	 *	this thread can use the network channels to tell the
-	 *	workers that the network side is going away.
+	 *	If the network threads are running, tell them to exit,
+	 *	and wait for them to do so.  Once they've exited, we
+	 *	know that this thread can use the network channels to
+	 *	tell the workers that the network side is going away.
+	 *
+	 *	Each worker only exits once all of its channels have
+	 *	been closed, i.e. after every network is destroyed.
 	 */
-	if (sc->sn->status == FR_CHILD_RUNNING) {
-		fr_network_exit(sc->sn->nr);
+	for (sn = fr_dlist_head(&sc->networks);
+	     sn != NULL;
+	     sn = fr_dlist_next(&sc->networks, sn)) {
+		if (sn->status != FR_CHILD_RUNNING) continue;
+
+		fr_network_exit(sn->nr);
 		SEM_WAIT_INTR(&sc->network_sem);
-		fr_network_destroy(sc->sn->nr);
+		fr_network_destroy(sn->nr);
+	}
+
+	/*
+	 *	The networks are gone, so workers which were started
+	 *	at run time don't need to wait for them to let go.
+	 */
+	pthread_mutex_lock(&sc->workers_mutex);
+	num_static = 0;
+	for (sw = fr_dlist_head(&sc->workers);
+	     sw != NULL;
+	     sw = fr_dlist_next(&sc->workers, sw)) {
+		if (!sw->dynamic) {
+			num_static++;
+			continue;
+		}
+		atomic_store(&sw->uses, 0);
 	}
+	pthread_mutex_unlock(&sc->workers_mutex);
 
 	/*
 	 *	Wait for all worker threads to finish.  THEN clean up
 	 *	modules.  Otherwise, the modules will be removed from
 	 *	underneath the workers!
+	 *
+	 *	Workers started at run time don't post to the
+	 *	semaphore, we just join them below.
 	 */
-	for (i = 0; i < (unsigned int)fr_dlist_num_elements(&sc->workers); i++) {
-		DEBUG2("Waiting for semaphore indicating exit %u/%u", i,
-		       (unsigned int)fr_dlist_num_elements(&sc->workers));
+	for (i = 0; i < num_static; i++) {
+		DEBUG2("Waiting for semaphore indicating exit %u/%u", i, num_static);
 		SEM_WAIT_INTR(&sc->worker_sem);
 	}
 
@@ -672,12 +1731,27 @@ int fr_schedule_destroy(fr_schedule_t *sc)
 			DEBUG2("Worker %i exited", sw->id);
 		}
 		talloc_free(sw->ctx);
+		if (sw->dynamic) talloc_free(sw);
 	}
 
-	TALLOC_FREE(sc->sn->ctx);
+	/*
+	 *	Clean up the exited networks.
+	 */
+	while ((sn = fr_dlist_head(&sc->networks)) != NULL) {
+		fr_dlist_remove(&sc->networks, sn);
+
+		if (pthread_join(sn->pthread_id, NULL) != 0) {
+			ERROR("Failed joining network %i: %s", sn->id, fr_syserror(errno));
+		} else {
+			DEBUG2("Network %i exited", sn->id);
+		}
+		TALLOC_FREE(sn->ctx);
+	}
 
 	sem_destroy(&sc->network_sem);
 	sem_destroy(&sc->worker_sem);
+	pthread_mutex_destroy(&sc->listen_mutex);
+	pthread_mutex_destroy(&sc->workers_mutex);
 done:
 	/*
 	 *	Now that all of the workers are done, we can return to
@@ -688,15 +1762,68 @@ done:
 	return 0;
 }
 
-/** Add a fr_listen_t to a scheduler.
+/** Pick the network with the fewest listeners
+ *
+ *  Listeners can be added from the main thread, and from network
+ *  threads (e.g. connected sockets), so the counters are protected
+ *  by a mutex.
+ *
+ * @param[in] sc	the scheduler
+ * @param[in] id	of the network to use, or -1 for "least loaded".
+ * @return
+ *	- NULL if there is no such network.
+ *	- the network the listener should be added to.
+ */
+static fr_schedule_network_t *fr_schedule_network_pick(fr_schedule_t *sc, int id)
+{
+	fr_schedule_network_t *sn, *found = NULL;
+
+	pthread_mutex_lock(&sc->listen_mutex);
+	for (sn = fr_dlist_head(&sc->networks);
+	     sn != NULL;
+	     sn = fr_dlist_next(&sc->networks, sn)) {
+		if (id >= 0) {
+			if (sn->id != id) continue;
+
+			found = sn;
+			break;
+		}
+
+		if (!found || (sn->num_listeners < found->num_listeners)) found = sn;
+	}
+	if (found) found->num_listeners++;
+	pthread_mutex_unlock(&sc->listen_mutex);
+
+	return found;
+}
+
+/** Return the number of network threads
+ *
+ *  Listeners which can be cloned (e.g. UDP sockets with SO_REUSEPORT)
+ *  use this to open one copy of the socket per network thread.
+ *
+ * @param[in] sc the scheduler
+ * @return the number of networks, which is always 1 in single-threaded mode.
+ */
+int fr_schedule_num_networks(fr_schedule_t const *sc)
+{
+	if (sc->el) return 1;
+
+	return fr_dlist_num_elements(&sc->networks);
+}
+
+/** Add a fr_listen_t to a specific network in a scheduler.
  *
  * @param[in] sc the scheduler
  * @param[in] li the ctx and callbacks for the transport.
+ * @param[in,out] id of the network, or -1 to pick the network with the
+ *			fewest listeners.  On success, this is set to the
+ *			id of the network the listener was added to.
  * @return
  *	- NULL on error
  *	- the fr_network_t that the socket was added to.
  */
-fr_network_t *fr_schedule_listen_add(fr_schedule_t *sc, fr_listen_t *li)
+fr_network_t *fr_schedule_listen_add_to(fr_schedule_t *sc, fr_listen_t *li, int *id)
 {
 	fr_network_t *nr;
 
@@ -704,8 +1831,17 @@ fr_network_t *fr_schedule_listen_add(fr_schedule_t *sc, fr_listen_t *li)
 
 	if (sc->el) {
 		nr = sc->single_network;
+		*id = 0;
 	} else {
-		nr = sc->sn->nr;
+		fr_schedule_network_t *sn;
+
+		sn = fr_schedule_network_pick(sc, *id);
+		if (!sn) {
+			fr_strerror_printf("No network %d", *id);
+			return NULL;
+		}
+		nr = sn->nr;
+		*id = sn->id;
 	}
 
 	if (fr_network_listen_add(nr, li) < 0) return NULL;
@@ -713,6 +1849,21 @@ fr_network_t *fr_schedule_listen_add(fr_schedule_t *sc, fr_listen_t *li)
 	return nr;
 }
 
+/** Add a fr_listen_t to a scheduler.
+ *
+ * @param[in] sc the scheduler
+ * @param[in] li the ctx and callbacks for the transport.
+ * @return
+ *	- NULL on error
+ *	- the fr_network_t that the socket was added to.
+ */
+fr_network_t *fr_schedule_listen_add(fr_schedule_t *sc, fr_listen_t *li)
+{
+	int id = -1;
+
+	return fr_schedule_listen_add_to(sc, li, &id);
+}
+
 /** Add a directory NOTE_EXTEND to a scheduler.
  *
  * @param[in] sc the scheduler
@@ -730,7 +1881,14 @@ fr_network_t *fr_schedule_directory_add(fr_schedule_t *sc, fr_listen_t *li)
 	if (sc->el) {
 		nr = sc->single_network;
 	} else {
-		nr = sc->sn->nr;
+		fr_schedule_network_t *sn;
+
+		sn = fr_schedule_network_pick(sc, -1);
+		if (!sn) {
+			fr_strerror_printf("No network available");
+			return NULL;
+		}
+		nr = sn->nr;
 	}
 
 	if (fr_network_directory_add(nr, li) < 0) return NULL;
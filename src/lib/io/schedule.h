@@ -56,9 +56,21 @@ typedef int (*fr_schedule_thread_instantiate_t)(TALLOC_CTX *ctx, fr_event_list_t
 
 typedef struct {
 	uint32_t	max_networks;		//!< number of network threads
-	uint32_t	max_workers;		//!< number of network threads
+	uint32_t	max_workers;		//!< number of worker threads
+	uint32_t	scale_max_workers;	//!< grow the pool up to this many workers, 0 for a fixed pool
+	fr_time_delta_t	scale_interval;		//!< how often we check if the pool should grow or shrink
 
 	fr_time_delta_t	stats_interval;		//!< print channel statistics
+
+	char const	*network_cpus;		//!< CPU list, e.g. "0-3,8", network thread N uses entry N % len
+	char const	*worker_cpus;		//!< CPU list, worker thread N uses entry N % len
+	char const	*network_numa_nodes;	//!< NUMA node list, network thread N runs on node N % len
+	char const	*worker_numa_nodes;	//!< NUMA node list, worker thread N runs on node N % len
+
+	bool		work_stealing;		//!< idle workers take requests from busy ones
+	bool		source_affinity;	//!< send related packets to the same worker
+	fr_time_delta_t	spin_time;		//!< how long idle threads poll for messages before sleeping
+	fr_time_delta_t	timer_resolution;	//!< use a timer wheel with this resolution, or 0 for a heap
 } fr_schedule_config_t;
 
 int			fr_schedule_worker_id(void);
@@ -70,7 +82,10 @@ fr_schedule_t		*fr_schedule_create(TALLOC_CTX *ctx, fr_event_list_t *el, fr_log_
 /* schedulers are async, so there's no fr_schedule_run() */
 int			fr_schedule_destroy(fr_schedule_t *sc);
 
+int			fr_schedule_num_networks(fr_schedule_t const *sc) CC_HINT(nonnull);
+
 fr_network_t		*fr_schedule_listen_add(fr_schedule_t *sc, fr_listen_t *li) CC_HINT(nonnull);
+fr_network_t		*fr_schedule_listen_add_to(fr_schedule_t *sc, fr_listen_t *li, int *id) CC_HINT(nonnull);
 fr_network_t		*fr_schedule_directory_add(fr_schedule_t *sc, fr_listen_t *li) CC_HINT(nonnull);
 #ifdef __cplusplus
 }
@@ -46,6 +46,15 @@
  *  yielded, it is placed onto the yielded list in the worker
  *  "tracking" data structure.
  *
+ *  When work stealing is enabled, packets which arrive while the
+ *  worker is busy are not decoded.  They are put into the "backlog"
+ *  atomic queue instead.  The worker takes them from there when it
+ *  runs out of other work, but idle workers can take them, too.
+ *  The channel still belongs to the worker which received the
+ *  packet, so a worker which steals a request hands the encoded
+ *  reply back to the owner via its "returned" queue, and the owner
+ *  sends it.
+ *
  * @copyright 2016 Alan DeKok (aland@freeradius.org)
  */
 RCSID("$Id$")
@@ -61,6 +70,13 @@ RCSID("$Id$")
 #include <freeradius-devel/io/listen.h>
 #include <freeradius-devel/unlang/interpret.h>
 #include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
 
 #ifdef WITH_VERIFY_PTR
 static void worker_verify(fr_worker_t *worker);
@@ -69,6 +85,63 @@ static void worker_verify(fr_worker_t *worker);
 #define WORKER_VERIFY
 #endif
 
+/*
+ *	Maximum number of requests a worker will make available to
+ *	other workers, including ones which have already been stolen.
+ */
+#define WORKER_BACKLOG_SIZE	(256)
+
+/**
+ *  What happened to a stolen request.
+ */
+typedef enum {
+	FR_WORKER_STOLEN_REPLY = 0,		//!< the thief encoded a reply into the buffer
+	FR_WORKER_STOLEN_NAK,			//!< the thief couldn't decode the packet
+	FR_WORKER_STOLEN_CANCEL			//!< the thief stopped the request, there's no reply
+} fr_worker_stolen_status_t;
+
+/**
+ *  A request which is waiting in the backlog of a worker.
+ *
+ *  These are only allocated and freed by the owner.  Everything
+ *  the owner needs to send the reply is copied out of the channel
+ *  data, because the thief marks that done when it decodes the
+ *  packet.
+ */
+typedef struct {
+	fr_worker_t		*owner;		//!< worker which received the packet, and owns the channel
+	fr_channel_data_t	*cd;		//!< the packet
+
+	fr_channel_t		*ch;		//!< channel the packet came in on
+	fr_listen_t		*listen;	//!< listener the packet came in on
+	void			*packet_ctx;	//!< for the listener
+	fr_time_t		recv_time;	//!< when the network thread received the packet
+	atomic_bool		closed;		//!< set by the owner when the channel is closed
+
+	fr_worker_stolen_status_t status;	//!< set by the thief
+	fr_time_t		when;		//!< when the thief finished the request
+	fr_time_delta_t		processing_time; //!< how long the thief spent running the request
+	size_t			reply_len;	//!< length of the encoded reply
+	size_t			buffer_len;	//!< size of the reply buffer
+	uint8_t			*buffer;	//!< where the thief encodes the reply
+
+	fr_dlist_t		entry;		//!< in the owners free, or active list
+} fr_worker_stolen_t;
+
+/**
+ *  A set of workers which take requests from each other.
+ */
+struct fr_worker_steal_s {
+	pthread_mutex_t		mutex;		//!< protects joining, and leaving
+	pthread_cond_t		cond;		//!< signalled when the last worker leaves
+
+	int			max_workers;	//!< size of the workers array
+	int			num_running;	//!< workers which haven't left yet
+
+	atomic_int		num_workers;	//!< number of entries in the workers array
+	fr_worker_t		**workers;	//!< everyone in the group
+};
+
 
 /**
  *  A worker which takes packets from a master, and processes them.
@@ -102,7 +175,7 @@ struct fr_worker_s {
 
 	fr_heap_t      		*runnable;	//!< current runnable requests which we've spent time processing
 	fr_heap_t		*time_order;	//!< time ordered heap of requests
-	rbtree_t		*dedup;		//!< de-dup tree
+	fr_hash_table_t		*dedup;		//!< de-dup table
 
 	fr_io_stats_t		stats;		//!< input / output stats
 	fr_time_elapsed_t	cpu_time;	//!< histogram of total CPU time per request
@@ -122,9 +195,23 @@ struct fr_worker_s {
 	fr_event_timer_t const	*ev_cleanup;	//!< timer for max_request_time
 
 	fr_channel_t		**channel;	//!< list of channels
+
+	fr_worker_steal_t	*steal;		//!< other workers we steal from, and who steal from us
+	fr_atomic_queue_t	*backlog;	//!< requests we haven't started yet, and which can be stolen
+	fr_atomic_queue_t	*returned;	//!< stolen requests which other workers have finished
+	fr_ring_buffer_t	*rb;		//!< for control-plane messages to other workers
+	fr_dlist_head_t		stolen_free;	//!< unused backlog entries
+	fr_dlist_head_t		stolen_active;	//!< backlog entries which are queued, or being run by another worker
+	int			num_backlog;	//!< backlog entries which aren't in the free list
+	int			steal_next;	//!< which worker we look at first when stealing
+	uint64_t		num_stolen;	//!< number of requests we took from other workers
+	atomic_bool		idle;		//!< waiting for events, and should be told about new work
 };
 
-static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd, fr_time_t now);
+static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd,
+				     fr_worker_stolen_t *stolen, fr_time_t now);
+static bool worker_backlog_push(fr_worker_t *worker, fr_channel_data_t *cd);
+static void worker_stop_request(fr_worker_t *worker, REQUEST *request, fr_time_t now);
 
 /** Callback which handles a message being received on the worker side.
  *
@@ -139,7 +226,13 @@ static void worker_recv_request(void *ctx, fr_channel_t *ch, fr_channel_data_t *
 	worker->stats.in++;
 	DEBUG3("Received request %" PRIu64 "", worker->stats.in);
 	cd->channel.ch = ch;
-	worker_request_bootstrap(worker, cd, fr_time());
+
+	/*
+	 *	If we're busy, let someone else have a go at it.
+	 */
+	if (worker->steal && worker_backlog_push(worker, cd)) return;
+
+	worker_request_bootstrap(worker, cd, NULL, fr_time());
 }
 
 static void worker_exit(fr_worker_t *worker)
@@ -154,6 +247,63 @@ static void worker_exit(fr_worker_t *worker)
 	fr_event_loop_exit(worker->el, 1);
 }
 
+/** Stop all of the requests which came in on a channel
+ *
+ * @param[in] worker	the worker
+ * @param[in] ch	which is being closed
+ * @param[in] now	the current time
+ */
+static void worker_channel_stop(fr_worker_t *worker, fr_channel_t *ch, fr_time_t now)
+{
+	int			i, num;
+	REQUEST			*request, **stop;
+	fr_heap_iter_t		iter;
+	fr_worker_stolen_t	*stolen;
+
+	/*
+	 *	The network frees the channel once we've acknowledged
+	 *	the close.  Workers which took requests from us can't
+	 *	look at the channel after that, so tell them through
+	 *	the backlog entries instead.
+	 */
+	for (stolen = fr_dlist_head(&worker->stolen_active);
+	     stolen != NULL;
+	     stolen = fr_dlist_next(&worker->stolen_active, stolen)) {
+		if (stolen->ch == ch) atomic_store_explicit(&stolen->closed, true, memory_order_release);
+	}
+
+	num = fr_heap_num_elements(worker->time_order);
+	if (!num) return;
+
+	MEM(stop = talloc_array(worker, REQUEST *, num));
+
+	/*
+	 *	Stolen requests are being run for another worker,
+	 *	and go back to it when they're stopped.
+	 */
+	i = 0;
+	for (request = fr_heap_iter_init(worker->time_order, &iter);
+	     request != NULL;
+	     request = fr_heap_iter_next(worker->time_order, &iter)) {
+		if (request->async->stolen || (request->async->channel != ch)) continue;
+
+		stop[i++] = request;
+	}
+	num = i;
+
+	for (i = 0; i < num; i++) {
+		request = stop[i];
+
+		RDEBUG("Channel is closing - telling request to stop");
+		worker_stop_request(worker, request, now);
+		rad_assert(worker->num_active > 0);
+		worker->num_active--;
+		talloc_free(request);
+	}
+
+	talloc_free(stop);
+}
+
 /** Handle a control plane message sent to the worker via a channel
  *
  * @param[in] ctx	the worker
@@ -250,12 +400,27 @@ static void worker_channel_callback(void *ctx, void const *data, size_t data_siz
 
 			if (worker->channel[i] != ch) continue;
 
+			/*
+			 *	The network side may close a channel
+			 *	while requests are still running, when
+			 *	it's retiring this worker.  There's
+			 *	nowhere to send their replies, so stop
+			 *	them now.
+			 */
+			worker_channel_stop(worker, ch, now);
+
 			ms = fr_channel_responder_uctx_get(ch);
 
 			fr_channel_responder_ack_close(ch);
 			rad_assert(ms != NULL);
+
+			/*
+			 *	The network may not have written
+			 *	the last few replies yet, so the
+			 *	message set is freed along with
+			 *	the worker.
+			 */
 			fr_message_set_gc(ms);
-			talloc_free(ms);
 
 			worker->channel[i] = NULL;
 			rad_assert(worker->num_channels > 0);
@@ -365,7 +530,34 @@ static void worker_nak(fr_worker_t *worker, fr_channel_data_t *cd, fr_time_t now
 }
 
 static void worker_max_request_timer(fr_worker_t *worker);
+static void worker_stolen_return(fr_worker_t *worker, fr_worker_stolen_t *stolen, fr_worker_stolen_status_t status);
 
+/** Encode a reply packet
+ *
+ * @param[in] worker		This worker.
+ * @param[in] request		we're sending a reply for.
+ * @param[out] out		where the reply is encoded.
+ * @param[in] outlen		the size of the output buffer.
+ * @return the length of the encoded reply.  A 1 byte "reply" is used on error.
+ */
+static size_t worker_reply_encode(fr_worker_t *worker, REQUEST *request, uint8_t *out, size_t outlen)
+{
+	ssize_t slen = 0;
+	fr_listen_t const *listen = request->async->listen;
+
+	if (listen->app->encode) {
+		slen = listen->app->encode(listen->app_instance, request, out, outlen);
+	} else if (listen->app_io->encode) {
+		slen = listen->app_io->encode(listen->app_io_instance, request, out, outlen);
+	}
+	if (slen < 0) {
+		ERROR("Failed encoding request");
+		*out = 0;
+		slen = 1;
+	}
+
+	return slen;
+}
 
 /** Send a response packet to the network side
  *
@@ -396,6 +588,33 @@ static void worker_send_reply(fr_worker_t *worker, REQUEST *request, size_t size
 		goto finished;
 	}
 
+	/*
+	 *	We took the request from another worker.  It owns
+	 *	the channel, so give the reply back to it.
+	 */
+	if (request->async->stolen) {
+		fr_worker_stolen_t *stolen = request->async->stolen;
+
+		stolen->reply_len = 0;
+		if (size) stolen->reply_len = worker_reply_encode(worker, request, stolen->buffer, stolen->buffer_len);
+
+		fr_time_tracking_end(&worker->predicted, &request->async->tracking, now);
+		rad_assert(worker->num_active > 0);
+		worker->num_active--;
+
+		stolen->when = request->async->tracking.last_changed;
+		stolen->processing_time = request->async->tracking.running_total;
+
+		fr_time_elapsed_update(&worker->cpu_time, now, now + stolen->processing_time);
+		fr_time_elapsed_update(&worker->wall_clock, stolen->recv_time, now);
+
+		RDEBUG("Finished stolen request");
+
+		request->async->stolen = NULL;
+		worker_stolen_return(worker, stolen, FR_WORKER_STOLEN_REPLY);
+		goto done;
+	}
+
 	/*
 	 *	Allocate and send the reply.
 	 */
@@ -423,28 +642,16 @@ static void worker_send_reply(fr_worker_t *worker, REQUEST *request, size_t size
 	 *	Encode it, if required.
 	 */
 	if (size) {
-		ssize_t slen = 0;
-		fr_listen_t const *listen = request->async->listen;
-
-		if (listen->app->encode) {
-			slen = listen->app->encode(listen->app_instance, request,
-						   reply->m.data, reply->m.rb_size);
-		} else if (listen->app_io->encode) {
-			slen = listen->app_io->encode(listen->app_io_instance, request,
-						      reply->m.data, reply->m.rb_size);
-		}
-		if (slen < 0) {
-			ERROR("Failed encoding request");
-			*reply->m.data = 0;
-			slen = 1;
-		}
+		size_t slen;
+
+		slen = worker_reply_encode(worker, request, reply->m.data, reply->m.rb_size);
 
 		/*
 		 *	Shrink the buffer to the actual packet size.
 		 *
 		 *	This will ALWAYS return the same message as we put in.
 		 */
-		rad_assert((size_t) slen <= reply->m.rb_size);
+		rad_assert(slen <= reply->m.rb_size);
 		(void) fr_message_alloc(ms, &reply->m, slen);
 	}
 
@@ -492,6 +699,7 @@ static void worker_send_reply(fr_worker_t *worker, REQUEST *request, size_t size
 
 	worker->stats.out++;
 
+done:
 	/*
 	 *	@todo Use a talloc pool for the request.  Clean it up,
 	 *	and insert it back into a slab allocator.
@@ -549,7 +757,9 @@ static void worker_stop_request(fr_worker_t *worker, REQUEST *request, fr_time_t
 	 */
 	if (request->time_order_id >= 0) (void) fr_heap_extract(worker->time_order, request);
 	if (request->runnable_id >= 0) (void) fr_heap_extract(worker->runnable, request);
-	if (request->async->listen->track_duplicates) rbtree_deletebydata(worker->dedup, request);
+	if (request->async->listen->track_duplicates && !request->async->stolen) {
+		fr_hash_table_delete(worker->dedup, request);
+	}
 
 #ifndef NDEBUG
 	request->async->process = NULL;
@@ -656,7 +866,16 @@ static char *itoa_internal(TALLOC_CTX *ctx, uint64_t number)
 }
 
 
-static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd, fr_time_t now)
+/** Decode a packet, and turn it into a runnable request
+ *
+ * @param[in] worker	the worker
+ * @param[in] cd	the packet
+ * @param[in] stolen	if we took the packet from another worker, the backlog entry.
+ *			The reply is sent via the entry instead of the channel.
+ * @param[in] now	the current time
+ */
+static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd,
+				     fr_worker_stolen_t *stolen, fr_time_t now)
 {
 	bool			is_dup;
 	int			ret = -1;
@@ -684,9 +903,11 @@ static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd,
 	request->server_cs = cd->listen->server_cs;
 
 	/*
-	 *	Update the transport-specific fields.
+	 *	Update the transport-specific fields.  The channel of
+	 *	a stolen request belongs to another worker, and we
+	 *	never look at it.
 	 */
-	request->async->channel = cd->channel.ch;
+	if (!stolen) request->async->channel = cd->channel.ch;
 
 	request->async->recv_time = cd->request.recv_time;
 	request->async->el = worker->el;
@@ -696,6 +917,7 @@ static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd,
 
 	request->async->listen = cd->listen;
 	request->async->packet_ctx = cd->packet_ctx;
+	request->async->stolen = stolen;
 	listen = request->async->listen;
 
 	/*
@@ -712,6 +934,10 @@ static void worker_request_bootstrap(fr_worker_t *worker, fr_channel_data_t *cd,
 	if (ret < 0) {
 		talloc_free(ctx);
 nak:
+		if (stolen) {
+			worker_stolen_return(worker, stolen, FR_WORKER_STOLEN_NAK);
+			return;
+		}
 		worker_nak(worker, cd, now);
 		return;
 	}
@@ -724,6 +950,10 @@ nak:
 
 	if (!request->async->process) {
 		RERROR("Protocol failed to set 'process' function");
+		if (stolen) {
+			worker_stolen_return(worker, stolen, FR_WORKER_STOLEN_NAK);
+			return;
+		}
 		worker_nak(worker, cd, now);
 		return;
 	}
@@ -736,12 +966,14 @@ nak:
 
 	/*
 	 *	Look for conflicting / duplicate packets, but only if
-	 *	requested to do so.
+	 *	requested to do so.  Stolen requests aren't tracked,
+	 *	as our dedup table only holds requests from our own
+	 *	channels.
 	 */
-	if (request->async->listen->track_duplicates) {
+	if (!stolen && request->async->listen->track_duplicates) {
 		REQUEST *old;
 
-		old = rbtree_finddata(worker->dedup, request);
+		old = fr_hash_table_finddata(worker->dedup, request);
 		if (!old) {
 			/*
 			 *	Ignore duplicate packets where we've
@@ -810,7 +1042,7 @@ nak:
 		talloc_free(old);
 
 	insert_new:
-		(void) rbtree_insert(worker->dedup, request);
+		(void) fr_hash_table_insert(worker->dedup, request);
 	}
 
 	/*
@@ -834,6 +1066,369 @@ nak:
 	if (!worker->ev_cleanup) worker_max_request_timer(worker);
 }
 
+/** Put a backlog entry back onto the free list
+ *
+ *  Only the owner of the entry calls this.
+ */
+static void worker_stolen_free(fr_worker_t *worker, fr_worker_stolen_t *stolen)
+{
+	rad_assert(stolen->owner == worker);
+	rad_assert(worker->num_backlog > 0);
+
+	stolen->cd = NULL;
+	fr_dlist_remove(&worker->stolen_active, stolen);
+	fr_dlist_insert_head(&worker->stolen_free, stolen);
+	worker->num_backlog--;
+}
+
+/** Wake up an idle worker
+ *
+ *  The message itself doesn't carry anything.  The worker looks at
+ *  its "returned" queue, and at the backlog of the other workers
+ *  once it's awake.
+ *
+ *  The caller has to issue a full memory barrier after pushing
+ *  work to a queue, and before calling this function.  Otherwise
+ *  the peer could miss the work, and we could miss that it's
+ *  going to sleep.  See worker_steal_sleep().
+ *
+ * @return
+ *	- true if we woke the peer up.
+ *	- false if it wasn't idle, or someone else woke it up.
+ */
+static bool worker_steal_wakeup(fr_worker_t *worker, fr_worker_t *peer)
+{
+	if (!atomic_exchange(&peer->idle, false)) return false;
+
+	(void) fr_control_message_send(peer->control, worker->rb, FR_CONTROL_ID_WORKER, &worker, sizeof(worker));
+	return true;
+}
+
+/** Give a stolen request back to the worker which owns it
+ *
+ * @param[in] worker	the worker which stole the request.
+ * @param[in] stolen	the backlog entry of the owner.
+ * @param[in] status	what happened to the request.
+ */
+static void worker_stolen_return(fr_worker_t *worker, fr_worker_stolen_t *stolen, fr_worker_stolen_status_t status)
+{
+	fr_worker_t *owner = stolen->owner;
+
+	stolen->status = status;
+
+	/*
+	 *	The queue is as large as the number of entries the
+	 *	owner can allocate, so this can't fail.
+	 */
+	if (!fr_cond_assert(fr_atomic_queue_push(owner->returned, stolen))) return;
+
+	atomic_thread_fence(memory_order_seq_cst);
+	(void) worker_steal_wakeup(worker, owner);
+}
+
+/** Send the replies for requests which other workers stole from us
+ *
+ * @param[in] worker	the worker
+ * @param[in] now	the current time
+ */
+static void worker_stolen_reply(fr_worker_t *worker, fr_time_t now)
+{
+	int			i;
+	fr_worker_stolen_t	*stolen;
+	fr_channel_data_t	*reply;
+	fr_message_set_t	*ms;
+
+	while (fr_atomic_queue_pop(worker->returned, (void **) &stolen)) {
+		/*
+		 *	The channel was closed while another worker
+		 *	was running the request.  There's no one to
+		 *	send the reply to.
+		 */
+		for (i = 0; i < worker->max_channels; i++) {
+			if (worker->channel[i] == stolen->ch) break;
+		}
+		if (i == worker->max_channels) goto done;
+
+		switch (stolen->status) {
+		case FR_WORKER_STOLEN_NAK:
+			worker_nak(worker, stolen->cd, now);
+			break;
+
+		case FR_WORKER_STOLEN_CANCEL:
+			fr_channel_null_reply(stolen->ch);
+			break;
+
+		case FR_WORKER_STOLEN_REPLY:
+			if (!fr_cond_assert_msg(fr_channel_active(stolen->ch),
+						"Wanted to send reply but channel has been closed")) break;
+
+			ms = fr_channel_responder_uctx_get(stolen->ch);
+			rad_assert(ms != NULL);
+
+			reply = (fr_channel_data_t *) fr_message_reserve(ms, stolen->reply_len);
+			rad_assert(reply != NULL);
+
+			if (stolen->reply_len) {
+				rad_assert(stolen->reply_len <= reply->m.rb_size);
+				memcpy(reply->m.data, stolen->buffer, stolen->reply_len);
+				(void) fr_message_alloc(ms, &reply->m, stolen->reply_len);
+			}
+
+			reply->m.when = stolen->when;
+			reply->reply.cpu_time = worker->tracking.running_total;
+			reply->reply.processing_time = stolen->processing_time;
+			reply->reply.request_time = stolen->recv_time;
+
+			reply->listen = stolen->listen;
+			reply->packet_ctx = stolen->packet_ctx;
+
+			if (fr_channel_send_reply(stolen->ch, reply) < 0) {
+				PERROR("Failed sending reply to network thread");
+			}
+
+			worker->stats.out++;
+			break;
+		}
+
+	done:
+		worker_stolen_free(worker, stolen);
+	}
+}
+
+/** Put a packet into our backlog, so that other workers can steal it
+ *
+ *  We only do this when we're already busy, so that a lightly
+ *  loaded worker doesn't pay for the extra hand-off.
+ *
+ * @param[in] worker	the worker
+ * @param[in] cd	the packet
+ * @return
+ *	- true if the packet is in the backlog.
+ *	- false if the caller should run the packet itself.
+ */
+static bool worker_backlog_push(fr_worker_t *worker, fr_channel_data_t *cd)
+{
+	int			i, num;
+	size_t			size;
+	fr_worker_stolen_t	*stolen;
+	fr_worker_steal_t	*ws = worker->steal;
+
+	if (!fr_heap_num_elements(worker->runnable)) return false;
+
+	/*
+	 *	Duplicates have to be checked against our own dedup
+	 *	tree.
+	 */
+	if (cd->request.is_dup || worker->exiting) return false;
+
+	if (worker->num_backlog >= WORKER_BACKLOG_SIZE) return false;
+
+	size = cd->listen->app_io->default_reply_size;
+	if (!size) size = cd->listen->app_io->default_message_size;
+
+	stolen = fr_dlist_head(&worker->stolen_free);
+	if (stolen) {
+		fr_dlist_remove(&worker->stolen_free, stolen);
+	} else {
+		MEM(stolen = talloc_zero(worker, fr_worker_stolen_t));
+		stolen->owner = worker;
+	}
+
+	if (stolen->buffer_len < size) {
+		talloc_free(stolen->buffer);
+		MEM(stolen->buffer = talloc_array(stolen, uint8_t, size));
+		stolen->buffer_len = size;
+	}
+
+	stolen->cd = cd;
+	stolen->ch = cd->channel.ch;
+	stolen->listen = cd->listen;
+	stolen->packet_ctx = cd->packet_ctx;
+	stolen->recv_time = cd->request.recv_time;
+	atomic_store_explicit(&stolen->closed, false, memory_order_relaxed);
+	fr_dlist_insert_tail(&worker->stolen_active, stolen);
+	worker->num_backlog++;
+
+	if (!fr_atomic_queue_push(worker->backlog, stolen)) {
+		worker_stolen_free(worker, stolen);
+		return false;
+	}
+
+	/*
+	 *	Tell the first idle worker we find that there's work
+	 *	to do.
+	 */
+	atomic_thread_fence(memory_order_seq_cst);
+
+	num = atomic_load_explicit(&ws->num_workers, memory_order_acquire);
+	for (i = 0; i < num; i++) {
+		fr_worker_t *peer = ws->workers[i];
+
+		if ((peer == worker) || !atomic_load_explicit(&peer->idle, memory_order_relaxed)) continue;
+
+		if (worker_steal_wakeup(worker, peer)) break;
+	}
+
+	return true;
+}
+
+/** Find a request to run when we have nothing else to do
+ *
+ *  We look at our own backlog first, and then at the backlog of
+ *  the other workers.
+ *
+ * @param[in] worker	the worker
+ * @param[in] now	the current time
+ * @return
+ *	- true if there's a new runnable request.
+ *	- false if there's nothing to do.
+ */
+static bool worker_backlog_pop(fr_worker_t *worker, fr_time_t now)
+{
+	int			i, num;
+	fr_channel_data_t	*cd;
+	fr_worker_stolen_t	*stolen;
+	fr_worker_steal_t	*ws = worker->steal;
+
+	while (fr_atomic_queue_pop(worker->backlog, (void **) &stolen)) {
+		cd = stolen->cd;
+
+		/*
+		 *	The channel was closed while the packet was
+		 *	waiting, and may already have been freed.
+		 */
+		if (atomic_load_explicit(&stolen->closed, memory_order_acquire)) {
+			fr_message_done(&cd->m);
+			worker_stolen_free(worker, stolen);
+			continue;
+		}
+
+		worker_stolen_free(worker, stolen);
+
+		worker_request_bootstrap(worker, cd, NULL, now);
+		if (fr_heap_num_elements(worker->runnable) > 0) return true;
+	}
+
+	if (worker->exiting) return false;
+
+	num = atomic_load_explicit(&ws->num_workers, memory_order_acquire);
+	for (i = 0; i < num; i++) {
+		int		idx = (worker->steal_next + i) % num;
+		fr_worker_t	*peer = ws->workers[idx];
+
+		if (peer == worker) continue;
+
+		while (fr_atomic_queue_pop(peer->backlog, (void **) &stolen)) {
+			/*
+			 *	Keep stealing from the same worker
+			 *	while it's busy.
+			 */
+			worker->steal_next = idx;
+
+			if (atomic_load_explicit(&stolen->closed, memory_order_acquire)) {
+				fr_message_done(&stolen->cd->m);
+				worker_stolen_return(worker, stolen, FR_WORKER_STOLEN_CANCEL);
+				continue;
+			}
+
+			worker->num_stolen++;
+
+			DEBUG3("Stole request from %s", peer->name);
+			worker_request_bootstrap(worker, stolen->cd, stolen, now);
+			if (fr_heap_num_elements(worker->runnable) > 0) return true;
+		}
+	}
+
+	return false;
+}
+
+/** Decide if we can sleep
+ *
+ *  We tell the other workers that we're idle, and then look for
+ *  work one more time.  Any work which is queued after this is
+ *  followed by a wakeup message.
+ *
+ * @param[in] worker	the worker
+ * @return
+ *	- true if we should wait for events.
+ *	- false if there's a new runnable request.
+ */
+static bool worker_steal_sleep(fr_worker_t *worker)
+{
+	fr_time_t now = fr_time();
+
+	atomic_store(&worker->idle, true);
+	atomic_thread_fence(memory_order_seq_cst);
+
+	worker_stolen_reply(worker, now);
+
+	if (!worker_backlog_pop(worker, now)) return true;
+
+	atomic_store(&worker->idle, false);
+	return false;
+}
+
+/** Called when another worker wakes us up
+ *
+ */
+static void worker_steal_callback(void *ctx, UNUSED void const *data, UNUSED size_t data_size, fr_time_t now)
+{
+	fr_worker_t *worker = talloc_get_type_abort(ctx, fr_worker_t);
+
+	worker_stolen_reply(worker, now);
+}
+
+/** Leave the stealing group, and wait for everyone else to leave
+ *
+ *  Other workers may still hold requests which they stole from us,
+ *  and will return them to our queues.  So our memory has to stay
+ *  around until no other worker can touch it.
+ *
+ * @param[in] worker	the worker
+ */
+static void worker_steal_leave(fr_worker_t *worker)
+{
+	fr_worker_steal_t	*ws = worker->steal;
+	fr_worker_stolen_t	*stolen;
+
+	/*
+	 *	No one can steal these any more, the channels are
+	 *	closed.
+	 */
+	while (fr_atomic_queue_pop(worker->backlog, (void **) &stolen)) {
+		worker_stolen_free(worker, stolen);
+	}
+
+	pthread_mutex_lock(&ws->mutex);
+	ws->num_running--;
+	if (ws->num_running == 0) {
+		pthread_cond_broadcast(&ws->cond);
+	} else while (ws->num_running > 0) {
+		pthread_cond_wait(&ws->cond, &ws->mutex);
+	}
+	pthread_mutex_unlock(&ws->mutex);
+}
+
+
+/** Check if the channel a request came in on is still open
+ *
+ *  The channel of a stolen request belongs to another worker, and
+ *  may be freed as soon as that worker acknowledges the close.  So
+ *  we ask the backlog entry, which the owner marks before doing so.
+ *
+ * @param[in] request	to check.
+ * @return
+ *	- true if the reply can be sent.
+ *	- false if the channel has been closed.
+ */
+static inline bool worker_request_channel_active(REQUEST *request)
+{
+	fr_worker_stolen_t *stolen = request->async->stolen;
+
+	if (stolen) return !atomic_load_explicit(&stolen->closed, memory_order_acquire);
+
+	return fr_channel_active(request->async->channel);
+}
 
 /** Run a request
  *
@@ -858,7 +1453,10 @@ static void worker_run_request(fr_worker_t *worker, fr_time_t start)
 
 redo:
 	request = fr_heap_pop(worker->runnable);
-	if (!request) return;
+	if (!request) {
+		if (!worker->steal || !worker_backlog_pop(worker, now)) return;
+		goto redo;
+	}
 
 	REQUEST_VERIFY(request);
 	rad_assert(request->runnable_id < 0);
@@ -875,8 +1473,9 @@ redo:
 	 *	For real requests, if the channel is gone, just stop
 	 *	the request and free it.
 	 */
-	if (!request->async->fake && !fr_channel_active(request->async->channel)) {
+	if (!request->async->fake && !worker_request_channel_active(request)) {
 		worker_stop_request(worker, request, now);
+		if (request->async->stolen) worker_stolen_return(worker, request->async->stolen, FR_WORKER_STOLEN_CANCEL);
 		talloc_free(request);
 		return;
 	}
@@ -922,11 +1521,11 @@ redo:
 	RDEBUG("Done request");
 
 	/*
-	 *	Only real packets are in the dedup tree.  And even
+	 *	Only real packets are in the dedup table.  And even
 	 *	then, only some of the time.
 	 */
-	if (!request->async->fake && request->async->listen->track_duplicates) {
-		(void) rbtree_deletebydata(worker->dedup, request);
+	if (!request->async->fake && !request->async->stolen && request->async->listen->track_duplicates) {
+		(void) fr_hash_table_delete(worker->dedup, request);
 	}
 
 	now = fr_time();
@@ -973,8 +1572,17 @@ static int8_t worker_time_order_cmp(void const *one, void const *two)
 }
 
 /**
- *  Track a REQUEST in the "dedup" tree
+ *  Track a REQUEST in the "dedup" table
  */
+static uint32_t worker_dedup_hash(void const *one)
+{
+	REQUEST const *a = one;
+	uint32_t hash;
+
+	hash = fr_hash_fast(&a->async->listen, sizeof(a->async->listen));
+	return fr_hash_fast_update(&a->async->packet_ctx, sizeof(a->async->packet_ctx), hash);
+}
+
 static int worker_dedup_cmp(void const *one, void const *two)
 {
 	int ret;
@@ -1018,10 +1626,13 @@ void fr_worker_destroy(fr_worker_t *worker)
 			count++;
 		}
 		worker_stop_request(worker, request, now);
+		if (request->async->stolen) worker_stolen_return(worker, request->async->stolen, FR_WORKER_STOLEN_CANCEL);
 		talloc_free(request);
 	}
 	rad_assert(fr_heap_num_elements(worker->runnable) == 0);
 
+	if (worker->steal) worker_steal_leave(worker);
+
 	/*
 	 *	Signal the channels that we're closing.
 	 *
@@ -1125,15 +1736,29 @@ nomem:
 		goto fail;
 	}
 
-	worker->dedup = rbtree_talloc_create(worker, worker_dedup_cmp, REQUEST, NULL, RBTREE_FLAG_NONE);
+	worker->dedup = fr_hash_table_create(worker, worker_dedup_hash, worker_dedup_cmp, NULL);
 	if (!worker->dedup) {
-		fr_strerror_printf("Failed creating de_dup tree");
+		fr_strerror_printf("Failed creating de_dup table");
 		goto fail;
 	}
 
+	fr_dlist_talloc_init(&worker->stolen_free, fr_worker_stolen_t, entry);
+	fr_dlist_talloc_init(&worker->stolen_active, fr_worker_stolen_t, entry);
+	atomic_init(&worker->idle, false);
+
 	return worker;
 }
 
+/** Set how long the worker polls for new requests before sleeping
+ *
+ * @param[in] worker the worker data structure
+ * @param[in] spin_time the maximum time to spin, or 0 to always sleep.
+ */
+void fr_worker_spin_set(fr_worker_t *worker, fr_time_delta_t spin_time)
+{
+	fr_control_spin_set(worker->control, spin_time);
+}
+
 
 /** The main loop and entry point of the worker thread.
  *
@@ -1149,11 +1774,28 @@ void fr_worker(fr_worker_t *worker)
 
 		WORKER_VERIFY;
 
+		/*
+		 *	Send any replies which other workers have
+		 *	given back to us.
+		 */
+		if (worker->steal) worker_stolen_reply(worker, fr_time());
+
 		/*
 		 *	There are runnable requests.  We still service
 		 *	the event loop, but we don't wait for events.
 		 */
 		wait_for_event = (fr_heap_num_elements(worker->runnable) == 0);
+
+		/*
+		 *	If requests are arriving quickly, poll for
+		 *	them for a little while, instead of going to
+		 *	sleep and being woken up again.
+		 */
+		if (wait_for_event && (fr_control_spin(worker->control) > 0)) {
+			wait_for_event = (fr_heap_num_elements(worker->runnable) == 0);
+		}
+
+		if (wait_for_event && worker->steal) wait_for_event = worker_steal_sleep(worker);
 		if (wait_for_event) {
 			DEBUG4("Ready to process requests");
 		}
@@ -1163,6 +1805,7 @@ void fr_worker(fr_worker_t *worker)
 		 *	(e.g. exit), we stop looping and clean up.
 		 */
 		num_events = fr_event_corral(worker->el, fr_time(), wait_for_event);
+		if (wait_for_event && worker->steal) atomic_store(&worker->idle, false);
 		if (num_events < 0) {
 			if (worker->exiting) return; /* don't complain if we're exiting */
 
@@ -1300,7 +1943,7 @@ static void worker_verify(fr_worker_t *worker)
 	(void) talloc_get_type_abort(worker->runnable, fr_heap_t);
 
 	rad_assert(worker->dedup != NULL);
-	(void) talloc_get_type_abort(worker->dedup, rbtree_t);
+	(void) talloc_get_type_abort(worker->dedup, fr_hash_table_t);
 
 	for (i = 0; i < worker->max_channels; i++) {
 		if (!worker->channel[i]) continue;
@@ -1327,10 +1970,122 @@ int fr_worker_stats(fr_worker_t const *worker, int num, uint64_t *stats)
 	return 6;
 }
 
+static int _worker_steal_free(fr_worker_steal_t *ws)
+{
+	pthread_cond_destroy(&ws->cond);
+	pthread_mutex_destroy(&ws->mutex);
+
+	return 0;
+}
+
+/** Create a group of workers which take requests from each other
+ *
+ *  Each worker joins the group with fr_worker_steal_join().  The
+ *  group has to be freed after all of the workers in it have been
+ *  destroyed.
+ *
+ * @param[in] ctx		the talloc context
+ * @param[in] max_workers	the maximum number of workers in the group
+ * @return
+ *	- NULL on error
+ *	- fr_worker_steal_t on success
+ */
+fr_worker_steal_t *fr_worker_steal_create(TALLOC_CTX *ctx, int max_workers)
+{
+	fr_worker_steal_t *ws;
+
+	ws = talloc_zero(ctx, fr_worker_steal_t);
+	if (!ws) {
+	nomem:
+		fr_strerror_printf("Failed allocating memory");
+		return NULL;
+	}
+
+	ws->workers = talloc_zero_array(ws, fr_worker_t *, max_workers);
+	if (!ws->workers) {
+		talloc_free(ws);
+		goto nomem;
+	}
+	ws->max_workers = max_workers;
+	atomic_init(&ws->num_workers, 0);
+
+	pthread_mutex_init(&ws->mutex, NULL);
+	pthread_cond_init(&ws->cond, NULL);
+	talloc_set_destructor(ws, _worker_steal_free);
+
+	return ws;
+}
+
+/** Add a worker to a stealing group
+ *
+ *  This function MUST be called from the worker thread, before it
+ *  starts processing requests.  Once it's called, other workers can
+ *  take requests from this one.
+ *
+ * @param[in] ws	the group
+ * @param[in] worker	the worker
+ * @return
+ *	- <0 on error
+ *	- 0 on success
+ */
+int fr_worker_steal_join(fr_worker_steal_t *ws, fr_worker_t *worker)
+{
+	int num;
+
+	WORKER_VERIFY;
+
+	worker->backlog = fr_atomic_queue_create(worker, WORKER_BACKLOG_SIZE);
+	if (!worker->backlog) {
+	nomem:
+		fr_strerror_printf("Failed creating atomic queue");
+		return -1;
+	}
+
+	/*
+	 *	We can't have more than WORKER_BACKLOG_SIZE entries
+	 *	out, so this queue never fills up.
+	 */
+	worker->returned = fr_atomic_queue_create(worker, WORKER_BACKLOG_SIZE);
+	if (!worker->returned) goto nomem;
+
+	worker->rb = fr_ring_buffer_create(worker, FR_CONTROL_MAX_MESSAGES * FR_CONTROL_MAX_SIZE);
+	if (!worker->rb) {
+		fr_strerror_printf_push("Failed allocating ring buffer");
+		return -1;
+	}
+
+	if (fr_control_callback_add(worker->control, FR_CONTROL_ID_WORKER, worker, worker_steal_callback) < 0) {
+		fr_strerror_printf_push("Failed adding control channel");
+		return -1;
+	}
+
+	pthread_mutex_lock(&ws->mutex);
+	num = atomic_load(&ws->num_workers);
+	if (num >= ws->max_workers) {
+		pthread_mutex_unlock(&ws->mutex);
+		fr_strerror_printf("Too many workers");
+		return -1;
+	}
+
+	/*
+	 *	Publish the worker before the new count, so that
+	 *	other workers never see an empty slot.
+	 */
+	ws->workers[num] = worker;
+	ws->num_running++;
+	worker->steal = ws;
+	worker->steal_next = num + 1;
+	atomic_store_explicit(&ws->num_workers, num + 1, memory_order_release);
+	pthread_mutex_unlock(&ws->mutex);
+
+	return 0;
+}
+
 static int cmd_stats_worker(FILE *fp, UNUSED FILE *fp_err, void *ctx, fr_cmd_info_t const *info)
 {
 	fr_worker_t const *worker = ctx;
 	fr_time_t when;
+	fr_control_stats_t cs;
 
 	if ((info->argc == 0) || (strcmp(info->argv[0], "count") == 0)) {
 		fprintf(fp, "count.in\t\t\t%" PRIu64 "\n", worker->stats.in);
@@ -1340,6 +2095,15 @@ static int cmd_stats_worker(FILE *fp, UNUSED FILE *fp_err, void *ctx, fr_cmd_inf
 		fprintf(fp, "count.naks\t\t\t%" PRIu64 "\n", worker->num_naks);
 		fprintf(fp, "count.active\t\t\t%" PRIu64 "\n", worker->num_active);
 		fprintf(fp, "count.runnable\t\t\t%u\n", fr_heap_num_elements(worker->runnable));
+		fprintf(fp, "count.stolen\t\t\t%" PRIu64 "\n", worker->num_stolen);
+	}
+
+	if ((info->argc == 0) || (strcmp(info->argv[0], "control") == 0)) {
+		fr_control_stats(worker->control, &cs);
+		fprintf(fp, "control.signals\t\t\t%" PRIu64 "\n", cs.signals);
+		fprintf(fp, "control.signals_avoided\t\t%" PRIu64 "\n", cs.signals_avoided);
+		fprintf(fp, "control.wakeups\t\t\t%" PRIu64 "\n", cs.wakeups);
+		fprintf(fp, "control.spin_hits\t\t%" PRIu64 "\n", cs.spin_hits);
 	}
 
 	if ((info->argc == 0) || (strcmp(info->argv[0], "cpu") == 0)) {
@@ -1375,7 +2139,7 @@ fr_cmd_table_t cmd_worker_table[] = {
 		.parent = "stats worker",
 		.add_name = true,
 		.name = "self",
-		.syntax = "[(count|cpu)]",
+		.syntax = "[(count|cpu|control)]",
 		.func = cmd_stats_worker,
 		.help = "Show statistics for a specific worker thread.",
 		.read_only = true
@@ -37,6 +37,11 @@ extern "C" {
  */
 typedef struct fr_worker_s fr_worker_t;
 
+/**
+ *  A set of workers which take requests from each other.
+ */
+typedef struct fr_worker_steal_s fr_worker_steal_t;
+
 #ifdef __cplusplus
 }
 #endif
@@ -62,6 +67,8 @@ void		fr_worker_destroy(fr_worker_t *worker) CC_HINT(nonnull);
 
 void		fr_worker(fr_worker_t *worker) CC_HINT(nonnull);
 
+void		fr_worker_spin_set(fr_worker_t *worker, fr_time_delta_t spin_time) CC_HINT(nonnull);
+
 void		fr_worker_debug(fr_worker_t *worker, FILE *fp) CC_HINT(nonnull);
 
 int		fr_worker_pre_event(void *uctx, fr_time_t wake);
@@ -71,6 +78,10 @@ void		fr_worker_post_event(fr_event_list_t *el, fr_time_t now, void *uctx);
 fr_channel_t	*fr_worker_channel_create(fr_worker_t *worker, TALLOC_CTX *ctx, fr_control_t *master) CC_HINT(nonnull);
 
 int		fr_worker_stats(fr_worker_t const *worker, int num, uint64_t *stats) CC_HINT(nonnull);
+
+fr_worker_steal_t *fr_worker_steal_create(TALLOC_CTX *ctx, int max_workers);
+
+int		fr_worker_steal_join(fr_worker_steal_t *ws, fr_worker_t *worker) CC_HINT(nonnull);
 #ifdef __cplusplus
 }
 #endif
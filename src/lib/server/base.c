@@ -58,6 +58,13 @@ int server_init(CONF_SECTION *cs)
 	 */
 	if (password_init() < 0) return -1;
 
+#ifdef HAVE_REGEX
+	/*
+	 *	Register radmin commands for the regex caches
+	 */
+	if (regex_cache_init() < 0) return -1;
+#endif
+
 	/*
 	 *	Initialize Auth-Type, etc. in the virtual servers
 	 *	before loading the modules.  Some modules need those
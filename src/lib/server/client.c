@@ -41,7 +41,7 @@ RCSID("$Id$")
 #include <fcntl.h>
 #include <sys/stat.h>
 
-//#define WITH_TRIE (1)
+#define WITH_TRIE (1)
 
 /** Group of clients
  *
@@ -49,10 +49,10 @@ RCSID("$Id$")
 struct rad_client_list {
 	char const	*name;			//!< Name of the client list.
 #ifdef WITH_TRIE
-	fr_trie_t	*v4_udp;
-	fr_trie_t	*v6_udp;
-	fr_trie_t	*v4_tcp;
-	fr_trie_t	*v6_tcp;
+	fr_trie_rcu_t	*v4_udp;		//!< Network threads look up clients while
+	fr_trie_rcu_t	*v6_udp;		//!< they're being added and deleted, so
+	fr_trie_rcu_t	*v4_tcp;		//!< use tries which can be read without
+	fr_trie_rcu_t	*v6_tcp;		//!< locking.
 #else
 	rbtree_t	*tree[129];
 #endif
@@ -113,25 +113,25 @@ RADCLIENT_LIST *client_list_init(CONF_SECTION *cs)
 	clients->name = talloc_strdup(clients, cs ? cf_section_name1(cs) : "root");
 
 #ifdef WITH_TRIE
-	clients->v4_udp = fr_trie_alloc(clients);
+	clients->v4_udp = fr_trie_rcu_alloc(clients);
 	if (!clients->v4_udp) {
 		talloc_free(clients);
 		return NULL;
 	}
 
-	clients->v6_udp = fr_trie_alloc(clients);
+	clients->v6_udp = fr_trie_rcu_alloc(clients);
 	if (!clients->v6_udp) {
 		talloc_free(clients);
 		return NULL;
 	}
 
-	clients->v4_tcp = fr_trie_alloc(clients);
+	clients->v4_tcp = fr_trie_rcu_alloc(clients);
 	if (!clients->v4_tcp) {
 		talloc_free(clients);
 		return NULL;
 	}
 
-	clients->v6_tcp = fr_trie_alloc(clients);
+	clients->v6_tcp = fr_trie_rcu_alloc(clients);
 	if (!clients->v6_tcp) {
 		talloc_free(clients);
 		return NULL;
@@ -143,18 +143,13 @@ RADCLIENT_LIST *client_list_init(CONF_SECTION *cs)
 
 #ifdef WITH_TRIE
 /*
- *	@todo - either support client definitions where "proto = *",
- *	or udpate this code to allow for that.  i.e. we create yet
- *	another set of v4/v6 tries, for "proto = *" clients.  And then
- *	do lookups there, too.  Or, just unify the udp/tcp tries, and
- *	instead do post-processing?  Though those two clients can have
- *	different secrets... and the trie code doesn't allow 2
- *	fr_trie_user_t nodes in a row.  So we would have to instead
- *	handle that ourselves, with a wrapper around the RADCLIENT
- *	structure that does udp/tcp/wildcard demultiplexing
+ *	Clients with "proto = *" are put into both the UDP and the TCP
+ *	tries.  This is the same as client_cmp() treating IPPROTO_IP
+ *	as matching either protocol.  Lookups for IPPROTO_IP check the
+ *	UDP trie first, and then the TCP one.
  */
-static fr_trie_t *clients_trie(RADCLIENT_LIST const *clients, fr_ipaddr_t const *ipaddr,
-			       int proto)
+static fr_trie_rcu_t *clients_trie(RADCLIENT_LIST const *clients, fr_ipaddr_t const *ipaddr,
+				   int proto)
 {
 	if (ipaddr->af == AF_INET) {
 		if (proto == IPPROTO_TCP) return clients->v4_tcp;
@@ -181,7 +176,7 @@ static fr_trie_t *clients_trie(RADCLIENT_LIST const *clients, fr_ipaddr_t const
 bool client_add(RADCLIENT_LIST *clients, RADCLIENT *client)
 {
 #ifdef WITH_TRIE
-	fr_trie_t *trie;
+	fr_trie_rcu_t *trie;
 #else
 #endif
 	RADCLIENT *old;
@@ -278,9 +273,14 @@ bool client_add(RADCLIENT_LIST *clients, RADCLIENT *client)
 	trie = clients_trie(clients, &client->ipaddr, client->proto);
 
 	/*
-	 *	Cannot insert the same client twice.
+	 *	Cannot insert the same client twice.  Wildcard
+	 *	clients conflict with clients of either protocol.
 	 */
-	old = fr_trie_match(trie, &client->ipaddr.addr, client->ipaddr.prefix);
+	old = fr_trie_rcu_match(trie, &client->ipaddr.addr, client->ipaddr.prefix);
+	if (!old && (client->proto == IPPROTO_IP)) {
+		old = fr_trie_rcu_match(clients_trie(clients, &client->ipaddr, IPPROTO_TCP),
+					&client->ipaddr.addr, client->ipaddr.prefix);
+	}
 
 #else  /* WITH_TRIE */
 
@@ -318,7 +318,15 @@ bool client_add(RADCLIENT_LIST *clients, RADCLIENT *client)
 	/*
 	 *	Other error adding client: likely is fatal.
 	 */
-	if (fr_trie_insert(trie, &client->ipaddr.addr, client->ipaddr.prefix, client) < 0) {
+	if (fr_trie_rcu_insert(trie, &client->ipaddr.addr, client->ipaddr.prefix, client) < 0) {
+		client_free(client);
+		return false;
+	}
+
+	if ((client->proto == IPPROTO_IP) &&
+	    (fr_trie_rcu_insert(clients_trie(clients, &client->ipaddr, IPPROTO_TCP),
+				&client->ipaddr.addr, client->ipaddr.prefix, client) < 0)) {
+		(void) fr_trie_rcu_remove(trie, &client->ipaddr.addr, client->ipaddr.prefix);
 		client_free(client);
 		return false;
 	}
@@ -342,7 +350,7 @@ bool client_add(RADCLIENT_LIST *clients, RADCLIENT *client)
 void client_delete(RADCLIENT_LIST *clients, RADCLIENT *client)
 {
 #ifdef WITH_TRIE
-	fr_trie_t *trie;
+	fr_trie_rcu_t *trie;
 #endif
 
 	if (!client) return;
@@ -357,7 +365,12 @@ void client_delete(RADCLIENT_LIST *clients, RADCLIENT *client)
 	/*
 	 *	Don't free the client.  The caller is responsible for that.
 	 */
-	(void) fr_trie_remove(trie, &client->ipaddr.addr, client->ipaddr.prefix);
+	(void) fr_trie_rcu_remove(trie, &client->ipaddr.addr, client->ipaddr.prefix);
+
+	if (client->proto == IPPROTO_IP) {
+		(void) fr_trie_rcu_remove(clients_trie(clients, &client->ipaddr, IPPROTO_TCP),
+					  &client->ipaddr.addr, client->ipaddr.prefix);
+	}
 #else
 
 	if (!clients->tree[client->ipaddr.prefix]) return;
@@ -378,11 +391,12 @@ RADCLIENT *client_findbynumber(UNUSED const RADCLIENT_LIST *clients, UNUSED int
  */
 RADCLIENT *client_find(RADCLIENT_LIST const *clients, fr_ipaddr_t const *ipaddr, int proto)
 {
+	RADCLIENT *client;
 #ifdef WITH_TRIE
-	fr_trie_t *trie;
+	fr_trie_rcu_t *trie;
 #else
 	int i, max;
-	RADCLIENT my_client, *client;
+	RADCLIENT my_client;
 #endif
 
 	if (!clients) clients = root_clients;
@@ -390,9 +404,17 @@ RADCLIENT *client_find(RADCLIENT_LIST const *clients, fr_ipaddr_t const *ipaddr,
 	if (!clients || !ipaddr) return NULL;
 
 #ifdef WITH_TRIE
+	/*
+	 *	Network threads call this for packets from sources
+	 *	they haven't seen yet, while clients may be added or
+	 *	deleted.  So the tries are never locked for reading.
+	 */
 	trie = clients_trie(clients, ipaddr, proto);
 
-	return fr_trie_lookup(trie, &ipaddr->addr, ipaddr->prefix);
+	client = fr_trie_rcu_lookup(trie, &ipaddr->addr, ipaddr->prefix);
+	if (client || (proto != IPPROTO_IP)) return client;
+
+	return fr_trie_rcu_lookup(clients_trie(clients, ipaddr, IPPROTO_TCP), &ipaddr->addr, ipaddr->prefix);
 #else
 
 	if (proto == AF_INET) {
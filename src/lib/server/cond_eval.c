@@ -41,7 +41,12 @@ RCSID("$Id$")
 #  define EVAL_DEBUG(...)
 #endif
 
-static bool all_digits(char const *string)
+/** Whether a string is compared as a number by cond_eval_map()
+ *
+ * @param[in] string	to check.
+ * @return true if the string is an optional '-' followed by digits.
+ */
+bool cond_all_digits(char const *string)
 {
 	char const *p = string;
 
@@ -157,7 +162,7 @@ static int cond_do_regex(REQUEST *request, fr_cond_t const *c,
 	uint32_t	subcaptures;
 	int		ret;
 
-	regex_t		*preg, *rreg = NULL;
+	regex_t		*preg;
 	fr_regmatch_t	*regmatch;
 
 	if (!fr_cond_assert(lhs != NULL)) return -1;
@@ -173,15 +178,14 @@ static int cond_do_regex(REQUEST *request, fr_cond_t const *c,
 	default:
 		if (!fr_cond_assert(rhs && rhs->type == FR_TYPE_STRING)) return -1;
 		if (!fr_cond_assert(rhs && rhs->vb_strvalue)) return -1;
-		slen = regex_compile(request, &rreg, rhs->vb_strvalue, rhs->datum.length,
-				     &map->rhs->tmpl_regex_flags, true, true);
+		slen = regex_cache_compile(&preg, rhs->vb_strvalue, rhs->datum.length,
+					   &map->rhs->tmpl_regex_flags, true);
 		if (slen <= 0) {
 			REMARKER(rhs->vb_strvalue, -slen, "%s", fr_strerror());
 			EVAL_DEBUG("FAIL %d", __LINE__);
 
 			return -1;
 		}
-		preg = rreg;
 		break;
 	}
 
@@ -214,7 +218,6 @@ static int cond_do_regex(REQUEST *request, fr_cond_t const *c,
 	}
 
 	talloc_free(regmatch);	/* free if not consumed */
-	if (preg) talloc_free(rreg);
 
 	return ret;
 }
@@ -403,7 +406,7 @@ do {\
 	if ((cast_type == FR_TYPE_INVALID) &&\
 	    _l && (_l->type == FR_TYPE_STRING) &&\
 	    _r && (_r->type == FR_TYPE_STRING) &&\
-	    all_digits(lhs->vb_strvalue) && all_digits(rhs->vb_strvalue)) {\
+	    cond_all_digits(lhs->vb_strvalue) && cond_all_digits(rhs->vb_strvalue)) {\
 	    	cast_type = FR_TYPE_UINT64;\
 	    	EVAL_DEBUG("OPERANDS ARE NUMBER STRINGS, SETTING CAST TO uint64");\
 	}\
@@ -38,6 +38,7 @@ typedef struct fr_cond_s fr_cond_t;
 int	cond_eval_tmpl(REQUEST *request, int modreturn, int depth, vp_tmpl_t const *vpt);
 int	cond_eval_map(REQUEST *request, int modreturn, int depth, fr_cond_t const *c);
 int	cond_eval(REQUEST *request, int modreturn, int depth, fr_cond_t const *c);
+bool	cond_all_digits(char const *string);
 
 #ifdef __cplusplus
 }
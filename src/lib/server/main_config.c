@@ -78,6 +78,7 @@ static int hostname_lookups_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF
 
 static int num_networks_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, CONF_PARSER const *rule);
 static int num_workers_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, CONF_PARSER const *rule);
+static int max_workers_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, CONF_PARSER const *rule);
 static int lib_dir_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, CONF_PARSER const *rule);
 
 static int talloc_memory_limit_parse(TALLOC_CTX *ctx, void *out, void *parent, CONF_ITEM *ci, CONF_PARSER const *rule);
@@ -155,6 +156,7 @@ static const CONF_PARSER resources[] = {
 	{ FR_CONF_OFFSET("talloc_pool_size", FR_TYPE_SIZE | FR_TYPE_HIDDEN, main_config_t, talloc_pool_size), .func = talloc_pool_size_parse },			/* DO NOT SET DEFAULT */
 	{ FR_CONF_OFFSET("talloc_memory_limit", FR_TYPE_SIZE | FR_TYPE_HIDDEN, main_config_t, talloc_memory_limit), .func = talloc_memory_limit_parse },		/* DO NOT SET DEFAULT */
 	{ FR_CONF_OFFSET("talloc_memory_report", FR_TYPE_BOOL | FR_TYPE_HIDDEN, main_config_t, talloc_memory_report) },						/* DO NOT SET DEFAULT */
+	{ FR_CONF_OFFSET("paircmp_index_threshold", FR_TYPE_UINT32, main_config_t, paircmp_index_threshold), .dflt = STRINGIFY(32) },
 	CONF_PARSER_TERMINATOR
 };
 
@@ -163,9 +165,22 @@ static const CONF_PARSER thread_config[] = {
 	  .func = num_networks_parse },
 	{ FR_CONF_OFFSET("num_workers", FR_TYPE_UINT32, main_config_t, max_workers), .dflt = STRINGIFY(4),
 	  .func = num_workers_parse },
+	{ FR_CONF_OFFSET("max_workers", FR_TYPE_UINT32, main_config_t, scale_max_workers), .dflt = STRINGIFY(0),
+	  .func = max_workers_parse },
+	{ FR_CONF_OFFSET("scale_interval", FR_TYPE_TIME_DELTA, main_config_t, scale_interval), .dflt = "1.0" },
 
 	{ FR_CONF_OFFSET("stats_interval | FR_TYPE_HIDDEN", FR_TYPE_TIME_DELTA, main_config_t, stats_interval), },
 
+	{ FR_CONF_OFFSET("network_cpus", FR_TYPE_STRING, main_config_t, network_cpus) },
+	{ FR_CONF_OFFSET("worker_cpus", FR_TYPE_STRING, main_config_t, worker_cpus) },
+	{ FR_CONF_OFFSET("network_numa_nodes", FR_TYPE_STRING, main_config_t, network_numa_nodes) },
+	{ FR_CONF_OFFSET("worker_numa_nodes", FR_TYPE_STRING, main_config_t, worker_numa_nodes) },
+
+	{ FR_CONF_OFFSET("work_stealing", FR_TYPE_BOOL, main_config_t, work_stealing), .dflt = "no" },
+	{ FR_CONF_OFFSET("source_affinity", FR_TYPE_BOOL, main_config_t, source_affinity), .dflt = "no" },
+	{ FR_CONF_OFFSET("spin_time", FR_TYPE_TIME_DELTA, main_config_t, spin_time), .dflt = "0" },
+	{ FR_CONF_OFFSET("timer_resolution", FR_TYPE_TIME_DELTA, main_config_t, timer_resolution), .dflt = "0" },
+
 	CONF_PARSER_TERMINATOR
 };
 
@@ -436,7 +451,8 @@ static int num_networks_parse(TALLOC_CTX *ctx, void *out, void *parent,
 
 	memcpy(&value, out, sizeof(value));
 
-	FR_INTEGER_BOUND_CHECK("thread.num_networks", value, ==, 1);
+	FR_INTEGER_BOUND_CHECK("thread.num_networks", value, >=, 1);
+	FR_INTEGER_BOUND_CHECK("thread.num_networks", value, <=, 64);
 
 	memcpy(out, &value, sizeof(value));
 
@@ -454,7 +470,27 @@ static int num_workers_parse(TALLOC_CTX *ctx, void *out, void *parent,
 	memcpy(&value, out, sizeof(value));
 
 	FR_INTEGER_BOUND_CHECK("thread.num_workers", value, >=, 1);
-	FR_INTEGER_BOUND_CHECK("thread.num_workers", value, <=, 64);
+	FR_INTEGER_BOUND_CHECK("thread.num_workers", value, <=, 1024);
+
+	memcpy(out, &value, sizeof(value));
+
+	return 0;
+}
+
+static int max_workers_parse(TALLOC_CTX *ctx, void *out, void *parent,
+			     CONF_ITEM *ci, CONF_PARSER const *rule)
+{
+	int		ret;
+	uint32_t	value;
+
+	if ((ret = cf_pair_parse_value(ctx, out, parent, ci, rule)) < 0) return ret;
+
+	memcpy(&value, out, sizeof(value));
+
+	/*
+	 *	0 means "don't change the number of workers".
+	 */
+	FR_INTEGER_BOUND_CHECK("thread.max_workers", value, <=, 1024);
 
 	memcpy(out, &value, sizeof(value));
 
@@ -1196,6 +1232,8 @@ do {\
 	 */
 	if (fr_debug_lvl == 0) fr_debug_lvl = config->debug_level;
 
+	fr_pair_list_index_threshold = config->paircmp_index_threshold;
+
 	INFO("Switching to configured log settings");
 
 	/*
@@ -94,6 +94,9 @@ struct main_config_s {
 
 	size_t		talloc_pool_size;		//!< Size of pool to allocate to hold each #REQUEST.
 
+	uint32_t	paircmp_index_threshold;	//!< Index request lists at least this long
+							///< when paircmp() compares check items.
+
 	bool		write_pid;			//!< write the PID file
 
 #ifdef HAVE_SETUID
@@ -136,8 +139,20 @@ struct main_config_s {
 							//!< Only applicable in single threaded mode.
 	uint32_t	max_networks;			//!< for the scheduler
 	uint32_t	max_workers;			//!< for the scheduler
+	uint32_t	scale_max_workers;		//!< Upper limit when growing the worker pool.
+	fr_time_delta_t	scale_interval;			//!< How often the worker pool is resized.
 	fr_time_delta_t	stats_interval;			//!< for the scheduler
 
+	char const	*network_cpus;			//!< CPUs to pin network threads to.
+	char const	*worker_cpus;			//!< CPUs to pin worker threads to.
+	char const	*network_numa_nodes;		//!< NUMA nodes to place network threads on.
+	char const	*worker_numa_nodes;		//!< NUMA nodes to place worker threads on.
+
+	bool		work_stealing;			//!< Idle workers take requests from busy ones.
+	bool		source_affinity;		//!< Send related packets to the same worker.
+	fr_time_delta_t	spin_time;			//!< How long idle threads poll for messages.
+	fr_time_delta_t	timer_resolution;		//!< Resolution of the thread timer wheels, or 0 for a heap.
+
 };
 
 void			main_config_name_set_default(main_config_t *config, char const *name, bool overwrite_config);
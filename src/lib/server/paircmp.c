@@ -340,7 +340,6 @@ int paircmp_pairs(UNUSED REQUEST *request, VALUE_PAIR *check, VALUE_PAIR *vp)
 			REDEBUG("Error stringifying operand for regular expression");
 
 		regex_error:
-			talloc_free(preg);
 			talloc_free(expr);
 			talloc_free(value);
 			return -2;
@@ -349,8 +348,7 @@ int paircmp_pairs(UNUSED REQUEST *request, VALUE_PAIR *check, VALUE_PAIR *vp)
 		/*
 		 *	Include substring matches.
 		 */
-		slen = regex_compile(request, &preg, expr_p, talloc_array_length(expr_p) - 1,
-				     NULL, true, true);
+		slen = regex_cache_compile(&preg, expr_p, talloc_array_length(expr_p) - 1, NULL, true);
 		if (slen <= 0) {
 			REMARKER(expr_p, -slen, "%s", fr_strerror());
 
@@ -382,7 +380,6 @@ int paircmp_pairs(UNUSED REQUEST *request, VALUE_PAIR *check, VALUE_PAIR *vp)
 		}
 
 		talloc_free(regmatch);
-		talloc_free(preg);
 		talloc_free(expr);
 		talloc_free(value);
 
@@ -566,6 +563,8 @@ int paircmp(REQUEST *request,
 	VALUE_PAIR		*check_item;
 	VALUE_PAIR		*auth_item;
 	fr_dict_attr_t const	*from;
+	fr_pair_list_index_t	*idx = NULL;
+	int			lookups = 0;
 
 	int			result = 0;
 	int			compare;
@@ -619,6 +618,16 @@ int paircmp(REQUEST *request,
 
 		auth_item = request_list;
 
+		/*
+		 *	Every check item means another scan of the
+		 *	request list, so index it if we're going to
+		 *	do more than one of them.
+		 */
+		if (!first_only && from) {
+			if (!idx && (++lookups == 2)) idx = fr_pair_list_index_alloc(NULL, request_list);
+			if (idx) auth_item = fr_pair_list_index_find(idx, from, TAG_ANY);
+		}
+
 	try_again:
 		if (!first_only) {
 			while (auth_item != NULL) {
@@ -639,7 +648,8 @@ int paircmp(REQUEST *request,
 			if (check_item->op == T_OP_CMP_FALSE) {
 				continue;
 			} else {
-				return -1;
+				result = -1;
+				break;
 			}
 		}
 
@@ -647,7 +657,10 @@ int paircmp(REQUEST *request,
 		 *	Else we found it, but we were trying to not
 		 *	find it, so we failed.
 		 */
-		if (check_item->op == T_OP_CMP_FALSE) return -1;
+		if (check_item->op == T_OP_CMP_FALSE) {
+			result = -1;
+			break;
+		}
 
 		/*
 		 *	We've got to xlat the string before doing
@@ -711,6 +724,8 @@ int paircmp(REQUEST *request,
 
 	} /* for every entry in the check item list */
 
+	talloc_free(idx);
+
 	return result;
 }
 
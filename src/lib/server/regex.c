@@ -25,10 +25,21 @@
 
 RCSID("$Id$")
 
+#include <freeradius-devel/server/command.h>
 #include <freeradius-devel/server/regex.h>
 #include <freeradius-devel/server/request_data.h>
 #include <freeradius-devel/server/rad_assert.h>
 
+#include <freeradius-devel/util/dlist.h>
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/thread_local.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
 #ifdef HAVE_REGEX
 
 #define REQUEST_DATA_REGEX (0xadbeef00)
@@ -45,6 +56,7 @@ typedef struct {
  * Allows use of %{n} expansions.
  *
  * @note If preg was runtime-compiled, it will be consumed and *preg will be set to NULL.
+ * @note If preg came from #regex_cache_compile, the match request data keeps a reference to it.
  * @note regmatch will be consumed and *regmatch will be set to NULL.
  * @note Their lifetimes will be bound to the match request data.
  *
@@ -82,10 +94,15 @@ void regex_sub_to_request(REQUEST *request, regex_t **preg, fr_regmatch_t **regm
 	MEM(new_rc = talloc(request, fr_regcapture_t));
 
 	/*
-	 *	Steal runtime pregs, leave precompiled ones
+	 *	Steal runtime pregs, leave precompiled ones.
+	 *
+	 *	Cached pregs can be evicted before the request is
+	 *	done with the subcaptures, so keep a reference.
 	 */
 #if defined(HAVE_REGEX_PCRE) || defined(HAVE_REGEX_PCRE2)
-	if (!(*preg)->precompiled) {
+	if ((*preg)->cached) {
+		MEM(new_rc->preg = talloc_reference(new_rc, *preg));
+	} else if (!(*preg)->precompiled) {
 		new_rc->preg = talloc_steal(new_rc, *preg);
 		*preg = NULL;
 	} else {
@@ -442,4 +459,226 @@ int regex_request_to_sub(TALLOC_CTX *ctx, char **out, REQUEST *request, uint32_t
 	return 0;
 }
 #  endif
+
+/** A compiled pattern in the per-thread regex cache
+ *
+ */
+typedef struct {
+	char const		*pattern;	//!< Uncompiled pattern.
+	size_t			len;		//!< Length of the pattern.
+	uint8_t			flags;		//!< Packed #fr_regex_flags_t.
+	bool			subcaptures;	//!< Whether the pattern was compiled with subcaptures.
+
+	regex_t			*preg;		//!< Compiled pattern.
+
+	fr_dlist_t		entry;		//!< Entry in the LRU list.
+} regex_cache_entry_t;
+
+typedef struct {
+	fr_hash_table_t		*ht;		//!< Entries by pattern and flags.
+	fr_dlist_head_t		lru;		//!< Most recently used at the head.
+} regex_cache_t;
+
+fr_thread_local_setup(regex_cache_t *, regex_cache); /* macro */
+
+/*
+ *	Shared by all threads, so radmin can read them.
+ */
+static _Atomic(uint64_t)	regex_cache_hits;
+static _Atomic(uint64_t)	regex_cache_misses;
+static _Atomic(uint64_t)	regex_cache_evictions;
+static _Atomic(uint64_t)	regex_cache_entries;
+
+static inline CC_HINT(always_inline) uint8_t regex_cache_flags(fr_regex_flags_t const *flags)
+{
+	if (!flags) return 0;
+
+	return (flags->global << 0) | (flags->ignore_case << 1) | (flags->multiline << 2) |
+	       (flags->dot_all << 3) | (flags->unicode << 4) | (flags->extended << 5);
+}
+
+/** Hash a cache entry
+ *
+ * Patterns can come from request data, so use a seeded hash to stop
+ * anyone choosing patterns which all land in the same bucket.
+ */
+static uint32_t regex_cache_entry_hash(void const *data)
+{
+	regex_cache_entry_t const	*c = data;
+	uint32_t			hash;
+
+	hash = fr_hash_seeded(c->pattern, c->len);
+	hash = fr_hash_seeded_update(&c->flags, sizeof(c->flags), hash);
+	return fr_hash_seeded_update(&c->subcaptures, sizeof(c->subcaptures), hash);
+}
+
+static int regex_cache_entry_cmp(void const *one, void const *two)
+{
+	regex_cache_entry_t const *a = one, *b = two;
+	int ret;
+
+	ret = (a->len > b->len) - (a->len < b->len);
+	if (ret != 0) return ret;
+
+	ret = (a->flags > b->flags) - (a->flags < b->flags);
+	if (ret != 0) return ret;
+
+	ret = (a->subcaptures > b->subcaptures) - (a->subcaptures < b->subcaptures);
+	if (ret != 0) return ret;
+
+	return memcmp(a->pattern, b->pattern, a->len);
+}
+
+static int _regex_cache_entry_free(regex_cache_entry_t *c)
+{
+	/*
+	 *	If a request still has subcaptures from this
+	 *	pattern, it becomes the owner.
+	 */
+	if (c->preg) talloc_unlink(c, c->preg);
+	atomic_fetch_sub_explicit(&regex_cache_entries, 1, memory_order_relaxed);
+
+	return 0;
+}
+
+static void _regex_cache_free(void *arg)
+{
+	talloc_free(arg);
+}
+
+/** Compile a pattern, or return a copy compiled earlier by this thread
+ *
+ * Each thread keeps the last #REGEX_CACHE_SIZE patterns it compiled,
+ * so patterns built from expansions aren't compiled (and JIT'd) again
+ * for every request.
+ *
+ * @note The caller must not free the compiled pattern.  It remains valid
+ *	until the next call to this function from the same thread.
+ *	#regex_sub_to_request keeps a reference, so subcaptures stay
+ *	available after the pattern is evicted.
+ *
+ * @param[out] out		Where to write out a pointer to the compiled pattern.
+ * @param[in] pattern		to compile.
+ * @param[in] len		of pattern.
+ * @param[in] flags		controlling matching. May be NULL.
+ * @param[in] subcaptures	Whether to compile the regular expression to store subcapture
+ *				data.
+ * @return
+ *	- >= 1 on success.
+ *	- <= 0 on error. Negative value is offset of parse error.
+ */
+ssize_t regex_cache_compile(regex_t **out, char const *pattern, size_t len,
+			    fr_regex_flags_t const *flags, bool subcaptures)
+{
+	regex_cache_t		*cache = regex_cache;
+	regex_cache_entry_t	find, *c;
+	ssize_t			slen;
+
+	*out = NULL;
+
+	if (unlikely(!cache)) {
+		MEM(cache = talloc_zero(NULL, regex_cache_t));
+		MEM(cache->ht = fr_hash_table_create(cache, regex_cache_entry_hash, regex_cache_entry_cmp, NULL));
+		fr_dlist_init(&cache->lru, regex_cache_entry_t, entry);
+		fr_thread_local_set_destructor(regex_cache, _regex_cache_free, cache);
+	}
+
+	find = (regex_cache_entry_t) {
+		.pattern = pattern,
+		.len = len,
+		.flags = regex_cache_flags(flags),
+		.subcaptures = subcaptures
+	};
+
+	c = fr_hash_table_finddata(cache->ht, &find);
+	if (c) {
+		atomic_fetch_add_explicit(&regex_cache_hits, 1, memory_order_relaxed);
+
+		fr_dlist_remove(&cache->lru, c);
+		fr_dlist_insert_head(&cache->lru, c);
+
+		*out = c->preg;
+		return len;
+	}
+	atomic_fetch_add_explicit(&regex_cache_misses, 1, memory_order_relaxed);
+
+	MEM(c = talloc_zero(cache, regex_cache_entry_t));
+
+	/*
+	 *	Not "runtime", so the pattern is JIT'd.
+	 */
+	slen = regex_compile(c, &c->preg, pattern, len, flags, subcaptures, false);
+	if (slen <= 0) {
+		talloc_free(c);
+		return slen;
+	}
+#if defined(HAVE_REGEX_PCRE) || defined(HAVE_REGEX_PCRE2)
+	c->preg->cached = true;
+#endif
+
+	MEM(c->pattern = talloc_memdup(c, pattern, len));
+	c->len = len;
+	c->flags = find.flags;
+	c->subcaptures = subcaptures;
+
+	/*
+	 *	Make room by evicting the least recently used pattern.
+	 */
+	if (fr_dlist_num_elements(&cache->lru) >= REGEX_CACHE_SIZE) {
+		regex_cache_entry_t *old = fr_dlist_tail(&cache->lru);
+
+		fr_dlist_remove(&cache->lru, old);
+		fr_hash_table_delete(cache->ht, old);
+		talloc_free(old);
+
+		atomic_fetch_add_explicit(&regex_cache_evictions, 1, memory_order_relaxed);
+	}
+
+	MEM(fr_hash_table_insert(cache->ht, c) == 1);
+	fr_dlist_insert_head(&cache->lru, c);
+	atomic_fetch_add_explicit(&regex_cache_entries, 1, memory_order_relaxed);
+	talloc_set_destructor(c, _regex_cache_entry_free);
+
+	*out = c->preg;
+
+	return slen;
+}
+
+static int cmd_stats_regex(FILE *fp, UNUSED FILE *fp_err, UNUSED void *ctx, UNUSED fr_cmd_info_t const *info)
+{
+	fprintf(fp, "cache.entries\t\t\t%" PRIu64 "\n", atomic_load_explicit(&regex_cache_entries, memory_order_relaxed));
+	fprintf(fp, "cache.hits\t\t\t%" PRIu64 "\n", atomic_load_explicit(&regex_cache_hits, memory_order_relaxed));
+	fprintf(fp, "cache.misses\t\t\t%" PRIu64 "\n", atomic_load_explicit(&regex_cache_misses, memory_order_relaxed));
+	fprintf(fp, "cache.evictions\t\t\t%" PRIu64 "\n", atomic_load_explicit(&regex_cache_evictions, memory_order_relaxed));
+
+	return 0;
+}
+
+static fr_cmd_table_t cmd_regex_table[] = {
+	{
+		.parent = "stats",
+		.name = "regex",
+		.func = cmd_stats_regex,
+		.help = "Show statistics for the per-thread caches of compiled regular expressions.",
+		.read_only = true
+	},
+
+	CMD_TABLE_END
+};
+
+/** Register the radmin commands for the regex cache
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int regex_cache_init(void)
+{
+	if (fr_command_register_hook(NULL, NULL, NULL, cmd_regex_table) < 0) {
+		ERROR("Failed registering radmin commands for regex cache - %s", fr_strerror());
+		return -1;
+	}
+
+	return 0;
+}
 #endif
@@ -41,6 +41,17 @@ extern "C" {
  */
 #  define REQUEST_MAX_REGEX 32
 
+/*
+ *	Maximum number of compiled patterns each thread keeps
+ *	in its regex cache.
+ */
+#  define REGEX_CACHE_SIZE 128
+
+int	regex_cache_init(void);
+
+ssize_t	regex_cache_compile(regex_t **out, char const *pattern, size_t len,
+			    fr_regex_flags_t const *flags, bool subcaptures);
+
 void	regex_sub_to_request(REQUEST *request, regex_t **preg, fr_regmatch_t **regmatch);
 
 int	regex_request_to_sub(TALLOC_CTX *ctx, char **out, REQUEST *request, uint32_t num);
@@ -34,6 +34,93 @@ RCSID("$Id$")
  */
 fr_thread_local_setup(fr_dlist_head_t *, request_free_list); /* macro */
 
+/** How much memory requests on this thread typically use
+ *
+ * Sampled as requests are freed, and used to size the talloc pool of
+ * new requests.  With a large enough pool, the pairs, packets and other
+ * data allocated while processing a request are carved out of the pool,
+ * instead of each being a separate call to malloc.
+ */
+typedef struct {
+	size_t			size;		//!< Moving average of bytes allocated per request.
+	size_t			blocks;		//!< Moving average of chunks allocated per request.
+	uint32_t		freed;		//!< Requests freed, used to pick which to sample.
+} request_pool_stats_t;
+
+fr_thread_local_setup(request_pool_stats_t *, request_pool_stats); /* macro */
+
+/*
+ *	Chunks and bytes every request needs, for the unlang stack
+ *	and the packets.  Pools never get smaller than this.
+ */
+#define REQUEST_POOL_BLOCKS	(1 + UNLANG_STACK_MAX + 2 + 10)
+#define REQUEST_POOL_SIZE	((UNLANG_FRAME_PRE_ALLOC * UNLANG_STACK_MAX) + (sizeof(RADIUS_PACKET) * 2) + 128)
+
+#define REQUEST_POOL_SIZE_MAX	(64 * 1024)	//!< Don't let large requests make every pool huge.
+#define REQUEST_POOL_SAMPLE	(16)		//!< Sample one in this many requests.
+#define REQUEST_FREE_LIST_MAX	(256)		//!< Requests kept for re-use, per thread.
+
+/** Update the moving averages of request memory use
+ *
+ * Only one in #REQUEST_POOL_SAMPLE requests is sampled, as counting
+ * the chunks means walking the whole talloc tree of the request.
+ */
+static inline void request_pool_sample(REQUEST *request)
+{
+	request_pool_stats_t	*stats = request_pool_stats;
+	size_t			size, blocks;
+
+	if (!stats || ((stats->freed++ % REQUEST_POOL_SAMPLE) != 0)) return;
+
+	size = talloc_total_size(request);
+	blocks = talloc_total_blocks(request);
+
+	if (!stats->size) {
+		stats->size = size;
+		stats->blocks = blocks;
+		return;
+	}
+
+	stats->size += (size / 8) - (stats->size / 8);
+	stats->blocks += (blocks / 8) - (stats->blocks / 8);
+}
+
+/** Return the pool size for new requests
+ *
+ * Leave 25% headroom over what requests typically use, so most never
+ * overflow the pool.
+ */
+static inline size_t request_pool_size(request_pool_stats_t const *stats)
+{
+	size_t pool_size = REQUEST_POOL_SIZE;
+
+	if (stats && (stats->size > pool_size)) pool_size = stats->size + (stats->size / 4);
+	if (pool_size > REQUEST_POOL_SIZE_MAX) pool_size = REQUEST_POOL_SIZE_MAX;
+
+	return pool_size;
+}
+
+/** Whether a request's pool is the right size to be re-used
+ *
+ * Requests whose pool is smaller than requests typically need are
+ * freed, so that they're replaced by ones with a larger pool.  Requests
+ * whose pool is much larger than new requests get are also freed, so
+ * that a burst of large requests doesn't leave the free list holding
+ * on to memory which is no longer needed.
+ */
+static inline bool request_pool_reusable(REQUEST const *request, request_pool_stats_t const *stats)
+{
+	size_t pool_size;
+
+	if (!stats) return true;
+
+	pool_size = request_pool_size(stats);
+
+	if (request->pool_size > (pool_size * 2)) return false;
+
+	return (request->pool_size >= stats->size) || (request->pool_size >= REQUEST_POOL_SIZE_MAX);
+}
+
 /** Setup logging and other fields for a request
  *
  * @param[in] request		to (re)-initialise.
@@ -107,13 +194,20 @@ static int _request_free(REQUEST *request)
 		goto really_free;
 	}
 
+	request_pool_sample(request);
+
 	/*
 	 *	We keep a buffer of <active> + N requests per
 	 *	thread, to avoid spurious allocations.
+	 *
+	 *	Requests whose pool is too small, or much too
+	 *	large, are freed instead.
 	 */
-	if (fr_dlist_num_elements(request_free_list) <= 256) {
+	if ((fr_dlist_num_elements(request_free_list) <= REQUEST_FREE_LIST_MAX) &&
+	    request_pool_reusable(request, request_pool_stats)) {
 		TALLOC_CTX		*state_ctx;
 		fr_dlist_head_t		*free_list;
+		size_t			pool_size;
 
 		/*
 		 *	Ensure any data associated
@@ -127,6 +221,7 @@ static int _request_free(REQUEST *request)
 			state_ctx = NULL;
 		}
 		free_list = request_free_list;
+		pool_size = request->pool_size;
 
 		/*
 		 *	Reinitialise the request
@@ -135,6 +230,7 @@ static int _request_free(REQUEST *request)
 		memset(request, 0, sizeof(*request));
 		request->component = "free_list";
 		request->state_ctx = state_ctx;		/* Use the old, now cleared, state_ctx */
+		request->pool_size = pool_size;
 
 		/*
 		 *	Reinsert into the free list
@@ -203,6 +299,15 @@ static void _request_free_list_free_on_exit(void *arg)
 	talloc_free(list);
 }
 
+/** Free the request memory stats when the thread is joined
+ *
+ */
+static void _request_pool_stats_free_on_exit(void *arg)
+{
+	talloc_free(talloc_get_type_abort(arg, request_pool_stats_t));
+	request_pool_stats = NULL;
+}
+
 /** Create a new REQUEST data structure
  *
  */
@@ -210,6 +315,7 @@ REQUEST *request_alloc(TALLOC_CTX *ctx)
 {
 	REQUEST			*request;
 	fr_dlist_head_t		*free_list;
+	request_pool_stats_t	*stats;
 
 	/*
 	 *	Setup the free list, or return the free
@@ -219,12 +325,21 @@ REQUEST *request_alloc(TALLOC_CTX *ctx)
 		MEM(free_list = talloc(NULL, fr_dlist_head_t));
 		fr_dlist_init(free_list, REQUEST, free_entry);
 		fr_thread_local_set_destructor(request_free_list, _request_free_list_free_on_exit, free_list);
+
+		MEM(stats = talloc_zero(NULL, request_pool_stats_t));
+		fr_thread_local_set_destructor(request_pool_stats, _request_pool_stats_free_on_exit, stats);
 	} else {
 		free_list = request_free_list;
+		stats = request_pool_stats;
 	}
 
 	request = fr_dlist_head(free_list);
 	if (!request) {
+		size_t			pool_size = request_pool_size(stats);
+		size_t			pool_blocks = REQUEST_POOL_BLOCKS;
+
+		if (stats && (stats->blocks > pool_blocks)) pool_blocks = stats->blocks + (stats->blocks / 4);
+
 		/*
 		 *	Only allocate requests in the NULL
 		 *	ctx.  There's no scenario where it's
@@ -234,16 +349,9 @@ REQUEST *request_alloc(TALLOC_CTX *ctx)
 		 *	cannot be returned to a free list
 		 *	and would have to be freed.
 		 */
-		MEM(request = talloc_zero_pooled_object(NULL, REQUEST,
-							1 + 				/* Stack pool */
-							UNLANG_STACK_MAX + 		/* Stack Frames */
-							2 + 				/* packets */
-							10,				/* extra */
-							(UNLANG_FRAME_PRE_ALLOC * UNLANG_STACK_MAX) +	/* Stack memory */
-							(sizeof(RADIUS_PACKET) * 2) +	/* packets */
-							128				/* extra */
-							));
+		MEM(request = talloc_zero_pooled_object(NULL, REQUEST, pool_blocks, pool_size));
 		talloc_set_destructor(request, _request_free);
+		request->pool_size = pool_size;
 	} else {
 		/*
 		 *	Remove from the free list, as we're
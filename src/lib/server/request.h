@@ -152,6 +152,7 @@ struct fr_request_s {
 	fr_async_t		*async;		//!< for new async listeners
 
 	fr_dlist_t		free_entry;	//!< Request's entry in the free list.
+	size_t			pool_size;	//!< Size of the talloc pool the request was allocated with.
 };				/* REQUEST typedef */
 
 #ifdef WITH_VERIFY_PTR
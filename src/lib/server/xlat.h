@@ -58,6 +58,7 @@ typedef struct xlat_exp xlat_exp_t;
 struct xlat_inst {
 	xlat_exp_t const	*node;		//!< Node this data relates to.
 	void			*data;		//!< xlat node specific instance data.
+	unsigned int		number;		//!< Index into the thread specific instance array.
 };
 
 /** Thread specific instance data for xlat expansion node
@@ -273,11 +274,19 @@ ssize_t		xlat_aeval_compiled(TALLOC_CTX *ctx, char **out, REQUEST *request,
 
 int		xlat_eval_pair(REQUEST *request, VALUE_PAIR *vp);
 
+char		*xlat_constant_aprint(TALLOC_CTX *ctx, xlat_exp_t const *head);
+
 ssize_t		xlat_tokenize_ephemeral(TALLOC_CTX *ctx, xlat_exp_t **head, REQUEST *request,
 					char const *fmt, vp_tmpl_rules_t const *rules);
 
 ssize_t		xlat_tokenize(TALLOC_CTX *ctx, xlat_exp_t **head, char *fmt, vp_tmpl_rules_t const *rules);
 
+int		xlat_tokenize_conf(TALLOC_CTX *ctx, xlat_exp_t **head, CONF_ITEM const *ci, char const *fmt);
+
+int		xlat_tokenize_conf_section(CONF_SECTION *cs, bool quoted_only);
+
+xlat_exp_t const *xlat_from_conf_pair(CONF_PAIR const *cp);
+
 size_t		xlat_snprint(char *buffer, size_t bufsize, xlat_exp_t const *node);
 
 #define XLAT_DEFAULT_BUF_LEN	2048
@@ -287,7 +296,7 @@ int		xlat_register(void *mod_inst, char const *name,
 			      xlat_instantiate_t instantiate, size_t inst_size,
 			      size_t buf_len, bool async_safe);
 
-xlat_t const	*xlat_async_register(TALLOC_CTX *ctx, char const *name, xlat_func_async_t func);
+xlat_t const	*xlat_async_register(TALLOC_CTX *ctx, char const *name, xlat_func_async_t func, bool pure);
 
 int		xlat_internal(char const *name);
 
@@ -2148,6 +2148,7 @@ int xlat_register(void *mod_inst, char const *name,
 	c->instantiate = instantiate;
 	c->inst_size = inst_size;
 	c->async_safe = async_safe;
+	c->pure = false;
 
 	DEBUG3("%s: %s", __FUNCTION__, c->name);
 
@@ -2165,14 +2166,20 @@ int xlat_register(void *mod_inst, char const *name,
  *
  * All functions registered must be async_safe.
  *
+ * Pure functions are called once, when the server starts, for any expansion
+ * where all of their arguments are constant.  They must not yield, must not
+ * look at the request, and must not use instance data.  The result of the
+ * call is then used in place of calling the function for every request.
+ *
  * @param[in] ctx		Used to automate deregistration of the xlat fnction.
  * @param[in] name		of the xlat.
  * @param[in] func		to register.
+ * @param[in] pure		whether the output of the function depends only on its input.
  * @return
  *	- 0 on success.
  *	- -1 on failure.
  */
-xlat_t const *xlat_async_register(TALLOC_CTX *ctx, char const *name, xlat_func_async_t func)
+xlat_t const *xlat_async_register(TALLOC_CTX *ctx, char const *name, xlat_func_async_t func, bool pure)
 {
 	xlat_t	*c;
 	bool	is_new = false;
@@ -2212,6 +2219,7 @@ xlat_t const *xlat_async_register(TALLOC_CTX *ctx, char const *name, xlat_func_a
 	c->func.async = func;
 	c->type = XLAT_FUNC_ASYNC;
 	c->async_safe = false;	/* async safe in this case means it might yield */
+	c->pure = pure;
 
 	DEBUG3("%s: %s", __FUNCTION__, c->name);
 
@@ -2605,7 +2613,7 @@ static xlat_action_t xlat_func_sub_regex(TALLOC_CTX *ctx, fr_cursor_t *out,
 	/*
 	 *	Process the substitution
 	 */
-	if (regex_compile(NULL, &pattern, regex, regex_len, &flags, false, true) <= 0) {
+	if (regex_cache_compile(&pattern, regex, regex_len, &flags, false) <= 0) {
 		RPEDEBUG("Failed compiling regex");
 		return XLAT_ACTION_FAIL;
 	}
@@ -2615,15 +2623,12 @@ static xlat_action_t xlat_func_sub_regex(TALLOC_CTX *ctx, fr_cursor_t *out,
 			     subject, subject_len, rep, rep_len, NULL) < 0) {
 		RPEDEBUG("Failed performing substitution");
 		talloc_free(vb);
-		talloc_free(pattern);
 		return XLAT_ACTION_FAIL;
 	}
 	fr_value_box_bstrsteal(vb, vb, NULL, buff, (*in)->tainted);
 
 	fr_cursor_append(out, vb);
 
-	talloc_free(pattern);
-
 	return XLAT_ACTION_DONE;
 }
 #endif
@@ -2956,52 +2961,52 @@ int xlat_init(void)
 	xlat_register(NULL, "debug", xlat_func_debug, NULL, NULL, 0, XLAT_DEFAULT_BUF_LEN, true);
 	xlat_internal("debug");
 
-	xlat_async_register(NULL, "base64", xlat_func_base64_encode);
-	xlat_async_register(NULL, "base64decode", xlat_func_base64_decode);
-	xlat_async_register(NULL, "bin", xlat_func_bin);
-	xlat_async_register(NULL, "concat", xlat_func_concat);
-	xlat_async_register(NULL, "hex", xlat_func_hex);
-	xlat_async_register(NULL, "hmacmd5", xlat_func_hmac_md5);
-	xlat_async_register(NULL, "hmacsha1", xlat_func_hmac_sha1);
-	xlat_async_register(NULL, "length", xlat_func_length);
-	xlat_async_register(NULL, "md4", xlat_func_md4);
-	xlat_async_register(NULL, "md5", xlat_func_md5);
-	xlat_async_register(NULL, "module", xlat_func_module);
-	xlat_async_register(NULL, "pairs", xlat_func_pairs);
-	xlat_async_register(NULL, "rand", xlat_func_rand);
-	xlat_async_register(NULL, "randstr", xlat_func_randstr);
+	xlat_async_register(NULL, "base64", xlat_func_base64_encode, true);
+	xlat_async_register(NULL, "base64decode", xlat_func_base64_decode, true);
+	xlat_async_register(NULL, "bin", xlat_func_bin, true);
+	xlat_async_register(NULL, "concat", xlat_func_concat, true);
+	xlat_async_register(NULL, "hex", xlat_func_hex, true);
+	xlat_async_register(NULL, "hmacmd5", xlat_func_hmac_md5, true);
+	xlat_async_register(NULL, "hmacsha1", xlat_func_hmac_sha1, true);
+	xlat_async_register(NULL, "length", xlat_func_length, true);
+	xlat_async_register(NULL, "md4", xlat_func_md4, true);
+	xlat_async_register(NULL, "md5", xlat_func_md5, true);
+	xlat_async_register(NULL, "module", xlat_func_module, false);
+	xlat_async_register(NULL, "pairs", xlat_func_pairs, false);
+	xlat_async_register(NULL, "rand", xlat_func_rand, false);
+	xlat_async_register(NULL, "randstr", xlat_func_randstr, false);
 #if defined(HAVE_REGEX_PCRE) || defined(HAVE_REGEX_PCRE2)
-	xlat_async_register(NULL, "regex", xlat_func_regex);
+	xlat_async_register(NULL, "regex", xlat_func_regex, false);
 #endif
-	xlat_async_register(NULL, "sha1", xlat_func_sha1);
+	xlat_async_register(NULL, "sha1", xlat_func_sha1, true);
 
 #ifdef HAVE_OPENSSL_EVP_H
-	xlat_async_register(NULL, "sha2_224", xlat_func_sha2_224);
-	xlat_async_register(NULL, "sha2_256", xlat_func_sha2_256);
-	xlat_async_register(NULL, "sha2_384", xlat_func_sha2_384);
-	xlat_async_register(NULL, "sha2_512", xlat_func_sha2_512);
+	xlat_async_register(NULL, "sha2_224", xlat_func_sha2_224, true);
+	xlat_async_register(NULL, "sha2_256", xlat_func_sha2_256, true);
+	xlat_async_register(NULL, "sha2_384", xlat_func_sha2_384, true);
+	xlat_async_register(NULL, "sha2_512", xlat_func_sha2_512, true);
 
 #  if OPENSSL_VERSION_NUMBER >= 0x10100000L
-	xlat_async_register(NULL, "blake2s_256", xlat_func_blake2s_256);
-	xlat_async_register(NULL, "blake2b_512", xlat_func_blake2b_512);
+	xlat_async_register(NULL, "blake2s_256", xlat_func_blake2s_256, true);
+	xlat_async_register(NULL, "blake2b_512", xlat_func_blake2b_512, true);
 #  endif
 
 #  if OPENSSL_VERSION_NUMBER >= 0x10101000L
-	xlat_async_register(NULL, "sha3_224", xlat_func_sha3_224);
-	xlat_async_register(NULL, "sha3_256", xlat_func_sha3_256);
-	xlat_async_register(NULL, "sha3_384", xlat_func_sha3_384);
-	xlat_async_register(NULL, "sha3_512", xlat_func_sha3_512);
+	xlat_async_register(NULL, "sha3_224", xlat_func_sha3_224, true);
+	xlat_async_register(NULL, "sha3_256", xlat_func_sha3_256, true);
+	xlat_async_register(NULL, "sha3_384", xlat_func_sha3_384, true);
+	xlat_async_register(NULL, "sha3_512", xlat_func_sha3_512, true);
 #  endif
 #endif
 
-	xlat_async_register(NULL, "string", xlat_func_string);
-	xlat_async_register(NULL, "strlen", xlat_func_strlen);
-	xlat_async_register(NULL, "sub", xlat_func_sub);
-	xlat_async_register(NULL, "tag", xlat_func_tag);
-	xlat_async_register(NULL, "tolower", xlat_func_tolower);
-	xlat_async_register(NULL, "toupper", xlat_func_toupper);
-	xlat_async_register(NULL, "urlquote", xlat_func_urlquote);
-	xlat_async_register(NULL, "urlunquote", xlat_func_urlunquote);
+	xlat_async_register(NULL, "string", xlat_func_string, true);
+	xlat_async_register(NULL, "strlen", xlat_func_strlen, true);
+	xlat_async_register(NULL, "sub", xlat_func_sub, false);
+	xlat_async_register(NULL, "tag", xlat_func_tag, false);
+	xlat_async_register(NULL, "tolower", xlat_func_tolower, true);
+	xlat_async_register(NULL, "toupper", xlat_func_toupper, true);
+	xlat_async_register(NULL, "urlquote", xlat_func_urlquote, true);
+	xlat_async_register(NULL, "urlunquote", xlat_func_urlunquote, true);
 
 	return 0;
 }
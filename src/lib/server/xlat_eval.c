@@ -1021,6 +1021,21 @@ xlat_action_t xlat_frame_eval(TALLOC_CTX *ctx, fr_cursor_t *out, xlat_exp_t cons
 			XLAT_DEBUG("** [%i] %s(func) - %%{%s:...}", unlang_interpret_stack_depth(request), __FUNCTION__,
 				   node->fmt);
 
+			/*
+			 *	Pure function with constant arguments,
+			 *	which was called when the xlat was
+			 *	bootstrapped.  Just copy the result.
+			 */
+			if (node->folded) {
+				fr_cursor_t from;
+
+				if (fr_value_box_list_acopy(ctx, &result, node->folded) < 0) goto fail;
+
+				fr_cursor_init(&from, &result);
+				fr_cursor_merge(out, &from);
+				continue;
+			}
+
 			/*
 			 *	Hand back the child node to the caller
 			 *	for evaluation.
@@ -1181,6 +1196,12 @@ static char *xlat_aprint(TALLOC_CTX *ctx, REQUEST *request, xlat_exp_t const * c
 	case XLAT_FUNC:
 		XLAT_DEBUG("xlat_aprint MODULE");
 
+		/*
+		 *	Printed the same way as the result of
+		 *	an async function below.
+		 */
+		if (node->folded) return fr_value_box_list_asprint(ctx, node->folded, NULL, '"');
+
 		/*
 		 *	Temporary hack to use the new API.
 		 *
@@ -1415,7 +1436,7 @@ static size_t xlat_process(TALLOC_CTX *ctx, char **out, REQUEST *request, xlat_e
 		 *	Break here to avoid nodes being evaluated multiple times
 		 *      and parts of strings being duplicated.
 		 */
-		if ((node->type == XLAT_FUNC) && (node->xlat->type == XLAT_FUNC_ASYNC)) {
+		if ((node->type == XLAT_FUNC) && (node->xlat->type == XLAT_FUNC_ASYNC) && !node->folded) {
 			i++;
 			break;
 		}
@@ -1634,6 +1655,185 @@ int xlat_eval_pair(REQUEST *request, VALUE_PAIR *vp)
 	return 0;
 }
 
+/** Print an expansion which is the same for every request
+ *
+ * i.e. one which consists entirely of literals, and pure functions
+ * which were called when the expansion was bootstrapped.
+ *
+ * @param[in] ctx	to allocate the string in.
+ * @param[in] head	of the xlat list.
+ * @return
+ *	- The expanded string, as #xlat_aeval_compiled would produce.
+ *	- NULL if the expansion depends on the request, or contains
+ *	  values which would be escaped when printed.
+ */
+char *xlat_constant_aprint(TALLOC_CTX *ctx, xlat_exp_t const *head)
+{
+	xlat_exp_t const	*node;
+	char			*out;
+
+	MEM(out = talloc_zero_array(ctx, char, 1));
+
+	for (node = head; node; node = node->next) {
+		char *str;
+
+		switch (node->type) {
+		case XLAT_LITERAL:
+			MEM(out = talloc_strdup_append_buffer(out, node->fmt));
+			continue;
+
+		case XLAT_FUNC:
+		{
+			char *escaped;
+			bool same;
+
+			if (!node->folded) break;
+
+			/*
+			 *	The caller uses the result as the raw
+			 *	value of a string, but function results
+			 *	are escaped when they're printed by
+			 *	xlat_aprint().  Only fold values which
+			 *	come out the same either way.
+			 */
+			str = fr_value_box_list_asprint(NULL, node->folded, NULL, '\0');
+			if (!str) break;
+
+			escaped = fr_value_box_list_asprint(NULL, node->folded, NULL, '"');
+			same = escaped && (strlen(str) == (talloc_array_length(str) - 1)) && (strcmp(str, escaped) == 0);
+			talloc_free(escaped);
+			if (!same) {
+				talloc_free(str);
+				break;
+			}
+
+			MEM(out = talloc_strdup_append_buffer(out, str));
+			talloc_free(str);
+		}
+			continue;
+
+		default:
+			break;
+		}
+
+		talloc_free(out);
+		return NULL;
+	}
+
+	return out;
+}
+
+/** Call a pure function whose arguments are all constant
+ *
+ * Arguments are built exactly as #xlat_frame_eval would build them,
+ * and the result is stored in the node.  Any failure just means the
+ * function will be called at run time as usual.
+ *
+ * @param[in,out] request	Allocated on first use.  Used only for
+ *				logging, which is disabled.
+ * @param[in] node		to fold.
+ */
+static void xlat_eval_fold_func(REQUEST **request, xlat_exp_t *node)
+{
+	TALLOC_CTX		*pool;
+	xlat_exp_t const	*child;
+	fr_value_box_t		*args = NULL, *result = NULL, *value;
+	fr_cursor_t		cursor;
+	xlat_action_t		xa;
+
+	if ((node->xlat->type != XLAT_FUNC_ASYNC) || !node->xlat->pure ||
+	    node->xlat->instantiate || node->xlat->thread_instantiate) return;
+
+	if (!*request) {
+		*request = request_local_alloc(NULL);
+		TALLOC_FREE((*request)->log.dst);
+	}
+
+	MEM(pool = talloc_pool(NULL, 1024));
+
+	fr_cursor_init(&cursor, &args);
+	for (child = node->child; child; child = child->next) {
+		switch (child->type) {
+		case XLAT_LITERAL:
+			MEM(value = fr_value_box_alloc_null(pool));
+			fr_value_box_strdup_buffer(value, value, NULL, child->fmt, false);
+			fr_cursor_append(&cursor, value);
+			continue;
+
+		case XLAT_FUNC:
+		{
+			fr_value_box_t	*copy = NULL;
+			fr_cursor_t	from;
+
+			if (!child->folded || (fr_value_box_list_acopy(pool, &copy, child->folded) < 0)) break;
+
+			fr_cursor_tail(&cursor);
+			fr_cursor_init(&from, &copy);
+			fr_cursor_merge(&cursor, &from);
+		}
+			continue;
+
+		default:
+			break;
+		}
+
+		talloc_free(pool);
+		return;
+	}
+
+	fr_cursor_init(&cursor, &result);
+	xa = node->xlat->func.async(pool, &cursor, *request, NULL, NULL, &args);
+
+	/*
+	 *	An empty result is left alone, so that NULL
+	 *	always means the node hasn't been folded.
+	 */
+	if ((xa == XLAT_ACTION_DONE) && result &&
+	    (fr_value_box_list_acopy(node, &node->folded, result) == 0)) {
+		DEBUG3("Folded xlat \"%s\" node %p to %pM", node->xlat->name, node, node->folded);
+	}
+
+	talloc_free(pool);
+}
+
+static void xlat_eval_fold_walk(REQUEST **request, xlat_exp_t *head)
+{
+	xlat_exp_t *node;
+
+	for (node = head; node; node = node->next) {
+		switch (node->type) {
+		case XLAT_FUNC:
+			xlat_eval_fold_walk(request, node->child);
+			xlat_eval_fold_func(request, node);
+			break;
+
+		case XLAT_ALTERNATE:
+			xlat_eval_fold_walk(request, node->child);
+			xlat_eval_fold_walk(request, node->alternate);
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+/** Call pure functions which only have constant arguments
+ *
+ * Works from the innermost expansions outwards, so that the result of
+ * one call can be the argument of another.  Calls which fail, yield,
+ * or return nothing are left to be evaluated at run time.
+ *
+ * @param[in] head	of the xlat list to fold.
+ */
+void xlat_eval_fold(xlat_exp_t *head)
+{
+	REQUEST *request = NULL;
+
+	xlat_eval_fold_walk(&request, head);
+	talloc_free(request);
+}
+
 /** Walk over all xlat nodes (depth first) in a xlat expansion, calling a callback
  *
  * @param[in] exp	to evaluate.
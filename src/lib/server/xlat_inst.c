@@ -36,9 +36,19 @@ RCSID("$Id$")
  */
 static rbtree_t *xlat_inst_tree;
 
+/** Number of "permanent" xlat instances created so far
+ *
+ * Used to give each instance a unique index into the thread specific
+ * instance array.  Numbers are never reused.
+ */
+static unsigned int xlat_inst_num;
+
 /** Holds thread specific instance data created by xlat_instantiate
+ *
+ * Indexed by #xlat_inst_t number, so finding the thread instance
+ * for a node is a single array lookup.
  */
-static _Thread_local rbtree_t *xlat_thread_inst_tree;
+static _Thread_local xlat_thread_inst_t **xlat_thread_inst_array;
 
 /** Compare two xlat instances based on node pointer
  *
@@ -56,22 +66,6 @@ static int _xlat_inst_cmp(void const *a, void const *b)
 	return (my_a->node > my_b->node) - (my_a->node < my_b->node);
 }
 
-/** Compare two thread instances based on node pointer
- *
- * @param[in] a		First thread specific xlat expansion instance.
- * @param[in] b		Second thread specific xlat expansion instance.
- * @return
- *	- +1 if a > b.
- *	- -1 if a < b.
- *	- 0 if a == b.
- */
-static int _xlat_thread_inst_cmp(void const *a, void const *b)
-{
-	xlat_thread_inst_t const *my_a = a, *my_b = b;
-
-	return (my_a->node > my_b->node) - (my_a->node < my_b->node);
-}
-
 /** Destructor for xlat_thread_inst_t
  *
  * Calls thread_detach method if provided by xlat expansion
@@ -91,16 +85,27 @@ static int _xlat_thread_inst_detach(xlat_thread_inst_t *thread_inst)
 	return 0;
 }
 
-/** Destructor for xlat_thread_inst_tree elements
+/** Destructor for xlat_thread_inst_array
  *
  */
-static void _xlat_thread_inst_free(void *to_free)
+static int _xlat_thread_inst_array_free(xlat_thread_inst_t **array)
 {
-	xlat_thread_inst_t *thread_inst = talloc_get_type_abort(to_free, xlat_thread_inst_t);
+	size_t i, len;
+
+	len = talloc_array_length(array);
+	for (i = 0; i < len; i++) {
+		xlat_thread_inst_t *thread_inst;
 
-	DEBUG4("Worker cleaning up xlat thread instance (%p/%p)", thread_inst, thread_inst->data);
+		if (!array[i]) continue;
 
-	talloc_free(thread_inst);
+		thread_inst = talloc_get_type_abort(array[i], xlat_thread_inst_t);
+
+		DEBUG4("Worker cleaning up xlat thread instance (%p/%p)", thread_inst, thread_inst->data);
+
+		talloc_free(thread_inst);
+	}
+
+	return 0;
 }
 
 /** Create thread instances where needed
@@ -109,7 +114,7 @@ static void _xlat_thread_inst_free(void *to_free)
  * @param[in] inst	to allocate thread-instance data for.
  * @return
  *	- 0 on success.  The node/thread specific data will be inserted
- *	  into xlat_thread_inst_tree.
+ *	  into xlat_thread_inst_array.
  *	- -1 on failure.
  */
 static xlat_thread_inst_t *xlat_thread_inst_alloc(TALLOC_CTX *ctx, xlat_inst_t *inst)
@@ -288,10 +293,18 @@ int xlat_instantiate_ephemeral(xlat_exp_t *root)
  */
 static int _xlat_thread_instantiate(void *data, void *uctx)
 {
+	xlat_thread_inst_t	**array = uctx;
 	xlat_thread_inst_t	*thread_inst;
 	xlat_inst_t		*inst = talloc_get_type_abort(data, xlat_inst_t);
 
-	thread_inst = xlat_thread_inst_alloc(uctx, data);
+	rad_assert(inst->number < talloc_array_length(array));
+
+	/*
+	 *	Already have a thread instance for this node.
+	 */
+	if (array[inst->number]) return 0;
+
+	thread_inst = xlat_thread_inst_alloc(array, data);
 	if (!thread_inst) return -1;
 
 	DEBUG3("Instantiating xlat \"%s\" node %p, instance %p, new thread instance %p",
@@ -308,7 +321,7 @@ static int _xlat_thread_instantiate(void *data, void *uctx)
 		}
 	}
 
-	rbtree_insert(xlat_thread_inst_tree, thread_inst);
+	array[inst->number] = thread_inst;
 
 	return 0;
 }
@@ -322,20 +335,18 @@ static int _xlat_thread_instantiate(void *data, void *uctx)
  */
 xlat_thread_inst_t *xlat_thread_instance_find(xlat_exp_t const *node)
 {
-	xlat_thread_inst_t	*found;
-
-	rad_assert(xlat_thread_inst_tree);
+	rad_assert(xlat_thread_inst_array);
 	rad_assert(node->type == XLAT_FUNC);
 
 	if (node->ephemeral) return node->thread_inst;
 
-	found = rbtree_finddata(xlat_thread_inst_tree, &(xlat_thread_inst_t){ .node = node });
-	rad_assert(found);
+	rad_assert(node->inst->number < talloc_array_length(xlat_thread_inst_array));
+	rad_assert(xlat_thread_inst_array[node->inst->number]);
 
-	return found;
+	return xlat_thread_inst_array[node->inst->number];
 }
 
-/** Create thread specific instance tree and create thread instances
+/** Create thread specific instance array and create thread instances
  *
  * This should be called directly after the modules_thread_instantiate() function.
  *
@@ -353,17 +364,17 @@ int xlat_thread_instantiate(TALLOC_CTX *ctx)
 
 	if (!xlat_inst_tree) return 0;
 
-	if (!xlat_thread_inst_tree) {
-		MEM(xlat_thread_inst_tree = rbtree_talloc_create(ctx, _xlat_thread_inst_cmp,
-								 xlat_thread_inst_t, _xlat_thread_inst_free, 0));
+	if (!xlat_thread_inst_array) {
+		MEM(xlat_thread_inst_array = talloc_zero_array(ctx, xlat_thread_inst_t *, xlat_inst_num));
+		talloc_set_destructor(xlat_thread_inst_array, _xlat_thread_inst_array_free);
 	}
 
 	/*
 	 *	Walk the inst tree, creating thread specific instances.
 	 */
-	ret = rbtree_walk(xlat_inst_tree, RBTREE_PRE_ORDER, _xlat_thread_instantiate, xlat_thread_inst_tree);
+	ret = rbtree_walk(xlat_inst_tree, RBTREE_PRE_ORDER, _xlat_thread_instantiate, xlat_thread_inst_array);
 	if (ret < 0) {
-		TALLOC_FREE(xlat_thread_inst_tree);
+		TALLOC_FREE(xlat_thread_inst_array);
 		return -1;
 	}
 
@@ -429,8 +440,15 @@ static int _xlat_bootstrap_walker(xlat_exp_t *node, UNUSED void *uctx)
 	rad_assert(node->type == XLAT_FUNC);
 	rad_assert(!node->inst && !node->thread_inst);
 
+	/*
+	 *	Never called at run time, so doesn't
+	 *	need any instance data.
+	 */
+	if (node->folded) return 0;
+
 	node->inst = xlat_inst_alloc(node);
 	if (!node->inst) return -1;
+	node->inst->number = xlat_inst_num++;
 
 	DEBUG3("Instantiating xlat \"%s\" node %p, new instance %p", node->xlat->name, node, node->inst);
 
@@ -457,10 +475,16 @@ int xlat_bootstrap(xlat_exp_t *root)
 	 *	If thread instantiate has been called, it's too late to
 	 *	bootstrap new xlats.
 	 */
-	rad_assert(!xlat_thread_inst_tree);
+	rad_assert(!xlat_thread_inst_array);
 
 	if (!xlat_inst_tree) xlat_instantiate_init();
 
+	/*
+	 *	Call pure functions with constant arguments
+	 *	now, instead of for every request.
+	 */
+	xlat_eval_fold(root);
+
 	return xlat_eval_walk(root, _xlat_bootstrap_walker, XLAT_FUNC, NULL);
 }
 
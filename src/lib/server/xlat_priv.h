@@ -71,6 +71,9 @@ typedef struct xlat_s {
 	void			*thread_uctx;			//!< uctx to pass to instantiation functions.
 
 	bool			async_safe;			//!< If true, is async safe
+	bool			pure;				//!< Has no side effects, and the output depends
+								///< only on the input, so calls with constant
+								///< arguments can be evaluated at startup.
 
 	size_t			buf_len;			//!< Length of output buffer to pre-allocate.
 	void			*mod_inst;			//!< Module instance passed to xlat
@@ -123,6 +126,9 @@ struct xlat_exp {
 		xlat_inst_t		*inst;		//!< Instance data for the #xlat_t.
 		xlat_thread_inst_t	*thread_inst;	//!< Thread specific instance.
 							///< ONLY USED FOR EPHEMERAL XLATS.
+		fr_value_box_t		*folded;	//!< Result of calling a pure function with constant
+							///< arguments.  Evaluated once, when the xlat is
+							///< bootstrapped.
 	};
 };
 
@@ -166,6 +172,8 @@ xlat_action_t	xlat_frame_eval(TALLOC_CTX *ctx, fr_cursor_t *out, xlat_exp_t cons
 
 int		xlat_eval_walk(xlat_exp_t *exp, xlat_walker_t walker, xlat_type_t type, void *uctx);
 
+void		xlat_eval_fold(xlat_exp_t *head);
+
 int		xlat_eval_init(void);
 
 void		xlat_eval_free(void);
@@ -985,3 +985,124 @@ ssize_t xlat_tokenize(TALLOC_CTX *ctx, xlat_exp_t **head, char *fmt, vp_tmpl_rul
 	return ret;
 }
 
+/** Tokenize an expansion from a module's configuration
+ *
+ * Modules should call this from their instantiate callback, so that
+ * expansions in their configuration are parsed once, instead of once
+ * per request.  The result is evaluated with #xlat_eval_compiled or
+ * #xlat_aeval_compiled.
+ *
+ * @param[in] ctx	to allocate the xlat tree in.  Usually the module instance.
+ * @param[out] head	Where to write the xlat tree.  Will be NULL if fmt is NULL.
+ * @param[in] ci	The expansion came from.  Used for error messages.
+ * @param[in] fmt	to tokenize.  May be NULL.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int xlat_tokenize_conf(TALLOC_CTX *ctx, xlat_exp_t **head, CONF_ITEM const *ci, char const *fmt)
+{
+	ssize_t	slen;
+	char	*tokens;
+
+	*head = NULL;
+
+	if (!fmt) return 0;
+
+	MEM(tokens = talloc_typed_strdup(ctx, fmt));	/* modified by xlat_tokenize */
+
+	slen = xlat_tokenize(ctx, head, tokens, NULL);
+	if (slen < 0) {
+		char *spaces, *text;
+
+		fr_canonicalize_error(ctx, &spaces, &text, slen, fmt);
+
+		cf_log_err(ci, "Failed parsing expansion string:");
+		cf_log_err(ci, "%s", text);
+		cf_log_err(ci, "%s^ %s", spaces, fr_strerror());
+
+		talloc_free(spaces);
+		talloc_free(text);
+		talloc_free(tokens);
+
+		return -1;
+	}
+
+	/*
+	 *	Zero length expansion.  The compiled evaluation
+	 *	functions need a node, so give them an empty literal.
+	 */
+	if (!*head) *head = xlat_exp_alloc(ctx, XLAT_LITERAL, "", 0);
+
+	(void) talloc_steal(*head, tokens);
+
+	return 0;
+}
+
+/** Tokenize the values of all the pairs in a section, and its subsections
+ *
+ * For modules which pick a configuration item to expand at run time, such
+ * as the SQL queries selected with a "reference".  The xlat trees are
+ * attached to the pairs, and retrieved with #xlat_from_conf_pair.
+ *
+ * @param[in] cs		to tokenize the pairs of.
+ * @param[in] quoted_only	Only tokenize double quoted and back quoted values.
+ *				For modules which treat other values as literals.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int xlat_tokenize_conf_section(CONF_SECTION *cs, bool quoted_only)
+{
+	CONF_ITEM *ci;
+
+	for (ci = cf_item_next(cs, NULL);
+	     ci != NULL;
+	     ci = cf_item_next(cs, ci)) {
+		CONF_PAIR	*cp;
+		xlat_exp_t	*head;
+
+		if (cf_item_is_section(ci)) {
+			if (xlat_tokenize_conf_section(cf_item_to_section(ci), quoted_only) < 0) return -1;
+			continue;
+		}
+
+		if (!cf_item_is_pair(ci)) continue;
+
+		cp = cf_item_to_pair(ci);
+		if (!cf_pair_value(cp) || cf_data_find(cp, xlat_exp_t, NULL)) continue;
+
+		if (quoted_only) switch (cf_pair_value_quote(cp)) {
+		case T_DOUBLE_QUOTED_STRING:
+		case T_BACK_QUOTED_STRING:
+			break;
+
+		default:
+			continue;
+		}
+
+		if (xlat_tokenize_conf(cp, &head, ci, cf_pair_value(cp)) < 0) return -1;
+
+		cf_data_add(cp, head, NULL, false);
+	}
+
+	return 0;
+}
+
+/** Return the xlat tree for a pair tokenized by #xlat_tokenize_conf_section
+ *
+ * @param[in] cp	to get the xlat tree for.
+ * @return
+ *	- The xlat tree.
+ *	- NULL if the pair hasn't been tokenized.
+ */
+xlat_exp_t const *xlat_from_conf_pair(CONF_PAIR const *cp)
+{
+	CONF_DATA const *cd;
+
+	cd = cf_data_find(cp, xlat_exp_t, NULL);
+	if (!cd) return NULL;
+
+	return cf_data_value(cd);
+}
+
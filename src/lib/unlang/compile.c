@@ -754,6 +754,105 @@ static bool pass2_fixup_map(fr_cond_t *c, vp_tmpl_rules_t const *rules)
 	return true;
 }
 
+/** Replace an expansion which is the same for every request with the string it expands to
+ *
+ * @return
+ *	- true if the template is now #TMPL_TYPE_UNPARSED.
+ *	- false if it still depends on the request.
+ */
+static bool pass2_constant_tmpl(TALLOC_CTX *ctx, vp_tmpl_t **pvpt)
+{
+	vp_tmpl_t	*vpt = *pvpt;
+	char		*str;
+
+	if (tmpl_is_unparsed(vpt)) return true;
+	if (!tmpl_is_xlat_struct(vpt)) return false;
+
+	str = xlat_constant_aprint(NULL, vpt->tmpl_xlat);
+	if (!str) return false;
+
+	MEM(*pvpt = tmpl_alloc(ctx, TMPL_TYPE_UNPARSED, str, talloc_array_length(str) - 1, T_DOUBLE_QUOTED_STRING));
+	talloc_free(str);
+	talloc_free(vpt);
+
+	return true;
+}
+
+/** Evaluate conditions which are the same for every request
+ *
+ * Expansions are only tokenized in pass2, and calls to pure xlat
+ * functions with constant arguments are evaluated as they're
+ * tokenized.  This may leave conditions which no longer depend on
+ * the request.  Those become true or false, as cond_tokenize() does
+ * for conditions on literals, so that compile_if() can skip them.
+ */
+static void pass2_cond_constant(fr_cond_t *c)
+{
+	int rcode;
+
+	switch (c->type) {
+	case COND_TYPE_EXISTS:
+	{
+		char *str;
+
+		if (!tmpl_is_xlat_struct(c->data.vpt)) return;
+
+		str = xlat_constant_aprint(NULL, c->data.vpt->tmpl_xlat);
+		if (!str) return;
+
+		/*
+		 *	Same as cond_eval_tmpl() for expansions.
+		 */
+		rcode = (*str != '\0');
+		talloc_free(str);
+		TALLOC_FREE(c->data.vpt);
+	}
+		break;
+
+	case COND_TYPE_MAP:
+	{
+		vp_map_t	*map = c->data.map;
+		REQUEST		*request;
+
+		if (c->cast || (c->pass2_fixup != PASS2_FIXUP_NONE) ||
+		    (map->op == T_OP_REG_EQ) || (map->op == T_OP_REG_NE)) return;
+
+		if (!tmpl_is_xlat_struct(map->lhs) && !tmpl_is_xlat_struct(map->rhs)) return;
+
+		/*
+		 *	cond_eval_map() treats an expansion exactly
+		 *	like the string it expands to, so it's fine
+		 *	if only one side is converted.
+		 */
+		if (!pass2_constant_tmpl(map, &map->lhs) || !pass2_constant_tmpl(map, &map->rhs)) return;
+
+		/*
+		 *	cond_eval_map() logs through the request when
+		 *	an operand can't be cast, e.g. a negative
+		 *	number compared as uint64.  So give it one
+		 *	which logs nowhere, as xlat_eval_fold() does.
+		 *	Anything which fails is left for run time.
+		 */
+		request = request_local_alloc(NULL);
+		TALLOC_FREE(request->log.dst);
+
+		rcode = cond_eval_map(request, 0, 0, c);
+		talloc_free(request);
+		if (rcode < 0) return;
+
+		TALLOC_FREE(c->data.map);
+	}
+		break;
+
+	default:
+		return;
+	}
+
+	if (c->negate) rcode = !rcode;
+	c->negate = false;
+	c->type = rcode ? COND_TYPE_TRUE : COND_TYPE_FALSE;
+}
+
 static bool pass2_cond_callback(fr_cond_t *c, void *uctx)
 {
 	unlang_compile_t	*unlang_ctx = uctx;
@@ -777,13 +876,19 @@ static bool pass2_cond_callback(fr_cond_t *c, void *uctx)
 	 */
 	case COND_TYPE_EXISTS:
 		rad_assert(!tmpl_is_regex(c->data.vpt));
-		return pass2_fixup_tmpl(c->ci, &c->data.vpt, unlang_ctx->rules, true);
+		if (!pass2_fixup_tmpl(c->ci, &c->data.vpt, unlang_ctx->rules, true)) return false;
+
+		pass2_cond_constant(c);
+		return true;
 
 	/*
 	 *	Fixup the map
 	 */
 	case COND_TYPE_MAP:
-		return pass2_fixup_map(c, unlang_ctx->rules);
+		if (!pass2_fixup_map(c, unlang_ctx->rules)) return false;
+
+		pass2_cond_constant(c);
+		return true;
 
 	/*
 	 *	Nothing else has pass2 fixups
@@ -2103,6 +2208,138 @@ static unlang_t *compile_group(unlang_t *parent, unlang_compile_t *unlang_ctx, C
 	return compile_section(parent, unlang_ctx, cs, UNLANG_TYPE_GROUP);
 }
 
+static uint32_t switch_case_hash(void const *data)
+{
+	fr_value_box_t const *vb = ((unlang_switch_case_t const *)data)->value;
+
+	switch (vb->type) {
+	case FR_TYPE_STRING:
+	case FR_TYPE_OCTETS:
+		return fr_hash_fast(vb->vb_octets, vb->datum.length);
+
+	default:
+		return fr_hash_fast(((uint8_t const *)vb) + fr_value_box_offsets[vb->type],
+				    fr_value_box_field_sizes[vb->type]);
+	}
+}
+
+static int switch_case_cmp(void const *one, void const *two)
+{
+	unlang_switch_case_t const *a = one, *b = two;
+
+	return fr_value_box_cmp(a->value, b->value);
+}
+
+/** Whether values of this type are equal only if their data is identical
+ *
+ */
+static bool switch_type_hashable(fr_type_t type)
+{
+	switch (type) {
+	case FR_TYPE_STRING:
+	case FR_TYPE_OCTETS:
+	case FR_TYPE_BOOL:
+	case FR_TYPE_UINT8:
+	case FR_TYPE_UINT16:
+	case FR_TYPE_UINT32:
+	case FR_TYPE_UINT64:
+	case FR_TYPE_INT8:
+	case FR_TYPE_INT16:
+	case FR_TYPE_INT32:
+	case FR_TYPE_INT64:
+	case FR_TYPE_SIZE:
+	case FR_TYPE_DATE:
+	case FR_TYPE_IFID:
+	case FR_TYPE_ETHERNET:
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+/** Build a hash table of the 'case' statements of a 'switch'
+ *
+ * This is only possible if every 'case' is a static value, and the
+ * values can be compared without casting.  Otherwise the 'case'
+ * statements are checked one by one at run time.
+ *
+ * @param[in] g		The 'switch' to build the hash table for.
+ * @return
+ *	- 0 on success, or if the 'switch' can't be hashed.
+ *	- -1 on failure.
+ */
+static int compile_switch_cases(unlang_group_t *g)
+{
+	fr_hash_table_t		*ht;
+	unlang_t		*this, *default_case = NULL;
+	unsigned int		position = 0;
+
+	if (tmpl_is_attr(g->vpt)) {
+		if (!switch_type_hashable(g->vpt->tmpl_da->type)) return 0;
+
+	} else if (!tmpl_is_xlat_struct(g->vpt) && !tmpl_is_xlat(g->vpt) && !tmpl_is_exec(g->vpt)) {
+		return 0;
+	}
+
+	ht = fr_hash_table_create(g, switch_case_hash, switch_case_cmp, NULL);
+	if (!ht) return -1;
+
+	for (this = g->children; this; this = this->next, position++) {
+		unlang_group_t		*h = unlang_generic_to_group(this);
+		unlang_switch_case_t	*sc;
+
+		rad_assert(this->type == UNLANG_TYPE_CASE);
+
+		if (!h->vpt) {
+			if (!default_case) default_case = this;
+			continue;
+		}
+
+		MEM(sc = talloc_zero(ht, unlang_switch_case_t));
+		sc->instruction = this;
+		sc->position = position;
+
+		/*
+		 *	The 'case' has already been cast to the type
+		 *	of the attribute.
+		 */
+		if (tmpl_is_attr(g->vpt)) {
+			if (!tmpl_is_data(h->vpt) || (h->vpt->tmpl_value_type != g->vpt->tmpl_da->type)) goto dynamic;
+
+			sc->value = &h->vpt->tmpl_value;
+
+		/*
+		 *	The expansion is compared as a string, unless
+		 *	it and the 'case' both look like numbers.
+		 */
+		} else {
+			fr_value_box_t *vb;
+
+			if (!tmpl_is_unparsed(h->vpt) || cond_all_digits(h->vpt->name)) goto dynamic;
+
+			MEM(vb = talloc_zero(sc, fr_value_box_t));
+			fr_value_box_bstrndup_shallow(vb, NULL, h->vpt->name, h->vpt->len, false);
+			sc->value = vb;
+		}
+
+		/*
+		 *	Duplicate values can never match, as the
+		 *	first one always wins.
+		 */
+		if (!fr_hash_table_insert(ht, sc)) talloc_free(sc);
+	}
+
+	g->cases = ht;
+	g->default_case = default_case;
+
+	return 0;
+
+dynamic:
+	talloc_free(ht);
+	return 0;
+}
+
 static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx, CONF_SECTION *cs)
 {
 	CONF_ITEM *ci;
@@ -2212,7 +2449,20 @@ static unlang_t *compile_switch(unlang_t *parent, unlang_compile_t *unlang_ctx,
 		return NULL;
 	}
 
-	return compile_children(g, parent, unlang_ctx);
+	c = compile_children(g, parent, unlang_ctx);
+	if (!c) return NULL;
+
+	/*
+	 *	Now that the 'case' statements have been compiled,
+	 *	see if we can find the right one with a hash lookup.
+	 */
+	if (compile_switch_cases(g) < 0) {
+		cf_log_err(cs, "Failed building hash table for 'switch'");
+		talloc_free(g);
+		return NULL;
+	}
+
+	return c;
 }
 
 static unlang_t *compile_case(unlang_t *parent, unlang_compile_t *unlang_ctx, CONF_SECTION *cs)
@@ -2554,6 +2804,18 @@ static unlang_t *compile_if_subsection(unlang_t *parent, unlang_compile_t *unlan
 	 */
 	if (!fr_cond_walk(cond, pass2_cond_callback, unlang_ctx)) return NULL;
 
+	/*
+	 *	The fixups may have found that the condition
+	 *	doesn't depend on the request.  Unlike
+	 *	cond_tokenize(), they don't remove the rest
+	 *	of the && or || list.
+	 */
+	if ((cond->type == COND_TYPE_FALSE) && (cond->next_op == COND_NONE)) {
+		cf_log_debug_prefix(cs, "Skipping contents of '%s' as it is always 'false'",
+				    unlang_ops[mod_type].name);
+		return compile_empty(parent, unlang_ctx, cs, mod_type, COND_TYPE_FALSE);
+	}
+
 	c = compile_section(parent, unlang_ctx, cs, mod_type);
 	if (!c) return NULL;
 
@@ -2578,7 +2840,7 @@ static int previous_if(CONF_SECTION *cs, unlang_t *parent, unlang_type_t mod_typ
 		return -1;
 	}
 
-	if (f->cond->type == COND_TYPE_TRUE) {
+	if ((f->cond->type == COND_TYPE_TRUE) && (f->cond->next_op == COND_NONE)) {
 		cf_log_debug_prefix(cs, "Skipping contents of '%s' as previous '%s' is always 'true'",
 				    unlang_ops[mod_type].name,
 				    unlang_ops[f->self.type].name);
@@ -28,6 +28,44 @@ RCSID("$Id$")
 #include "unlang_priv.h"
 #include "group_priv.h"
 
+/** Find the 'case' matching the subject of a hashed 'switch'
+ *
+ * If we're switching over an attribute with multiple instances, the
+ * first 'case' which matches any of them wins, as it would if we
+ * checked the 'case' statements one by one.
+ *
+ * @param[in] request	The current request.
+ * @param[in] g		The 'switch'.
+ * @param[in] data	The expanded subject, if it's not an attribute.
+ * @return
+ *	- The matching 'case' statement.
+ *	- NULL if no 'case' matches.
+ */
+static unlang_t *switch_find_case(REQUEST *request, unlang_group_t *g, fr_value_box_t const *data)
+{
+	unlang_switch_case_t	my_case, *sc, *found = NULL;
+	VALUE_PAIR		*vp;
+	fr_cursor_t		cursor;
+
+	if (!tmpl_is_attr(g->vpt)) {
+		my_case.value = data;
+		found = fr_hash_table_finddata(g->cases, &my_case);
+
+		return found ? found->instruction : NULL;
+	}
+
+	for (vp = tmpl_cursor_init(NULL, &cursor, request, g->vpt);
+	     vp;
+	     vp = fr_cursor_next(&cursor)) {
+		my_case.value = &vp->data;
+
+		sc = fr_hash_table_finddata(g->cases, &my_case);
+		if (sc && (!found || (sc->position < found->position))) found = sc;
+	}
+
+	return found ? found->instruction : NULL;
+}
+
 static unlang_action_t unlang_switch(REQUEST *request, UNUSED rlm_rcode_t *presult)
 {
 	unlang_stack_t		*stack = request->stack;
@@ -88,10 +126,20 @@ static unlang_action_t unlang_switch(REQUEST *request, UNUSED rlm_rcode_t *presu
 
 		len = tmpl_aexpand(request, &p, request, g->vpt, NULL, NULL);
 		if (len < 0) goto find_null_case;
-		data.vb_strvalue = p;
+		fr_value_box_bstrndup_shallow(&data, NULL, p, len, false);
 		tmpl_init(&vpt, TMPL_TYPE_UNPARSED, data.vb_strvalue, len, T_SINGLE_QUOTED_STRING);
 	}
 
+	/*
+	 *	All the 'case' statements are static values, so we
+	 *	can find the right one with a hash lookup.
+	 */
+	if (g->cases) {
+		found = switch_find_case(request, g, &data);
+		if (!found) found = g->default_case;
+		goto do_null_case;
+	}
+
 	/*
 	 *	Find either the exact matching name, or the
 	 *	"case {...}" statement.
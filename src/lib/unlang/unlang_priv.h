@@ -32,6 +32,7 @@
 #include <freeradius-devel/server/rad_assert.h>
 #include <freeradius-devel/unlang/base.h>
 #include <freeradius-devel/io/listen.h>
+#include <freeradius-devel/util/hash.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -156,6 +157,11 @@ typedef struct {
 					fr_dict_attr_t const	*attr_packet_type;
 					fr_dict_enum_t const	*type_enum;
 				};
+				struct {
+					fr_hash_table_t		*cases;		//!< #UNLANG_TYPE_SWITCH, when all the
+										//!< 'case' statements are static values.
+					unlang_t		*default_case;	//!< #UNLANG_TYPE_SWITCH
+				};
 			};
 		};
 		fr_cond_t		*cond;		//!< #UNLANG_TYPE_IF, #UNLANG_TYPE_ELSIF.
@@ -167,6 +173,15 @@ typedef struct {
 	};
 } unlang_group_t;
 
+/** A 'case' statement in a hashed 'switch'
+ *
+ */
+typedef struct {
+	fr_value_box_t const	*value;		//!< To match against the 'switch' subject.
+	unlang_t		*instruction;	//!< The 'case' statement.
+	unsigned int		position;	//!< Of the 'case' statement in the 'switch'.
+} unlang_switch_case_t;
+
 /** A naked xlat
  *
  * @note These are vestigial and may be removed in future.
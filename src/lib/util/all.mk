@@ -38,6 +38,7 @@ SOURCES		:= \
 		   packet.c \
 		   pair_cursor.c \
 		   pair.c \
+		   pair_index.c \
 		   pcap.c \
 		   print.c \
 		   proto.c \
@@ -59,7 +60,9 @@ SOURCES		:= \
 		   time.c \
 		   timeval.c \
 		   trie.c \
+		   trie_rcu.c \
 		   udp.c \
+		   udp_uring.c \
 		   udpfromto.c \
 		   value.c \
 		   version.c
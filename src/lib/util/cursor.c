@@ -308,13 +308,17 @@ void CC_HINT(hot) fr_cursor_append(fr_cursor_t *cursor, void *v)
 	 */
 	if (!*(cursor->head)) {
 		*cursor->head = v;
+		cursor->tail = v;				/* Don't re-walk the list on the next append */
 		*NEXT_PTR(v) = NULL;				/* Only insert one at a time */
 
 		return;
 	}
 
 	/*
-	 *	Wind to the end (not updating current)
+	 *	Wind to the end (not updating current).
+	 *
+	 *	This starts from the cached tail, so a run of
+	 *	appends only ever walks each item once.
 	 */
 	cursor->tail = cursor_tail(NULL, cursor, cursor->tail);
 
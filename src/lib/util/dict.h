@@ -41,6 +41,7 @@ extern "C" {
  */
 typedef struct dict_attr fr_dict_attr_t;
 typedef struct fr_dict fr_dict_t;
+typedef struct fr_dict_child_index_s fr_dict_child_index_t;
 
 #include <freeradius-devel/util/value.h>
 
@@ -113,6 +114,8 @@ struct dict_attr {
 		struct {
 			fr_dict_attr_t const	*vendor;	//!< ancestor which has type FR_TYPE_VENDOR
 			fr_dict_attr_t const	**children;	//!< Children of this attribute.
+			fr_dict_child_index_t const *child_index;	//!< Direct lookup table for children, built
+								///< once the dictionary has been loaded.
 		};
 		struct {
 			fr_dict_t const		*dict;		//!< child dictionary
@@ -172,6 +172,8 @@ fr_dict_attr_t		*dict_attr_alloc(TALLOC_CTX *ctx,
 
 int			dict_attr_child_add(fr_dict_attr_t *parent, fr_dict_attr_t *child);
 
+int			dict_attr_child_index_build_all(fr_dict_attr_t const *da);
+
 int			dict_protocol_add(fr_dict_t *dict);
 
 int			dict_vendor_add(fr_dict_t *dict, char const *name, unsigned int num);
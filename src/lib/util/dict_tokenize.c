@@ -1595,6 +1595,15 @@ static int fr_dict_finalise(dict_tokenize_ctx_t *ctx)
 	fr_hash_table_fill(ctx->dict->values_by_da);
 	fr_hash_table_fill(ctx->dict->values_by_name);
 
+	/*
+	 *	Now that all the attributes are known, build the
+	 *	tables used to look up children by number.
+	 */
+	if (dict_attr_child_index_build_all(ctx->dict->root) < 0) {
+		fr_strerror_printf("Out of memory");
+		return -1;
+	}
+
 	ctx->value_attr = NULL;
 	ctx->relative_attr = NULL;
 
@@ -126,14 +126,6 @@ bool const fr_dict_non_data_types[FR_TYPE_MAX + 1] = {
 	[FR_TYPE_VENDOR] = true
 };
 
-/*
- *	Create the hash of the name.
- *
- *	We copy the hash function here because it's substantially faster.
- */
-#define FNV_MAGIC_INIT (0x811c9dc5)
-#define FNV_MAGIC_PRIME (0x01000193)
-
 static void hash_pool_free(void *to_free)
 {
 	talloc_free(to_free);
@@ -148,20 +140,7 @@ static void hash_pool_free(void *to_free)
  */
 static uint32_t dict_hash_name(char const *name, size_t len)
 {
-	uint32_t hash = FNV_MAGIC_INIT;
-
-	char const *p = name, *q = name + len;
-
-	while (p < q) {
-		int c = *(unsigned char const *)p;
-		if (isalpha(c)) c = tolower(c);
-
-		hash *= FNV_MAGIC_PRIME;
-		hash ^= (uint32_t)(c & 0xff);
-		p++;
-	}
-
-	return hash;
+	return fr_hash_fast_case(name, len);
 }
 
 /** Wrap name hash function for fr_dict_protocol_t
@@ -194,7 +173,7 @@ static int dict_protocol_name_cmp(void const *one, void const *two)
  */
 static uint32_t dict_protocol_num_hash(void const *data)
 {
-	return fr_hash(&(((fr_dict_t const *)data)->root->attr), sizeof(((fr_dict_t const *)data)->root->attr));
+	return fr_hash_fast(&(((fr_dict_t const *)data)->root->attr), sizeof(((fr_dict_t const *)data)->root->attr));
 }
 
 /** Compare two protocol numbers
@@ -240,9 +219,9 @@ static uint32_t dict_attr_combo_hash(void const *data)
 	uint32_t hash;
 	fr_dict_attr_t const *attr = data;
 
-	hash = fr_hash(&attr->parent, sizeof(attr->parent));			//-V568
-	hash = fr_hash_update(&attr->type, sizeof(attr->type), hash);
-	return fr_hash_update(&attr->attr, sizeof(attr->attr), hash);
+	hash = fr_hash_fast(&attr->parent, sizeof(attr->parent));		//-V568
+	hash = fr_hash_fast_update(&attr->type, sizeof(attr->type), hash);
+	return fr_hash_fast_update(&attr->attr, sizeof(attr->attr), hash);
 }
 
 /** Compare two combo attribute entries
@@ -292,8 +271,8 @@ static int dict_vendor_name_cmp(void const *one, void const *two)
  */
 static uint32_t dict_vendor_pen_hash(void const *data)
 {
-	return fr_hash(&(((fr_dict_vendor_t const *)data)->pen),
-		       sizeof(((fr_dict_vendor_t const *)data)->pen));
+	return fr_hash_fast(&(((fr_dict_vendor_t const *)data)->pen),
+			    sizeof(((fr_dict_vendor_t const *)data)->pen));
 }
 
 /** Compare two vendor numbers
@@ -317,7 +296,7 @@ static uint32_t dict_enum_name_hash(void const *data)
 
 	hash = dict_hash_name((void const *)enumv->name, enumv->name_len);
 
-	return fr_hash_update(&enumv->da, sizeof(enumv->da), hash);		//-V568
+	return fr_hash_fast_update(&enumv->da, sizeof(enumv->da), hash);	//-V568
 }
 
 /** Compare two dictionary attribute enum values
@@ -343,8 +322,8 @@ static uint32_t dict_enum_value_hash(void const *data)
 	uint32_t hash = 0;
 	fr_dict_enum_t const *enumv = data;
 
-	hash = fr_hash_update((void const *)&enumv->da, sizeof(void *), hash);	/* Cast to quiet static analysis */
-	return fr_hash_update((void const *)enumv->value, sizeof(void *), hash);
+	hash = fr_hash_fast_update((void const *)&enumv->da, sizeof(void *), hash);	/* Cast to quiet static analysis */
+	return fr_hash_fast_update((void const *)enumv->value, sizeof(void *), hash);
 }
 
 /** Compare two dictionary enum values
@@ -626,6 +605,16 @@ int dict_attr_child_add(fr_dict_attr_t *parent, fr_dict_attr_t *child)
 		return false;
 	}
 
+	/*
+	 *	The child index doesn't know about the new child,
+	 *	so stop using it.  It's rebuilt when the dictionary
+	 *	is finalised.
+	 */
+	if (parent->child_index) {
+		talloc_const_free(parent->child_index);
+		parent->child_index = NULL;
+	}
+
 	/*
 	 *	We only allocate the pointer array *if* the parent has children.
 	 */
@@ -693,6 +682,321 @@ int dict_attr_child_add(fr_dict_attr_t *parent, fr_dict_attr_t *child)
 	return 0;
 }
 
+/** Direct lookup table for the children of an attribute
+ *
+ * The children array sorts attributes into 256 bins by the bottom 8 bits
+ * of their number, and chains attributes which share a bin.  That's a
+ * direct lookup when all of the numbers are below 256, but vendor PENs,
+ * and the attributes of protocols with 16 or 32 bit numbers, end up
+ * walking the chains.
+ *
+ * Once the dictionary has been loaded we build one of these for each
+ * attribute with such children.  If the numbers are dense, it's an
+ * array indexed by attribute number.  If they're sparse, it's a
+ * minimal-ish perfect hash, using "hash and displace".  Each key hashes
+ * to a bucket, and the bucket's displacement value selects a slot for
+ * the key which no other key uses.  So a lookup is two hashes and one
+ * comparison, whatever the keys are.
+ */
+struct fr_dict_child_index_s {
+	fr_dict_attr_t const	**slots;		//!< Children, indexed by number or by hash.
+	uint32_t		num_slots;		//!< Max number + 1 if direct, else a power of 2.
+	uint32_t		*disp;			//!< Displacement for each bucket, NULL if direct.
+	uint32_t		num_disp;		//!< Number of buckets, a power of 2.
+};
+
+/*
+ *	Direct arrays are used if at least a quarter of the slots
+ *	would be used, and the array isn't unreasonably large.
+ */
+#define CHILD_INDEX_DIRECT_MAX	(65536)
+#define CHILD_INDEX_DIRECT_FILL	(4)
+
+/*
+ *	Give up on finding a displacement for a bucket after this
+ *	many attempts, and try again with a larger table.
+ */
+#define CHILD_INDEX_DISP_MAX	(1 << 16)
+
+static inline CC_HINT(always_inline) uint32_t child_index_mix(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
+
+	return key;
+}
+
+static inline CC_HINT(always_inline) uint32_t child_index_bucket(fr_dict_child_index_t const *idx, uint32_t attr)
+{
+	return child_index_mix(attr) & (idx->num_disp - 1);
+}
+
+static inline CC_HINT(always_inline) uint32_t child_index_slot(fr_dict_child_index_t const *idx,
+								uint32_t attr, uint32_t disp)
+{
+	return child_index_mix(attr + (disp * 0x9e3779b9) + 0x7f4a7c15) & (idx->num_slots - 1);
+}
+
+/** Find a child using a compiled index
+ *
+ */
+static inline CC_HINT(always_inline) fr_dict_attr_t const *child_index_find(fr_dict_child_index_t const *idx,
+									    unsigned int attr)
+{
+	fr_dict_attr_t const *child;
+
+	if (!idx->disp) {
+		if (attr >= idx->num_slots) return NULL;
+
+		return idx->slots[attr];
+	}
+
+	child = idx->slots[child_index_slot(idx, attr, idx->disp[child_index_bucket(idx, attr)])];
+	if (!child || (child->attr != attr)) return NULL;
+
+	return child;
+}
+
+typedef struct {
+	uint32_t		bucket;
+	uint32_t		size;			//!< Number of keys in the bucket.
+	uint32_t		start;			//!< Offset of the bucket's keys in the sorted keys.
+} child_index_bucket_t;
+
+/*
+ *	Sort buckets by size, largest first.
+ */
+static int child_index_bucket_cmp(void const *one, void const *two)
+{
+	child_index_bucket_t const *a = one, *b = two;
+
+	if (a->size != b->size) return (a->size < b->size) - (a->size > b->size);
+
+	return (a->bucket > b->bucket) - (a->bucket < b->bucket);
+}
+
+/** Try to build a perfect hash of the keys into idx->num_slots slots
+ *
+ * @param[in] idx		to fill in.  slots, disp and num_disp must be set.
+ * @param[in] keys		to hash.
+ * @param[out] sorted		scratch space, for num_keys keys.
+ * @param[in] num_keys		number of keys.
+ * @param[out] buckets		scratch space, for idx->num_disp buckets.
+ * @return
+ *	- 0 on success.
+ *	- -1 if no displacement could be found for one of the buckets.
+ */
+static int child_index_hash(fr_dict_child_index_t *idx, fr_dict_attr_t const **keys, fr_dict_attr_t const **sorted,
+			    uint32_t num_keys, child_index_bucket_t *buckets)
+{
+	uint32_t	i, j, k, d, offset = 0;
+	uint32_t	slot[256];
+
+	memset(idx->slots, 0, sizeof(idx->slots[0]) * idx->num_slots);
+	memset(idx->disp, 0, sizeof(idx->disp[0]) * idx->num_disp);
+	memset(buckets, 0, sizeof(buckets[0]) * idx->num_disp);
+
+	/*
+	 *	Counting sort the keys by bucket.
+	 */
+	for (i = 0; i < num_keys; i++) buckets[child_index_bucket(idx, keys[i]->attr)].size++;
+	for (i = 0; i < idx->num_disp; i++) {
+		buckets[i].bucket = i;
+		buckets[i].start = offset;
+		offset += buckets[i].size;
+		buckets[i].size = 0;
+	}
+	for (i = 0; i < num_keys; i++) {
+		child_index_bucket_t *b = &buckets[child_index_bucket(idx, keys[i]->attr)];
+
+		sorted[b->start + b->size++] = keys[i];
+	}
+
+	/*
+	 *	Placing the largest buckets first, while the
+	 *	table is mostly empty, makes finding slots for
+	 *	all of them much more likely.
+	 */
+	qsort(buckets, idx->num_disp, sizeof(buckets[0]), child_index_bucket_cmp);
+
+	for (i = 0; (i < idx->num_disp) && buckets[i].size; i++) {
+		fr_dict_attr_t const **bkeys = sorted + buckets[i].start;
+
+		if (buckets[i].size > NUM_ELEMENTS(slot)) return -1;
+
+		for (d = 0; d < CHILD_INDEX_DISP_MAX; d++) {
+			for (k = 0; k < buckets[i].size; k++) {
+				uint32_t s = child_index_slot(idx, bkeys[k]->attr, d);
+
+				if (idx->slots[s]) break;
+				for (j = 0; j < k; j++) if (slot[j] == s) break;
+				if (j < k) break;
+
+				slot[k] = s;
+			}
+			if (k == buckets[i].size) break;
+		}
+		if (d == CHILD_INDEX_DISP_MAX) return -1;
+
+		idx->disp[buckets[i].bucket] = d;
+		for (k = 0; k < buckets[i].size; k++) idx->slots[slot[k]] = bkeys[k];
+	}
+
+	return 0;
+}
+
+/** Build a direct lookup table for the children of an attribute
+ *
+ * Only the first child in each chain with a given number is indexed, as
+ * that's the one #dict_attr_child_by_num would return.
+ *
+ * @param[in] da	to build the child index for.
+ * @return
+ *	- 0 on success, or if the attribute doesn't need an index.
+ *	- -1 on memory allocation error.
+ */
+static int dict_attr_child_index_build(fr_dict_attr_t *da)
+{
+	fr_dict_child_index_t	*idx;
+	fr_dict_attr_t const	**keys, **sorted;
+	child_index_bucket_t	*buckets;
+	uint32_t		num_keys = 0, max = 0, i;
+	fr_dict_attr_t const	*child, *p;
+	size_t			len = talloc_array_length(da->children);
+
+	if (da->child_index) return 0;
+
+	for (i = 0; i < len; i++) {
+		for (child = da->children[i]; child; child = child->next) {
+			for (p = da->children[i]; p != child; p = p->next) if (p->attr == child->attr) break;
+			if (p != child) continue;	/* Shadowed by an earlier child */
+
+			num_keys++;
+			if (child->attr > max) max = child->attr;
+		}
+	}
+
+	/*
+	 *	All of the numbers fit in the children array, so
+	 *	it's already a direct lookup.
+	 */
+	if (max <= UINT8_MAX) return 0;
+
+	idx = talloc_zero(da, fr_dict_child_index_t);
+	if (!idx) return -1;
+
+	if ((max < CHILD_INDEX_DIRECT_MAX) && (max < (num_keys * CHILD_INDEX_DIRECT_FILL))) {
+		idx->num_slots = max + 1;
+		idx->slots = talloc_zero_array(idx, fr_dict_attr_t const *, idx->num_slots);
+		if (!idx->slots) {
+		oom:
+			talloc_free(idx);
+			return -1;
+		}
+
+		for (i = 0; i < len; i++) {
+			for (child = da->children[i]; child; child = child->next) {
+				if (!idx->slots[child->attr]) idx->slots[child->attr] = child;
+			}
+		}
+
+		da->child_index = idx;
+		return 0;
+	}
+
+	keys = talloc_array(idx, fr_dict_attr_t const *, num_keys);
+	sorted = talloc_array(idx, fr_dict_attr_t const *, num_keys);
+	if (!keys || !sorted) goto oom;
+
+	num_keys = 0;
+	for (i = 0; i < len; i++) {
+		for (child = da->children[i]; child; child = child->next) {
+			for (p = da->children[i]; p != child; p = p->next) if (p->attr == child->attr) break;
+			if (p != child) continue;
+
+			keys[num_keys++] = child;
+		}
+	}
+
+	/*
+	 *	Start with twice as many slots as keys, and two keys
+	 *	per bucket.  If we can't find a perfect hash, double
+	 *	the number of slots and try again.
+	 */
+	for (idx->num_disp = 1; idx->num_disp < ((num_keys + 1) / 2); idx->num_disp <<= 1);
+	for (idx->num_slots = 2; idx->num_slots < (num_keys * 2); idx->num_slots <<= 1);
+
+	buckets = talloc_array(idx, child_index_bucket_t, idx->num_disp);
+	idx->disp = talloc_array(idx, uint32_t, idx->num_disp);
+	if (!buckets || !idx->disp) goto oom;
+
+	for (;;) {
+		idx->slots = talloc_array(idx, fr_dict_attr_t const *, idx->num_slots);
+		if (!idx->slots) goto oom;
+
+		if (child_index_hash(idx, keys, sorted, num_keys, buckets) == 0) break;
+
+		talloc_free(idx->slots);
+		idx->num_slots <<= 1;
+
+		/*
+		 *	Something is very wrong, just use
+		 *	the chains.
+		 */
+		if (idx->num_slots > (num_keys * 64)) {
+			talloc_free(idx);
+			return 0;
+		}
+	}
+
+	talloc_free(keys);
+	talloc_free(sorted);
+	talloc_free(buckets);
+
+	da->child_index = idx;
+
+	return 0;
+}
+
+/** Build direct lookup tables for the children of an attribute, and all its descendents
+ *
+ * Called once a dictionary has been loaded.  Adding more children to an
+ * attribute frees its index, and lookups go back to using the children
+ * array until this is called again.
+ *
+ * @param[in] da	to start at, usually the root of a dictionary.
+ * @return
+ *	- 0 on success.
+ *	- -1 on memory allocation error.
+ */
+int dict_attr_child_index_build_all(fr_dict_attr_t const *da)
+{
+	fr_dict_attr_t const	*child;
+	fr_dict_attr_t		*mutable;
+	size_t			i, len;
+
+	/*
+	 *	Groups are references to other attributes, and
+	 *	don't have their own children.
+	 */
+	if ((da->type == FR_TYPE_GROUP) || !da->children) return 0;
+
+	memcpy(&mutable, &da, sizeof(mutable));
+	if (dict_attr_child_index_build(mutable) < 0) return -1;
+
+	len = talloc_array_length(da->children);
+	for (i = 0; i < len; i++) {
+		for (child = da->children[i]; child; child = child->next) {
+			if (dict_attr_child_index_build_all(child) < 0) return -1;
+		}
+	}
+
+	return 0;
+}
+
 /** Add an attribute to the name table for the dictionary.
  *
  * @param[in] dict		of protocol context we're operating in.
@@ -2013,6 +2317,15 @@ inline fr_dict_attr_t *dict_attr_child_by_num(fr_dict_attr_t const *parent, unsi
 	 */
 	if (parent->type == FR_TYPE_GROUP) parent = parent->ref;
 
+	if (parent->child_index) {
+		fr_dict_attr_t *out;
+
+		bin = child_index_find(parent->child_index, attr);
+		memcpy(&out, &bin, sizeof(bin));
+
+		return out;
+	}
+
 	/*
 	 *	Child arrays may be trimmed back to save memory.
 	 *	Check that so we don't SEGV.
@@ -18,6 +18,13 @@
  *
  * Non-thread-safe event handling specific to FreeRADIUS.
  *
+ * On Linux, the server can be built with --with-epoll, in which case
+ * the same API is implemented directly on top of epoll, timerfd, eventfd,
+ * and inotify, instead of going through the libkqueue emulation layer.
+ * The filter changes are still built as kevents, and the epoll events
+ * are translated back into kevents, so that the rest of this file
+ * doesn't need to care which backend is in use.
+ *
  * By non-thread-safe we mean multiple threads can't insert/delete
  * events concurrently into the same event list without synchronization.
  *
@@ -42,6 +49,19 @@ RCSID("$Id$")
 #include <freeradius-devel/util/token.h>
 #include <sys/stat.h>
 
+#ifdef WITH_EPOLL
+#  ifndef __linux__
+#    error epoll is only available on Linux
+#  endif
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#  include <sys/inotify.h>
+#  include <sys/ioctl.h>
+#  include <sys/syscall.h>
+#  include <sys/timerfd.h>
+#  include <sys/wait.h>
+#endif
+
 #define FR_EV_BATCH_FDS (256)
 
 DIAG_OFF(unused-macros)
@@ -77,6 +97,18 @@ static fr_table_num_sorted_t const kevent_filter_table[] = {
 };
 static size_t kevent_filter_table_len = NUM_ELEMENTS(kevent_filter_table);
 
+#ifdef WITH_EPOLL
+/** What the data pointer of an epoll event refers to
+ *
+ * The timerfd and eventfd of the event list use pointers to their
+ * own fields, and are checked for first.
+ */
+typedef enum {
+	FR_EVENT_EPOLL_FD = 1,				//!< An #fr_event_fd_t.
+	FR_EVENT_EPOLL_PID				//!< An #fr_event_pid_t.
+} fr_event_epoll_type_t;
+#endif
+
 /** A timer event
  *
  */
@@ -90,6 +122,10 @@ struct fr_event_timer {
 	fr_event_timer_t const	**parent;		//!< Previous timer.
 	int32_t			heap_id;	       	//!< Where to store opaque heap data.
 	fr_event_timer_t	*next;			//!< in linked list of event timers
+
+	fr_dlist_t		wheel_entry;		//!< Entry in a timer wheel slot.
+	uint8_t			level;			//!< Timer wheel level.
+	uint8_t			slot;			//!< Slot within the timer wheel level.
 };
 
 typedef enum {
@@ -232,6 +268,9 @@ static size_t fr_event_fd_type_table_len = NUM_ELEMENTS(fr_event_fd_type_table);
  *
  */
 struct fr_event_fd {
+#ifdef WITH_EPOLL
+	fr_event_epoll_type_t	epoll_type;		//!< Must be first.  What epoll events refer to.
+#endif
 	fr_event_list_t		*el;			//!< because talloc_parent() is O(N) in number of objects
 	fr_event_filter_t	filter;
 	int			fd;			//!< File descriptor we're listening for events on.
@@ -255,9 +294,22 @@ struct fr_event_fd {
 	TALLOC_CTX		*linked_ctx;		//!< talloc ctx this event was bound to.
 
 	fr_event_fd_t		*next;			//!< item in a list of fr_event_fd.
+
+#ifdef WITH_EPOLL
+	uint32_t		epoll_events;		//!< EPOLLIN and/or EPOLLOUT, as registered with epoll.
+	bool			epoll_unsupported;	//!< epoll can't watch this FD, so it's always ready.
+	fr_dlist_t		ready_entry;		//!< Entry in the list of always ready FDs.
+
+	int			inotify_fd;		//!< For vnode filters.
+	uint32_t		vnode_fflags;		//!< NOTE_* flags we're watching for.
+#endif
 };
 
 struct fr_event_pid {
+#ifdef WITH_EPOLL
+	fr_event_epoll_type_t	epoll_type;		//!< Must be first.  What epoll events refer to.
+	int			pidfd;			//!< from pidfd_open().
+#endif
 	fr_event_list_t		*el;			//!< because talloc_parent() is O(N) in number of objects
 	pid_t			pid;			//!< child to wait for
 
@@ -293,11 +345,44 @@ typedef struct {
 	void			*uctx;			//!< Context for the callback.
 } fr_event_user_t;
 
+/** Timer wheel
+ *
+ * An alternative to the timer heap, for event lists with very large
+ * numbers of timers.  Timers are rounded up to a multiple of the
+ * resolution (one "tick"), and placed in one of 256 slots on one of 8
+ * levels.  Level 0 holds timers which fire within the current 256 ticks,
+ * one slot per tick.  Each slot on level N covers 256^N ticks, and its
+ * timers are moved ("cascaded") down to lower levels when the current
+ * tick reaches the start of the slot.
+ *
+ * Inserting and deleting a timer is O(1), and each timer is cascaded at
+ * most 7 times over its lifetime, and usually not at all.  The cost is
+ * that timers may fire up to one tick late.  They never fire early.
+ */
+#define FR_EVENT_WHEEL_LEVELS	(8)
+#define FR_EVENT_WHEEL_BITS	(8)
+#define FR_EVENT_WHEEL_SLOTS	(1 << FR_EVENT_WHEEL_BITS)
+#define FR_EVENT_WHEEL_MASK	(FR_EVENT_WHEEL_SLOTS - 1)
+
+typedef struct fr_event_wheel_s fr_event_wheel_t;
+
+struct fr_event_wheel_s {
+	fr_time_delta_t		resolution;		//!< Length of one tick.
+	uint64_t		base;			//!< The current tick.  All timers for earlier ticks
+							///< have fired.
+	uint32_t		num_timers;		//!< Number of timers in the wheel.
+
+	uint64_t		occupied[FR_EVENT_WHEEL_LEVELS][FR_EVENT_WHEEL_SLOTS / 64];	//!< Non-empty slots.
+	fr_dlist_t		slot[FR_EVENT_WHEEL_LEVELS][FR_EVENT_WHEEL_SLOTS];		//!< Lists of timers.
+};
+
 /** Stores all information relating to an event list
  *
  */
 struct fr_event_list {
 	fr_heap_t		*times;			//!< of timer events to be executed.
+	fr_event_wheel_t	*wheel;			//!< of timer events to be executed, used instead of
+							///< the heap if set.
 	rbtree_t		*fds;			//!< Tree used to track FDs with filters in kqueue.
 
 	int			exit;			//!< If non-zero, the event loop will exit after its current
@@ -311,6 +396,7 @@ struct fr_event_list {
 	int			num_fd_events;		//!< Number of events in this event list.
 
 	int			kq;			//!< instance associated with this event list.
+							///< This is the epoll FD when built with epoll.
 
 	fr_dlist_head_t		pre_callbacks;		//!< callbacks when we may be idle...
 	fr_dlist_head_t		user_callbacks;		//!< EVFILT_USER callbacks
@@ -323,6 +409,16 @@ struct fr_event_list {
 
 	fr_event_fd_t		*fd_to_free;		//!< File descriptor events pending deletion.
 	fr_event_timer_t	*ev_to_add;		//!< event to add
+
+#ifdef WITH_EPOLL
+	int			timer_fd;		//!< timerfd for waking up for timer events.
+	fr_time_t		timer_armed;		//!< When the timerfd is due to fire, or 0.
+	int			wake_fd;		//!< eventfd for waking up the event loop.
+
+	fr_dlist_head_t		ready;			//!< FDs which epoll can't watch, e.g. regular files.
+
+	struct epoll_event	epoll_events[FR_EV_BATCH_FDS / 2]; //!< Each may become a read and a write kevent.
+#endif
 };
 
 /** Compare two timer events to see which one should occur first
@@ -341,6 +437,271 @@ static int8_t fr_event_timer_cmp(void const *a, void const *b)
 	return fr_time_cmp(ev_a->when, ev_b->when);
 }
 
+static inline CC_HINT(always_inline) uint64_t wheel_tick(fr_event_wheel_t const *w, fr_time_t when, bool round_up)
+{
+	if (when <= 0) return 0;
+
+	if (round_up) return ((uint64_t)when + w->resolution - 1) / w->resolution;
+
+	return (uint64_t)when / w->resolution;
+}
+
+static inline CC_HINT(always_inline) unsigned int wheel_index(uint64_t tick, unsigned int level)
+{
+	return (tick >> (level * FR_EVENT_WHEEL_BITS)) & FR_EVENT_WHEEL_MASK;
+}
+
+/** Return the first non-empty slot at or after "from", or -1
+ *
+ */
+static inline int wheel_slot_next(uint64_t const *occupied, unsigned int from)
+{
+	unsigned int	i = from / 64;
+	uint64_t	bits;
+
+	if (from >= FR_EVENT_WHEEL_SLOTS) return -1;
+
+	bits = occupied[i] & (~(uint64_t)0 << (from & 63));
+	for (;;) {
+		if (bits) return (i * 64) + __builtin_ctzll(bits);
+		if (++i == (FR_EVENT_WHEEL_SLOTS / 64)) return -1;
+		bits = occupied[i];
+	}
+}
+
+static void wheel_insert(fr_event_wheel_t *w, fr_event_timer_t *ev)
+{
+	uint64_t	tick = wheel_tick(w, ev->when, true);
+	unsigned int	level = 0;
+	fr_dlist_t	*head;
+
+	/*
+	 *	Timers in the past fire on the current tick.
+	 */
+	if (tick < w->base) tick = w->base;
+
+	/*
+	 *	The level is where the highest bit which differs
+	 *	from the current tick lies.
+	 */
+	if (tick != w->base) level = (63 - __builtin_clzll(tick ^ w->base)) / FR_EVENT_WHEEL_BITS;
+
+	ev->level = level;
+	ev->slot = wheel_index(tick, level);
+
+	head = &w->slot[level][ev->slot];
+	ev->wheel_entry.prev = head->prev;
+	ev->wheel_entry.next = head;
+	head->prev->next = &ev->wheel_entry;
+	head->prev = &ev->wheel_entry;
+
+	w->occupied[level][ev->slot / 64] |= ((uint64_t)1 << (ev->slot & 63));
+	w->num_timers++;
+}
+
+static int wheel_extract(fr_event_wheel_t *w, fr_event_timer_t *ev)
+{
+	fr_dlist_t *head;
+
+	if (!fr_dlist_entry_in_list(&ev->wheel_entry)) return -1;
+
+	fr_dlist_entry_unlink(&ev->wheel_entry);
+
+	head = &w->slot[ev->level][ev->slot];
+	if (head->next == head) w->occupied[ev->level][ev->slot / 64] &= ~((uint64_t)1 << (ev->slot & 63));
+	w->num_timers--;
+
+	return 0;
+}
+
+static inline CC_HINT(always_inline) fr_event_timer_t *wheel_entry_to_ev(fr_dlist_t *entry)
+{
+	return (fr_event_timer_t *)(((uint8_t *)entry) - offsetof(fr_event_timer_t, wheel_entry));
+}
+
+/** Move all the timers in a slot to lower levels
+ *
+ */
+static void wheel_cascade(fr_event_wheel_t *w, unsigned int level, unsigned int slot)
+{
+	fr_dlist_t *head = &w->slot[level][slot];
+
+	while (head->next != head) {
+		fr_event_timer_t *ev = wheel_entry_to_ev(head->next);
+
+		(void) wheel_extract(w, ev);
+		wheel_insert(w, ev);
+	}
+}
+
+/** Find the earliest tick on which a timer might fire
+ *
+ * For timers on level 0 this is exact.  For higher levels it's the first
+ * tick of the slot, when the slot will be cascaded.
+ *
+ * @return
+ *	- true if there are timers.
+ *	- false if the wheel is empty.
+ */
+static bool wheel_next(fr_event_wheel_t const *w, uint64_t *tick)
+{
+	unsigned int	level;
+	int		slot;
+
+	slot = wheel_slot_next(w->occupied[0], wheel_index(w->base, 0));
+	if (slot >= 0) {
+		*tick = (w->base & ~(uint64_t)FR_EVENT_WHEEL_MASK) | slot;
+		return true;
+	}
+
+	/*
+	 *	On higher levels, the slot for the current tick
+	 *	has already been cascaded, so start at the next one.
+	 */
+	for (level = 1; level < FR_EVENT_WHEEL_LEVELS; level++) {
+		unsigned int	shift = level * FR_EVENT_WHEEL_BITS;
+		uint64_t	high;
+
+		slot = wheel_slot_next(w->occupied[level], wheel_index(w->base, level) + 1);
+		if (slot < 0) continue;
+
+		high = (level == (FR_EVENT_WHEEL_LEVELS - 1)) ? 0 : (w->base >> (shift + FR_EVENT_WHEEL_BITS)) << (shift + FR_EVENT_WHEEL_BITS);
+		*tick = high | ((uint64_t)slot << shift);
+		return true;
+	}
+
+	return false;
+}
+
+/** Advance the wheel up to a tick, and return the first timer which is due
+ *
+ * @param[in] w		to advance.
+ * @param[in] now	the current tick.
+ * @return
+ *	- A timer which is due.
+ *	- NULL if no timers are due.
+ */
+static fr_event_timer_t *wheel_due(fr_event_wheel_t *w, uint64_t now)
+{
+	for (;;) {
+		unsigned int	level, slot = wheel_index(w->base, 0);
+		uint64_t	next;
+
+		if (w->occupied[0][slot / 64] & ((uint64_t)1 << (slot & 63))) {
+			return wheel_entry_to_ev(w->slot[0][slot].next);
+		}
+
+		if (!wheel_next(w, &next) || (next > now)) {
+			if (now > w->base) w->base = now;
+			return NULL;
+		}
+
+		w->base = next;
+
+		/*
+		 *	We've reached the start of a slot on one or more
+		 *	levels.  Cascade from the top down, so timers
+		 *	which move to a lower level are cascaded again if
+		 *	they need to be.
+		 */
+		for (level = FR_EVENT_WHEEL_LEVELS - 1; level > 0; level--) {
+			unsigned int shift = level * FR_EVENT_WHEEL_BITS;
+
+			if ((w->base & (((uint64_t)1 << shift) - 1)) != 0) continue;
+
+			slot = wheel_index(w->base, level);
+			if (w->occupied[level][slot / 64] & ((uint64_t)1 << (slot & 63))) wheel_cascade(w, level, slot);
+		}
+	}
+}
+
+/** Return any timer from the wheel
+ *
+ */
+static fr_event_timer_t *wheel_any(fr_event_wheel_t *w)
+{
+	unsigned int	level;
+	int		slot;
+
+	for (level = 0; level < FR_EVENT_WHEEL_LEVELS; level++) {
+		slot = wheel_slot_next(w->occupied[level], 0);
+		if (slot >= 0) return wheel_entry_to_ev(w->slot[level][slot].next);
+	}
+
+	return NULL;
+}
+
+/** Insert a timer into the heap or wheel
+ *
+ */
+static inline int event_timer_insert(fr_event_list_t *el, fr_event_timer_t *ev)
+{
+	if (el->wheel) {
+		wheel_insert(el->wheel, ev);
+		return 0;
+	}
+
+	return fr_heap_insert(el->times, ev);
+}
+
+/** Remove a timer from the heap or wheel
+ *
+ */
+static inline int event_timer_extract(fr_event_list_t *el, fr_event_timer_t *ev)
+{
+	if (el->wheel) return wheel_extract(el->wheel, ev);
+
+	return fr_heap_extract(el->times, ev);
+}
+
+/** Return any timer from the heap or wheel
+ *
+ */
+static inline fr_event_timer_t *event_timer_any(fr_event_list_t *el)
+{
+	if (el->wheel) return wheel_any(el->wheel);
+
+	return fr_heap_peek(el->times);
+}
+
+/** Return the number of timers in the heap or wheel
+ *
+ */
+static inline uint32_t event_num_timers(fr_event_list_t *el)
+{
+	if (el->wheel) return el->wheel->num_timers;
+
+	return fr_heap_num_elements(el->times);
+}
+
+/** Return when the next timer should fire
+ *
+ * For the wheel, this may be earlier than any timer fires, see #wheel_next.
+ *
+ * @return
+ *	- true if there are timers.
+ *	- false if there are no timers.
+ */
+static inline bool event_timer_next(fr_event_list_t *el, fr_time_t *when)
+{
+	fr_event_timer_t *ev;
+
+	if (el->wheel) {
+		uint64_t tick;
+
+		if (!wheel_next(el->wheel, &tick)) return false;
+
+		*when = tick * el->wheel->resolution;
+		return true;
+	}
+
+	ev = fr_heap_peek(el->times);
+	if (!ev) return false;
+
+	*when = ev->when;
+	return true;
+}
+
 /** Compare two file descriptor handles
  *
  * @param[in] a the first file descriptor handle.
@@ -380,10 +741,12 @@ int fr_event_list_num_timers(fr_event_list_t *el)
 {
 	if (unlikely(!el)) return -1;
 
-	return fr_heap_num_elements(el->times);
+	return event_num_timers(el);
 }
 
 /** Return the kq associated with an event list.
+ *
+ * @note When built with epoll, this is the epoll FD.
  *
  * @param[in] el to return timer events for.
  * @return kq
@@ -536,6 +899,468 @@ static ssize_t fr_event_build_evset(struct kevent out_kev[], size_t outlen, fr_e
 	return out - out_kev;
 }
 
+#ifdef WITH_EPOLL
+/** Convert kevent vnode fflags to an inotify mask
+ *
+ * @param[in] ef	the vnode filter is for.
+ * @param[in] fflags	NOTE_* flags to watch for.
+ * @return the inotify mask.
+ */
+static uint32_t fr_event_inotify_mask(fr_event_fd_t const *ef, uint32_t fflags)
+{
+	uint32_t mask = 0;
+
+	/*
+	 *	A file which is deleted while we have it open
+	 *	doesn't get IN_DELETE_SELF until it's closed.  We
+	 *	check the link count on IN_ATTRIB instead.
+	 */
+	if (fflags & NOTE_DELETE) mask |= IN_DELETE_SELF | IN_ATTRIB;
+
+	if (fflags & (NOTE_WRITE | NOTE_EXTEND)) {
+		if (ef->type == FR_EVENT_FD_DIRECTORY) {
+			mask |= IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+		} else {
+			mask |= IN_MODIFY;
+		}
+	}
+
+	if (fflags & (NOTE_ATTRIB | NOTE_LINK)) mask |= IN_ATTRIB;
+	if (fflags & NOTE_RENAME) mask |= IN_MOVE_SELF;
+
+	return mask;
+}
+
+/** Stop watching a file or directory for vnode events
+ *
+ */
+static void fr_event_epoll_vnode_close(fr_event_list_t *el, fr_event_fd_t *ef)
+{
+	if (ef->inotify_fd < 0) return;
+
+	(void) epoll_ctl(el->kq, EPOLL_CTL_DEL, ef->inotify_fd, NULL);
+	close(ef->inotify_fd);
+	ef->inotify_fd = -1;
+	ef->vnode_fflags = 0;
+}
+
+/** Apply an EVFILT_VNODE change using inotify
+ *
+ * @param[in] el	the event list.
+ * @param[in] ef	to change.
+ * @param[in] kev	the change, as built by #fr_event_build_evset.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure, with errno set.
+ */
+static int fr_event_epoll_vnode(fr_event_list_t *el, fr_event_fd_t *ef, struct kevent const *kev)
+{
+	char	path[64];
+
+	if (kev->flags & EV_DELETE) {
+		fr_event_epoll_vnode_close(el, ef);
+		return 0;
+	}
+
+	if (ef->inotify_fd < 0) {
+		struct epoll_event ev = { .events = EPOLLIN, .data.ptr = ef };
+
+		ef->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (ef->inotify_fd < 0) return -1;
+
+		if (epoll_ctl(el->kq, EPOLL_CTL_ADD, ef->inotify_fd, &ev) < 0) {
+			int my_errno = errno;
+
+			close(ef->inotify_fd);
+			ef->inotify_fd = -1;
+			errno = my_errno;
+			return -1;
+		}
+	}
+
+	/*
+	 *	inotify takes a path, not an FD.  This is the same
+	 *	trick that libkqueue uses.
+	 */
+	snprintf(path, sizeof(path), "/proc/self/fd/%i", ef->fd);
+	if (inotify_add_watch(ef->inotify_fd, path, fr_event_inotify_mask(ef, kev->fflags)) < 0) {
+		int my_errno = errno;
+
+		fr_event_epoll_vnode_close(el, ef);
+		errno = my_errno;
+		return -1;
+	}
+	ef->vnode_fflags = kev->fflags;
+
+	return 0;
+}
+
+/** Set the read/write events epoll watches for an FD
+ *
+ * @param[in] el	the event list.
+ * @param[in] ef	to change.
+ * @param[in] events	EPOLLIN and/or EPOLLOUT, or 0 to stop watching the FD.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure, with errno set.
+ */
+static int fr_event_epoll_io(fr_event_list_t *el, fr_event_fd_t *ef, uint32_t events)
+{
+	struct epoll_event	ev = { .events = events, .data.ptr = ef };
+	int			op;
+
+	if (events == ef->epoll_events) return 0;
+
+	if (ef->epoll_unsupported) goto ready;
+
+	if (!ef->epoll_events) {
+		op = EPOLL_CTL_ADD;
+	} else if (!events) {
+		op = EPOLL_CTL_DEL;
+	} else {
+		op = EPOLL_CTL_MOD;
+	}
+
+	/*
+	 *	kqueue sets EV_EOF on the read filter when the other
+	 *	end of a connection goes away.  See
+	 *	fr_event_epoll_io_translate() for when we do.
+	 */
+	if (events & EPOLLIN) ev.events |= EPOLLRDHUP;
+
+	if (epoll_ctl(el->kq, op, ef->fd, &ev) < 0) {
+		/*
+		 *	Regular files and directories can't be
+		 *	watched with epoll.  kqueue says they're
+		 *	always ready, so we do the same.
+		 */
+		if ((op == EPOLL_CTL_ADD) && (errno == EPERM)) {
+			ef->epoll_unsupported = true;
+			goto ready;
+		}
+		return -1;
+	}
+	ef->epoll_events = events;
+
+	return 0;
+
+ready:
+	if (events && !ef->epoll_events) fr_dlist_insert_tail(&el->ready, ef);
+	if (!events && ef->epoll_events) fr_dlist_remove(&el->ready, ef);
+	ef->epoll_events = events;
+
+	return 0;
+}
+
+/** Apply a set of kevent filter changes using epoll and inotify
+ *
+ * @param[in] el	the event list.
+ * @param[in] ef	the changes are for.
+ * @param[in] evset	as built by #fr_event_build_evset.
+ * @param[in] count	number of changes.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure, with errno set.
+ */
+static int fr_event_epoll_apply(fr_event_list_t *el, fr_event_fd_t *ef, struct kevent const evset[], int count)
+{
+	uint32_t	events = ef->epoll_events;
+	bool		io = false;
+	int		i;
+
+	for (i = 0; i < count; i++) {
+		switch (evset[i].filter) {
+		case EVFILT_READ:
+			io = true;
+			if (evset[i].flags & EV_DELETE) {
+				events &= ~EPOLLIN;
+			} else {
+				events |= EPOLLIN;
+			}
+			break;
+
+		case EVFILT_WRITE:
+			io = true;
+			if (evset[i].flags & EV_DELETE) {
+				events &= ~EPOLLOUT;
+			} else {
+				events |= EPOLLOUT;
+			}
+			break;
+
+		case EVFILT_VNODE:
+			if (fr_event_epoll_vnode(el, ef, &evset[i]) < 0) return -1;
+			break;
+
+		default:
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	if (io) return fr_event_epoll_io(el, ef, events);
+
+	return 0;
+}
+
+/** Read everything from a timerfd or eventfd, so that it's no longer readable
+ *
+ */
+static inline void fr_event_epoll_drain(int fd)
+{
+	uint64_t value;
+
+	while (read(fd, &value, sizeof(value)) > 0);
+}
+
+/** Translate an epoll event for an IO filter into kevents
+ *
+ * @param[out] out	where to write the kevents.  Must have room for two.
+ * @param[in] ef	the event is for.
+ * @param[in] events	as returned by epoll_wait().
+ * @return the number of kevents written.
+ */
+static int fr_event_epoll_io_translate(struct kevent *out, fr_event_fd_t *ef, uint32_t events)
+{
+	int		count = 0;
+	uint16_t	flags = 0;
+	uint32_t	fflags = 0;
+
+	/*
+	 *	epoll says the peer has hung up as soon as its FIN
+	 *	arrives, even if there's still data for us to read.
+	 *	The event loop treats EOF as an error, and the data
+	 *	would be lost.  So while there's data, the socket is
+	 *	just readable.  It's only EOF once a read would return
+	 *	0, which we'll see on the next call, as the events are
+	 *	level triggered.
+	 */
+	if ((events & (EPOLLHUP | EPOLLRDHUP)) && !(events & EPOLLERR) && (ef->epoll_events & EPOLLIN)) {
+		int pending = 0;
+
+		if ((ioctl(ef->fd, FIONREAD, &pending) == 0) && (pending > 0)) {
+			events &= ~(EPOLLHUP | EPOLLRDHUP);
+			events |= EPOLLIN;
+		}
+	}
+
+	if (events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) {
+		flags |= EV_EOF;
+
+		if (events & EPOLLERR) {
+			int		sock_errno = 0;
+			socklen_t	len = sizeof(sock_errno);
+
+			(void) getsockopt(ef->fd, SOL_SOCKET, SO_ERROR, &sock_errno, &len);
+			fflags = sock_errno;
+		}
+	}
+
+	if ((ef->epoll_events & EPOLLIN) && (events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP | EPOLLERR))) {
+		EV_SET(&out[count++], ef->fd, EVFILT_READ, flags, fflags, 0, ef);
+	}
+
+	if ((ef->epoll_events & EPOLLOUT) && (events & (EPOLLOUT | EPOLLHUP | EPOLLERR))) {
+		EV_SET(&out[count++], ef->fd, EVFILT_WRITE, flags, fflags, 0, ef);
+	}
+
+	return count;
+}
+
+/** Translate inotify events for a vnode filter into a kevent
+ *
+ * @param[out] out	where to write the kevent.
+ * @param[in] ef	the event is for.
+ * @return the number of kevents written.
+ */
+static int fr_event_epoll_vnode_translate(struct kevent *out, fr_event_fd_t *ef)
+{
+	union {
+		struct inotify_event	ev;
+		uint8_t			data[4096];
+	} buffer;
+	uint32_t	fflags = 0;
+	ssize_t		len;
+
+	while ((len = read(ef->inotify_fd, &buffer, sizeof(buffer))) > 0) {
+		uint8_t const *p = buffer.data, *end = buffer.data + len;
+
+		while (p < end) {
+			struct inotify_event const *iev = (struct inotify_event const *) p;
+
+			if (iev->mask & IN_DELETE_SELF) fflags |= NOTE_DELETE;
+			if (iev->mask & IN_MOVE_SELF) fflags |= NOTE_RENAME;
+
+			/*
+			 *	inotify doesn't tell us if the file
+			 *	got larger, so any write is an extend.
+			 */
+			if (iev->mask & (IN_MODIFY | IN_CREATE | IN_MOVED_TO)) fflags |= NOTE_WRITE | NOTE_EXTEND;
+			if (iev->mask & (IN_DELETE | IN_MOVED_FROM)) fflags |= NOTE_WRITE;
+
+			if (iev->mask & IN_ATTRIB) {
+				struct stat buf;
+
+				fflags |= NOTE_ATTRIB | NOTE_LINK;
+				if ((fstat(ef->fd, &buf) == 0) && (buf.st_nlink == 0)) fflags |= NOTE_DELETE;
+			}
+
+			p += sizeof(*iev) + iev->len;
+		}
+	}
+
+	/*
+	 *	Only return the events we were asked for, as the
+	 *	callbacks for the others won't be set.
+	 */
+	fflags &= ef->vnode_fflags;
+	if (!fflags) return 0;
+
+	EV_SET(out, ef->fd, EVFILT_VNODE, EV_CLEAR, fflags, 0, ef);
+
+	return 1;
+}
+
+/** Translate a pidfd event into an EVFILT_PROC kevent
+ *
+ * @param[out] out	where to write the kevent.
+ * @param[in] el	the event list.
+ * @param[in] ev	the PID event.
+ * @return the number of kevents written.
+ */
+static int fr_event_epoll_pid_translate(struct kevent *out, fr_event_list_t *el, fr_event_pid_t *ev)
+{
+	siginfo_t	info;
+	int		status = 0;
+
+	(void) epoll_ctl(el->kq, EPOLL_CTL_DEL, ev->pidfd, NULL);
+	close(ev->pidfd);
+	ev->pidfd = -1;
+
+	/*
+	 *	Get the exit status, but leave the child for the
+	 *	caller to reap.  That's what kqueue does.
+	 */
+	memset(&info, 0, sizeof(info));
+	if (waitid(P_PID, ev->pid, &info, WEXITED | WNOHANG | WNOWAIT) == 0) {
+		if (info.si_code == CLD_EXITED) {
+			status = (info.si_status & 0xff) << 8;
+		} else {
+			status = info.si_status & 0x7f;
+		}
+	}
+
+	EV_SET(out, ev->pid, EVFILT_PROC, EV_ONESHOT, NOTE_EXIT, status, ev);
+
+	return 1;
+}
+
+/** Wait for events with epoll, and translate them into kevents
+ *
+ * @param[in] el	the event list.
+ * @param[in] wake	how long to wait, or NULL to wait forever.
+ * @return
+ *	- >= 0 the number of kevents written to el->events.
+ *	- -1 on failure, with errno set.
+ */
+static int fr_event_epoll_wait(fr_event_list_t *el, fr_time_delta_t const *wake)
+{
+	int		timeout, num, i, count = 0;
+	fr_event_fd_t	*ef;
+
+	if (!fr_dlist_empty(&el->ready) || (wake && (*wake == 0))) {
+		timeout = 0;
+
+	} else {
+		timeout = -1;
+
+		/*
+		 *	epoll_wait() only has millisecond resolution,
+		 *	so we use a timerfd.  It only needs to be
+		 *	changed when the next timer event changes.
+		 */
+		if (wake && ((el->now + *wake) != el->timer_armed)) {
+			struct itimerspec its = { .it_value = fr_time_delta_to_timespec(*wake) };
+
+			if (timerfd_settime(el->timer_fd, 0, &its, NULL) < 0) return -1;
+			el->timer_armed = el->now + *wake;
+		}
+	}
+
+	num = epoll_wait(el->kq, el->epoll_events, NUM_ELEMENTS(el->epoll_events), timeout);
+	if (num < 0) return -1;
+
+	for (i = 0; i < num; i++) {
+		void *ptr = el->epoll_events[i].data.ptr;
+
+		if (ptr == &el->timer_fd) {
+			fr_event_epoll_drain(el->timer_fd);
+			el->timer_armed = 0;
+			continue;
+		}
+
+		/*
+		 *	Just a wakeup, e.g. from fr_event_loop_exit().
+		 */
+		if (ptr == &el->wake_fd) {
+			fr_event_epoll_drain(el->wake_fd);
+			continue;
+		}
+
+		switch (*(fr_event_epoll_type_t *) ptr) {
+		case FR_EVENT_EPOLL_PID:
+			count += fr_event_epoll_pid_translate(&el->events[count], el, ptr);
+			break;
+
+		case FR_EVENT_EPOLL_FD:
+			ef = ptr;
+			if (ef->filter == FR_EVENT_FILTER_VNODE) {
+				count += fr_event_epoll_vnode_translate(&el->events[count], ef);
+			} else {
+				count += fr_event_epoll_io_translate(&el->events[count], ef,
+								     el->epoll_events[i].events);
+			}
+			break;
+		}
+	}
+
+	/*
+	 *	FDs which epoll can't watch are always ready.  If
+	 *	there isn't room for them all, the rest are picked
+	 *	up on the next call, as we don't wait if the list
+	 *	isn't empty.
+	 */
+	for (ef = fr_dlist_head(&el->ready);
+	     ef && (count <= (FR_EV_BATCH_FDS - 2));
+	     ef = fr_dlist_next(&el->ready, ef)) {
+		if (ef->epoll_events & EPOLLIN) EV_SET(&el->events[count++], ef->fd, EVFILT_READ, 0, 0, 0, ef);
+		if (ef->epoll_events & EPOLLOUT) EV_SET(&el->events[count++], ef->fd, EVFILT_WRITE, 0, 0, 0, ef);
+	}
+
+	return count;
+}
+#endif
+
+/** Apply a set of filter changes to the kqueue, or epoll
+ *
+ * @param[in] el	the event list.
+ * @param[in] ef	the changes are for.
+ * @param[in] evset	as built by #fr_event_build_evset.
+ * @param[in] count	number of changes.
+ * @return
+ *	- >= 0 on success.
+ *	- -1 on failure, with errno set.
+ */
+static inline int fr_event_changes_apply(fr_event_list_t *el, UNUSED fr_event_fd_t *ef,
+					 struct kevent const evset[], int count)
+{
+#ifdef WITH_EPOLL
+	return fr_event_epoll_apply(el, ef, evset, count);
+#else
+	return kevent(el->kq, evset, count, NULL, 0, NULL);
+#endif
+}
+
 /** Discover the type of a file descriptor
  *
  * This function writes the result of the discovery to the ef->type,
@@ -629,7 +1454,7 @@ static int _event_fd_delete(fr_event_fd_t *ef)
 			/*
 			 *	If this fails, assert on debug builds.
 			 */
-			ret = kevent(el->kq, evset, count, NULL, 0, NULL);
+			ret = fr_event_changes_apply(el, ef, evset, count);
 			if (!fr_cond_assert_msg(ret >= 0,
 						"FD %i was closed without being removed from the KQ: %s",
 						ef->fd, fr_syserror(errno))) {
@@ -785,7 +1610,7 @@ int fr_event_filter_update(fr_event_list_t *el, int fd, fr_event_filter_t filter
 		return -1;
 	}
 
-	if (count && unlikely(kevent(el->kq, evset, count, NULL, 0, NULL) < 0)) {
+	if (count && unlikely(fr_event_changes_apply(el, ef, evset, count) < 0)) {
 		fr_strerror_printf("Failed updating filters for FD %i: %s", ef->fd, fr_syserror(errno));
 		goto error;
 	}
@@ -850,6 +1675,10 @@ int fr_event_filter_insert(TALLOC_CTX *ctx, fr_event_list_t *el, int fd,
 			return -1;
 		}
 		talloc_set_destructor(ef, _event_fd_delete);
+#ifdef WITH_EPOLL
+		ef->epoll_type = FR_EVENT_EPOLL_FD;
+		ef->inotify_fd = -1;
+#endif
 
 		/*
 		 *	Bind the lifetime of the event to the specified
@@ -886,7 +1715,7 @@ int fr_event_filter_insert(TALLOC_CTX *ctx, fr_event_list_t *el, int fd,
 
 		count = fr_event_build_evset(evset, sizeof(evset)/sizeof(*evset), &ef->active, ef, funcs, &ef->active);
 		if (count < 0) goto free;
-		if (count && (unlikely(kevent(el->kq, evset, count, NULL, 0, NULL) < 0))) {
+		if (count && (unlikely(fr_event_changes_apply(el, ef, evset, count) < 0))) {
 			fr_strerror_printf("Failed inserting filters for FD %i: %s", fd, fr_syserror(errno));
 			goto free;
 		}
@@ -916,7 +1745,7 @@ int fr_event_filter_insert(TALLOC_CTX *ctx, fr_event_list_t *el, int fd,
 			memcpy(&ef->active, &active, sizeof(ef->active));
 			return -1;
 		}
-		if (count && (unlikely(kevent(el->kq, evset, count, NULL, 0, NULL) < 0))) {
+		if (count && (unlikely(fr_event_changes_apply(el, ef, evset, count) < 0))) {
 			fr_strerror_printf("Failed modifying filters for FD %i: %s", fd, fr_syserror(errno));
 			goto error;
 		}
@@ -995,7 +1824,7 @@ static int _event_timer_free(fr_event_timer_t *ev)
 	fr_event_timer_t const **ev_p;
 	int		ret;
 
-	ret = fr_heap_extract(el->times, ev);
+	ret = event_timer_extract(el, ev);
 
 	ev_p = ev->parent;
 	rad_assert(*(ev->parent) == ev);
@@ -1064,6 +1893,7 @@ int fr_event_timer_at(TALLOC_CTX *ctx, fr_event_list_t *el, fr_event_timer_t con
 	new_event:
 		ev = talloc_zero(el, fr_event_timer_t);
 		if (unlikely(!ev)) return -1;
+		fr_dlist_entry_init(&ev->wheel_entry);
 
 		/*
 		 *	Bind the lifetime of the event to the specified
@@ -1095,7 +1925,7 @@ int fr_event_timer_at(TALLOC_CTX *ctx, fr_event_list_t *el, fr_event_timer_t con
 		 *	Event may have fired, in which case the
 		 *	event will no longer be in the event loop.
 		 */
-		(void) fr_heap_extract(el->times, ev);
+		(void) event_timer_extract(el, ev);
 	}
 
 	ev->el = el;
@@ -1109,7 +1939,7 @@ int fr_event_timer_at(TALLOC_CTX *ctx, fr_event_list_t *el, fr_event_timer_t con
 		ev->next = el->ev_to_add;
 		el->ev_to_add = ev;
 
-	} else if (unlikely(fr_heap_insert(el->times, ev) < 0)) {
+	} else if (unlikely(event_timer_insert(el, ev) < 0)) {
 		talloc_free(ev);
 		return -1;
 	}
@@ -1155,6 +1985,12 @@ int fr_event_timer_in(TALLOC_CTX *ctx, fr_event_list_t *el, fr_event_timer_t con
  */
 static int _event_pid_free(fr_event_pid_t *ev)
 {
+#ifdef WITH_EPOLL
+	if (ev->pidfd < 0) return 0; /* already deleted from epoll */
+
+	(void) epoll_ctl(ev->el->kq, EPOLL_CTL_DEL, ev->pidfd, NULL);
+	close(ev->pidfd);
+#else
 	struct kevent evset;
 
 	if (ev->pid == 0) return 0; /* already deleted from kevent */
@@ -1162,6 +1998,7 @@ static int _event_pid_free(fr_event_pid_t *ev)
 	EV_SET(&evset, ev->pid, EVFILT_PROC, EV_DELETE, NOTE_EXIT, 0, ev);
 
 	(void) kevent(ev->el->kq, &evset, 1, NULL, 0, NULL);
+#endif
 
 	return 0;
 }
@@ -1188,19 +2025,48 @@ int fr_event_pid_wait(TALLOC_CTX *ctx, fr_event_list_t *el, fr_event_pid_t const
 		      pid_t pid, fr_event_pid_cb_t wait_fn, void *uctx)
 {
 	fr_event_pid_t *ev;
+#ifdef WITH_EPOLL
+	struct epoll_event epev;
+#else
 	struct kevent evset;
+#endif
 
 	ev = talloc(ctx, fr_event_pid_t);
+	ev->el = el;
 	ev->pid = pid;
 	ev->callback = wait_fn;
 	ev->uctx = uctx;
 
+#ifdef WITH_EPOLL
+	ev->epoll_type = FR_EVENT_EPOLL_PID;
+
+#  ifdef SYS_pidfd_open
+	ev->pidfd = syscall(SYS_pidfd_open, pid, 0);
+#  else
+	ev->pidfd = -1;
+	errno = ENOSYS;
+#  endif
+	if (ev->pidfd < 0) {
+		fr_strerror_printf("Failed opening pidfd for PID %ld: %s", (long) pid, fr_syserror(errno));
+		talloc_free(ev);
+		return -1;
+	}
+
+	epev = (struct epoll_event) { .events = EPOLLIN, .data.ptr = ev };
+	if (unlikely(epoll_ctl(el->kq, EPOLL_CTL_ADD, ev->pidfd, &epev) < 0)) {
+		fr_strerror_printf("Failed adding waiter for PID %ld", (long) pid);
+		close(ev->pidfd);
+		talloc_free(ev);
+		return -1;
+	}
+#else
 	EV_SET(&evset, pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, ev);
 
 	if (unlikely(kevent(el->kq, &evset, 1, NULL, 0, NULL) < 0)) {
 		fr_strerror_printf("Failed adding waiter for PID %ld", (long) pid);
 		return -1;
 	}
+#endif
 	talloc_set_destructor(ev, _event_pid_free);
 
 	*ev_p = ev;
@@ -1216,6 +2082,17 @@ int fr_event_pid_wait(TALLOC_CTX *ctx, fr_event_list_t *el, fr_event_pid_t const
  *	- 0 on error
  *	- uintptr_t ident for EVFILT_USER signaling
  */
+#ifdef WITH_EPOLL
+uintptr_t fr_event_user_insert(UNUSED fr_event_list_t *el, UNUSED fr_event_user_handler_t callback,
+			       UNUSED void *uctx)
+{
+	/*
+	 *	There's no EVFILT_USER equivalent for epoll.
+	 */
+	fr_strerror_printf("User events are not supported with epoll");
+	return 0;
+}
+#else
 uintptr_t fr_event_user_insert(fr_event_list_t *el, fr_event_user_handler_t callback, void *uctx)
 {
 	fr_event_user_t *user;
@@ -1229,6 +2106,7 @@ uintptr_t fr_event_user_insert(fr_event_list_t *el, fr_event_user_handler_t call
 
 	return user->ident;
 }
+#endif
 
 /** Delete a user callback to the event list.
  *
@@ -1383,11 +2261,23 @@ int fr_event_timer_run(fr_event_list_t *el, fr_time_t *when)
 
 	if (unlikely(!el)) return 0;
 
-	if (fr_heap_num_elements(el->times) == 0) {
+	if (event_num_timers(el) == 0) {
 		*when = 0;
 		return 0;
 	}
 
+	/*
+	 *	The wheel only hands back timers which are due.
+	 */
+	if (el->wheel) {
+		ev = wheel_due(el->wheel, wheel_tick(el->wheel, *when, false));
+		if (!ev) {
+			if (!event_timer_next(el, when)) *when = 0;
+			return 0;
+		}
+		goto run;
+	}
+
 	ev = fr_heap_peek(el->times);
 	if (!ev) {
 		*when = 0;
@@ -1402,6 +2292,8 @@ int fr_event_timer_run(fr_event_list_t *el, fr_time_t *when)
 		return 0;
 	}
 
+run:
+
 	callback = ev->callback;
 	memcpy(&uctx, &ev->uctx, sizeof(uctx));
 
@@ -1429,11 +2321,13 @@ int fr_event_timer_run(fr_event_list_t *el, fr_time_t *when)
 int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 {
 	fr_time_t		when, *wake;
+#ifndef WITH_EPOLL
 	struct timespec		ts_when, *ts_wake;
+#endif
 	fr_event_pre_t		*pre;
 	int			num_fd_events;
 	bool			timer_event_ready = false;
-	fr_event_timer_t	*ev;
+	fr_time_t		next;
 
 	el->num_fd_events = 0;
 
@@ -1455,13 +2349,12 @@ int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 	 *	events are in the past.  Or, we wait for a future
 	 *	timer event.
 	 */
-	ev = fr_heap_peek(el->times);
-	if (ev) {
-		if (ev->when <= el->now) {
+	if (event_timer_next(el, &next)) {
+		if (next <= el->now) {
 			timer_event_ready = true;
 
 		} else if (wait) {
-			when = ev->when - el->now;
+			when = next - el->now;
 
 		} /* else we're not waiting, leave "when == 0" */
 
@@ -1492,6 +2385,14 @@ int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 		}
 	}
 
+	/*
+	 *	Populate el->events with the list of I/O events
+	 *	that occurred since this function was last called
+	 *	or wait for the next timer event.
+	 */
+#ifdef WITH_EPOLL
+	num_fd_events = fr_event_epoll_wait(el, wake);
+#else
 	/*
 	 *	Wake is the delta between el->now
 	 *	(the event loops view of the current time)
@@ -1504,12 +2405,8 @@ int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 		ts_wake = NULL;
 	}
 
-	/*
-	 *	Populate el->events with the list of I/O events
-	 *	that occurred since this function was last called
-	 *	or wait for the next timer event.
-	 */
 	num_fd_events = kevent(el->kq, NULL, 0, el->events, FR_EV_BATCH_FDS, ts_wake);
+#endif
 
 	/*
 	 *	Interrupt is different from timeout / FD events.
@@ -1518,7 +2415,7 @@ int fr_event_corral(fr_event_list_t *el, fr_time_t now, bool wait)
 		if (errno == EINTR) {
 			return 0;
 		} else {
-			fr_strerror_printf("Failed calling kevent: %s", fr_syserror(errno));
+			fr_strerror_printf("Failed waiting for events: %s", fr_syserror(errno));
 			return -1;
 		}
 	}
@@ -1758,7 +2655,7 @@ service:
 	 *	Run all of the timer events.  Note that these can add
 	 *	new timers!
 	 */
-	if (fr_heap_num_elements(el->times) > 0) {
+	if (event_num_timers(el) > 0) {
 		do {
 			when = el->now;
 		} while (fr_event_timer_run(el, &when) == 1);
@@ -1785,7 +2682,7 @@ service:
 			next = ev->next;
 			ev->next = NULL;
 
-			if (unlikely(fr_heap_insert(el->times, ev) < 0)) {
+			if (unlikely(event_timer_insert(el, ev) < 0)) {
 				talloc_free(ev);
 			}
 			el->ev_to_add = next;
@@ -1815,7 +2712,11 @@ service:
  */
 void fr_event_loop_exit(fr_event_list_t *el, int code)
 {
+#ifdef WITH_EPOLL
+	uint64_t one = 1;
+#else
 	struct kevent kev;
+#endif
 
 	if (unlikely(!el)) return;
 
@@ -1824,8 +2725,12 @@ void fr_event_loop_exit(fr_event_list_t *el, int code)
 	/*
 	 *	Signal the control plane to exit.
 	 */
+#ifdef WITH_EPOLL
+	if (write(el->wake_fd, &one, sizeof(one)) < 0) return;	/* Already signalled */
+#else
 	EV_SET(&kev, 0, EVFILT_USER, 0, NOTE_TRIGGER | NOTE_FFNOP, 0, NULL);
 	(void) kevent(el->kq, &kev, 1, NULL, 0, NULL);
+#endif
 }
 
 /** Check to see whether the event loop is in the process of exiting
@@ -1867,11 +2772,15 @@ static int _event_list_free(fr_event_list_t *el)
 {
 	fr_event_timer_t const *ev;
 
-	while ((ev = fr_heap_peek(el->times)) != NULL) fr_event_timer_delete(el, &ev);
+	while ((ev = event_timer_any(el)) != NULL) fr_event_timer_delete(el, &ev);
 
 	talloc_free_children(el);
 
 	if (el->kq >= 0) close(el->kq);
+#ifdef WITH_EPOLL
+	if (el->timer_fd >= 0) close(el->timer_fd);
+	if (el->wake_fd >= 0) close(el->wake_fd);
+#endif
 
 	return 0;
 }
@@ -1888,7 +2797,11 @@ static int _event_list_free(fr_event_list_t *el)
 fr_event_list_t *fr_event_list_alloc(TALLOC_CTX *ctx, fr_event_status_cb_t status, void *status_uctx)
 {
 	fr_event_list_t		*el;
+#ifdef WITH_EPOLL
+	struct epoll_event	ev;
+#else
 	struct kevent		kev;
+#endif
 
 	el = talloc_zero(ctx, fr_event_list_t);
 	if (!fr_cond_assert(el)) {
@@ -1897,6 +2810,10 @@ fr_event_list_t *fr_event_list_alloc(TALLOC_CTX *ctx, fr_event_status_cb_t statu
 	}
 	el->time = fr_time;
 	el->kq = -1;	/* So destructor can be used before kqueue() provides us with fd */
+#ifdef WITH_EPOLL
+	el->timer_fd = -1;
+	el->wake_fd = -1;
+#endif
 	talloc_set_destructor(el, _event_list_free);
 
 	el->times = fr_heap_talloc_create(el, fr_event_timer_cmp, fr_event_timer_t, heap_id);
@@ -1913,11 +2830,49 @@ fr_event_list_t *fr_event_list_alloc(TALLOC_CTX *ctx, fr_event_status_cb_t statu
 		goto error;
 	}
 
+#ifdef WITH_EPOLL
+	el->kq = epoll_create1(EPOLL_CLOEXEC);
+	if (el->kq < 0) {
+		fr_strerror_printf("Failed allocating epoll: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	el->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (el->timer_fd < 0) {
+		fr_strerror_printf("Failed allocating timerfd: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	el->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (el->wake_fd < 0) {
+		fr_strerror_printf("Failed allocating eventfd: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	/*
+	 *	The timer and wakeup FDs are identified by the
+	 *	address of the field holding them.
+	 */
+	ev = (struct epoll_event) { .events = EPOLLIN, .data.ptr = &el->timer_fd };
+	if (epoll_ctl(el->kq, EPOLL_CTL_ADD, el->timer_fd, &ev) < 0) {
+		fr_strerror_printf("Failed adding timer to epoll: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	ev = (struct epoll_event) { .events = EPOLLIN, .data.ptr = &el->wake_fd };
+	if (epoll_ctl(el->kq, EPOLL_CTL_ADD, el->wake_fd, &ev) < 0) {
+		fr_strerror_printf("Failed adding exit callback to epoll: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	fr_dlist_init(&el->ready, fr_event_fd_t, ready_entry);
+#else
 	el->kq = kqueue();
 	if (el->kq < 0) {
 		fr_strerror_printf("Failed allocating kqueue: %s", fr_syserror(errno));
 		goto error;
 	}
+#endif
 
 	fr_dlist_init(&el->pre_callbacks, fr_event_pre_t, entry);
 	fr_dlist_init(&el->post_callbacks, fr_event_post_t, entry);
@@ -1925,6 +2880,7 @@ fr_event_list_t *fr_event_list_alloc(TALLOC_CTX *ctx, fr_event_status_cb_t statu
 
 	if (status) (void) fr_event_pre_insert(el, status, status_uctx);
 
+#ifndef WITH_EPOLL
 	/*
 	 *	Set our "exit" callback as ident 0.
 	 */
@@ -1933,6 +2889,7 @@ fr_event_list_t *fr_event_list_alloc(TALLOC_CTX *ctx, fr_event_status_cb_t statu
 		fr_strerror_printf("Failed adding exit callback to kqueue: %s", fr_syserror(errno));
 		goto error;
 	}
+#endif
 
 	return el;
 }
@@ -1947,6 +2904,73 @@ void fr_event_list_set_time_func(fr_event_list_t *el, fr_event_time_source_t fun
 	el->time = func;
 }
 
+/** Switch an event list to using a timer wheel
+ *
+ * The default is to keep timers in a heap, which fires them at exactly
+ * the time they were scheduled for, but costs O(log n) to insert and
+ * delete them.  A timer wheel costs O(1), but timers may fire up to
+ * resolution late.  Use the wheel for event lists which have hundreds
+ * of thousands of timers, and don't need them to be precise.
+ *
+ * Any timers already in the event list are moved over.
+ *
+ * @param[in] el		to change.
+ * @param[in] resolution	of the timer wheel.  Zero switches back to the heap.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int fr_event_list_set_timer_wheel(fr_event_list_t *el, fr_time_delta_t resolution)
+{
+	fr_event_wheel_t	*w = NULL, *old = el->wheel;
+	fr_event_timer_t	*ev, *pending = NULL;
+	unsigned int		i, j;
+
+	if (resolution < 0) {
+		fr_strerror_printf("Invalid timer resolution");
+		return -1;
+	}
+
+	if (resolution) {
+		w = talloc_zero(el, fr_event_wheel_t);
+		if (!w) {
+			fr_strerror_printf("Out of memory");
+			return -1;
+		}
+		w->resolution = resolution;
+		w->base = wheel_tick(w, el->time(), false);
+
+		for (i = 0; i < FR_EVENT_WHEEL_LEVELS; i++) {
+			for (j = 0; j < FR_EVENT_WHEEL_SLOTS; j++) fr_dlist_entry_init(&w->slot[i][j]);
+		}
+	}
+
+	/*
+	 *	Take the existing timers out of the old heap or
+	 *	wheel, and put them into the new one.
+	 */
+	for (;;) {
+		ev = event_timer_any(el);
+		if (!ev) break;
+
+		(void) event_timer_extract(el, ev);
+		ev->next = pending;
+		pending = ev;
+	}
+
+	talloc_free(old);
+	el->wheel = w;
+
+	while ((ev = pending) != NULL) {
+		pending = ev->next;
+		ev->next = NULL;
+
+		if (unlikely(event_timer_insert(el, ev) < 0)) talloc_free(ev);
+	}
+
+	return 0;
+}
+
 #ifdef TESTING
 
 /*
@@ -16,51 +16,79 @@
 
 /** Resizable hash tables
  *
- * The weird "reverse" function is based on an idea from
- * "Split-Ordered Lists - Lock-free Resizable Hash Tables", with
- * modifications so that they're not lock-free. :(
+ * The table is open addressed, in the style of Google's "SwissTable".
+ * Entries are stored in one flat array of slots, and alongside it is an
+ * array of control bytes, one per slot.  A control byte records whether
+ * the slot is empty, deleted, or full.  If it's full, the control byte
+ * also holds 7 bits of the entry's hash.
  *
- * However, the split-order idea allows a fast & easy splitting of the
- * hash bucket chain when the hash table is resized.  Without it, we'd
- * have to check & update the pointers for every node in the buck chain,
- * rather than being able to move 1/2 of the entries in the chain with
- * one update.
+ * Lookups check a whole group of control bytes at once (using SSE2
+ * where it's available), and only look at the slots whose hash bits
+ * match.  So most lookups touch one cache line of control bytes and one
+ * slot, instead of chasing a pointer per entry.
+ *
+ * Deleted entries leave a tombstone, so that deleting entries doesn't
+ * move other entries around.  The tombstones are cleaned up the next
+ * time the table is resized.
+ *
+ * Lookups never modify the table, so it can be read by multiple threads
+ * at once, so long as nothing is updating it.
  *
  * @file src/lib/util/hash.c
  *
- * @copyright 2005,2006 The FreeRADIUS server project
+ * @copyright 2005,2006,2020 The FreeRADIUS server project
  */
 RCSID("$Id$")
 
 #include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/rand.h>
 #include <freeradius-devel/util/talloc.h>
 
+#include <pthread.h>
+
+#ifdef __SSE2__
+#  include <emmintrin.h>
+#endif
+
+/*
+ *	The number of control bytes we examine at once.  Tables
+ *	are always a whole number of groups in size.
+ */
+#define FR_HASH_GROUP_SIZE	(16)
+
+/*
+ *	A reasonable number of slots to start off with.
+ *	Should be a power of two, and a multiple of the group size.
+ */
+#define FR_HASH_NUM_SLOTS	(64)
+
 /*
- *	A reasonable number of buckets to start off with.
- *	Should be a power of two.
+ *	Control byte values.  Full slots have the top bit clear,
+ *	and hold the bottom 7 bits of the (mixed) hash.
  */
-#define FR_HASH_NUM_BUCKETS (64)
+#define CTRL_EMPTY		((uint8_t)0x80)
+#define CTRL_DELETED		((uint8_t)0xfe)
+
+#define CTRL_IS_FULL(_c)	(((_c) & 0x80) == 0)
 
 struct fr_hash_entry_s {
-	fr_hash_entry_t *next;
-	uint32_t	reversed;
-	uint32_t	key;
-	void 		*data;
+	uint32_t	key;		//!< Hash of the data, from the user's hash function.
+	void		*data;
 };
 
 struct fr_hash_table_s {
 	int			num_elements;
-	int			num_buckets; /* power of 2 */
-	int			next_grow;
-	int			mask;
+	int			num_deleted;	//!< Tombstones left by deletions.
+	uint32_t		num_slots;	//!< Power of 2.
+	uint32_t		mask;		//!< Group index mask, i.e. (num_slots / FR_HASH_GROUP_SIZE) - 1.
+	uint32_t		max_used;	//!< Resize once elements + tombstones reach this.
 
 	fr_hash_table_free_t	free;
 	fr_hash_table_hash_t	hash;
 	fr_hash_table_cmp_t	cmp;
 
-	fr_hash_entry_t		null;
-
-	fr_hash_entry_t		**buckets;
+	uint8_t			*ctrl;		//!< One control byte per slot.
+	fr_hash_entry_t		*slots;
 };
 
 #ifdef TESTING
@@ -68,205 +96,175 @@ static int grow = 0;
 #endif
 
 /*
- * perl -e 'foreach $i (0..255) {$r = 0; foreach $j (0 .. 7 ) { if (($i & ( 1<< $j)) != 0) { $r |= (1 << (7 - $j));}} print $r, ", ";if (($i & 7) == 7) {print "\n";}}'
- */
-static const uint8_t reversed_byte[256] = {
-	0,  128, 64, 192, 32, 160, 96,  224,
-	16, 144, 80, 208, 48, 176, 112, 240,
-	8,  136, 72, 200, 40, 168, 104, 232,
-	24, 152, 88, 216, 56, 184, 120, 248,
-	4,  132, 68, 196, 36, 164, 100, 228,
-	20, 148, 84, 212, 52, 180, 116, 244,
-	12, 140, 76, 204, 44, 172, 108, 236,
-	28, 156, 92, 220, 60, 188, 124, 252,
-	2,  130, 66, 194, 34, 162, 98,  226,
-	18, 146, 82, 210, 50, 178, 114, 242,
-	10, 138, 74, 202, 42, 170, 106, 234,
-	26, 154, 90, 218, 58, 186, 122, 250,
-	6,  134, 70, 198, 38, 166, 102, 230,
-	22, 150, 86, 214, 54, 182, 118, 246,
-	14, 142, 78, 206, 46, 174, 110, 238,
-	30, 158, 94, 222, 62, 190, 126, 254,
-	1,  129, 65, 193, 33, 161, 97,  225,
-	17, 145, 81, 209, 49, 177, 113, 241,
-	9,  137, 73, 201, 41, 169, 105, 233,
-	25, 153, 89, 217, 57, 185, 121, 249,
-	5,  133, 69, 197, 37, 165, 101, 229,
-	21, 149, 85, 213, 53, 181, 117, 245,
-	13, 141, 77, 205, 45, 173, 109, 237,
-	29, 157, 93, 221, 61, 189, 125, 253,
-	3,  131, 67, 195, 35, 163, 99,  227,
-	19, 147, 83, 211, 51, 179, 115, 243,
-	11, 139, 75, 203, 43, 171, 107, 235,
-	27, 155, 91, 219, 59, 187, 123, 251,
-	7,  135, 71, 199, 39, 167, 103, 231,
-	23, 151, 87, 215, 55, 183, 119, 247,
-	15, 143, 79, 207, 47, 175, 111, 239,
-	31, 159, 95, 223, 63, 191, 127, 255
-};
-
+ *	The user's hash functions are mostly FNV, and some of them
+ *	only hash a few bits of their data.  Mix the key so that both
+ *	the group index (high bits) and the control byte (low bits)
+ *	depend on all of it.
+ */
+static inline CC_HINT(always_inline) uint32_t key_mix(uint32_t key)
+{
+	key ^= key >> 16;
+	key *= 0x85ebca6b;
+	key ^= key >> 13;
+	key *= 0xc2b2ae35;
+	key ^= key >> 16;
 
-/*
- * perl -e 'foreach $i (0..255) {$r = 0;foreach $j (0 .. 7) { $r = $i & (1 << (7 - $j)); last if ($r)} print $i & ~($r), ", ";if (($i & 7) == 7) {print "\n";}}'
- */
-static uint8_t parent_byte[256] = {
-	0, 0, 0, 1, 0, 1, 2, 3,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	8, 9, 10, 11, 12, 13, 14, 15,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	8, 9, 10, 11, 12, 13, 14, 15,
-	16, 17, 18, 19, 20, 21, 22, 23,
-	24, 25, 26, 27, 28, 29, 30, 31,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	8, 9, 10, 11, 12, 13, 14, 15,
-	16, 17, 18, 19, 20, 21, 22, 23,
-	24, 25, 26, 27, 28, 29, 30, 31,
-	32, 33, 34, 35, 36, 37, 38, 39,
-	40, 41, 42, 43, 44, 45, 46, 47,
-	48, 49, 50, 51, 52, 53, 54, 55,
-	56, 57, 58, 59, 60, 61, 62, 63,
-	0, 1, 2, 3, 4, 5, 6, 7,
-	8, 9, 10, 11, 12, 13, 14, 15,
-	16, 17, 18, 19, 20, 21, 22, 23,
-	24, 25, 26, 27, 28, 29, 30, 31,
-	32, 33, 34, 35, 36, 37, 38, 39,
-	40, 41, 42, 43, 44, 45, 46, 47,
-	48, 49, 50, 51, 52, 53, 54, 55,
-	56, 57, 58, 59, 60, 61, 62, 63,
-	64, 65, 66, 67, 68, 69, 70, 71,
-	72, 73, 74, 75, 76, 77, 78, 79,
-	80, 81, 82, 83, 84, 85, 86, 87,
-	88, 89, 90, 91, 92, 93, 94, 95,
-	96, 97, 98, 99, 100, 101, 102, 103,
-	104, 105, 106, 107, 108, 109, 110, 111,
-	112, 113, 114, 115, 116, 117, 118, 119,
-	120, 121, 122, 123, 124, 125, 126, 127
-};
+	return key;
+}
 
+#define H1(_mixed)	((_mixed) >> 7)
+#define H2(_mixed)	((uint8_t)((_mixed) & 0x7f))
 
 /*
- *	Reverse a key.
+ *	Return a bitmask of the slots in a group whose control
+ *	byte is "c".
  */
-static uint32_t reverse(uint32_t key)
+static inline CC_HINT(always_inline) uint32_t group_match(uint8_t const *group, uint8_t c)
 {
-	return ((reversed_byte[key & 0xff] << 24) |
-		(reversed_byte[(key >> 8) & 0xff] << 16) |
-		(reversed_byte[(key >> 16) & 0xff] << 8) |
-		(reversed_byte[(key >> 24) & 0xff]));
+#ifdef __SSE2__
+	__m128i ctrl = _mm_loadu_si128((__m128i const *)group);
+
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)c)));
+#else
+	uint32_t	mask = 0;
+	int		i;
+
+	for (i = 0; i < FR_HASH_GROUP_SIZE; i++) if (group[i] == c) mask |= (1 << i);
+
+	return mask;
+#endif
 }
 
 /*
- *	Take the parent by discarding the highest bit that is set.
+ *	Return a bitmask of the slots in a group which are
+ *	empty or deleted.
  */
-static uint32_t parent_of(uint32_t key)
+static inline CC_HINT(always_inline) uint32_t group_match_free(uint8_t const *group)
 {
-	if (key > 0x00ffffff)
-		return (key & 0x00ffffff) | (parent_byte[key >> 24] << 24);
-
-	if (key > 0x0000ffff)
-		return (key & 0x0000ffff) | (parent_byte[key >> 16] << 16);
+#ifdef __SSE2__
+	return (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((__m128i const *)group));
+#else
+	uint32_t	mask = 0;
+	int		i;
 
-	if (key > 0x000000ff)
-		return (key & 0x000000ff) | (parent_byte[key >> 8] << 8);
+	for (i = 0; i < FR_HASH_GROUP_SIZE; i++) if (!CTRL_IS_FULL(group[i])) mask |= (1 << i);
 
-	return parent_byte[key];
+	return mask;
+#endif
 }
 
+/*
+ *	Probe the groups using triangular numbers.  As the number
+ *	of groups is a power of 2, this visits every group once.
+ */
+#define PROBE_START(_ht, _mixed, _group, _step) \
+	_group = H1(_mixed) & (_ht)->mask; \
+	_step = 0
+
+#define PROBE_NEXT(_ht, _group, _step) \
+	_group = ((_group) + ++(_step)) & (_ht)->mask
 
-static fr_hash_entry_t *list_find(fr_hash_table_t *ht,
-				    fr_hash_entry_t *head,
-				    uint32_t reversed,
-				    void const *data)
+/*
+ *	Find the slot holding an entry which matches the data.
+ */
+static fr_hash_entry_t *hash_table_find(fr_hash_table_t *ht, uint32_t key, void const *data)
 {
-	fr_hash_entry_t *cur;
+	uint32_t	mixed = key_mix(key);
+	uint32_t	group, step;
+	uint8_t		h2 = H2(mixed);
+
+	PROBE_START(ht, mixed, group, step);
+
+	for (;;) {
+		uint8_t const	*ctrl = ht->ctrl + (group * FR_HASH_GROUP_SIZE);
+		fr_hash_entry_t	*slots = ht->slots + (group * FR_HASH_GROUP_SIZE);
+		uint32_t	match;
+
+		for (match = group_match(ctrl, h2); match; match &= match - 1) {
+			fr_hash_entry_t *slot = &slots[__builtin_ctz(match)];
+
+			if (slot->key != key) continue;
+			if (ht->cmp && (ht->cmp(data, slot->data) != 0)) continue;
 
-	for (cur = head; cur != &ht->null; cur = cur->next) {
-		if (cur->reversed == reversed) {
-			if (ht->cmp) {
-				int cmp = ht->cmp(data, cur->data);
-				if (cmp > 0) break;
-				if (cmp < 0) continue;
-			}
-			return cur;
+			return slot;
 		}
-		if (cur->reversed > reversed) break;
-	}
 
-	return NULL;
-}
+		/*
+		 *	Entries are only ever placed past a group
+		 *	if the group was full.  So if there's an
+		 *	empty slot here, the entry isn't in the table.
+		 */
+		if (group_match(ctrl, CTRL_EMPTY)) return NULL;
 
+		if (step > ht->mask) return NULL;	/* Can't happen, but don't loop forever */
+		PROBE_NEXT(ht, group, step);
+	}
+}
 
 /*
- *	Inserts a new entry into the list, in order.
+ *	Find the first empty or deleted slot for a key.
  */
-static int list_insert(fr_hash_table_t *ht,
-		       fr_hash_entry_t **head, fr_hash_entry_t *node)
+static uint32_t hash_table_find_free(fr_hash_table_t *ht, uint32_t mixed)
 {
-	fr_hash_entry_t **last, *cur;
+	uint32_t	group, step;
 
-	last = head;
+	PROBE_START(ht, mixed, group, step);
 
-	for (cur = *head; cur != &ht->null; cur = cur->next) {
-		if (cur->reversed > node->reversed) break;
-		last = &(cur->next);
+	for (;;) {
+		uint32_t match;
 
-		if (cur->reversed == node->reversed) {
-			if (ht->cmp) {
-				int cmp = ht->cmp(node->data, cur->data);
-				if (cmp > 0) break;
-				if (cmp < 0) continue;
-			}
-			return 0;
-		}
-	}
+		match = group_match_free(ht->ctrl + (group * FR_HASH_GROUP_SIZE));
+		if (match) return (group * FR_HASH_GROUP_SIZE) + __builtin_ctz(match);
 
-	node->next = *last;
-	*last = node;
-
-	return 1;
+		PROBE_NEXT(ht, group, step);
+	}
 }
 
-
 /*
- *	Delete an entry from the list.
+ *	Allocate new arrays of "num_slots", and move all the entries
+ *	into them.  Tombstones are discarded.
  */
-static int list_delete(fr_hash_table_t *ht,
-		       fr_hash_entry_t **head, fr_hash_entry_t *node)
+static int hash_table_resize(fr_hash_table_t *ht, uint32_t num_slots)
 {
-	fr_hash_entry_t **last, *cur;
+	uint8_t		*ctrl, *old_ctrl = ht->ctrl;
+	fr_hash_entry_t	*slots, *old_slots = ht->slots;
+	uint32_t	i, old_num_slots = ht->num_slots;
 
-	last = head;
+	ctrl = talloc_array(ht, uint8_t, num_slots);
+	if (!ctrl) return -1;
 
-	for (cur = *head; cur != &ht->null; cur = cur->next) {
-		if (cur == node) break;
-		last = &(cur->next);
+	slots = talloc_array(ht, fr_hash_entry_t, num_slots);
+	if (!slots) {
+		talloc_free(ctrl);
+		return -1;
 	}
+	memset(ctrl, CTRL_EMPTY, num_slots);
 
-	*last = node->next;
-	return 1;
-}
+	ht->ctrl = ctrl;
+	ht->slots = slots;
+	ht->num_slots = num_slots;
+	ht->mask = (num_slots / FR_HASH_GROUP_SIZE) - 1;
+	ht->max_used = num_slots - (num_slots >> 3);	/* 7/8 */
+	ht->num_deleted = 0;
 
+	for (i = 0; i < old_num_slots; i++) {
+		uint32_t mixed, slot;
 
-static int _fr_hash_table_free(fr_hash_table_t *ht)
-{
-	int i;
-	fr_hash_entry_t *node, *next;
+		if (!CTRL_IS_FULL(old_ctrl[i])) continue;
 
-	/*
-	 *	Walk over the buckets, freeing them all.
-	 */
-	for (i = 0; i < ht->num_buckets; i++) {
-		if (ht->buckets[i]) for (node = ht->buckets[i];
-					 node != &ht->null;
-					 node = next) {
-			next = node->next;
-			if (!node->data) continue; /* dummy entry */
-
-			talloc_free(node);
-		}
+		mixed = key_mix(old_slots[i].key);
+		slot = hash_table_find_free(ht, mixed);
+		ctrl[slot] = H2(mixed);
+		slots[slot] = old_slots[i];
 	}
-	talloc_free(ht->buckets);
+
+	talloc_free(old_ctrl);
+	talloc_free(old_slots);
+
+#ifdef TESTING
+	grow = 1;
+	fprintf(stderr, "RESIZE TO %u\n", ht->num_slots);
+#endif
 
 	return 0;
 }
@@ -274,7 +272,8 @@ static int _fr_hash_table_free(fr_hash_table_t *ht)
 /*
  *	Create the table.
  *
- *	Memory usage in bytes is (20/3) * number of entries.
+ *	Memory usage in bytes is between (17 * 8/7) and (17 * 16/7) per
+ *	entry on 64-bit systems.
  */
 fr_hash_table_t *fr_hash_table_create(TALLOC_CTX *ctx,
 				      fr_hash_table_hash_t hashNode,
@@ -287,186 +286,60 @@ fr_hash_table_t *fr_hash_table_create(TALLOC_CTX *ctx,
 
 	ht = talloc_zero(NULL, fr_hash_table_t);
 	if (!ht) return NULL;
-	talloc_set_destructor(ht, _fr_hash_table_free);
 	talloc_link_ctx(ctx, ht);
 
 	ht->free = freeNode;
 	ht->hash = hashNode;
 	ht->cmp = cmpNode;
-	ht->num_buckets = FR_HASH_NUM_BUCKETS;
-	ht->mask = ht->num_buckets - 1;
 
-	/*
-	 *	Have a default load factor of 2.5.  In practice this
-	 *	means that the average load will hit 3 before the
-	 *	table grows.
-	 */
-	ht->next_grow = (ht->num_buckets << 1) + (ht->num_buckets >> 1);
-
-	ht->buckets = talloc_zero_array(NULL, fr_hash_entry_t *, ht->num_buckets);
-	if (!ht->buckets) {
+	if (hash_table_resize(ht, FR_HASH_NUM_SLOTS) < 0) {
 		talloc_free(ht);
 		return NULL;
 	}
 
-	ht->null.reversed = ~0;
-	ht->null.key = ~0;
-	ht->null.next = &ht->null;
-	ht->buckets[0] = &ht->null;
-
 	return ht;
 }
 
-
-/*
- *	If the current bucket is uninitialized, initialize it
- *	by recursively copying information from the parent.
- *
- *	We may have a situation where entry E is a parent to 2 other
- *	entries E' and E".  If we split E into E and E', then the
- *	nodes meant for E" end up in E or E', either of which is
- *	wrong.  To solve that problem, we walk down the whole chain,
- *	inserting the elements into the correct place.
- */
-static void fr_hash_table_fixup(fr_hash_table_t *ht, uint32_t entry)
-{
-	uint32_t parent_entry;
-	fr_hash_entry_t **last, *cur;
-	uint32_t this;
-
-	parent_entry = parent_of(entry);
-
-	/* parent_entry == entry if and only if entry == 0 */
-
-	if (!ht->buckets[parent_entry]) {
-		fr_hash_table_fixup(ht, parent_entry);
-	}
-
-	/*
-	 *	Keep walking down cur, trying to find entries that
-	 *	don't belong here any more.  There may be multiple
-	 *	ones, so we can't have a naive algorithm...
-	 */
-	last = &ht->buckets[parent_entry];
-	this = parent_entry;
-
-	for (cur = *last; cur != &ht->null; cur = cur->next) {
-		uint32_t real_entry;
-
-		real_entry = cur->key & ht->mask;
-		if (real_entry != this) { /* ht->buckets[real_entry] == NULL */
-			*last = &ht->null;
-			ht->buckets[real_entry] = cur;
-			this = real_entry;
-		}
-
-		last = &(cur->next);
-	}
-
-	/*
-	 *	We may NOT have initialized this bucket, so do it now.
-	 */
-	if (!ht->buckets[entry]) ht->buckets[entry] = &ht->null;
-}
-
-/*
- *	This should be a power of two.  Changing it to 4 doesn't seem
- *	to make any difference.
- */
-#define GROW_FACTOR (2)
-
-/*
- *	Grow the hash table.
- */
-static void fr_hash_table_grow(fr_hash_table_t *ht)
-{
-	fr_hash_entry_t **buckets;
-
-	buckets = talloc_zero_array(NULL, fr_hash_entry_t *, GROW_FACTOR * ht->num_buckets);
-	if (!buckets) return;
-
-	memcpy(buckets, ht->buckets, sizeof(*buckets) * ht->num_buckets);
-	talloc_free(ht->buckets); /* Free the old buckets */
-
-	ht->buckets = buckets;
-	ht->num_buckets *= GROW_FACTOR;
-	ht->next_grow *= GROW_FACTOR;
-	ht->mask = ht->num_buckets - 1;
-#ifdef TESTING
-	grow = 1;
-	fprintf(stderr, "GROW TO %d\n", ht->num_buckets);
-#endif
-}
-
-
 /*
  *	Insert data.
  */
 int fr_hash_table_insert(fr_hash_table_t *ht, void const *data)
 {
-	uint32_t key;
-	uint32_t entry;
-	uint32_t reversed;
-	fr_hash_entry_t *node;
+	uint32_t	key, mixed, slot;
 
 	if (!ht || !data) return 0;
 
 	key = ht->hash(data);
-	entry = key & ht->mask;
-	reversed = reverse(key);
-
-	if (!ht->buckets[entry]) fr_hash_table_fixup(ht, entry);
-
-	/*
-	 *	If we try to do our own memory allocation here, the
-	 *	speedup is only ~15% or so, which isn't worth it.
-	 */
-	node = talloc_zero(NULL, fr_hash_entry_t);
-	if (!node) return 0;
-
-	node->next = &ht->null;
-	node->reversed = reversed;
-	node->key = key;
-	memcpy(&node->data, &data, sizeof(node->data));
 
 	/* already in the table, can't insert it */
-	if (!list_insert(ht, &ht->buckets[entry], node)) {
-		talloc_free(node);
-		return 0;
-	}
+	if (hash_table_find(ht, key, data)) return 0;
 
 	/*
 	 *	Check the load factor, and grow the table if
-	 *	necessary.
+	 *	necessary.  If it's mostly tombstones, then
+	 *	rebuild it at the same size.
 	 */
-	ht->num_elements++;
-	if (ht->num_elements >= ht->next_grow) fr_hash_table_grow(ht);
+	if ((uint32_t)(ht->num_elements + ht->num_deleted + 1) > ht->max_used) {
+		uint32_t num_slots = ht->num_slots;
 
-	return 1;
-}
+		if ((uint32_t)(ht->num_elements + 1) > (ht->max_used >> 1)) num_slots <<= 1;
 
+		if (hash_table_resize(ht, num_slots) < 0) return 0;
+	}
 
-/*
- *	Internal find a node routine.
- */
-static fr_hash_entry_t *fr_hash_table_find(fr_hash_table_t *ht, void const *data)
-{
-	uint32_t key;
-	uint32_t entry;
-	uint32_t reversed;
-
-	if (!ht) return NULL;
+	mixed = key_mix(key);
+	slot = hash_table_find_free(ht, mixed);
+	if (ht->ctrl[slot] == CTRL_DELETED) ht->num_deleted--;
 
-	key = ht->hash(data);
-	entry = key & ht->mask;
-	reversed = reverse(key);
+	ht->ctrl[slot] = H2(mixed);
+	ht->slots[slot].key = key;
+	memcpy(&ht->slots[slot].data, &data, sizeof(ht->slots[slot].data));
 
-	if (!ht->buckets[entry]) fr_hash_table_fixup(ht, entry);
+	ht->num_elements++;
 
-	return list_find(ht, ht->buckets[entry], reversed, data);
+	return 1;
 }
 
-
 /*
  *	Replace old data with new data, OR insert if there is no old.
  */
@@ -476,7 +349,7 @@ int fr_hash_table_replace(fr_hash_table_t *ht, void const *data)
 
 	if (!ht || !data) return 0;
 
-	node = fr_hash_table_find(ht, data);
+	node = hash_table_find(ht, ht->hash(data), data);
 	if (!node) return fr_hash_table_insert(ht, data);
 
 	if (ht->free) ht->free(node->data);
@@ -486,56 +359,54 @@ int fr_hash_table_replace(fr_hash_table_t *ht, void const *data)
 	return 1;
 }
 
-
 /*
  *	Find data from a template
  */
 void *fr_hash_table_finddata(fr_hash_table_t *ht, void const *data)
 {
 	fr_hash_entry_t *node;
-	void *out;
 
-	node = fr_hash_table_find(ht, data);
-	if (!node) return NULL;
+	if (!ht) return NULL;
 
-	memcpy(&out, &node->data, sizeof(out));
+	node = hash_table_find(ht, ht->hash(data), data);
+	if (!node) return NULL;
 
-	return out;
+	return node->data;
 }
 
-
-
 /*
  *	Yank an entry from the hash table, without freeing the data.
  */
 void *fr_hash_table_yank(fr_hash_table_t *ht, void const *data)
 {
-	uint32_t key;
-	uint32_t entry;
-	uint32_t reversed;
-	void *old;
-	fr_hash_entry_t *node;
+	fr_hash_entry_t	*node;
+	uint32_t	slot, group;
 
 	if (!ht) return NULL;
 
-	key = ht->hash(data);
-	entry = key & ht->mask;
-	reversed = reverse(key);
-
-	if (!ht->buckets[entry]) fr_hash_table_fixup(ht, entry);
-
-	node = list_find(ht, ht->buckets[entry], reversed, data);
+	node = hash_table_find(ht, ht->hash(data), data);
 	if (!node) return NULL;
 
-	list_delete(ht, &ht->buckets[entry], node);
+	slot = node - ht->slots;
+	group = slot & ~(FR_HASH_GROUP_SIZE - 1);
+
+	/*
+	 *	If the group has an empty slot then it has never
+	 *	been full, and no probe has continued past it.  So
+	 *	we can mark the slot as empty, instead of leaving
+	 *	a tombstone.
+	 */
+	if (group_match(ht->ctrl + group, CTRL_EMPTY)) {
+		ht->ctrl[slot] = CTRL_EMPTY;
+	} else {
+		ht->ctrl[slot] = CTRL_DELETED;
+		ht->num_deleted++;
+	}
 	ht->num_elements--;
 
-	old = node->data;
-	talloc_free(node);
-	return old;
+	return node->data;
 }
 
-
 /*
  *	Delete a piece of data from the hash table.
  */
@@ -551,40 +422,27 @@ int fr_hash_table_delete(fr_hash_table_t *ht, void const *data)
 	return 1;
 }
 
-
 /*
  *	Free a hash table
  */
 void fr_hash_table_free(fr_hash_table_t *ht)
 {
-	int i;
-	fr_hash_entry_t *node, *next;
+	uint32_t i;
 
 	if (!ht) return;
 
-	/*
-	 *	Walk over the buckets, freeing them all.
-	 */
 	if (ht->free) {
-		for (i = 0; i < ht->num_buckets; i++) {
-			if (ht->buckets[i]) for (node = ht->buckets[i];
-						 node != &ht->null;
-						 node = next) {
-				next = node->next;
-				if (!node->data) continue; /* dummy entry */
-
-				ht->free(node->data);
-			}
+		for (i = 0; i < ht->num_slots; i++) {
+			if (CTRL_IS_FULL(ht->ctrl[i])) ht->free(ht->slots[i].data);
 		}
 	}
 
 	/*
-	 *	Also frees nodes and buckets
+	 *	Also frees the slots and control bytes
 	 */
 	talloc_free(ht);
 }
 
-
 /*
  *	Count number of elements
  */
@@ -595,33 +453,27 @@ int fr_hash_table_num_elements(fr_hash_table_t *ht)
 	return ht->num_elements;
 }
 
-
 /*
- *	Walk over the nodes, allowing deletes & inserts to happen.
+ *	Walk over the entries, allowing the current entry to be deleted.
+ *
+ *	Inserting entries during the walk may cause the table to be
+ *	resized, in which case entries may be visited twice, or not
+ *	at all.
  */
 int fr_hash_table_walk(fr_hash_table_t *ht,
 		       fr_hash_table_walk_t callback,
 		       void *context)
 {
-	int i, rcode;
+	int64_t	i;
+	int	rcode;
 
 	if (!ht || !callback) return 0;
 
-	for (i = ht->num_buckets - 1; i >= 0; i--) {
-		fr_hash_entry_t *node, *next;
-
-		/*
-		 *	Ensure that the current bucket is filled.
-		 */
-		if (!ht->buckets[i]) fr_hash_table_fixup(ht, i);
-
-		for (node = ht->buckets[i]; node != &ht->null; node = next) {
-			next = node->next;
+	for (i = (int64_t)ht->num_slots - 1; i >= 0; i--) {
+		if (!CTRL_IS_FULL(ht->ctrl[i])) continue;
 
-			rcode = callback(context, node->data);
-
-			if (rcode != 0) return rcode;
-		}
+		rcode = callback(context, ht->slots[i].data);
+		if (rcode != 0) return rcode;
 	}
 
 	return 0;
@@ -640,33 +492,12 @@ int fr_hash_table_walk(fr_hash_table_t *ht,
  */
 void *fr_hash_table_iter_next(fr_hash_table_t *ht, fr_hash_iter_t *iter)
 {
-	fr_hash_entry_t *node;
-
 	if (unlikely(!ht)) return NULL;
 
-	/*
-	 *	Return the next element in the bucket
-	 */
-	if (iter->node != &ht->null) {
-		node = iter->node;
-		iter->node = node->next;
+	while (iter->slot > 0) {
+		iter->slot--;
 
-		return node->data;
-	}
-
-	/*
-	 *	We might have to go through multiple empty
-	 *	buckets to find one that contains something
-	 *	we should return
-	 */
-	while ((--iter->bucket) >= 0) {
-		if (!ht->buckets[iter->bucket]) fr_hash_table_fixup(ht, iter->bucket);
-
-		node = ht->buckets[iter->bucket];
-		if (node == &ht->null) continue;	/* This bucket was empty too... */
-
-		iter->node = node->next;		/* Store the next one to examine */
-		return node->data;
+		if (CTRL_IS_FULL(ht->ctrl[iter->slot])) return ht->slots[iter->slot].data;
 	}
 
 	return NULL;
@@ -674,16 +505,14 @@ void *fr_hash_table_iter_next(fr_hash_table_t *ht, fr_hash_iter_t *iter)
 
 /** Ensure all buckets are filled
  *
- * This must be called if the table will be read by multiple threads without
- * synchronisation.  Synchronisation is still required for updates.
+ * This used to be required if the table was to be read by multiple threads
+ * without synchronisation.  Lookups no longer modify the table, so there's
+ * nothing to do.  Synchronisation is still required for updates.
  *
  * @param[in] ht	to fill.
  */
-void fr_hash_table_fill(fr_hash_table_t *ht)
+void fr_hash_table_fill(UNUSED fr_hash_table_t *ht)
 {
-	int i;
-
-	for (i = ht->num_buckets - 1; i >= 0; i--) if (!ht->buckets[i]) fr_hash_table_fixup(ht, i);
 }
 
 /** Initialise an iterator
@@ -700,8 +529,7 @@ void *fr_hash_table_iter_init(fr_hash_table_t *ht, fr_hash_iter_t *iter)
 {
 	if (unlikely(!ht)) return NULL;
 
-	iter->bucket = ht->num_buckets;
-	iter->node = &ht->null;
+	iter->slot = ht->num_slots;
 
 	return fr_hash_table_iter_next(ht, iter);
 }
@@ -712,69 +540,48 @@ void *fr_hash_table_iter_init(fr_hash_table_t *ht, fr_hash_iter_t *iter)
  */
 int fr_hash_table_info(fr_hash_table_t *ht)
 {
-	int i, a, collisions, uninitialized;
-	int array[256];
+	uint32_t	i;
+	int		probes = 0, max_probes = 0;
+	int		array[32];
 
 	if (!ht) return 0;
 
-	uninitialized = collisions = 0;
 	memset(array, 0, sizeof(array));
 
-	for (i = 0; i < ht->num_buckets; i++) {
-		uint32_t key;
-		int load;
-		fr_hash_entry_t *node, *next;
+	/*
+	 *	For each entry, count how many groups a lookup
+	 *	has to examine before it finds the entry.
+	 */
+	for (i = 0; i < ht->num_slots; i++) {
+		uint32_t	mixed, group, step;
+		int		count = 1;
 
-		/*
-		 *	If we haven't inserted or looked up an entry
-		 *	in a bucket, it's uninitialized.
-		 */
-		if (!ht->buckets[i]) {
-			uninitialized++;
-			continue;
-		}
+		if (!CTRL_IS_FULL(ht->ctrl[i])) continue;
 
-		load = 0;
-		key = ~0;
-		for (node = ht->buckets[i]; node != &ht->null; node = next) {
-			if (node->reversed == key) {
-				collisions++;
-			} else {
-				key = node->reversed;
-			}
-			next = node->next;
-			load++;
+		mixed = key_mix(ht->slots[i].key);
+		PROBE_START(ht, mixed, group, step);
+		while (group != (i / FR_HASH_GROUP_SIZE)) {
+			PROBE_NEXT(ht, group, step);
+			count++;
 		}
 
-		if (load > 255) load = 255;
-		array[load]++;
+		probes += count;
+		if (count > max_probes) max_probes = count;
+		if (count > 31) count = 31;
+		array[count]++;
 	}
 
-	printf("HASH TABLE %p\tbuckets: %d\t(%d uninitialized)\n", ht,
-		ht->num_buckets, uninitialized);
-	printf("\tnum entries %d\thash collisions %d\n",
-		ht->num_elements, collisions);
+	printf("HASH TABLE %p\tslots: %u\tgroups: %u\n", ht, ht->num_slots, ht->mask + 1);
+	printf("\tnum entries %d\ttombstones %d\tload %f\n",
+	       ht->num_elements, ht->num_deleted, (float) ht->num_elements / (float) ht->num_slots);
 
-	a = 0;
-	for (i = 1; i < 256; i++) {
+	for (i = 1; i < 32; i++) {
 		if (!array[i]) continue;
-		printf("%d\t%d\n", i, array[i]);
-
-		/*
-		 *	Since the entries are ordered, the lookup cost
-		 *	for any one element in a chain is (on average)
-		 *	the cost of walking half of the chain.
-		 */
-		if (i > 1) {
-			a += array[i] * i;
-		}
+		printf("%u\t%d\n", i, array[i]);
 	}
-	a /= 2;
-	a += array[1];
 
-	printf("\texpected lookup cost = %d/%d or %f\n\n",
-	       ht->num_elements, a,
-	       (float) ht->num_elements / (float) a);
+	printf("\texpected groups examined per lookup = %f (max %d)\n\n",
+	       ht->num_elements ? (float) probes / (float) ht->num_elements : 0, max_probes);
 
 	return 0;
 }
@@ -870,83 +677,362 @@ uint32_t fr_hash_case_string(char const *p)
 	return hash;
 }
 
+/*
+ *	Word at a time hashing, based on wyhash (public domain) by
+ *	Wang Yi.  See https://github.com/wangyi-fudan/wyhash
+ *
+ *	The FNV functions above hash one octet at a time, which is
+ *	slow for anything longer than a few bytes.  These read 8
+ *	octets at a time, and mix them with 64x64->128 bit multiplies.
+ *
+ *	The results depend on the byte order of the host, so they
+ *	should only be used for in-memory data structures.  Where
+ *	the hash value is visible outside of the process (e.g. for
+ *	generating enum values), use the FNV functions.
+ */
+static uint64_t const hash_secret[4] = {
+	0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+	0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL
+};
+
+static inline CC_HINT(always_inline) uint64_t hash_mix(uint64_t a, uint64_t b)
+{
+#ifdef __SIZEOF_INT128__
+	__uint128_t r = (__uint128_t)a * b;
+
+	return (uint64_t)r ^ (uint64_t)(r >> 64);
+#else
+	uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+	uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+	uint64_t t = rl + (rm0 << 32), c = (t < rl);
+	uint64_t lo = t + (rm1 << 32);
+
+	c += (lo < t);
+
+	return lo ^ (rh + (rm0 >> 32) + (rm1 >> 32) + c);
+#endif
+}
+
+/*
+ *	Convert ASCII upper case letters in a word to lower case,
+ *	without looking at each octet individually.
+ */
+static inline CC_HINT(always_inline) uint64_t word_tolower(uint64_t w)
+{
+	uint64_t heptets = w & 0x7f7f7f7f7f7f7f7fULL;
+	uint64_t ge_a = heptets + (0x80 - 'A') * 0x0101010101010101ULL;
+	uint64_t gt_z = heptets + (0x80 - 'Z' - 1) * 0x0101010101010101ULL;
+
+	return w | (((ge_a ^ gt_z) & ~w & 0x8080808080808080ULL) >> 2);
+}
+
+static inline CC_HINT(always_inline) uint64_t read8(uint8_t const *p, bool fold)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return fold ? word_tolower(v) : v;
+}
+
+static inline CC_HINT(always_inline) uint64_t read4(uint8_t const *p, bool fold)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return fold ? word_tolower(v) : v;
+}
+
+static inline CC_HINT(always_inline) uint64_t read3(uint8_t const *p, size_t k, bool fold)
+{
+	uint64_t v = (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+
+	return fold ? word_tolower(v) : v;
+}
+
+static inline CC_HINT(always_inline) uint64_t hash_words(void const *data, size_t len, uint64_t seed, bool fold)
+{
+	uint8_t const	*p = data;
+	uint64_t	a, b;
+
+	seed ^= hash_mix(seed ^ hash_secret[0], hash_secret[1]);
+
+	if (len <= 16) {
+		if (len >= 4) {
+			a = (read4(p, fold) << 32) | read4(p + ((len >> 3) << 2), fold);
+			b = (read4(p + len - 4, fold) << 32) | read4(p + len - 4 - ((len >> 3) << 2), fold);
+		} else if (len > 0) {
+			a = read3(p, len, fold);
+			b = 0;
+		} else {
+			a = b = 0;
+		}
+	} else {
+		size_t i = len;
+
+		if (i > 48) {
+			uint64_t see1 = seed, see2 = seed;
+
+			do {
+				seed = hash_mix(read8(p, fold) ^ hash_secret[1], read8(p + 8, fold) ^ seed);
+				see1 = hash_mix(read8(p + 16, fold) ^ hash_secret[2], read8(p + 24, fold) ^ see1);
+				see2 = hash_mix(read8(p + 32, fold) ^ hash_secret[3], read8(p + 40, fold) ^ see2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= see1 ^ see2;
+		}
+
+		while (i > 16) {
+			seed = hash_mix(read8(p, fold) ^ hash_secret[1], read8(p + 8, fold) ^ seed);
+			p += 16;
+			i -= 16;
+		}
+
+		a = read8(p + i - 16, fold);
+		b = read8(p + i - 8, fold);
+	}
+
+	return hash_mix(hash_secret[1] ^ len, hash_mix(a ^ hash_secret[1], b ^ seed));
+}
+
+/** Hash data a word at a time
+ *
+ * Much faster than #fr_hash for anything longer than a few octets.
+ * The result is the same for every process on the same platform.
+ *
+ * @param[in] data	to hash.
+ * @param[in] size	of data.
+ * @return the hash of data.
+ */
+uint32_t fr_hash_fast(void const *data, size_t size)
+{
+	return (uint32_t)hash_words(data, size, 0, false);
+}
+
+/** Continue hashing data a word at a time
+ *
+ * @param[in] data	to hash.
+ * @param[in] size	of data.
+ * @param[in] hash	returned by a previous call to one of the fr_hash_fast or
+ *			fr_hash_seeded functions.
+ * @return the hash of data, combined with the previous hash.
+ */
+uint32_t fr_hash_fast_update(void const *data, size_t size, uint32_t hash)
+{
+	return (uint32_t)hash_words(data, size, hash, false);
+}
+
+/** Hash a string a word at a time, ignoring the case of ASCII letters
+ *
+ * Intended for dictionary names, which are compared case insensitively.
+ *
+ * @param[in] p		string to hash.
+ * @param[in] len	of the string.
+ * @return the hash of the lowercased string.
+ */
+uint32_t fr_hash_fast_case(char const *p, size_t len)
+{
+	return (uint32_t)hash_words(p, len, 0, true);
+}
+
+static uint64_t	hash_seed;
+static pthread_once_t hash_seed_once = PTHREAD_ONCE_INIT;
+
+static void _hash_seed_init(void)
+{
+	hash_seed = ((uint64_t)fr_rand() << 32) | fr_rand();
+}
+
+/** Hash data, using a seed chosen randomly when the process starts
+ *
+ * Use this for hash tables keyed on data which can be chosen by
+ * whoever is sending us packets, such as addresses or User-Name.
+ * Without the seed, an attacker can work out which keys collide,
+ * and send packets which make every lookup walk a long probe
+ * sequence.
+ *
+ * @note The result is different in every process, so it should
+ *	never be stored, or sent to anyone else.
+ *
+ * @param[in] data	to hash.
+ * @param[in] size	of data.
+ * @return the hash of data.
+ */
+uint32_t fr_hash_seeded(void const *data, size_t size)
+{
+	(void) pthread_once(&hash_seed_once, _hash_seed_init);
+
+	return (uint32_t)hash_words(data, size, hash_seed, false);
+}
+
+/** Continue hashing data with the per-process seed
+ *
+ * @param[in] data	to hash.
+ * @param[in] size	of data.
+ * @param[in] hash	returned by a previous call to #fr_hash_seeded.
+ * @return the hash of data, combined with the previous hash.
+ */
+uint32_t fr_hash_seeded_update(void const *data, size_t size, uint32_t hash)
+{
+	(void) pthread_once(&hash_seed_once, _hash_seed_init);
+
+	return (uint32_t)hash_words(data, size, hash_seed ^ hash, false);
+}
+
 #ifdef TESTING
 /*
- *  cc -g -DTESTING -I ../include hash.c -o hash
+ *  cc -g -O2 -DTESTING -I ../include hash.c -o hash
+ *
+ *  ./hash [num_entries]
  *
- *  ./hash
+ *  Prints the time taken per operation, so that changes to the
+ *  table can be compared against the previous implementation.
  */
+#include <time.h>
+
 static uint32_t hash_int(void const *data)
 {
 	return fr_hash((int *) data, sizeof(int));
 }
 
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
 #define MAX 1024*1024
 int main(int argc, char **argv)
 {
-	int i, *p, *q, k;
+	int i, *p, *q, k, max = MAX;
 	fr_hash_table_t *ht;
 	int *array;
+	uint64_t start;
+
+	if (argc > 1) max = atoi(argv[1]);
+	if (max <= 0) exit(1);
+
+	/*
+	 *	Compare the hash functions on something the
+	 *	length of a typical attribute name.
+	 */
+	{
+		char		name[] = "Tunnel-Client-Endpoint";
+		size_t		len = strlen(name);
+		uint32_t	sum = 0;
+
+		/*
+		 *	Change the name each time around, so the
+		 *	compiler can't hoist the hash out of the loop.
+		 */
+#define HASH_TIME(_name, _expr) do { \
+			start = now_ns(); \
+			for (i = 0; i < max; i++) { \
+				name[0] = 'A' + (i & 0x0f); \
+				sum += (_expr); \
+			} \
+			printf("%-20s%f ns/op\n", _name, (double)(now_ns() - start) / max); \
+		} while (0)
+
+		HASH_TIME("fr_hash", fr_hash(name, len));
+		HASH_TIME("fr_hash_string", fr_hash_string(name));
+		HASH_TIME("fr_hash_fast", fr_hash_fast(name, len));
+		HASH_TIME("fr_hash_fast_case", fr_hash_fast_case(name, len));
+		HASH_TIME("fr_hash_seeded", fr_hash_seeded(name, len));
+
+		if (fr_hash_fast_case("Tunnel-Client-Endpoint", len) != fr_hash_fast_case("tunnel-client-ENDPOINT", len)) {
+			fprintf(stderr, "Case insensitive hash is case sensitive\n");
+			exit(1);
+		}
+		if (!sum) printf("\n");	/* Stop the loops being optimised out */
+	}
 
 	ht = fr_hash_table_create(NULL, hash_int, NULL, NULL);
 	if (!ht) {
 		fprintf(stderr, "Hash create failed\n");
-		fr_exit(1);
+		exit(1);
 	}
 
-	array = talloc_zero_array(NULL, int, MAX);
-	if (!array) fr_exit(1);
+	array = talloc_zero_array(NULL, int, max);
+	if (!array) exit(1);
 
-	for (i = 0; i < MAX; i++) {
+	start = now_ns();
+	for (i = 0; i < max; i++) {
 		p = array + i;
 		*p = i;
 
 		if (!fr_hash_table_insert(ht, p)) {
 			fprintf(stderr, "Failed insert %08x\n", i);
-			fr_exit(1);
+			exit(1);
 		}
 #ifdef TEST_INSERT
 		q = fr_hash_table_finddata(ht, p);
 		if (q != p) {
 			fprintf(stderr, "Bad data %d\n", i);
-			fr_exit(1);
+			exit(1);
 		}
 #endif
 	}
+	printf("insert\t\t%f ns/op\n", (double)(now_ns() - start) / max);
 
 	fr_hash_table_info(ht);
 
+	start = now_ns();
+	for (i = 0; i < max ; i++) {
+		q = fr_hash_table_finddata(ht, &i);
+		if (!q || *q != i) {
+			fprintf(stderr, "Failed finding %d\n", i);
+			exit(1);
+		}
+	}
+	printf("find (hit)\t%f ns/op\n", (double)(now_ns() - start) / max);
+
+	start = now_ns();
+	for (i = max; i < (max * 2); i++) {
+		k = i;
+		if (fr_hash_table_finddata(ht, &k)) {
+			fprintf(stderr, "Found missing %d\n", i);
+			exit(1);
+		}
+	}
+	printf("find (miss)\t%f ns/op\n", (double)(now_ns() - start) / max);
+
 	/*
-	 *	Build this to see how lookups result in shortening
-	 *	of the hash chains.
+	 *	Delete every other entry, and check that the
+	 *	rest can still be found past the tombstones.
 	 */
-	if (1) {
-		for (i = 0; i < MAX ; i++) {
-			q = fr_hash_table_finddata(ht, &i);
-			if (!q || *q != i) {
-				fprintf(stderr, "Failed finding %d\n", i);
-				fr_exit(1);
-			}
+	start = now_ns();
+	for (i = 0; i < max; i += 2) {
+		if (!fr_hash_table_delete(ht, &i)) {
+			fprintf(stderr, "Failed deleting %d\n", i);
+			exit(1);
+		}
+	}
+	printf("delete\t\t%f ns/op\n", (double)(now_ns() - start) / ((max + 1) / 2));
 
-#if 0
-			if (!fr_hash_table_delete(ht, &i)) {
-				fprintf(stderr, "Failed deleting %d\n", i);
-				fr_exit(1);
-			}
-			q = fr_hash_table_finddata(ht, &i);
-			if (q) {
-				fprintf(stderr, "Failed to delete %08x\n", i);
-				fr_exit(1);
-			}
-#endif
+	for (i = 0; i < max; i++) {
+		q = fr_hash_table_finddata(ht, &i);
+		if ((i & 1) ? (!q || (*q != i)) : (q != NULL)) {
+			fprintf(stderr, "Bad lookup after delete %d\n", i);
+			exit(1);
 		}
+	}
 
-		fr_hash_table_info(ht);
+	if (fr_hash_table_num_elements(ht) != (max / 2)) {
+		fprintf(stderr, "Bad element count %d\n", fr_hash_table_num_elements(ht));
+		exit(1);
 	}
 
+	fr_hash_table_info(ht);
+
 	fr_hash_table_free(ht);
 	talloc_free(array);
 
-	fr_exit(0);
+	exit(0);
 }
 #endif
@@ -40,8 +40,7 @@ typedef struct fr_hash_entry_s fr_hash_entry_t;
  *
  */
 typedef struct {
-	int			bucket;
-	fr_hash_entry_t		*node;
+	uint32_t		slot;
 } fr_hash_iter_t;
 
 /*
@@ -53,6 +52,20 @@ uint32_t fr_hash_update(void const *data, size_t size, uint32_t hash);
 uint32_t fr_hash_string(char const *p);
 uint32_t fr_hash_case_string(char const *p);
 
+/*
+ *	Word at a time hashes, for in-memory hash tables.
+ */
+uint32_t fr_hash_fast(void const *data, size_t size);
+uint32_t fr_hash_fast_update(void const *data, size_t size, uint32_t hash);
+uint32_t fr_hash_fast_case(char const *p, size_t len);
+
+/*
+ *	As above, but seeded randomly when the process starts, for
+ *	tables keyed on data which comes from the network.
+ */
+uint32_t fr_hash_seeded(void const *data, size_t size);
+uint32_t fr_hash_seeded_update(void const *data, size_t size, uint32_t hash);
+
 typedef struct fr_hash_table_s fr_hash_table_t;
 typedef void (*fr_hash_table_free_t)(void *);
 typedef uint32_t (*fr_hash_table_hash_t)(void const *);
@@ -39,6 +39,19 @@ RCSID("$Id$")
 #  define FREE_MAGIC (0xF4EEF4EE)
 #endif
 
+/** Largest string or octets value carved out of the pair's own allocation
+ *
+ * Most string and octets values are short (User-Name, Calling-Station-Id,
+ * NAS-Identifier, Class).  When the caller knows the length of the value
+ * up front, and it's no more than this, fr_pair_afrom_da_len() allocates
+ * the pair as a talloc pool sized exactly for the value, so the value
+ * doesn't need a malloc of its own.
+ *
+ * Longer values, and values of unknown length, are allocated from the
+ * parent as before, and no space is reserved for them.
+ */
+#define FR_PAIR_VALUE_POOL_SIZE	(64)
+
 /** Free a VALUE_PAIR
  *
  * @note Do not call directly, use talloc_free instead.
@@ -59,11 +72,24 @@ static int _fr_pair_free(NDEBUG_UNUSED VALUE_PAIR *vp)
 }
 
 
-VALUE_PAIR *fr_pair_alloc(TALLOC_CTX *ctx)
+/** Allocate a VALUE_PAIR, optionally with room for its value
+ *
+ * @param[in] ctx		to allocate the pair in.
+ * @param[in] value_size	to reserve for a single child of the pair.
+ *				Zero for no reservation.
+ * @return
+ *	- A new #VALUE_PAIR.
+ *	- NULL on error.
+ */
+static inline VALUE_PAIR *pair_alloc(TALLOC_CTX *ctx, size_t value_size)
 {
 	VALUE_PAIR *vp;
 
-	vp = talloc_zero(ctx, VALUE_PAIR);
+	if (value_size) {
+		vp = talloc_zero_pooled_object(ctx, VALUE_PAIR, 1, value_size);
+	} else {
+		vp = talloc_zero(ctx, VALUE_PAIR);
+	}
 	if (!vp) {
 		fr_strerror_printf("Out of memory");
 		return NULL;
@@ -78,20 +104,13 @@ VALUE_PAIR *fr_pair_alloc(TALLOC_CTX *ctx)
 	return vp;
 }
 
+VALUE_PAIR *fr_pair_alloc(TALLOC_CTX *ctx)
+{
+	return pair_alloc(ctx, 0);
+}
 
-/** Dynamically allocate a new attribute
- *
- * Allocates a new attribute and a new dictionary attr if no DA is provided.
- *
- * @note Doesn't require qualification with a dictionary as fr_dict_attr_t are unique.
- *
- * @param[in] ctx	for allocated memory, usually a pointer to a #RADIUS_PACKET
- * @param[in] da	Specifies the dictionary attribute to build the #VALUE_PAIR from.
- * @return
- *	- A new #VALUE_PAIR.
- *	- NULL if an error occurred.
- */
-VALUE_PAIR *fr_pair_afrom_da(TALLOC_CTX *ctx, fr_dict_attr_t const *da)
+
+static VALUE_PAIR *pair_afrom_da(TALLOC_CTX *ctx, fr_dict_attr_t const *da, size_t value_size)
 {
 	VALUE_PAIR *vp;
 
@@ -103,7 +122,7 @@ VALUE_PAIR *fr_pair_afrom_da(TALLOC_CTX *ctx, fr_dict_attr_t const *da)
 		return NULL;
 	}
 
-	vp = fr_pair_alloc(ctx);
+	vp = pair_alloc(ctx, value_size);
 	if (!vp) {
 		fr_strerror_printf("Out of memory");
 		return NULL;
@@ -130,6 +149,62 @@ VALUE_PAIR *fr_pair_afrom_da(TALLOC_CTX *ctx, fr_dict_attr_t const *da)
 	return vp;
 }
 
+/** Dynamically allocate a new attribute
+ *
+ * Allocates a new attribute and a new dictionary attr if no DA is provided.
+ *
+ * @note Doesn't require qualification with a dictionary as fr_dict_attr_t are unique.
+ *
+ * @param[in] ctx	for allocated memory, usually a pointer to a #RADIUS_PACKET
+ * @param[in] da	Specifies the dictionary attribute to build the #VALUE_PAIR from.
+ * @return
+ *	- A new #VALUE_PAIR.
+ *	- NULL if an error occurred.
+ */
+VALUE_PAIR *fr_pair_afrom_da(TALLOC_CTX *ctx, fr_dict_attr_t const *da)
+{
+	return pair_afrom_da(ctx, da, 0);
+}
+
+/** Dynamically allocate a new attribute, with room for a value of known length
+ *
+ * As fr_pair_afrom_da(), but if the attribute is a string or octets, and
+ * the value is no longer than #FR_PAIR_VALUE_POOL_SIZE, the pair is allocated
+ * as a talloc pool with exactly enough room for the value.
+ *
+ * @param[in] ctx	for allocated memory, usually a pointer to a #RADIUS_PACKET
+ * @param[in] da	Specifies the dictionary attribute to build the #VALUE_PAIR from.
+ * @param[in] len	of the value which will be assigned to the pair.
+ * @return
+ *	- A new #VALUE_PAIR.
+ *	- NULL if an error occurred.
+ */
+VALUE_PAIR *fr_pair_afrom_da_len(TALLOC_CTX *ctx, fr_dict_attr_t const *da, size_t len)
+{
+	size_t value_size = 0;
+
+	/*
+	 *	Unknown attributes copy the da into the pair,
+	 *	which would use up the reserved space.
+	 */
+	if (!da || da->flags.is_unknown || !len || (len > FR_PAIR_VALUE_POOL_SIZE)) return pair_afrom_da(ctx, da, 0);
+
+	switch (da->type) {
+	case FR_TYPE_STRING:
+		value_size = len + 1;	/* Strings are always \0 terminated */
+		break;
+
+	case FR_TYPE_OCTETS:
+		value_size = len;
+		break;
+
+	default:
+		break;
+	}
+
+	return pair_afrom_da(ctx, da, value_size);
+}
+
 /** Create a new valuepair
  *
  * If attr and vendor match a dictionary entry then a VP with that #fr_dict_attr_t
@@ -871,6 +946,10 @@ VALUE_PAIR *fr_pair_find_by_child_num(VALUE_PAIR *head, fr_dict_attr_t const *pa
  *
  * Locates the end of 'head', and links an additional VP 'add' at the end.
  *
+ * @note This walks the whole list on every call.  When adding many
+ *	VPs in a loop, use a #fr_cursor_t and #fr_cursor_append instead,
+ *	which remembers where the tail of the list is.
+ *
  * @param[in] head VP in linked list. Will add new VP to the end of this list.
  * @param[in] add VP to add to list.
  */
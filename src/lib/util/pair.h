@@ -189,6 +189,8 @@ VALUE_PAIR	*fr_pair_alloc(TALLOC_CTX *ctx);
 
 VALUE_PAIR	*fr_pair_afrom_da(TALLOC_CTX *ctx, fr_dict_attr_t const *da);
 
+VALUE_PAIR	*fr_pair_afrom_da_len(TALLOC_CTX *ctx, fr_dict_attr_t const *da, size_t len);
+
 VALUE_PAIR	*fr_pair_afrom_num(TALLOC_CTX *ctx, unsigned int vendor, unsigned int attr);
 
 VALUE_PAIR	*fr_pair_afrom_child_num(TALLOC_CTX *ctx, fr_dict_attr_t const *parent, unsigned int attr);
@@ -265,6 +267,15 @@ int		fr_pair_update_by_da(TALLOC_CTX *ctx, VALUE_PAIR **out, VALUE_PAIR **list,
 
 int		fr_pair_delete_by_da(VALUE_PAIR **head, fr_dict_attr_t const *da);
 
+/* Indexing */
+typedef struct fr_pair_list_index_s fr_pair_list_index_t;
+
+extern uint32_t	fr_pair_list_index_threshold;
+
+fr_pair_list_index_t *fr_pair_list_index_alloc(TALLOC_CTX *ctx, VALUE_PAIR *head);
+
+VALUE_PAIR	*fr_pair_list_index_find(fr_pair_list_index_t *idx, fr_dict_attr_t const *da, int8_t tag);
+
 /* Sorting */
 typedef		int8_t (*fr_cmp_t)(void const *a, void const *b);
 
@@ -0,0 +1,212 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Index VALUE_PAIR lists by attribute
+ *
+ * Maps each #fr_dict_attr_t in a list to the first VALUE_PAIR using it,
+ * so that code doing many lookups against one large list doesn't scan
+ * the list for each of them.
+ *
+ * The index is open addressed with linear probing, and is stored in a
+ * single array.  Pairs appended to the list after the index was built
+ * are picked up on the next lookup.  Removing pairs from the list
+ * invalidates the index, and it must be freed.
+ *
+ * @file src/lib/util/pair_index.c
+ *
+ * @copyright 2020 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/pair.h>
+#include <freeradius-devel/util/talloc.h>
+
+/** Lists shorter than this aren't indexed
+ *
+ * Scanning a short list is cheaper than building the index.
+ * Zero disables indexing entirely.
+ */
+uint32_t fr_pair_list_index_threshold = 32;
+
+typedef struct {
+	fr_dict_attr_t const	*da;			//!< Attribute, or NULL if the slot is free.
+	VALUE_PAIR		*vp;			//!< First pair in the list with this attribute.
+} fr_pair_list_index_entry_t;
+
+struct fr_pair_list_index_s {
+	fr_pair_list_index_entry_t	*entry;		//!< Array of slots.
+	uint32_t			mask;		//!< Number of slots - 1.
+	uint32_t			used;		//!< Number of slots in use.
+	VALUE_PAIR			*head;		//!< Of the list, for when we can't grow the index.
+	VALUE_PAIR			*last;		//!< Last pair in the list we've indexed.
+};
+
+static inline CC_HINT(always_inline) uint32_t index_hash(fr_dict_attr_t const *da)
+{
+	uint64_t h = (uint64_t)(uintptr_t)da;
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+
+	return (uint32_t)h;
+}
+
+static inline CC_HINT(always_inline) fr_pair_list_index_entry_t *index_slot(fr_pair_list_index_entry_t *entry,
+									    uint32_t mask, fr_dict_attr_t const *da)
+{
+	uint32_t i = index_hash(da) & mask;
+
+	while (entry[i].da && (entry[i].da != da)) i = (i + 1) & mask;
+
+	return &entry[i];
+}
+
+/** Double the number of slots, and re-insert all the entries
+ *
+ */
+static int index_grow(fr_pair_list_index_t *idx)
+{
+	fr_pair_list_index_entry_t	*entry;
+	uint32_t			i, mask = (idx->mask << 1) | 1;
+
+	entry = talloc_zero_array(idx, fr_pair_list_index_entry_t, mask + 1);
+	if (!entry) return -1;
+
+	for (i = 0; i <= idx->mask; i++) {
+		if (!idx->entry[i].da) continue;
+		*index_slot(entry, mask, idx->entry[i].da) = idx->entry[i];
+	}
+
+	talloc_free(idx->entry);
+	idx->entry = entry;
+	idx->mask = mask;
+
+	return 0;
+}
+
+/** Index a pair, if it's the first with its attribute
+ *
+ */
+static int index_add(fr_pair_list_index_t *idx, VALUE_PAIR *vp)
+{
+	fr_pair_list_index_entry_t *slot;
+
+	slot = index_slot(idx->entry, idx->mask, vp->da);
+	if (slot->da) return 0;
+
+	/*
+	 *	Keep the load factor at or below 1/2, so
+	 *	probe sequences stay short.
+	 */
+	if (((idx->used + 1) * 2) > (idx->mask + 1)) {
+		if (index_grow(idx) < 0) return -1;
+		slot = index_slot(idx->entry, idx->mask, vp->da);
+	}
+
+	slot->da = vp->da;
+	slot->vp = vp;
+	idx->used++;
+
+	return 0;
+}
+
+/** Build an index for a list of VALUE_PAIRs
+ *
+ * @note The index is only valid while no pairs are removed from the list.
+ *	Pairs appended to the end of the list are indexed lazily by
+ *	#fr_pair_list_index_find.
+ *
+ * @param[in] ctx	to allocate the index in.
+ * @param[in] head	of the list to index.
+ * @return
+ *	- The new index.
+ *	- NULL if the list is shorter than #fr_pair_list_index_threshold,
+ *	  or on error.  Callers should fall back to #fr_pair_find_by_da.
+ */
+fr_pair_list_index_t *fr_pair_list_index_alloc(TALLOC_CTX *ctx, VALUE_PAIR *head)
+{
+	fr_pair_list_index_t	*idx;
+	VALUE_PAIR		*vp;
+	uint32_t		count = 0, slots = 16;
+
+	if (!fr_pair_list_index_threshold) return NULL;
+
+	for (vp = head; vp; vp = vp->next) count++;
+	if (count < fr_pair_list_index_threshold) return NULL;
+
+	while (slots < (count * 2)) slots <<= 1;
+
+	idx = talloc_zero(ctx, fr_pair_list_index_t);
+	if (!idx) return NULL;
+
+	idx->entry = talloc_zero_array(idx, fr_pair_list_index_entry_t, slots);
+	if (!idx->entry) {
+	error:
+		talloc_free(idx);
+		return NULL;
+	}
+	idx->mask = slots - 1;
+	idx->head = head;
+
+	for (vp = head; vp; vp = vp->next) {
+		if (index_add(idx, vp) < 0) goto error;
+		idx->last = vp;
+	}
+
+	return idx;
+}
+
+/** Find the first pair matching an attribute and tag using an index
+ *
+ * Equivalent to calling #fr_pair_find_by_da on the list the index was
+ * built from.
+ *
+ * @param[in] idx	built by #fr_pair_list_index_alloc.
+ * @param[in] da	to search for.
+ * @param[in] tag	to search for.
+ * @return
+ *	- The first matching pair.
+ *	- NULL if no pairs match.
+ */
+VALUE_PAIR *fr_pair_list_index_find(fr_pair_list_index_t *idx, fr_dict_attr_t const *da, int8_t tag)
+{
+	fr_pair_list_index_entry_t	*slot;
+	VALUE_PAIR			*vp;
+
+	/*
+	 *	Catch up with anything appended since
+	 *	the last lookup.
+	 */
+	while (idx->last->next) {
+		if (index_add(idx, idx->last->next) < 0) return fr_pair_find_by_da(idx->head, da, tag);
+		idx->last = idx->last->next;
+	}
+
+	slot = index_slot(idx->entry, idx->mask, da);
+	vp = slot->vp;
+	if (!vp) return NULL;
+
+	VP_VERIFY(vp);
+
+	if (TAG_EQ(tag, vp->tag)) return vp;
+
+	/*
+	 *	Only the first instance is indexed, so
+	 *	other tags are found by scanning forward.
+	 */
+	return fr_pair_find_by_da(vp->next, da, tag);
+}
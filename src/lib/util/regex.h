@@ -67,6 +67,8 @@ typedef struct {
 	bool			precompiled;	//!< Whether this regex was precompiled,
 						///< or compiled for one off evaluation.
 	bool			jitd;		//!< Whether JIT data is available.
+	bool			cached;		//!< Owned by a regex cache, and may be freed
+						///< when the cache evicts it.
 } regex_t;
 /*
  *######################################
@@ -112,6 +114,7 @@ typedef struct {
 
 	bool			precompiled;	//!< Whether this regex was precompiled, or compiled for one off evaluation.
 	bool			jitd;		//!< Whether JIT data is available.
+	bool			cached;		//!< Owned by a regex cache, and may be freed when the cache evicts it.
 } regex_t;
 /*
  *######################################
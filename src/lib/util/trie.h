@@ -45,6 +45,19 @@ void		*fr_trie_match(fr_trie_t const *ft, void const *key, size_t keylen) CC_HIN
 void		*fr_trie_remove(fr_trie_t *ft, void const *key, size_t keylen) CC_HINT(nonnull);
 int		fr_trie_walk(fr_trie_t *ft, void *ctx, fr_trie_walk_t callback) CC_HINT(nonnull(1,3));
 
+/*
+ *	Tries which can be read by many threads without locking,
+ *	while another thread updates them.
+ */
+typedef struct fr_trie_rcu_s fr_trie_rcu_t;
+
+fr_trie_rcu_t	*fr_trie_rcu_alloc(TALLOC_CTX *ctx);
+int		fr_trie_rcu_insert(fr_trie_rcu_t *rcu, void const *key, size_t keylen, void const *data) CC_HINT(nonnull);
+void		*fr_trie_rcu_lookup(fr_trie_rcu_t const *rcu, void const *key, size_t keylen) CC_HINT(nonnull);
+void		*fr_trie_rcu_match(fr_trie_rcu_t const *rcu, void const *key, size_t keylen) CC_HINT(nonnull);
+void		*fr_trie_rcu_remove(fr_trie_rcu_t *rcu, void const *key, size_t keylen) CC_HINT(nonnull);
+int		fr_trie_rcu_walk(fr_trie_rcu_t *rcu, void *ctx, fr_trie_walk_t callback) CC_HINT(nonnull(1,3));
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,489 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Prefix tries which can be read without locks while they're being updated
+ *
+ * An #fr_trie_rcu_t holds two identical copies of a trie.  Readers use
+ * whichever copy is currently published, and never take a lock.
+ *
+ * Writers are serialised with a mutex.  A writer brings the copy which
+ * isn't published up to date, makes its change to it, and publishes it.
+ * The same change is then pending for the old copy.  It's applied by the
+ * next writer, once a grace period has passed, and no reader can still be
+ * using the old copy.  Writers never hold the mutex while waiting for a
+ * grace period, and writers which are waiting at the same time share one
+ * grace period.  Writes therefore cost two trie operations, but never copy
+ * the whole trie, so loading a large table one entry at a time is still
+ * cheap.
+ *
+ * Readers are tracked with a pair of counters per thread, selected by
+ * the parity of a global epoch, as in SRCU.  A reader increments its
+ * counter for the current epoch, does the lookup, and decrements the
+ * counter.  A grace period bumps the epoch twice, each time waiting for
+ * the counters of the previous epoch to drain.
+ *
+ * The data pointers stored in the trie are shared by both copies.
+ * Data which is removed from the trie must not be freed until the
+ * caller knows that no reader is still using a pointer it got from a
+ * lookup.  #fr_trie_rcu_remove only guarantees that no new lookup will
+ * return it.
+ *
+ * @file src/lib/util/trie_rcu.c
+ *
+ * @copyright 2020 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/strerror.h>
+#include <freeradius-devel/util/thread_local.h>
+#include <freeradius-devel/util/trie.h>
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <sched.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+/** Maximum number of threads with their own reader counters
+ *
+ * Threads past this share counters with earlier threads.  That's still
+ * correct, it just means they contend on the same cache line.  Counters
+ * are given back when a thread exits.
+ */
+#define FR_TRIE_RCU_MAX_READERS	(256)
+
+typedef struct {
+	alignas(128) _Atomic(uint64_t)	active[2];	//!< Readers in even and odd epochs.
+	atomic_bool			used;		//!< Owned by a thread.
+} fr_trie_rcu_reader_t;
+
+/** A change which has been made to the published copy, but not to the other one
+ *
+ */
+typedef struct {
+	bool			insert;			//!< Insert, or remove.
+	uint8_t			*key;			//!< Copy of the key.
+	size_t			keylen;			//!< Length of the key in bits.
+	void const		*data;			//!< User ctx to insert.
+	uint64_t		gp;			//!< Grace period which must complete first.
+} fr_trie_rcu_pending_t;
+
+struct fr_trie_rcu_s {
+	fr_trie_t		*trie[2];		//!< The two copies of the trie.
+	_Atomic(fr_trie_t *)	current;		//!< The copy readers use.
+	pthread_mutex_t		mutex;			//!< Serialises writers.
+	fr_trie_rcu_pending_t	pending;		//!< Change still to be made to the other copy.
+	bool			has_pending;		//!< Whether "pending" is valid.
+};
+
+static fr_trie_rcu_reader_t	rcu_readers[FR_TRIE_RCU_MAX_READERS];
+static _Atomic(uint32_t)	rcu_num_readers;	//!< Highest reader slot ever used, plus one.
+static _Atomic(uint32_t)	rcu_next_shared;
+static _Atomic(uint64_t)	rcu_epoch;
+static _Atomic(uint64_t)	rcu_gp_seq;		//!< Odd while a grace period is running.
+static pthread_mutex_t		rcu_sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+fr_thread_local_setup(fr_trie_rcu_reader_t *, rcu_reader);	/* macro */
+
+/** Give our reader counters back when the thread exits
+ *
+ */
+static void _rcu_reader_free(void *arg)
+{
+	fr_trie_rcu_reader_t *reader = arg;
+
+	atomic_store(&reader->used, false);
+}
+
+/** Return the reader counters for this thread
+ *
+ */
+static fr_trie_rcu_reader_t *rcu_reader_alloc(void)
+{
+	unsigned int	i;
+	uint32_t	num;
+
+	for (i = 0; i < FR_TRIE_RCU_MAX_READERS; i++) {
+		bool expected = false;
+
+		if (!atomic_compare_exchange_strong(&rcu_readers[i].used, &expected, true)) continue;
+
+		/*
+		 *	Make sure that writers look at this slot.  It's
+		 *	done before the caller reads the epoch, so any
+		 *	grace period which doesn't see it can't be
+		 *	waiting for us.
+		 */
+		num = atomic_load(&rcu_num_readers);
+		while ((num < (i + 1)) &&
+		       !atomic_compare_exchange_weak(&rcu_num_readers, &num, i + 1));
+
+		fr_thread_local_set_destructor(rcu_reader, _rcu_reader_free, &rcu_readers[i]);
+
+		return rcu_reader;
+	}
+
+	/*
+	 *	All of the slots are owned.  Share one, but don't give
+	 *	it back when we exit, as it's not ours.
+	 */
+	rcu_reader = &rcu_readers[atomic_fetch_add(&rcu_next_shared, 1) % FR_TRIE_RCU_MAX_READERS];
+
+	return rcu_reader;
+}
+
+static inline CC_HINT(always_inline) fr_trie_rcu_reader_t *rcu_reader_get(void)
+{
+	if (likely(rcu_reader != NULL)) return rcu_reader;
+
+	return rcu_reader_alloc();
+}
+
+/** Return the grace period which has to complete, before readers of the current copy are gone
+ *
+ * If a grace period is already running, it may have started before the
+ * caller published its change, so we need the one after it.
+ */
+static inline uint64_t rcu_gp_snap(void)
+{
+	return (atomic_load(&rcu_gp_seq) + 3) & ~((uint64_t) 1);
+}
+
+/** Wait until grace period "gp" has completed
+ *
+ * Only one thread runs a grace period at a time.  Threads which were
+ * waiting for the same grace period find that it has completed when they
+ * get the lock, and return without doing anything.
+ */
+static void rcu_synchronize(uint64_t gp)
+{
+	unsigned int	pass, i, num;
+
+	if (atomic_load(&rcu_gp_seq) >= gp) return;
+
+	pthread_mutex_lock(&rcu_sync_mutex);
+
+	while (atomic_load(&rcu_gp_seq) < gp) {
+		atomic_fetch_add(&rcu_gp_seq, 1);
+
+		/*
+		 *	A reader may have read the epoch just before we
+		 *	changed it, and not yet incremented its counter.
+		 *	So one pass isn't enough.  After the second pass,
+		 *	any reader which started before this grace
+		 *	period has finished.
+		 */
+		for (pass = 0; pass < 2; pass++) {
+			unsigned int idx = atomic_fetch_add(&rcu_epoch, 1) & 1;
+
+			num = atomic_load(&rcu_num_readers);
+			if (num > FR_TRIE_RCU_MAX_READERS) num = FR_TRIE_RCU_MAX_READERS;
+
+			for (i = 0; i < num; i++) {
+				while (atomic_load(&rcu_readers[i].active[idx]) != 0) sched_yield();
+			}
+		}
+
+		atomic_fetch_add(&rcu_gp_seq, 1);
+	}
+
+	pthread_mutex_unlock(&rcu_sync_mutex);
+}
+
+static inline CC_HINT(always_inline) fr_trie_t *rcu_standby(fr_trie_rcu_t *rcu)
+{
+	return (atomic_load(&rcu->current) == rcu->trie[0]) ? rcu->trie[1] : rcu->trie[0];
+}
+
+/** Make the copy which isn't published the same as the published one
+ *
+ * Called, and returns, with rcu->mutex held.  The mutex is released while
+ * we wait for a grace period.
+ *
+ * @return
+ *	- 0 on success.
+ *	- -1 if we're out of memory.  The change stays pending.
+ */
+static int rcu_catch_up(fr_trie_rcu_t *rcu)
+{
+	fr_trie_rcu_pending_t *pending = &rcu->pending;
+
+	while (rcu->has_pending) {
+		uint64_t gp = pending->gp;
+
+		/*
+		 *	Readers may still be using the standby copy.
+		 *	Another writer may catch up while we're
+		 *	waiting, so check again afterwards.
+		 */
+		if (atomic_load(&rcu_gp_seq) < gp) {
+			pthread_mutex_unlock(&rcu->mutex);
+			rcu_synchronize(gp);
+			pthread_mutex_lock(&rcu->mutex);
+			continue;
+		}
+
+		if (pending->insert) {
+			if (fr_trie_insert(rcu_standby(rcu), pending->key, pending->keylen, pending->data) < 0) {
+				return -1;
+			}
+		} else {
+			(void) fr_trie_remove(rcu_standby(rcu), pending->key, pending->keylen);
+		}
+
+		TALLOC_FREE(pending->key);
+		rcu->has_pending = false;
+	}
+
+	return 0;
+}
+
+/** Publish the standby copy, and remember the change which the old copy needs
+ *
+ * Called with rcu->mutex held, once the change has been made to the
+ * standby copy.
+ *
+ * @param[in] rcu	to publish.
+ * @param[in] insert	whether the change was an insert, or a remove.
+ * @param[in] key	copy of the key, parented by rcu.
+ * @param[in] keylen	length of the key in bits.
+ * @param[in] data	user ctx which was inserted.
+ * @return the grace period after which no reader can be using the old copy.
+ */
+static uint64_t rcu_publish(fr_trie_rcu_t *rcu, bool insert, uint8_t *key, size_t keylen, void const *data)
+{
+	fr_trie_rcu_pending_t *pending = &rcu->pending;
+
+	atomic_store(&rcu->current, rcu_standby(rcu));
+
+	pending->insert = insert;
+	pending->key = key;
+	pending->keylen = keylen;
+	pending->data = data;
+	pending->gp = rcu_gp_snap();
+	rcu->has_pending = true;
+
+	return pending->gp;
+}
+
+static int _trie_rcu_free(fr_trie_rcu_t *rcu)
+{
+	pthread_mutex_destroy(&rcu->mutex);
+
+	return 0;
+}
+
+/** Allocate a trie which can be read while it's being updated
+ *
+ * @param[in] ctx	to allocate the trie in.
+ * @return
+ *	- The new trie.
+ *	- NULL on error.
+ */
+fr_trie_rcu_t *fr_trie_rcu_alloc(TALLOC_CTX *ctx)
+{
+	fr_trie_rcu_t *rcu;
+
+	rcu = talloc_zero(ctx, fr_trie_rcu_t);
+	if (!rcu) {
+		fr_strerror_printf("Out of memory");
+		return NULL;
+	}
+
+	rcu->trie[0] = fr_trie_alloc(rcu);
+	rcu->trie[1] = fr_trie_alloc(rcu);
+	if (!rcu->trie[0] || !rcu->trie[1]) {
+		talloc_free(rcu);
+		return NULL;
+	}
+	atomic_init(&rcu->current, rcu->trie[0]);
+
+	pthread_mutex_init(&rcu->mutex, NULL);
+	talloc_set_destructor(rcu, _trie_rcu_free);
+
+	return rcu;
+}
+
+/** Insert a key and user ctx into a trie
+ *
+ * Only one writer runs at a time.  Readers are never blocked.  Returns
+ * once the new entry is visible to all readers.  We may first have to
+ * wait for readers of an older version of the trie, so that the change
+ * made by a previous writer can be copied.
+ *
+ * @param[in] rcu	to insert into.
+ * @param[in] key	to insert.
+ * @param[in] keylen	length of the key in bits.
+ * @param[in] data	user ctx to associate with the key.
+ * @return
+ *	- 0 on success.
+ *	- <0 on error, including the key already being in the trie.
+ */
+int fr_trie_rcu_insert(fr_trie_rcu_t *rcu, void const *key, size_t keylen, void const *data)
+{
+	uint8_t *copy;
+
+	pthread_mutex_lock(&rcu->mutex);
+
+	copy = talloc_memdup(rcu, key, (keylen + 7) / 8);
+	if (!copy) {
+	oom:
+		pthread_mutex_unlock(&rcu->mutex);
+		fr_strerror_printf("Out of memory");
+		return -1;
+	}
+
+	if (rcu_catch_up(rcu) < 0) {
+		talloc_free(copy);
+		goto oom;
+	}
+
+	if (fr_trie_insert(rcu_standby(rcu), key, keylen, data) < 0) {
+		talloc_free(copy);
+		pthread_mutex_unlock(&rcu->mutex);
+		return -1;
+	}
+
+	(void) rcu_publish(rcu, true, copy, keylen, data);
+
+	pthread_mutex_unlock(&rcu->mutex);
+
+	return 0;
+}
+
+/** Remove a key from a trie
+ *
+ * Returns once no reader can find the key.  Readers which found it
+ * earlier may still be using the data.
+ *
+ * @param[in] rcu	to remove from.
+ * @param[in] key	to remove.
+ * @param[in] keylen	length of the key in bits.
+ * @return
+ *	- The user ctx which was associated with the key.
+ *	- NULL if the key wasn't in the trie.
+ */
+void *fr_trie_rcu_remove(fr_trie_rcu_t *rcu, void const *key, size_t keylen)
+{
+	void		*data = NULL;
+	uint8_t		*copy;
+	uint64_t	gp;
+
+	pthread_mutex_lock(&rcu->mutex);
+
+	copy = talloc_memdup(rcu, key, (keylen + 7) / 8);
+	if (!copy || (rcu_catch_up(rcu) < 0)) goto done;
+
+	data = fr_trie_remove(rcu_standby(rcu), key, keylen);
+	if (!data) {
+	done:
+		talloc_free(copy);
+		pthread_mutex_unlock(&rcu->mutex);
+		return data;
+	}
+
+	gp = rcu_publish(rcu, false, copy, keylen, NULL);
+
+	pthread_mutex_unlock(&rcu->mutex);
+
+	/*
+	 *	Readers of the old copy can still find the key.  Wait
+	 *	for them, without blocking other writers.
+	 */
+	rcu_synchronize(gp);
+
+	/*
+	 *	The old copy isn't being read, so we may as well
+	 *	remove the key from it now.
+	 */
+	pthread_mutex_lock(&rcu->mutex);
+	(void) rcu_catch_up(rcu);
+	pthread_mutex_unlock(&rcu->mutex);
+
+	return data;
+}
+
+/** Lookup a key in a trie, and return the longest matching prefix
+ *
+ * Safe to call from any thread, at any time, without locks.
+ *
+ * @param[in] rcu	to search.
+ * @param[in] key	to look up.
+ * @param[in] keylen	length of the key in bits.
+ * @return
+ *	- The user ctx of the longest matching prefix.
+ *	- NULL if nothing matches.
+ */
+void *fr_trie_rcu_lookup(fr_trie_rcu_t const *rcu, void const *key, size_t keylen)
+{
+	fr_trie_rcu_reader_t	*reader = rcu_reader_get();
+	unsigned int		idx = atomic_load(&rcu_epoch) & 1;
+	void			*data;
+
+	atomic_fetch_add(&reader->active[idx], 1);
+	data = fr_trie_lookup(atomic_load(&rcu->current), key, keylen);
+	atomic_fetch_sub(&reader->active[idx], 1);
+
+	return data;
+}
+
+/** Lookup a key in a trie, and return only an exact match
+ *
+ * Safe to call from any thread, at any time, without locks.
+ *
+ * @param[in] rcu	to search.
+ * @param[in] key	to look up.
+ * @param[in] keylen	length of the key in bits.
+ * @return
+ *	- The user ctx of the key.
+ *	- NULL if the key isn't in the trie.
+ */
+void *fr_trie_rcu_match(fr_trie_rcu_t const *rcu, void const *key, size_t keylen)
+{
+	fr_trie_rcu_reader_t	*reader = rcu_reader_get();
+	unsigned int		idx = atomic_load(&rcu_epoch) & 1;
+	void			*data;
+
+	atomic_fetch_add(&reader->active[idx], 1);
+	data = fr_trie_match(atomic_load(&rcu->current), key, keylen);
+	atomic_fetch_sub(&reader->active[idx], 1);
+
+	return data;
+}
+
+/** Walk over a trie
+ *
+ * Writers are blocked until the walk finishes.  Readers aren't.
+ *
+ * @param[in] rcu	to walk over.
+ * @param[in] ctx	to pass to the callback.
+ * @param[in] callback	to call for each key.
+ * @return the return code of #fr_trie_walk.
+ */
+int fr_trie_rcu_walk(fr_trie_rcu_t *rcu, void *ctx, fr_trie_walk_t callback)
+{
+	int rcode;
+
+	pthread_mutex_lock(&rcu->mutex);
+	rcode = fr_trie_walk(atomic_load(&rcu->current), ctx, callback);
+	pthread_mutex_unlock(&rcu->mutex);
+
+	return rcode;
+}
@@ -36,8 +36,63 @@ RCSID("$Id$")
 #define UDP_UNUSED UNUSED
 #endif
 
+#ifdef HAVE_SENDMMSG
+#define SENDMMSG_UNUSED
+#else
+#define SENDMMSG_UNUSED UNUSED
+#endif
+
 #define FR_DEBUG_STRERROR_PRINTF if (fr_debug_lvl) fr_strerror_printf
 
+/*
+ *	Size of the control buffer used to receive IP_PKTINFO for
+ *	each packet in a batch.
+ */
+#define UDP_BATCH_CBUF_SIZE	(256)
+
+/** A batch of packets read from a UDP socket with one system call
+ *
+ */
+struct fr_udp_recv_batch_s {
+	unsigned int		num;		//!< maximum number of packets per read.
+	unsigned int		count;		//!< number of packets returned by the last read.
+	unsigned int		next;		//!< next packet to return to the caller.
+	size_t			size;		//!< size of each packet buffer.
+
+	struct sockaddr_storage	local;		//!< bound address of the socket.
+	socklen_t		local_len;	//!< length of the bound address.
+
+#ifdef HAVE_RECVMMSG
+	uint8_t			*buffers;	//!< packet data, num * size bytes.
+	struct mmsghdr		*msgs;		//!< one header per packet.
+	struct iovec		*iov;		//!< one iovec per packet.
+	struct sockaddr_storage	*src;		//!< source address of each packet.
+	uint8_t			*cbuf;		//!< control data (IP_PKTINFO, etc.) for each packet.
+#endif
+};
+
+/** A batch of packets to be written to a UDP socket with one system call
+ *
+ */
+struct fr_udp_send_batch_s {
+	unsigned int		num;		//!< maximum number of packets per write.
+	unsigned int		count;		//!< number of packets queued.
+	unsigned int		next;		//!< first queued packet which hasn't been written.
+	size_t			size;		//!< size of each packet buffer.
+
+	struct sockaddr_storage	from;		//!< source address of the queued packets.
+	socklen_t		from_len;	//!< zero if the source address isn't set.
+	int			if_index;	//!< interface of the queued packets.
+
+#ifdef HAVE_SENDMMSG
+	uint8_t			*buffers;	//!< packet data, num * size bytes.
+	struct mmsghdr		*msgs;		//!< one header per packet.
+	struct iovec		*iov;		//!< one iovec per packet.
+	struct sockaddr_storage	*dst;		//!< destination address of each packet.
+	uint8_t			cbuf[UDP_BATCH_CBUF_SIZE]; //!< control data, shared by all packets.
+#endif
+};
+
 /** Send a packet via a UDP socket.
  *
  * @param[in] sockfd we're reading from.
@@ -256,3 +311,441 @@ done:
 
 	return received;
 }
+
+/** Allocate a structure for reading batches of UDP packets
+ *
+ * @param[in] ctx	to allocate the batch in.
+ * @param[in] num	maximum number of packets to read in one system call.
+ * @param[in] size	maximum size of a packet.
+ * @return
+ *	- NULL on error.
+ *	- a new batch structure.
+ */
+fr_udp_recv_batch_t *udp_recv_batch_alloc(TALLOC_CTX *ctx, unsigned int num, size_t size)
+{
+	fr_udp_recv_batch_t	*batch;
+#ifdef HAVE_RECVMMSG
+	unsigned int		i;
+#endif
+
+	if (!num) num = 1;
+
+	batch = talloc_zero(ctx, fr_udp_recv_batch_t);
+	if (!batch) return NULL;
+
+	batch->num = num;
+	batch->size = size;
+
+#ifdef HAVE_RECVMMSG
+	batch->buffers = talloc_array(batch, uint8_t, num * size);
+	batch->msgs = talloc_zero_array(batch, struct mmsghdr, num);
+	batch->iov = talloc_zero_array(batch, struct iovec, num);
+	batch->src = talloc_zero_array(batch, struct sockaddr_storage, num);
+	batch->cbuf = talloc_zero_array(batch, uint8_t, num * UDP_BATCH_CBUF_SIZE);
+	if (!batch->buffers || !batch->msgs || !batch->iov || !batch->src || !batch->cbuf) {
+		talloc_free(batch);
+		return NULL;
+	}
+
+	for (i = 0; i < num; i++) {
+		batch->iov[i].iov_base = batch->buffers + (i * size);
+		batch->iov[i].iov_len = size;
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+#endif
+
+	return batch;
+}
+
+/** Return how many packets have been read from the socket, but not yet returned
+ *
+ * @param[in] batch	to check.
+ * @return the number of packets remaining.
+ */
+unsigned int udp_recv_batch_pending(fr_udp_recv_batch_t const *batch)
+{
+	return batch->count - batch->next;
+}
+
+#ifdef HAVE_RECVMMSG
+/** Read up to batch->num packets from the socket with one system call
+ *
+ * @param[in] sockfd	we're reading from.
+ * @param[in] batch	to read packets into.
+ * @return
+ *	- >0 the number of packets read.
+ *	- 0 if there's no data.
+ *	- <0 on error.
+ */
+static int udp_recv_batch_fill(int sockfd, fr_udp_recv_batch_t *batch)
+{
+	unsigned int	i;
+	int		num;
+
+	/*
+	 *	The kernel gives us the destination IP address, but
+	 *	not the destination port.  The socket is bound, so
+	 *	its address doesn't change.  Look it up once.
+	 */
+	if (!batch->local_len) {
+		batch->local_len = sizeof(batch->local);
+		if (getsockname(sockfd, (struct sockaddr *) &batch->local, &batch->local_len) < 0) {
+			batch->local_len = 0;
+			fr_strerror_printf("Failed getting socket name: %s", fr_syserror(errno));
+			return -1;
+		}
+	}
+
+	for (i = 0; i < batch->num; i++) {
+		struct msghdr *msgh = &batch->msgs[i].msg_hdr;
+
+		msgh->msg_name = &batch->src[i];
+		msgh->msg_namelen = sizeof(batch->src[i]);
+		msgh->msg_control = batch->cbuf + (i * UDP_BATCH_CBUF_SIZE);
+		msgh->msg_controllen = UDP_BATCH_CBUF_SIZE;
+		msgh->msg_flags = 0;
+	}
+
+	batch->count = batch->next = 0;
+
+	num = recvmmsg(sockfd, batch->msgs, batch->num, 0, NULL);
+	if (num < 0) {
+		if ((errno == EWOULDBLOCK) || (errno == EAGAIN) || (errno == EINTR)) return 0;
+
+		fr_strerror_printf("Failed reading socket: %s", fr_syserror(errno));
+		return -1;
+	}
+
+	batch->count = num;
+
+	return num;
+}
+#endif
+
+/** Read a UDP packet, using a batch of packets read with one system call
+ *
+ * If there are packets left over from a previous read, the next one is
+ * returned without calling the kernel.  Otherwise, up to batch->num
+ * packets are read with recvmmsg().  The caller should use
+ * udp_recv_batch_pending() to see if it should call this function
+ * again, as the socket may no longer be readable.
+ *
+ * Where recvmmsg() isn't available, this function is the same as
+ * udp_recv().
+ *
+ * @param[in] sockfd	we're reading from.
+ * @param[in] batch	of packets previously read from the socket.
+ * @param[out] data	pointer where data will be written
+ * @param[in] data_len	length of data to read
+ * @param[out] src_ipaddr of the packet.
+ * @param[out] src_port of the packet.
+ * @param[out] dst_ipaddr of the packet.
+ * @param[out] dst_port of the packet.
+ * @param[out] if_index of the interface that received the packet.
+ * @param[out] when the packet was received.
+ * @return
+ *	- > 0 on success (number of bytes read).
+ *	- 0 if there's no data.
+ *	- < 0 on failure.
+ */
+ssize_t udp_recv_batch(int sockfd, fr_udp_recv_batch_t *batch, void *data, size_t data_len,
+		       fr_ipaddr_t *src_ipaddr, uint16_t *src_port,
+		       fr_ipaddr_t *dst_ipaddr, uint16_t *dst_port, int *if_index,
+		       fr_time_t *when)
+{
+#ifndef HAVE_RECVMMSG
+	return udp_recv(sockfd, data, data_len, 0, src_ipaddr, src_port,
+			dst_ipaddr, dst_port, if_index, when);
+#else
+	struct mmsghdr		*mmsg;
+	struct sockaddr_storage	dst;
+	socklen_t		sizeof_dst;
+	size_t			len;
+	uint16_t		port;
+
+	if (batch->next >= batch->count) {
+		int num;
+
+		num = udp_recv_batch_fill(sockfd, batch);
+		if (num <= 0) return num;
+	}
+
+	mmsg = &batch->msgs[batch->next++];
+
+	/*
+	 *	The OS discards any data after "size" bytes, just
+	 *	like recvfrom().  We do the same for the caller's
+	 *	buffer.
+	 */
+	len = mmsg->msg_len;
+	if (len > data_len) len = data_len;
+	memcpy(data, mmsg->msg_hdr.msg_iov->iov_base, len);
+
+	if (fr_ipaddr_from_sockaddr(mmsg->msg_hdr.msg_name, mmsg->msg_hdr.msg_namelen, src_ipaddr, &port) < 0) {
+		fr_strerror_printf_push("Failed converting sockaddr to ipaddr");
+		return -1;
+	}
+	*src_port = port;
+
+	memcpy(&dst, &batch->local, sizeof(dst));
+	sizeof_dst = batch->local_len;
+
+#ifdef WITH_UDPFROMTO
+	udpfromto_cmsg_parse(&mmsg->msg_hdr, (struct sockaddr *) &dst, &sizeof_dst, if_index, when);
+#else
+	if (if_index) *if_index = 0;
+	if (when) *when = fr_time();
+#endif
+
+	if (dst_ipaddr) {
+		fr_ipaddr_from_sockaddr(&dst, sizeof_dst, dst_ipaddr, &port);
+		*dst_port = port;
+	}
+
+	return len;
+#endif
+}
+
+/** Allocate a structure for writing batches of UDP packets
+ *
+ * @param[in] ctx	to allocate the batch in.
+ * @param[in] num	maximum number of packets to write in one system call.
+ * @param[in] size	maximum size of a packet.
+ * @return
+ *	- NULL on error.
+ *	- a new batch structure.
+ */
+fr_udp_send_batch_t *udp_send_batch_alloc(TALLOC_CTX *ctx, unsigned int num, size_t size)
+{
+	fr_udp_send_batch_t	*batch;
+#ifdef HAVE_SENDMMSG
+	unsigned int		i;
+#endif
+
+	if (!num) num = 1;
+
+	batch = talloc_zero(ctx, fr_udp_send_batch_t);
+	if (!batch) return NULL;
+
+	batch->num = num;
+	batch->size = size;
+
+#ifdef HAVE_SENDMMSG
+	batch->buffers = talloc_array(batch, uint8_t, num * size);
+	batch->msgs = talloc_zero_array(batch, struct mmsghdr, num);
+	batch->iov = talloc_zero_array(batch, struct iovec, num);
+	batch->dst = talloc_zero_array(batch, struct sockaddr_storage, num);
+	if (!batch->buffers || !batch->msgs || !batch->iov || !batch->dst) {
+		talloc_free(batch);
+		return NULL;
+	}
+
+	for (i = 0; i < num; i++) {
+		batch->iov[i].iov_base = batch->buffers + (i * size);
+		batch->msgs[i].msg_hdr.msg_iov = &batch->iov[i];
+		batch->msgs[i].msg_hdr.msg_iovlen = 1;
+		batch->msgs[i].msg_hdr.msg_name = &batch->dst[i];
+	}
+#endif
+
+	return batch;
+}
+
+/** Return how many packets are queued, but not yet written
+ *
+ * @param[in] batch	to check.
+ * @return the number of queued packets.
+ */
+unsigned int udp_send_batch_pending(fr_udp_send_batch_t const *batch)
+{
+	return batch->count - batch->next;
+}
+
+/** Write all of the queued packets to the socket
+ *
+ * Where sendmmsg() isn't available, packets are never queued, and this
+ * function does nothing.
+ *
+ * If the socket buffer is full, the packets which haven't been written
+ * stay in the batch, and errno is set to EWOULDBLOCK.  The caller
+ * should wait for the socket to become writable, and then call this
+ * function again.  If the write fails for any other reason, the
+ * remaining packets are discarded.  This is no worse than a packet
+ * being lost on the network.
+ *
+ * @param[in] sockfd	we're writing to.
+ * @param[in] batch	of packets to write.
+ * @return
+ *	- >=0 the number of packets written.
+ *	- <0 on error, or if the socket is full (errno == EWOULDBLOCK).
+ */
+int udp_send_batch_flush(SENDMMSG_UNUSED int sockfd, fr_udp_send_batch_t *batch)
+{
+#ifdef HAVE_SENDMMSG
+	unsigned int	i, sent = 0;
+	void		*control = NULL;
+	size_t		controllen = 0;
+
+	if (batch->next >= batch->count) {
+		batch->count = batch->next = 0;
+		return 0;
+	}
+
+#ifdef WITH_UDPFROMTO
+	/*
+	 *	All of the queued packets have the same source, so
+	 *	they can share one control buffer.
+	 */
+	if (batch->from_len) {
+		struct msghdr *msgh = &batch->msgs[0].msg_hdr;
+
+		if (udpfromto_cmsg_set(sockfd, msgh, batch->cbuf, sizeof(batch->cbuf),
+				       (struct sockaddr *) &batch->from, batch->from_len,
+				       batch->if_index) < 0) {
+			fr_strerror_printf("udp_sendmmsg failed: %s", fr_syserror(errno));
+			batch->count = batch->next = 0;
+			return -1;
+		}
+
+		control = msgh->msg_control;
+		controllen = msgh->msg_controllen;
+	}
+#endif
+
+	for (i = batch->next; i < batch->count; i++) {
+		batch->msgs[i].msg_hdr.msg_control = control;
+		batch->msgs[i].msg_hdr.msg_controllen = controllen;
+	}
+
+	while (batch->next < batch->count) {
+		int rcode;
+
+		rcode = sendmmsg(sockfd, &batch->msgs[batch->next], batch->count - batch->next, 0);
+		if (rcode < 0) {
+			if (errno == EINTR) continue;
+
+			/*
+			 *	The socket buffer is full.  Leave the
+			 *	packets which haven't been written in
+			 *	the batch, so that the caller can try
+			 *	again when the socket is writable.
+			 */
+			if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+				fr_strerror_printf("udp_sendmmsg failed: %s", fr_syserror(errno));
+				errno = EWOULDBLOCK;
+				return -1;
+			}
+
+			fr_strerror_printf("udp_sendmmsg failed: %s", fr_syserror(errno));
+			batch->count = batch->next = 0;
+			return -1;
+		}
+
+		batch->next += rcode;
+		sent += rcode;
+	}
+
+	batch->count = batch->next = 0;
+
+	return sent;
+#else
+	return 0;
+#endif
+}
+
+/** Queue a packet to be written to a UDP socket
+ *
+ * Packets are copied into the batch, and are written with sendmmsg() when
+ * the batch is full, or when udp_send_batch_flush() is called.
+ *
+ * All of the packets in a batch have the same source address and
+ * interface.  When a packet has a different source, the queued packets
+ * are flushed, and the packet is written by itself with udp_send().
+ *
+ * If the socket is full, and the packet can't be queued, this function
+ * returns an error with errno set to EWOULDBLOCK.  The caller should
+ * write the packet again when the socket is writable.
+ *
+ * Where sendmmsg() isn't available, this function is the same as
+ * udp_send().
+ *
+ * @param[in] sockfd	we're writing to.
+ * @param[in] batch	of queued packets.
+ * @param[in] data	pointer to data to send
+ * @param[in] data_len	length of data to send
+ * @param[in] src_ipaddr of the packet.
+ * @param[in] src_port of the packet.
+ * @param[in] if_index of the packet.
+ * @param[in] dst_ipaddr of the packet.
+ * @param[in] dst_port of the packet.
+ * @return
+ *	- > 0 on success (number of bytes queued or written).
+ *	- < 0 on failure.
+ */
+ssize_t udp_send_batch(int sockfd, fr_udp_send_batch_t *batch, void *data, size_t data_len,
+		       fr_ipaddr_t const *src_ipaddr, uint16_t src_port, int if_index,
+		       fr_ipaddr_t const *dst_ipaddr, uint16_t dst_port)
+{
+#ifndef HAVE_SENDMMSG
+	return udp_send(sockfd, data, data_len, 0, src_ipaddr, src_port, if_index, dst_ipaddr, dst_port);
+#else
+	struct sockaddr_storage	from;
+	socklen_t		from_len = 0;
+	unsigned int		i;
+
+	/*
+	 *	Too large to queue.  Send any queued packets first, so
+	 *	that we don't re-order them.
+	 */
+	if (data_len > batch->size) goto send_one;
+
+	/*
+	 *	The batch is full of packets which couldn't be written
+	 *	the last time.  Try them again before queueing this
+	 *	one.
+	 */
+	if ((batch->count == batch->num) && (udp_send_batch_flush(sockfd, batch) < 0)) return -1;
+
+#ifdef WITH_UDPFROMTO
+	/*
+	 *	The same checks as udp_send(), to see if we pin the
+	 *	source address.
+	 */
+	if ((src_ipaddr->af != AF_UNSPEC) && (dst_ipaddr->af != AF_UNSPEC) &&
+	    !fr_ipaddr_is_inaddr_any(src_ipaddr)) {
+		if (fr_ipaddr_to_sockaddr(src_ipaddr, src_port, &from, &from_len) < 0) return -1;
+	}
+#endif
+
+	if (batch->count == 0) {
+		if (from_len) memcpy(&batch->from, &from, from_len);
+		batch->from_len = from_len;
+		batch->if_index = if_index;
+
+	} else if ((from_len != batch->from_len) || (if_index != batch->if_index) ||
+		   (from_len && (memcmp(&from, &batch->from, from_len) != 0))) {
+	send_one:
+		if (udp_send_batch_flush(sockfd, batch) < 0) return -1;
+
+		return udp_send(sockfd, data, data_len, 0, src_ipaddr, src_port, if_index, dst_ipaddr, dst_port);
+	}
+
+	i = batch->count;
+	if (fr_ipaddr_to_sockaddr(dst_ipaddr, dst_port, &batch->dst[i],
+				  &batch->msgs[i].msg_hdr.msg_namelen) < 0) return -1;
+
+	memcpy(batch->iov[i].iov_base, data, data_len);
+	batch->iov[i].iov_len = data_len;
+	batch->count++;
+
+	/*
+	 *	If the socket is full, the packet stays queued, and
+	 *	will be written by the next flush.
+	 */
+	if ((batch->count == batch->num) && (udp_send_batch_flush(sockfd, batch) < 0) &&
+	    (errno != EWOULDBLOCK)) return -1;
+
+	return data_len;
+#endif
+}
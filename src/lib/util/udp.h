@@ -35,6 +35,8 @@ extern "C" {
 #include <freeradius-devel/util/inet.h>
 #include <freeradius-devel/util/time.h>
 
+#include <talloc.h>
+
 #define UDP_FLAGS_NONE		(0)
 #define UDP_FLAGS_CONNECTED	(1 << 0)
 #define UDP_FLAGS_PEEK		(1 << 1)
@@ -52,6 +54,42 @@ ssize_t udp_recv(int sockfd, void *data, size_t data_len, int flags,
 		 fr_ipaddr_t *dst_ipaddr, uint16_t *dst_port, int *if_index,
 		 fr_time_t *when);
 
+typedef struct fr_udp_recv_batch_s fr_udp_recv_batch_t;
+
+fr_udp_recv_batch_t *udp_recv_batch_alloc(TALLOC_CTX *ctx, unsigned int num, size_t size);
+
+unsigned int udp_recv_batch_pending(fr_udp_recv_batch_t const *batch);
+
+ssize_t udp_recv_batch(int sockfd, fr_udp_recv_batch_t *batch, void *data, size_t data_len,
+		       fr_ipaddr_t *src_ipaddr, uint16_t *src_port,
+		       fr_ipaddr_t *dst_ipaddr, uint16_t *dst_port, int *if_index,
+		       fr_time_t *when);
+
+typedef struct fr_udp_send_batch_s fr_udp_send_batch_t;
+
+fr_udp_send_batch_t *udp_send_batch_alloc(TALLOC_CTX *ctx, unsigned int num, size_t size);
+
+unsigned int udp_send_batch_pending(fr_udp_send_batch_t const *batch);
+
+int udp_send_batch_flush(int sockfd, fr_udp_send_batch_t *batch);
+
+ssize_t udp_send_batch(int sockfd, fr_udp_send_batch_t *batch, void *data, size_t data_len,
+		       fr_ipaddr_t const *src_ipaddr, uint16_t src_port, int if_index,
+		       fr_ipaddr_t const *dst_ipaddr, uint16_t dst_port);
+
+typedef struct fr_udp_uring_s fr_udp_uring_t;
+
+fr_udp_uring_t *udp_uring_alloc(TALLOC_CTX *ctx, int sockfd, unsigned int num, size_t size);
+
+int udp_uring_fd(fr_udp_uring_t const *uring);
+
+unsigned int udp_uring_pending(fr_udp_uring_t const *uring);
+
+ssize_t udp_uring_recv(fr_udp_uring_t *uring, void *data, size_t data_len,
+		       fr_ipaddr_t *src_ipaddr, uint16_t *src_port,
+		       fr_ipaddr_t *dst_ipaddr, uint16_t *dst_port, int *if_index,
+		       fr_time_t *when);
+
 #ifdef __cplusplus
 }
 #endif
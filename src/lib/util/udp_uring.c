@@ -0,0 +1,500 @@
+/*
+ *   This library is free software; you can redistribute it and/or
+ *   modify it under the terms of the GNU Lesser General Public
+ *   License as published by the Free Software Foundation; either
+ *   version 2.1 of the License, or (at your option) any later version.
+ *
+ *   This library is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ *   Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+/** Read UDP packets with io_uring
+ *
+ * A multishot recvmsg() is armed on the socket, and the kernel places
+ * each packet it receives into a buffer taken from a ring of buffers
+ * we provide.  Completions are read from shared memory, so reading
+ * a packet doesn't need a system call.  The io_uring FD is readable
+ * when there are completions, and it's that FD which is inserted into
+ * the event loop, not the socket.
+ *
+ * Each packet is copied out of its buffer into the buffer which the
+ * caller passes to udp_uring_recv(), and the buffer goes straight back
+ * to the kernel.  The network side reserves space in an fr_message_set_t
+ * only once it has decided to read, and that space can be moved or
+ * released after the read.  It can't be handed to the kernel ahead of
+ * time, so the packets aren't received into it directly.
+ *
+ * Only UDP sockets are read this way.  TCP sockets and detail files
+ * still use read().
+ *
+ * We don't use liburing.  The small subset of it that we need is
+ * done here with the kernel API.
+ *
+ * @file src/lib/util/udp_uring.c
+ *
+ * @copyright 2020 The FreeRADIUS server project
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/strerror.h>
+#include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/util/udp.h>
+
+#ifdef HAVE_LINUX_IO_URING_H
+#  include <linux/io_uring.h>
+#endif
+
+/*
+ *	Multishot recvmsg() and provided buffer rings need Linux 6.0
+ *	headers.  The kernel is checked at run time.
+ */
+#ifdef IORING_RECV_MULTISHOT
+#  define HAVE_UDP_URING
+#  include <sys/mman.h>
+#  include <sys/syscall.h>
+#endif
+
+#ifdef HAVE_UDP_URING
+#define UDP_URING_CBUF_SIZE	(256)
+#define UDP_URING_BGID		(0)		//!< Buffer group ID.  We only have one.
+#define UDP_URING_RECV		(1)		//!< user_data for the multishot recvmsg().
+
+/** io_uring state for one UDP socket
+ *
+ */
+struct fr_udp_uring_s {
+	int			ring_fd;	//!< from io_uring_setup().
+	int			sockfd;		//!< we're reading from.  Not owned by us.
+
+	unsigned int		num;		//!< number of packet buffers.
+	size_t			size;		//!< size of each packet buffer, including headers.
+	bool			armed;		//!< whether the multishot recvmsg() is active.
+
+	struct sockaddr_storage	local;		//!< bound address of the socket.
+	socklen_t		local_len;	//!< length of the bound address.
+
+	struct msghdr		msgh;		//!< tells the kernel how to lay out each buffer.
+
+	uint8_t			*sq_ring;	//!< submission queue ring.
+	size_t			sq_ring_size;
+	uint32_t		*sq_tail;
+	uint32_t		*sq_mask;
+	uint32_t		*sq_array;
+	struct io_uring_sqe	*sqes;		//!< submission queue entries.
+	size_t			sqes_size;
+
+	uint8_t			*cq_ring;	//!< completion queue ring.  May be the same as sq_ring.
+	size_t			cq_ring_size;
+	uint32_t		*cq_head;
+	uint32_t		*cq_tail;
+	uint32_t		*cq_mask;
+	struct io_uring_cqe	*cqes;
+
+	struct io_uring_buf_ring *br;		//!< ring of buffers provided to the kernel.
+	size_t			br_size;
+	uint8_t			*buffers;	//!< packet data, num * size bytes.
+};
+
+static inline int sys_io_uring_setup(unsigned int entries, struct io_uring_params *p)
+{
+	return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+	return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static inline int sys_io_uring_register(int fd, unsigned int opcode, void *arg, unsigned int nr_args)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static int _udp_uring_free(fr_udp_uring_t *uring)
+{
+	if (uring->br) munmap(uring->br, uring->br_size);
+	if (uring->buffers) munmap(uring->buffers, uring->num * uring->size);
+	if (uring->sqes) munmap(uring->sqes, uring->sqes_size);
+	if (uring->cq_ring && (uring->cq_ring != uring->sq_ring)) munmap(uring->cq_ring, uring->cq_ring_size);
+	if (uring->sq_ring) munmap(uring->sq_ring, uring->sq_ring_size);
+	if (uring->ring_fd >= 0) close(uring->ring_fd);
+
+	return 0;
+}
+
+/** Give a buffer back to the kernel
+ *
+ */
+static inline void udp_uring_buffer_add(fr_udp_uring_t *uring, uint16_t bid)
+{
+	uint16_t		tail = uring->br->tail;
+	struct io_uring_buf	*buf = &uring->br->bufs[tail & (uring->num - 1)];
+
+	buf->addr = (uintptr_t) (uring->buffers + (bid * uring->size));
+	buf->len = uring->size;
+	buf->bid = bid;
+
+	__atomic_store_n(&uring->br->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/** Arm the multishot recvmsg()
+ *
+ * The kernel stops a multishot request when it runs out of buffers,
+ * or on error.  So this is called again whenever that happens.
+ */
+static int udp_uring_arm(fr_udp_uring_t *uring)
+{
+	uint32_t		tail = *uring->sq_tail;
+	uint32_t		idx = tail & *uring->sq_mask;
+	struct io_uring_sqe	*sqe = &uring->sqes[idx];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = uring->sockfd;
+	sqe->addr = (uintptr_t) &uring->msgh;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = UDP_URING_BGID;
+	sqe->user_data = UDP_URING_RECV;
+
+	uring->sq_array[idx] = idx;
+	__atomic_store_n(uring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	if (sys_io_uring_enter(uring->ring_fd, 1, 0, 0) < 0) {
+		fr_strerror_printf("Failed submitting to io_uring: %s", fr_syserror(errno));
+		return -1;
+	}
+	uring->armed = true;
+
+	return 0;
+}
+
+/** Allocate io_uring state for reading packets from a UDP socket
+ *
+ * @param[in] ctx	to allocate the ring in.
+ * @param[in] sockfd	to read from.  It must stay open until the ring is freed.
+ * @param[in] num	number of packet buffers.  Rounded up to a power of 2.
+ * @param[in] size	maximum size of a packet.
+ * @return
+ *	- NULL on error, including if the kernel doesn't support what we need.
+ *	- a new ring, with a multishot recvmsg() armed on the socket.
+ */
+fr_udp_uring_t *udp_uring_alloc(TALLOC_CTX *ctx, int sockfd, unsigned int num, size_t size)
+{
+	fr_udp_uring_t		*uring;
+	struct io_uring_params	p;
+	struct io_uring_buf_reg	reg;
+	unsigned int		i;
+
+	if (num < 2) num = 2;
+	if (num > 32768) num = 32768;
+	while (num & (num - 1)) num += num & -num;	/* round up to a power of 2 */
+
+	uring = talloc_zero(ctx, fr_udp_uring_t);
+	if (!uring) return NULL;
+
+	uring->ring_fd = -1;
+	uring->sockfd = sockfd;
+	uring->num = num;
+	talloc_set_destructor(uring, _udp_uring_free);
+
+	/*
+	 *	The kernel needs to know how much room to leave for
+	 *	the source address and the control data.  The rest
+	 *	of each buffer is the packet.
+	 */
+	uring->msgh.msg_namelen = sizeof(struct sockaddr_storage);
+	uring->msgh.msg_controllen = UDP_URING_CBUF_SIZE;
+	uring->size = sizeof(struct io_uring_recvmsg_out) + uring->msgh.msg_namelen + uring->msgh.msg_controllen + size;
+	uring->size = (uring->size + 63) & ~((size_t) 63);
+
+	uring->local_len = sizeof(uring->local);
+	if (getsockname(sockfd, (struct sockaddr *) &uring->local, &uring->local_len) < 0) {
+		fr_strerror_printf("Failed getting socket name: %s", fr_syserror(errno));
+	error:
+		talloc_free(uring);
+		return NULL;
+	}
+
+	/*
+	 *	We only ever submit one request at a time, but every
+	 *	packet is a completion.
+	 */
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = num * 2;
+
+	uring->ring_fd = sys_io_uring_setup(4, &p);
+	if (uring->ring_fd < 0) {
+		fr_strerror_printf("Failed creating io_uring: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	uring->sq_ring_size = p.sq_off.array + (p.sq_entries * sizeof(uint32_t));
+	uring->cq_ring_size = p.cq_off.cqes + (p.cq_entries * sizeof(struct io_uring_cqe));
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (uring->cq_ring_size > uring->sq_ring_size) uring->sq_ring_size = uring->cq_ring_size;
+		uring->cq_ring_size = uring->sq_ring_size;
+	}
+
+	uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			      uring->ring_fd, IORING_OFF_SQ_RING);
+	if (uring->sq_ring == MAP_FAILED) {
+		uring->sq_ring = NULL;
+	map_error:
+		fr_strerror_printf("Failed mapping io_uring: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		uring->cq_ring = uring->sq_ring;
+	} else {
+		uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+				      uring->ring_fd, IORING_OFF_CQ_RING);
+		if (uring->cq_ring == MAP_FAILED) {
+			uring->cq_ring = NULL;
+			goto map_error;
+		}
+	}
+
+	uring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+			   uring->ring_fd, IORING_OFF_SQES);
+	if (uring->sqes == MAP_FAILED) {
+		uring->sqes = NULL;
+		goto map_error;
+	}
+
+	uring->sq_tail = (uint32_t *) (uring->sq_ring + p.sq_off.tail);
+	uring->sq_mask = (uint32_t *) (uring->sq_ring + p.sq_off.ring_mask);
+	uring->sq_array = (uint32_t *) (uring->sq_ring + p.sq_off.array);
+
+	uring->cq_head = (uint32_t *) (uring->cq_ring + p.cq_off.head);
+	uring->cq_tail = (uint32_t *) (uring->cq_ring + p.cq_off.tail);
+	uring->cq_mask = (uint32_t *) (uring->cq_ring + p.cq_off.ring_mask);
+	uring->cqes = (struct io_uring_cqe *) (uring->cq_ring + p.cq_off.cqes);
+
+	/*
+	 *	The buffer ring has to be page aligned, so we use
+	 *	mmap() for it, and for the buffers.
+	 */
+	uring->br_size = num * sizeof(struct io_uring_buf);
+	uring->br = mmap(NULL, uring->br_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (uring->br == MAP_FAILED) {
+		uring->br = NULL;
+		goto map_error;
+	}
+
+	uring->buffers = mmap(NULL, num * uring->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (uring->buffers == MAP_FAILED) {
+		uring->buffers = NULL;
+		goto map_error;
+	}
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (uintptr_t) uring->br;
+	reg.ring_entries = num;
+	reg.bgid = UDP_URING_BGID;
+
+	if (sys_io_uring_register(uring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		fr_strerror_printf("Failed registering io_uring buffers: %s", fr_syserror(errno));
+		goto error;
+	}
+
+	for (i = 0; i < num; i++) udp_uring_buffer_add(uring, i);
+
+	if (udp_uring_arm(uring) < 0) goto error;
+
+	return uring;
+}
+
+/** Return the FD to insert into the event loop
+ *
+ * @param[in] uring	to return the FD for.
+ * @return the io_uring FD.
+ */
+int udp_uring_fd(fr_udp_uring_t const *uring)
+{
+	return uring->ring_fd;
+}
+
+/** Return how many completions are waiting to be read
+ *
+ * Not every completion is a packet, but most are.
+ *
+ * @param[in] uring	to check.
+ * @return the number of completions.
+ */
+unsigned int udp_uring_pending(fr_udp_uring_t const *uring)
+{
+	return __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE) - *uring->cq_head;
+}
+
+/** Read a UDP packet from an io_uring
+ *
+ * The packet has already been received by the kernel, so this function
+ * only copies it out of the buffer, and gives the buffer back to the
+ * kernel.  The caller should use udp_uring_pending() to see if it should
+ * call this function again.
+ *
+ * @param[in] uring	to read from.
+ * @param[out] data	pointer where data will be written
+ * @param[in] data_len	length of data to read
+ * @param[out] src_ipaddr of the packet.
+ * @param[out] src_port of the packet.
+ * @param[out] dst_ipaddr of the packet.
+ * @param[out] dst_port of the packet.
+ * @param[out] if_index of the interface that received the packet.
+ * @param[out] when the packet was received.
+ * @return
+ *	- > 0 on success (number of bytes read).
+ *	- 0 if there's no data.
+ *	- < 0 on failure.
+ */
+ssize_t udp_uring_recv(fr_udp_uring_t *uring, void *data, size_t data_len,
+		       fr_ipaddr_t *src_ipaddr, uint16_t *src_port,
+		       fr_ipaddr_t *dst_ipaddr, uint16_t *dst_port, int *if_index,
+		       fr_time_t *when)
+{
+	uint32_t			head, tail;
+	struct io_uring_cqe		*cqe;
+	struct io_uring_recvmsg_out	*out;
+	uint8_t				*buffer, *name, *control, *payload;
+	struct sockaddr_storage		src, dst;
+	socklen_t			sizeof_src, sizeof_dst;
+	uint16_t			bid, port;
+	ssize_t				received;
+	int				res;
+	uint32_t			flags;
+
+	if (when) *when = 0;
+
+next:
+	head = *uring->cq_head;
+	tail = __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE);
+
+	if (head == tail) {
+		if (!uring->armed && (udp_uring_arm(uring) < 0)) return -1;
+		return 0;
+	}
+
+	cqe = &uring->cqes[head & *uring->cq_mask];
+	res = cqe->res;
+	flags = cqe->flags;
+	__atomic_store_n(uring->cq_head, head + 1, __ATOMIC_RELEASE);
+
+	if (!(flags & IORING_CQE_F_MORE)) uring->armed = false;
+
+	if (res < 0) {
+		/*
+		 *	We ran out of buffers, or were interrupted.
+		 *	Re-arm once we've read everything.
+		 */
+		if ((res == -ENOBUFS) || (res == -EINTR) || (res == -EAGAIN)) goto next;
+
+		if (res == -EINVAL) {
+			fr_strerror_printf("Kernel does not support multishot recvmsg() with io_uring");
+		} else {
+			fr_strerror_printf("Failed reading socket: %s", fr_syserror(-res));
+		}
+		return -1;
+	}
+
+	if (!(flags & IORING_CQE_F_BUFFER)) goto next;
+
+	bid = flags >> IORING_CQE_BUFFER_SHIFT;
+	buffer = uring->buffers + (bid * uring->size);
+
+	if ((size_t) res < sizeof(*out)) {
+	discard:
+		udp_uring_buffer_add(uring, bid);
+		goto next;
+	}
+
+	out = (struct io_uring_recvmsg_out *) buffer;
+	name = buffer + sizeof(*out);
+	control = name + uring->msgh.msg_namelen;
+	payload = control + uring->msgh.msg_controllen;
+
+	/*
+	 *	The rest of the packet was discarded by the kernel.
+	 */
+	received = res - (payload - buffer);
+	if (received < 0) goto discard;
+	if ((size_t) received > data_len) received = data_len;
+
+	sizeof_src = out->namelen;
+	if (sizeof_src > sizeof(src)) sizeof_src = sizeof(src);
+	memcpy(&src, name, sizeof_src);
+
+	if (fr_ipaddr_from_sockaddr(&src, sizeof_src, src_ipaddr, &port) < 0) {
+		fr_strerror_printf("Failed converting sockaddr to ipaddr");
+		udp_uring_buffer_add(uring, bid);
+		return -1;
+	}
+	*src_port = port;
+
+	memcpy(&dst, &uring->local, uring->local_len);
+	sizeof_dst = uring->local_len;
+
+#ifdef WITH_UDPFROMTO
+	{
+		struct msghdr msgh = {
+			.msg_control = control,
+			.msg_controllen = out->controllen
+		};
+
+		udpfromto_cmsg_parse(&msgh, (struct sockaddr *) &dst, &sizeof_dst, if_index, when);
+	}
+#else
+	if (if_index) *if_index = 0;
+#endif
+
+	if (dst_ipaddr) {
+		fr_ipaddr_from_sockaddr(&dst, sizeof_dst, dst_ipaddr, &port);
+		*dst_port = port;
+	}
+
+	memcpy(data, payload, received);
+	udp_uring_buffer_add(uring, bid);
+
+	if (!uring->armed && (udp_uring_arm(uring) < 0)) return -1;
+
+	if (when && !*when) *when = fr_time();
+
+	return received;
+}
+
+#else
+fr_udp_uring_t *udp_uring_alloc(UNUSED TALLOC_CTX *ctx, UNUSED int sockfd, UNUSED unsigned int num,
+				UNUSED size_t size)
+{
+	fr_strerror_printf("io_uring is not supported on this system");
+	return NULL;
+}
+
+int udp_uring_fd(UNUSED fr_udp_uring_t const *uring)
+{
+	return -1;
+}
+
+unsigned int udp_uring_pending(UNUSED fr_udp_uring_t const *uring)
+{
+	return 0;
+}
+
+ssize_t udp_uring_recv(UNUSED fr_udp_uring_t *uring, UNUSED void *data, UNUSED size_t data_len,
+		       UNUSED fr_ipaddr_t *src_ipaddr, UNUSED uint16_t *src_port,
+		       UNUSED fr_ipaddr_t *dst_ipaddr, UNUSED uint16_t *dst_port, UNUSED int *if_index,
+		       UNUSED fr_time_t *when)
+{
+	fr_strerror_printf("io_uring is not supported on this system");
+	return -1;
+}
+#endif
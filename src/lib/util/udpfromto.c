@@ -29,6 +29,15 @@ RCSID("$Id$")
 
 #ifdef WITH_UDPFROMTO
 
+/*
+ *	The socket is only needed to check the bound address on FreeBSD.
+ */
+#ifdef __FreeBSD__
+#define FREEBSD_UNUSED
+#else
+#define FREEBSD_UNUSED UNUSED
+#endif
+
 #ifdef HAVE_SYS_UIO_H
 #  include <sys/uio.h>
 #endif
@@ -197,7 +206,6 @@ int recvfromto(int fd, void *buf, size_t len, int flags,
 	       int *if_index, fr_time_t *when)
 {
 	struct msghdr		msgh;
-	struct cmsghdr		*cmsg;
 	struct iovec		iov;
 	char			cbuf[256];
 	int			ret;
@@ -300,13 +308,36 @@ int recvfromto(int fd, void *buf, size_t len, int flags,
 
 	if (from_len) *from_len = msgh.msg_namelen;
 
+	udpfromto_cmsg_parse(&msgh, to, to_len, if_index, when);
+
+	return ret;
+}
+
+/** Process the auxiliary data returned by recvmsg() or recvmmsg()
+ *
+ * Updates the destination address with the address the packet was actually
+ * received on, and fills in the receiving interface and receive time.
+ *
+ * @param[in] msgh	as filled in by the kernel.
+ * @param[in,out] to	the destination address.  This should be initialised
+ *			with the bound address of the socket, as the kernel does
+ *			not return the destination port.
+ * @param[out] to_len	Length of the structure pointed to by to.
+ * @param[out] if_index	The interface which received the datagram (may be NULL).
+ * @param[out] when	the packet was received (may be NULL).
+ */
+void udpfromto_cmsg_parse(struct msghdr *msgh, struct sockaddr *to, socklen_t *to_len,
+			  int *if_index, fr_time_t *when)
+{
+	struct cmsghdr		*cmsg;
+
 	if (if_index) *if_index = 0;
 	if (when) *when = 0;
 
 	/* Process auxiliary received data in msgh */
-	for (cmsg = CMSG_FIRSTHDR(&msgh);
+	for (cmsg = CMSG_FIRSTHDR(msgh);
 	     cmsg != NULL;
-	     cmsg = CMSG_NXTHDR(&msgh, cmsg)) {
+	     cmsg = CMSG_NXTHDR(msgh, cmsg)) {
 
 #ifdef IP_PKTINFO
 		if ((cmsg->cmsg_level == SOL_IP) &&
@@ -357,8 +388,6 @@ int recvfromto(int fd, void *buf, size_t len, int flags,
 	}
 
 	if (when && !*when) *when = fr_time();
-
-	return ret;
 }
 
 /** Send packet via a file descriptor, setting the src address and outbound interface
@@ -387,6 +416,59 @@ int sendfromto(int fd, void *buf, size_t len, int flags,
 	struct iovec	iov;
 	char		cbuf[256];
 
+	/*
+	 *	No "from", just use regular sendto.
+	 */
+	if (!from || (from_len == 0)) return sendto(fd, buf, len, flags, to, to_len);
+
+	/* Set up iov and msgh structures. */
+	memset(&msgh, 0, sizeof(msgh));
+	memset(&iov, 0, sizeof(iov));
+	iov.iov_base = buf;
+	iov.iov_len = len;
+
+	msgh.msg_iov = &iov;
+	msgh.msg_iovlen = 1;
+	msgh.msg_name = to;
+	msgh.msg_namelen = to_len;
+
+	if (udpfromto_cmsg_set(fd, &msgh, cbuf, sizeof(cbuf), from, from_len, if_index) < 0) return -1;
+
+	/*
+	 *	The source address can't be set, just use regular sendto.
+	 */
+	if (!msgh.msg_control) return sendto(fd, buf, len, flags, to, to_len);
+
+	return sendmsg(fd, &msgh, flags);
+}
+
+/** Add the source address and interface of an outgoing datagram to a msghdr
+ *
+ * The control data is written to cbuf, which must remain valid until the
+ * datagram has been sent.  One control buffer may be shared by several
+ * msghdrs, e.g. for sendmmsg(), if they all have the same source.
+ *
+ * If the source address can't be set on this platform or socket,
+ * msgh->msg_control is left as NULL.
+ *
+ * @param[in] fd	The file descriptor the datagram will be sent on.
+ * @param[in,out] msgh	to add the control data to.
+ * @param[out] cbuf	buffer for the control data, at least 256 bytes.
+ * @param[in] cbuf_len	length of the control buffer.
+ * @param[in] from	The source address.
+ * @param[in] from_len	Length of the structure pointed to by from.
+ * @param[in] if_index	The interface on which to send the datagram.
+ *			If automatic interface selection is desired, value should be 0.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+int udpfromto_cmsg_set(FREEBSD_UNUSED int fd, struct msghdr *msgh, void *cbuf, size_t cbuf_len,
+		       struct sockaddr *from, socklen_t from_len, int if_index)
+{
+	msgh->msg_control = NULL;
+	msgh->msg_controllen = 0;
+
 	/*
 	 *	Unknown address family, die.
 	 */
@@ -438,22 +520,9 @@ int sendfromto(int fd, void *buf, size_t len, int flags,
 	if (from && from->sa_family == AF_INET6) from = NULL;
 #  endif
 
-	/*
-	 *	No "from", just use regular sendto.
-	 */
-	if (!from || (from_len == 0)) return sendto(fd, buf, len, flags, to, to_len);
-
-	/* Set up control buffer iov and msgh structures. */
-	memset(&cbuf, 0, sizeof(cbuf));
-	memset(&msgh, 0, sizeof(msgh));
-	memset(&iov, 0, sizeof(iov));
-	iov.iov_base = buf;
-	iov.iov_len = len;
+	if (!from || (from_len == 0)) return 0;
 
-	msgh.msg_iov = &iov;
-	msgh.msg_iovlen = 1;
-	msgh.msg_name = to;
-	msgh.msg_namelen = to_len;
+	memset(cbuf, 0, cbuf_len);
 
 # if defined(IP_PKTINFO) || defined(IP_SENDSRCADDR)
 	if (from->sa_family == AF_INET) {
@@ -463,10 +532,10 @@ int sendfromto(int fd, void *buf, size_t len, int flags,
 		struct cmsghdr *cmsg;
 		struct in_pktinfo *pkt;
 
-		msgh.msg_control = cbuf;
-		msgh.msg_controllen = CMSG_SPACE(sizeof(*pkt));
+		msgh->msg_control = cbuf;
+		msgh->msg_controllen = CMSG_SPACE(sizeof(*pkt));
 
-		cmsg = CMSG_FIRSTHDR(&msgh);
+		cmsg = CMSG_FIRSTHDR(msgh);
 		cmsg->cmsg_level = SOL_IP;
 		cmsg->cmsg_type = IP_PKTINFO;
 		cmsg->cmsg_len = CMSG_LEN(sizeof(*pkt));
@@ -480,10 +549,10 @@ int sendfromto(int fd, void *buf, size_t len, int flags,
 		struct cmsghdr *cmsg;
 		struct in_addr *in;
 
-		msgh.msg_control = cbuf;
-		msgh.msg_controllen = CMSG_SPACE(sizeof(*in));
+		msgh->msg_control = cbuf;
+		msgh->msg_controllen = CMSG_SPACE(sizeof(*in));
 
-		cmsg = CMSG_FIRSTHDR(&msgh);
+		cmsg = CMSG_FIRSTHDR(msgh);
 		cmsg->cmsg_level = IPPROTO_IP;
 		cmsg->cmsg_type = IP_SENDSRCADDR;
 		cmsg->cmsg_len = CMSG_LEN(sizeof(*in));
@@ -501,10 +570,10 @@ int sendfromto(int fd, void *buf, size_t len, int flags,
 		struct cmsghdr *cmsg;
 		struct in6_pktinfo *pkt;
 
-		msgh.msg_control = cbuf;
-		msgh.msg_controllen = CMSG_SPACE(sizeof(*pkt));
+		msgh->msg_control = cbuf;
+		msgh->msg_controllen = CMSG_SPACE(sizeof(*pkt));
 
-		cmsg = CMSG_FIRSTHDR(&msgh);
+		cmsg = CMSG_FIRSTHDR(msgh);
 		cmsg->cmsg_level = IPPROTO_IPV6;
 		cmsg->cmsg_type = IPV6_PKTINFO;
 		cmsg->cmsg_len = CMSG_LEN(sizeof(*pkt));
@@ -516,7 +585,7 @@ int sendfromto(int fd, void *buf, size_t len, int flags,
 	}
 #  endif	/* IPV6_PKTINFO */
 
-	return sendmsg(fd, &msgh, flags);
+	return 0;
 }
 
 
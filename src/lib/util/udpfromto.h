@@ -35,6 +35,7 @@ extern "C" {
 #include <freeradius-devel/util/time.h>
 
 #include <netinet/in.h>
+#include <sys/socket.h>
 #include <stddef.h>
 #include <stdlib.h>
 
@@ -45,10 +46,16 @@ int	recvfromto(int s, void *buf, size_t len, int flags,
 		   struct sockaddr *to, socklen_t *tolen,
 		   int *if_index, fr_time_t *when);
 
+void	udpfromto_cmsg_parse(struct msghdr *msgh, struct sockaddr *to, socklen_t *to_len,
+			     int *if_index, fr_time_t *when);
+
 int	sendfromto(int s, void *buf, size_t len, int flags,
 		   struct sockaddr *from, socklen_t fromlen,
 		   struct sockaddr *to, socklen_t tolen,
 		   int if_index);
+
+int	udpfromto_cmsg_set(int fd, struct msghdr *msgh, void *cbuf, size_t cbuf_len,
+			   struct sockaddr *from, socklen_t from_len, int if_index);
 #endif
 
 #ifdef __cplusplus
@@ -99,11 +99,15 @@ fr_dict_autoload_t proto_radius_dict[] = {
 
 static fr_dict_attr_t const *attr_packet_type;
 static fr_dict_attr_t const *attr_user_name;
+static fr_dict_attr_t const *attr_calling_station_id;
+static fr_dict_attr_t const *attr_state;
 
 extern fr_dict_attr_autoload_t proto_radius_dict_attr[];
 fr_dict_attr_autoload_t proto_radius_dict_attr[] = {
 	{ .out = &attr_packet_type, .name = "Packet-Type", .type = FR_TYPE_UINT32, .dict = &dict_radius},
 	{ .out = &attr_user_name, .name = "User-Name", .type = FR_TYPE_STRING, .dict = &dict_radius},
+	{ .out = &attr_calling_station_id, .name = "Calling-Station-Id", .type = FR_TYPE_STRING, .dict = &dict_radius},
+	{ .out = &attr_state, .name = "State", .type = FR_TYPE_OCTETS, .dict = &dict_radius},
 	{ NULL }
 };
 
@@ -576,6 +580,74 @@ static int mod_priority_set(void const *instance, uint8_t const *buffer, UNUSED
 	return inst->priorities[buffer[0]];
 }
 
+/** Get the affinity key for a packet
+ *
+ *  All rounds of an EAP conversation come from the same NAS, and
+ *  carry the same Calling-Station-Id.  Hashing those means that the
+ *  whole conversation ends up on the same worker.  If there's no
+ *  Calling-Station-Id, we fall back to hashing the State attribute,
+ *  which at least keeps the second and subsequent rounds together.
+ *
+ *  The hash is seeded, so clients can't pick values which all end
+ *  up on one worker.
+ */
+static uint32_t mod_affinity_get(UNUSED void const *instance, void const *packet_ctx,
+				 uint8_t const *buffer, size_t buflen)
+{
+	uint8_t const		*p, *end;
+	uint8_t const		*csi = NULL, *state = NULL;
+	size_t			packet_len;
+	fr_io_track_t const	*track;
+	uint32_t		hash;
+
+	if (buflen < RADIUS_HEADER_LENGTH) return 0;
+
+	if (buffer[0] != FR_CODE_ACCESS_REQUEST) return 0;
+
+	packet_len = (buffer[2] << 8) | buffer[3];
+	if (packet_len > buflen) packet_len = buflen;
+
+	p = buffer + RADIUS_HEADER_LENGTH;
+	end = buffer + packet_len;
+
+	while ((p + 2) <= end) {
+		if ((p[1] < 2) || ((p + p[1]) > end)) return 0;
+
+		if (!csi && (p[0] == attr_calling_station_id->attr)) csi = p;
+		if (!state && (p[0] == attr_state->attr)) state = p;
+
+		p += p[1];
+	}
+
+	if (csi) {
+		track = talloc_get_type(packet_ctx, fr_io_track_t);
+		if (!track || !track->address) return 0;
+
+		hash = fr_hash_seeded(&track->address->src_ipaddr.af, sizeof(track->address->src_ipaddr.af));
+		if (track->address->src_ipaddr.af == AF_INET) {
+			hash = fr_hash_seeded_update(&track->address->src_ipaddr.addr.v4,
+						     sizeof(track->address->src_ipaddr.addr.v4), hash);
+		} else {
+			hash = fr_hash_seeded_update(&track->address->src_ipaddr.addr.v6,
+						     sizeof(track->address->src_ipaddr.addr.v6), hash);
+		}
+		hash = fr_hash_seeded_update(csi + 2, csi[1] - 2, hash);
+
+	} else if (state) {
+		hash = fr_hash_seeded(state + 2, state[1] - 2);
+
+	} else {
+		return 0;
+	}
+
+	/*
+	 *	Zero means "no affinity".
+	 */
+	if (!hash) hash = 1;
+
+	return hash;
+}
+
 /** Open listen sockets/connect to external event source
  *
  * @param[in] instance	Ctx data for this application.
@@ -742,5 +814,6 @@ fr_app_t proto_radius = {
 	.decode			= mod_decode,
 	.encode			= mod_encode,
 	.entry_point_set	= mod_entry_point_set,
-	.priority		= mod_priority_set
+	.priority		= mod_priority_set,
+	.affinity		= mod_affinity_get
 };
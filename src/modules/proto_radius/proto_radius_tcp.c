@@ -383,6 +383,23 @@ static int mod_compare(void const *instance, UNUSED void *thread_instance, UNUSE
 	return (a[0] < b[0]) - (a[0] > b[0]);
 }
 
+static uint32_t mod_hash(void const *instance, UNUSED void *thread_instance, UNUSED RADCLIENT *client,
+			 void const *packet)
+{
+	proto_radius_tcp_t const *inst = talloc_get_type_abort_const(instance, proto_radius_tcp_t);
+	uint8_t const *p = packet;
+	uint32_t hash;
+
+	/*
+	 *	Code and ID, then the authenticator if
+	 *	mod_compare() looks at it.
+	 */
+	hash = fr_hash_seeded(p, 2);
+	if (inst->dedup_authenticator) hash = fr_hash_seeded_update(p + 4, RADIUS_AUTH_VECTOR_LENGTH, hash);
+
+	return hash;
+}
+
 
 static char const *mod_name(fr_listen_t *li)
 {
@@ -604,6 +621,7 @@ fr_app_io_t proto_radius_tcp = {
 	.write			= mod_write,
 	.fd_set			= mod_fd_set,
 	.compare		= mod_compare,
+	.hash			= mod_hash,
 	.connection_set		= mod_connection_set,
 	.network_get		= mod_network_get,
 	.client_find		= mod_client_find,
@@ -38,12 +38,18 @@
 
 extern fr_app_io_t proto_radius_udp;
 
+#define UDP_URING_BUFFERS	(256)
+
 typedef struct {
 	char const			*name;			//!< socket name
 	int				sockfd;
 
 	fr_io_address_t			*connection;		//!< for connected sockets.
 
+	fr_udp_recv_batch_t		*batch;			//!< for reading multiple packets at once.
+	fr_udp_send_batch_t		*send_batch;		//!< for writing multiple packets at once.
+	fr_udp_uring_t			*uring;			//!< for reading packets with io_uring.
+
 	fr_stats_t			stats;			//!< statistics for this socket
 } proto_radius_udp_thread_t;
 
@@ -61,12 +67,16 @@ typedef struct {
 	uint32_t			max_packet_size;	//!< for message ring buffer.
 	uint32_t			max_attributes;		//!< Limit maximum decodable attributes.
 
+	uint32_t			recv_batch;		//!< How many packets to read in one system call.
+	uint32_t			send_batch;		//!< How many packets to write in one system call.
+
 	uint16_t			port;			//!< Port to listen on.
 
 	bool				recv_buff_is_set;	//!< Whether we were provided with a recv_buff
 	bool				send_buff_is_set;	//!< Whether we were provided with a send_buff
 	bool				dynamic_clients;	//!< whether we have dynamic clients
 	bool				dedup_authenticator;	//!< dedup using the request authenticator
+	bool				io_uring;		//!< read packets with io_uring.
 
 	RADCLIENT_LIST			*clients;		//!< local clients
 
@@ -96,6 +106,9 @@ static const CONF_PARSER udp_listen_config[] = {
 
 	{ FR_CONF_OFFSET_IS_SET("recv_buff", FR_TYPE_UINT32, proto_radius_udp_t, recv_buff) },
 	{ FR_CONF_OFFSET_IS_SET("send_buff", FR_TYPE_UINT32, proto_radius_udp_t, send_buff) },
+	{ FR_CONF_OFFSET("recv_batch", FR_TYPE_UINT32, proto_radius_udp_t, recv_batch), .dflt = "1" },
+	{ FR_CONF_OFFSET("send_batch", FR_TYPE_UINT32, proto_radius_udp_t, send_batch), .dflt = "1" },
+	{ FR_CONF_OFFSET("io_uring", FR_TYPE_BOOL, proto_radius_udp_t, io_uring), .dflt = "no" },
 
 	{ FR_CONF_OFFSET("accept_conflicting_packets", FR_TYPE_BOOL, proto_radius_udp_t, dedup_authenticator) } ,
 	{ FR_CONF_OFFSET("dynamic_clients", FR_TYPE_BOOL, proto_radius_udp_t, dynamic_clients) } ,
@@ -133,10 +146,22 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 	 */
 	flags = UDP_FLAGS_CONNECTED * (thread->connection != NULL);
 
-	data_size = udp_recv(thread->sockfd, buffer, buffer_len, flags,
-			     &address->src_ipaddr, &address->src_port,
-			     &address->dst_ipaddr, &address->dst_port,
-			     &address->if_index, recv_time_p);
+	if (thread->uring) {
+		data_size = udp_uring_recv(thread->uring, buffer, buffer_len,
+					   &address->src_ipaddr, &address->src_port,
+					   &address->dst_ipaddr, &address->dst_port,
+					   &address->if_index, recv_time_p);
+	} else if (thread->batch) {
+		data_size = udp_recv_batch(thread->sockfd, thread->batch, buffer, buffer_len,
+					   &address->src_ipaddr, &address->src_port,
+					   &address->dst_ipaddr, &address->dst_port,
+					   &address->if_index, recv_time_p);
+	} else {
+		data_size = udp_recv(thread->sockfd, buffer, buffer_len, flags,
+				     &address->src_ipaddr, &address->src_port,
+				     &address->dst_ipaddr, &address->dst_port,
+				     &address->if_index, recv_time_p);
+	}
 	if (data_size < 0) {
 		DEBUG2("proto_radius_udp got read error: %s", fr_strerror());
 		return data_size;
@@ -193,6 +218,39 @@ static ssize_t mod_read(fr_listen_t *li, void **packet_ctx, fr_time_t *recv_time
 	return packet_len;
 }
 
+/** Return how many packets we've read from the socket, but not yet returned
+ *
+ */
+static int mod_pending(fr_listen_t *li)
+{
+	proto_radius_udp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_radius_udp_thread_t);
+
+	if (thread->uring) return udp_uring_pending(thread->uring);
+
+	if (!thread->batch) return 0;
+
+	return udp_recv_batch_pending(thread->batch);
+}
+
+
+/** Write a packet, or queue it if we're writing batches of packets
+ *
+ */
+static ssize_t udp_write(proto_radius_udp_thread_t *thread, int flags, fr_io_address_t *address,
+			 void *packet, size_t packet_len)
+{
+	if (thread->send_batch) {
+		return udp_send_batch(thread->sockfd, thread->send_batch, packet, packet_len,
+				      &address->dst_ipaddr, address->dst_port,
+				      address->if_index,
+				      &address->src_ipaddr, address->src_port);
+	}
+
+	return udp_send(thread->sockfd, packet, packet_len, flags,
+			&address->dst_ipaddr, address->dst_port,
+			address->if_index,
+			&address->src_ipaddr, address->src_port);
+}
 
 static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t request_time,
 			 uint8_t *buffer, size_t buffer_len, UNUSED size_t written)
@@ -230,10 +288,7 @@ static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t req
 
 			memcpy(&packet, &track->reply, sizeof(packet)); /* const issues */
 
-			(void) udp_send(thread->sockfd, packet, track->reply_len, flags,
-					&address->dst_ipaddr, address->dst_port,
-					address->if_index,
-					&address->src_ipaddr, address->src_port);
+			(void) udp_write(thread, flags, address, packet, track->reply_len);
 		}
 
 		return buffer_len;
@@ -248,10 +303,7 @@ static ssize_t mod_write(fr_listen_t *li, void *packet_ctx, UNUSED fr_time_t req
 	 *	Only write replies if they're RADIUS packets.
 	 *	sometimes we want to NOT send a reply...
 	 */
-	data_size = udp_send(thread->sockfd, buffer, buffer_len, flags,
-			     &address->dst_ipaddr, address->dst_port,
-			     address->if_index,
-			     &address->src_ipaddr, address->src_port);
+	data_size = udp_write(thread, flags, address, buffer, buffer_len);
 
 	/*
 	 *	This socket is dead.  That's an error...
@@ -289,6 +341,18 @@ static void mod_network_get(void *instance, int *ipproto, bool *dynamic_clients,
 }
 
 
+/** Write any packets which have been queued by mod_write()
+ *
+ */
+static int mod_flush(fr_listen_t *li)
+{
+	proto_radius_udp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_radius_udp_thread_t);
+
+	if (!thread->send_batch) return 0;
+
+	return udp_send_batch_flush(thread->sockfd, thread->send_batch);
+}
+
 /** Open a UDP listener for RADIUS
  *
  */
@@ -322,6 +386,7 @@ static int mod_open(fr_listen_t *li)
 			ERROR("Failed to set socket 'reuseport': %s", fr_syserror(errno));
 			return -1;
 		}
+		li->reuse_port = true;
 	}
 
 #ifdef SO_RCVBUF
@@ -354,6 +419,45 @@ static int mod_open(fr_listen_t *li)
 
 	thread->sockfd = sockfd;
 
+	/*
+	 *	Read and write multiple packets per system call.
+	 *	Connected sockets don't get enough traffic to make
+	 *	this worthwhile, and udp_recv_batch() doesn't know
+	 *	about UDP_FLAGS_CONNECTED.
+	 */
+	if (!thread->connection && (inst->recv_batch > 1)) {
+		thread->batch = udp_recv_batch_alloc(thread, inst->recv_batch, inst->max_packet_size);
+		if (!thread->batch) {
+			close(sockfd);
+			ERROR("Failed allocating read batch");
+			goto error;
+		}
+	}
+
+	if (!thread->connection && (inst->send_batch > 1)) {
+		thread->send_batch = udp_send_batch_alloc(thread, inst->send_batch, inst->max_packet_size);
+		if (!thread->send_batch) {
+			close(sockfd);
+			ERROR("Failed allocating write batch");
+			goto error;
+		}
+	}
+
+	/*
+	 *	The kernel puts packets into our buffers as they
+	 *	arrive, and we wait on the io_uring FD instead of the
+	 *	socket.  If the kernel can't do that, we just read the
+	 *	socket.
+	 */
+	if (inst->io_uring && !thread->connection) {
+		thread->uring = udp_uring_alloc(thread, sockfd, UDP_URING_BUFFERS, inst->max_packet_size);
+		if (!thread->uring) {
+			PWARN("Failed setting up io_uring, reading the socket directly");
+		} else {
+			li->fd = udp_uring_fd(thread->uring);
+		}
+	}
+
 	ci = cf_parent(inst->cs); /* listen { ... } */
 	rad_assert(ci != NULL);
 	ci = cf_parent(ci);
@@ -373,6 +477,19 @@ static int mod_open(fr_listen_t *li)
 	return 0;
 }
 
+/** Close the socket, and the io_uring if we have one
+ *
+ */
+static int mod_close(fr_listen_t *li)
+{
+	proto_radius_udp_thread_t	*thread = talloc_get_type_abort(li->thread_instance, proto_radius_udp_thread_t);
+
+	TALLOC_FREE(thread->uring);
+	close(thread->sockfd);
+
+	return 0;
+}
+
 /** Set the file descriptor for this socket.
  *
  */
@@ -421,6 +538,23 @@ static int mod_compare(void const *instance, UNUSED void *thread_instance, UNUSE
 	return (a[0] < b[0]) - (a[0] > b[0]);
 }
 
+static uint32_t mod_hash(void const *instance, UNUSED void *thread_instance, UNUSED RADCLIENT *client,
+			 void const *packet)
+{
+	proto_radius_udp_t const *inst = talloc_get_type_abort_const(instance, proto_radius_udp_t);
+	uint8_t const *p = packet;
+	uint32_t hash;
+
+	/*
+	 *	Code and ID, then the authenticator if
+	 *	mod_compare() looks at it.
+	 */
+	hash = fr_hash_seeded(p, 2);
+	if (inst->dedup_authenticator) hash = fr_hash_seeded_update(p + 4, RADIUS_AUTH_VECTOR_LENGTH, hash);
+
+	return hash;
+}
+
 
 static char const *mod_name(fr_listen_t *li)
 {
@@ -460,6 +594,12 @@ static int mod_bootstrap(void *instance, CONF_SECTION *cs)
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, >=, 20);
 	FR_INTEGER_BOUND_CHECK("max_packet_size", inst->max_packet_size, <=, 65536);
 
+	FR_INTEGER_BOUND_CHECK("recv_batch", inst->recv_batch, >=, 1);
+	FR_INTEGER_BOUND_CHECK("recv_batch", inst->recv_batch, <=, 256);
+
+	FR_INTEGER_BOUND_CHECK("send_batch", inst->send_batch, >=, 1);
+	FR_INTEGER_BOUND_CHECK("send_batch", inst->send_batch, <=, 256);
+
 	if (!inst->port) {
 		struct servent *s;
 
@@ -548,9 +688,13 @@ fr_app_io_t proto_radius_udp = {
 
 	.open			= mod_open,
 	.read			= mod_read,
+	.pending		= mod_pending,
 	.write			= mod_write,
+	.flush			= mod_flush,
+	.close			= mod_close,
 	.fd_set			= mod_fd_set,
 	.compare		= mod_compare,
+	.hash			= mod_hash,
 	.connection_set		= mod_connection_set,
 	.network_get		= mod_network_get,
 	.client_find		= mod_client_find,
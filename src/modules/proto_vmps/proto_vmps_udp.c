@@ -389,6 +389,17 @@ static int mod_compare(UNUSED void const *instance, UNUSED void *thread_instance
 	return (a[1] < b[1]) - (a[1] > b[1]);
 }
 
+static uint32_t mod_hash(UNUSED void const *instance, UNUSED void *thread_instance, UNUSED RADCLIENT *client,
+			 void const *packet)
+{
+	uint8_t const *p = packet;
+
+	/*
+	 *	Opcode, then the transaction ID.
+	 */
+	return fr_hash_seeded_update(p + 4, 4, fr_hash_seeded(p + 1, 1));
+}
+
 static int mod_bootstrap(void *instance, CONF_SECTION *cs)
 {
 	proto_vmps_udp_t	*inst = talloc_get_type_abort(instance, proto_vmps_udp_t);
@@ -512,6 +523,7 @@ fr_app_io_t proto_vmps_udp = {
 	.write			= mod_write,
 	.fd_set			= mod_fd_set,
 	.compare		= mod_compare,
+	.hash			= mod_hash,
 	.connection_set		= mod_connection_set,
 	.network_get		= mod_network_get,
 	.client_find		= mod_client_find,
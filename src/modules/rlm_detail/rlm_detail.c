@@ -52,10 +52,12 @@ RCSID("$Id$")
 typedef struct {
 	char const	*name;		//!< Instance name.
 	char const	*filename;	//!< File/path to write to.
+	xlat_exp_t	*filename_xlat;	//!< Tokenized filename.
 	uint32_t	perm;		//!< Permissions to use for new files.
 	char const	*group;		//!< Group to use for new files.
 
 	char const	*header;	//!< Header format.
+	xlat_exp_t	*header_xlat;	//!< Tokenized header format.
 	bool		locking;	//!< Whether the file should be locked.
 
 	bool		log_srcdst;	//!< Add IP src/dst attributes to entries.
@@ -132,7 +134,7 @@ static int mod_detach(void *instance)
 static uint32_t detail_hash(void const *data)
 {
 	fr_dict_attr_t const *da = data;
-	return fr_hash(&da, sizeof(da));
+	return fr_hash_fast(&da, sizeof(da));
 }
 
 static int detail_cmp(void const *a, void const *b)
@@ -160,6 +162,11 @@ static int mod_instantiate(void *instance, CONF_SECTION *conf)
 		inst->escape_func = rad_filename_make_safe;
 	}
 
+	if ((xlat_tokenize_conf(inst, &inst->filename_xlat, cf_section_to_item(conf), inst->filename) < 0) ||
+	    (xlat_tokenize_conf(inst, &inst->header_xlat, cf_section_to_item(conf), inst->header) < 0)) {
+		return -1;
+	}
+
 	inst->ef = module_exfile_init(inst, conf, 256, 30, inst->locking, NULL, NULL);
 	if (!inst->ef) {
 		cf_log_err(conf, "Failed creating log file context");
@@ -250,7 +257,7 @@ static int detail_write(FILE *out, rlm_detail_t const *inst, REQUEST *request, R
 	VALUE_PAIR *vp;
 	char timestamp[256];
 
-	if (xlat_eval(timestamp, sizeof(timestamp), request, inst->header, NULL, NULL) < 0) {
+	if (xlat_eval_compiled(timestamp, sizeof(timestamp), request, inst->header_xlat, NULL, NULL) < 0) {
 		return -1;
 	}
 
@@ -400,7 +407,7 @@ static rlm_rcode_t CC_HINT(nonnull) detail_do(void const *instance, REQUEST *req
 	 *	format, but truncate at the last /.  Then feed it
 	 *	through xlat_eval() to expand the variables.
 	 */
-	if (xlat_eval(buffer, sizeof(buffer), request, inst->filename, inst->escape_func, NULL) < 0) {
+	if (xlat_eval_compiled(buffer, sizeof(buffer), request, inst->filename_xlat, inst->escape_func, NULL) < 0) {
 		return RLM_MODULE_FAIL;
 	}
 
@@ -39,6 +39,7 @@ static int auth_type_parse(TALLOC_CTX *ctx, void *out, UNUSED void *parent,
  */
 typedef struct {
 	char const		*challenge;
+	xlat_exp_t		*challenge_xlat;	//!< Tokenized challenge.
 	fr_dict_enum_t const	*auth_type;
 } rlm_eap_gtc_t;
 
@@ -200,7 +201,7 @@ static rlm_rcode_t mod_session_init(void *instance, UNUSED void *thread, REQUEST
 	eap_round_t	*eap_round = eap_session->this_round;
 	rlm_eap_gtc_t	*inst = talloc_get_type_abort(instance, rlm_eap_gtc_t);
 
-	if (xlat_eval(challenge_str, sizeof(challenge_str), request, inst->challenge, NULL, NULL) < 0) {
+	if (xlat_eval_compiled(challenge_str, sizeof(challenge_str), request, inst->challenge_xlat, NULL, NULL) < 0) {
 		return RLM_MODULE_FAIL;
 	}
 
@@ -229,6 +230,16 @@ static rlm_rcode_t mod_session_init(void *instance, UNUSED void *thread, REQUEST
 	return RLM_MODULE_HANDLED;
 }
 
+/*
+ *	Tokenize the challenge, so it's not re-parsed for every session.
+ */
+static int mod_instantiate(void *instance, CONF_SECTION *cs)
+{
+	rlm_eap_gtc_t *inst = talloc_get_type_abort(instance, rlm_eap_gtc_t);
+
+	return xlat_tokenize_conf(inst, &inst->challenge_xlat, cf_section_to_item(cs), inst->challenge);
+}
+
 /*
  *	The module name should be the only globally exported symbol.
  *	That is, everything else should be 'static'.
@@ -241,6 +252,7 @@ rlm_eap_submodule_t rlm_eap_gtc = {
 	.provides	= { FR_EAP_METHOD_GTC },
 	.inst_size	= sizeof(rlm_eap_gtc_t),
 	.config		= submodule_config,
+	.instantiate	= mod_instantiate,	/* Create new submodule instance */
 
 	.session_init	= mod_session_init,	/* Initialise a new EAP session */
 	.entry_point	= mod_process,		/* Process next round of EAP method */
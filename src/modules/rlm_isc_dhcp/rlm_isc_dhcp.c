@@ -766,7 +766,7 @@ static uint32_t host_ether_hash(void const *data)
 {
 	isc_host_ether_t const *self = data;
 
-	return fr_hash(self->ether, sizeof(self->ether));
+	return fr_hash_seeded(self->ether, sizeof(self->ether));
 }
 
 static int host_ether_cmp(void const *one, void const *two)
@@ -786,7 +786,7 @@ static uint32_t host_uid_hash(void const *data)
 {
 	isc_host_uid_t const *self = data;
 
-	return fr_hash(self->client->vb_octets, self->client->vb_length);
+	return fr_hash_seeded(self->client->vb_octets, self->client->vb_length);
 }
 
 static int host_uid_cmp(void const *one, void const *two)
@@ -1197,7 +1197,7 @@ static rlm_rcode_t user_modify(rlm_ldap_t const *inst, REQUEST *request, ldap_ac
 		*p++ = '.';
 	}
 
-	if (xlat_eval(p, (sizeof(path) - (p - path)) - 1, request, section->reference, NULL, NULL) < 0) {
+	if (xlat_eval_compiled(p, (sizeof(path) - (p - path)) - 1, request, section->reference_xlat, NULL, NULL) < 0) {
 		goto error;
 	}
 
@@ -1269,9 +1269,22 @@ static rlm_rcode_t user_modify(rlm_ldap_t const *inst, REQUEST *request, ldap_ac
 		if (op == T_OP_CMP_FALSE) {
 			passed[last_pass] = NULL;
 		} else if (do_xlat) {
-			char *exp = NULL;
+			char			*exp = NULL;
+			xlat_exp_t const	*xlat;
+			ssize_t			slen;
 
-			if (xlat_aeval(request, &exp, request, value, NULL, NULL) <= 0) {
+			/*
+			 *	Values in the section were tokenized on
+			 *	instantiation, but the reference may
+			 *	point outside of it.
+			 */
+			xlat = xlat_from_conf_pair(cp);
+			if (xlat) {
+				slen = xlat_aeval_compiled(request, &exp, request, xlat, NULL, NULL);
+			} else {
+				slen = xlat_aeval(request, &exp, request, value, NULL, NULL);
+			}
+			if (slen <= 0) {
 				RDEBUG2("Skipping attribute \"%s\"", attr);
 
 				talloc_free(exp);
@@ -1454,6 +1467,13 @@ static int parse_sub_section(rlm_ldap_t *inst, CONF_SECTION *parent, ldap_acct_s
 
 	(*config)->cs = cs;
 
+	/*
+	 *	Tokenize the reference, and the update values, so
+	 *	they're not re-parsed for every request.
+	 */
+	if ((xlat_tokenize_conf(*config, &(*config)->reference_xlat, cf_section_to_item(cs), (*config)->reference) < 0) ||
+	    (xlat_tokenize_conf_section(cs, true) < 0)) return -1;
+
 	return 0;
 }
 
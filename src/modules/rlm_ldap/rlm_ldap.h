@@ -29,6 +29,7 @@ typedef struct {
 	CONF_SECTION	*cs;				//!< Section configuration.
 
 	char const	*reference;			//!< Configuration reference string.
+	xlat_exp_t	*reference_xlat;		//!< Tokenized reference string.
 } ldap_acct_section_t;
 
 struct ldap_inst_s {
@@ -99,6 +99,7 @@ typedef struct {
 
 	struct {
 		char const		*name;			//!< File to write to.
+		xlat_exp_t		*name_xlat;		//!< Tokenized filename.
 		uint32_t		permissions;		//!< Permissions to use when creating new files.
 		char const		*group_str;		//!< Group to set on new files.
 		gid_t			group;			//!< Resolved gid.
@@ -323,6 +324,10 @@ static int mod_instantiate(void *instance, CONF_SECTION *conf)
 			return -1;
 		}
 
+		if (xlat_tokenize_conf(inst, &inst->file.name_xlat, cf_section_to_item(conf), inst->file.name) < 0) {
+			return -1;
+		}
+
 		inst->file.ef = module_exfile_init(inst, conf, 256, 30, true, NULL, NULL);
 		if (!inst->file.ef) {
 			cf_log_err(conf, "Failed creating log file context");
@@ -638,7 +643,8 @@ build_vector:
 		int fd = -1;
 		char path[2048];
 
-		if (xlat_eval(path, sizeof(path), request, inst->file.name, inst->file.escape_func, NULL) < 0) {
+		if (xlat_eval_compiled(path, sizeof(path), request, inst->file.name_xlat,
+				       inst->file.escape_func, NULL) < 0) {
 			return RLM_MODULE_FAIL;
 		}
 
@@ -760,7 +760,7 @@ static int CC_HINT(nonnull (1, 2, 4, 5)) do_mschap_cpw(rlm_mschap_t const *inst,
 		 */
 
 		if (inst->ntlm_cpw_username) {
-			len = xlat_eval(buf, sizeof(buf) - 2, request, inst->ntlm_cpw_username, NULL, NULL);
+			len = xlat_eval_compiled(buf, sizeof(buf) - 2, request, inst->ntlm_cpw_username_xlat, NULL, NULL);
 			if (len < 0) {
 				goto ntlm_auth_err;
 			}
@@ -777,7 +777,7 @@ static int CC_HINT(nonnull (1, 2, 4, 5)) do_mschap_cpw(rlm_mschap_t const *inst,
 		}
 
 		if (inst->ntlm_cpw_domain) {
-			len = xlat_eval(buf, sizeof(buf) - 2, request, inst->ntlm_cpw_domain, NULL, NULL);
+			len = xlat_eval_compiled(buf, sizeof(buf) - 2, request, inst->ntlm_cpw_domain_xlat, NULL, NULL);
 			if (len < 0) {
 				goto ntlm_auth_err;
 			}
@@ -1027,7 +1027,7 @@ ntlm_auth_err:
 		fr_pair_value_strsteal(new_pass, x);
 
 		/* Perform the xlat */
-		result_len = xlat_eval(result, sizeof(result), request, inst->local_cpw, NULL, NULL);
+		result_len = xlat_eval_compiled(result, sizeof(result), request, inst->local_cpw_xlat, NULL, NULL);
 		if (result_len < 0){
 			return -1;
 		} else if (result_len == 0) {
@@ -2122,6 +2122,17 @@ static int mod_instantiate(void *instance, CONF_SECTION *conf)
 	 */
 	inst->method = AUTH_INTERNAL;
 
+	/*
+	 *	Tokenize the password change expansions.
+	 */
+	if ((xlat_tokenize_conf(inst, &inst->ntlm_cpw_username_xlat, cf_section_to_item(conf),
+				inst->ntlm_cpw_username) < 0) ||
+	    (xlat_tokenize_conf(inst, &inst->ntlm_cpw_domain_xlat, cf_section_to_item(conf),
+				inst->ntlm_cpw_domain) < 0) ||
+	    (xlat_tokenize_conf(inst, &inst->local_cpw_xlat, cf_section_to_item(conf), inst->local_cpw) < 0)) {
+		return -1;
+	}
+
 	if (inst->wb_username) {
 #ifdef WITH_AUTH_WINBIND
 		inst->method = AUTH_WBCLIENT;
@@ -64,8 +64,11 @@ typedef struct {
 	fr_time_delta_t		ntlm_auth_timeout;
 	char const		*ntlm_cpw;
 	char const		*ntlm_cpw_username;
+	xlat_exp_t		*ntlm_cpw_username_xlat;
 	char const		*ntlm_cpw_domain;
+	xlat_exp_t		*ntlm_cpw_domain_xlat;
 	char const		*local_cpw;
+	xlat_exp_t		*local_cpw_xlat;
 
 	bool			allow_retry;
 	char const		*retry_msg;
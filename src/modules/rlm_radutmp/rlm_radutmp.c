@@ -50,7 +50,9 @@ struct nas_port_s {
 typedef struct {
 	NAS_PORT	*nas_port_list;
 	char const	*filename;
+	xlat_exp_t	*filename_xlat;
 	char const	*username;
+	xlat_exp_t	*username_xlat;
 	bool		case_sensitive;
 	bool		check_nas;
 	uint32_t	permission;
@@ -103,6 +105,22 @@ fr_dict_attr_autoload_t rlm_radutmp_dict_attr[] = {
 	{ NULL }
 };
 
+static int mod_instantiate(void *instance, CONF_SECTION *conf)
+{
+	rlm_radutmp_t *inst = instance;
+
+	/*
+	 *	Tokenize the expansions now, so they're not re-parsed
+	 *	for every request.
+	 */
+	if ((xlat_tokenize_conf(inst, &inst->filename_xlat, cf_section_to_item(conf), inst->filename) < 0) ||
+	    (xlat_tokenize_conf(inst, &inst->username_xlat, cf_section_to_item(conf), inst->username) < 0)) {
+		return -1;
+	}
+
+	return 0;
+}
+
 #ifdef WITH_ACCOUNTING
 /*
  *	Zap all users on a NAS from the radutmp file.
@@ -327,7 +345,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_accounting(void *instance, UNUSED void *
 	 *	Get the utmp filename, via xlat.
 	 */
 	filename = NULL;
-	if (xlat_aeval(request, &filename, request, inst->filename, NULL, NULL) < 0) {
+	if (xlat_aeval_compiled(request, &filename, request, inst->filename_xlat, NULL, NULL) < 0) {
 		return RLM_MODULE_FAIL;
 	}
 
@@ -364,7 +382,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_accounting(void *instance, UNUSED void *
 	/*
 	 *	Translate the User-Name attribute, or whatever else they told us to use.
 	 */
-	if (xlat_aeval(request, &expanded, request, inst->username, NULL, NULL) < 0) {
+	if (xlat_aeval_compiled(request, &expanded, request, inst->username_xlat, NULL, NULL) < 0) {
 		rcode = RLM_MODULE_FAIL;
 
 		goto finish;
@@ -559,6 +577,7 @@ module_t rlm_radutmp = {
 	.type		= RLM_TYPE_THREAD_UNSAFE,
 	.inst_size	= sizeof(rlm_radutmp_t),
 	.config		= module_config,
+	.instantiate	= mod_instantiate,
 	.methods = {
 #ifdef WITH_ACCOUNTING
 		[MOD_ACCOUNTING]	= mod_accounting,
@@ -488,12 +488,12 @@ static int mod_bootstrap(void *instance, CONF_SECTION *conf)
 	 *	%{redis_node:<key>[ idx]}
 	 */
 	name = talloc_asprintf(NULL, "%s_node", inst->name);
-	xlat = xlat_async_register(inst, name, redis_node_xlat);
+	xlat = xlat_async_register(inst, name, redis_node_xlat, false);
 	xlat_async_instantiate_set(xlat, redis_xlat_instantiate, rlm_redis_t *, NULL, inst);
 	talloc_free(name);
 
 	name = talloc_asprintf(NULL, "%s_remap", inst->name);
-	xlat = xlat_async_register(inst, name, redis_remap_xlat);
+	xlat = xlat_async_register(inst, name, redis_remap_xlat, false);
 	xlat_async_instantiate_set(xlat, redis_xlat_instantiate, rlm_redis_t *, NULL, inst);
 	talloc_free(name);
 
@@ -1996,7 +1996,7 @@ do {\
 
 		if (!username) {
 			char *tmp = NULL;
-			if (xlat_aeval(cred_ctx, &tmp, request, section->username, NULL, NULL) < 0) {
+			if (xlat_aeval_compiled(cred_ctx, &tmp, request, section->username_xlat, NULL, NULL) < 0) {
 				REDEBUG("Failed expanding username");
 				talloc_free(cred_ctx);
 				goto error;
@@ -2006,7 +2006,7 @@ do {\
 
 		if (!password) {
 			char *tmp = NULL;
-			if (xlat_aeval(cred_ctx, &tmp, request, section->password, NULL, NULL) < 0) {
+			if (xlat_aeval_compiled(cred_ctx, &tmp, request, section->password_xlat, NULL, NULL) < 0) {
 				REDEBUG("Failed expanding password");
 				talloc_free(cred_ctx);
 				goto error;
@@ -2104,7 +2104,7 @@ do {\
 		rest_custom_data_t *data;
 		char *expanded = NULL;
 
-		if (xlat_aeval(request, &expanded, request, section->data, NULL, NULL) < 0) return -1;
+		if (xlat_aeval_compiled(request, &expanded, request, section->data_xlat, NULL, NULL) < 0) return -1;
 
 		data = talloc_zero(request, rest_custom_data_t);
 		data->p = expanded;
@@ -2389,65 +2389,87 @@ size_t rest_uri_escape(UNUSED REQUEST *request, char *out, size_t outlen, char c
 	return strlen(out);
 }
 
+/** Splits and tokenizes the URI of a section
+ *
+ * Splits the URI into "http://example.org" and "/%{xlat}/query/?bar=foo",
+ * so both components only need to be parsed once.  If the URI is malformed,
+ * the components are left NULL, and #rest_uri_build reports the error when
+ * the section is used.
+ *
+ * @param[in] ctx	to allocate the xlat trees in.
+ * @param[in] section	containing the URI.
+ * @param[in] ci	the URI came from.  Used for error messages.
+ * @return
+ *	- 0 on success.
+ *	- -1 if either component failed to parse.
+ */
+int rest_uri_tokenize(TALLOC_CTX *ctx, rlm_rest_section_t *section, CONF_ITEM const *ci)
+{
+	char const	*p;
+	char		*host;
+	int		ret;
+
+	section->uri_host = NULL;
+	section->uri_path = NULL;
+
+	if (!section->uri) return 0;
+
+	/*
+	 *  All URLs must contain at least <scheme>://<server>/
+	 */
+	p = strchr(section->uri, ':');
+	if (!p || (*++p != '/') || (*++p != '/')) return 0;
+
+	p = strchr(p + 1, '/');
+	if (!p) return 0;
+
+	host = talloc_bstrndup(ctx, section->uri, p - section->uri);
+	if (!host) return -1;
+
+	ret = xlat_tokenize_conf(ctx, &section->uri_host, ci, host);
+	talloc_free(host);
+	if (ret < 0) return -1;
+
+	if (xlat_tokenize_conf(ctx, &section->uri_path, ci, p) < 0) {
+		TALLOC_FREE(section->uri_host);
+		return -1;
+	}
+
+	return 0;
+}
+
 /** Builds URI; performs XLAT expansions and encoding.
  *
- * Splits the URI into "http://example.org" and "/%{xlat}/query/?bar=foo"
+ * Expands the components of the URI split by #rest_uri_tokenize.
  * Both components are expanded, but values expanded for the second component
  * are also url encoded.
  *
  * @param[out] out	Where to write the pointer to the new buffer containing the escaped URI.
  * @param[in] inst	of rlm_rest.
- * @param[in] uri	configuration data.
  * @param[in] request	Current request
+ * @param[in] section	configuration data.
  * @return
  *	- Length of data written to buffer (excluding NULL).
  *	- < 0 if an error occurred.
  */
-ssize_t rest_uri_build(char **out, rlm_rest_t const *inst, REQUEST *request, char const *uri)
+ssize_t rest_uri_build(char **out, rlm_rest_t const *inst, REQUEST *request, rlm_rest_section_t const *section)
 {
-	char const	*p;
 	char		*path_exp = NULL;
-
-	char		*scheme;
-	char const	*path;
-
 	ssize_t		len;
 
-	p = uri;
-
-	/*
-	 *  All URLs must contain at least <scheme>://<server>/
-	 */
-	p = strchr(p, ':');
-	if (!p || (*++p != '/') || (*++p != '/')) {
-		malformed:
-		REDEBUG("Error URI \"%s\" is malformed, can't find start of path", uri);
+	if (!section->uri_host || !section->uri_path) {
+		REDEBUG("Error URI \"%s\" is malformed, can't find start of path", section->uri);
 		return -1;
 	}
-	p = strchr(p + 1, '/');
-	if (!p) {
-		goto malformed;
-	}
-
-	len = (p - uri);
-
-	/*
-	 *  Allocate a temporary buffer to hold the first part of the URI
-	 */
-	scheme = talloc_array(request, char, len + 1);
-	strlcpy(scheme, uri, len + 1);
-
-	path = (uri + len);
 
-	len = xlat_aeval(request, out, request, scheme, NULL, NULL);
-	talloc_free(scheme);
+	len = xlat_aeval_compiled(request, out, request, section->uri_host, NULL, NULL);
 	if (len < 0) {
 		TALLOC_FREE(*out);
 
 		return 0;
 	}
 
-	len = xlat_aeval(request, &path_exp, request, path, rest_uri_escape, NULL);
+	len = xlat_aeval_compiled(request, &path_exp, request, section->uri_path, rest_uri_escape, NULL);
 	if (len < 0) {
 		TALLOC_FREE(*out);
 
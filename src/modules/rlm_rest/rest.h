@@ -119,6 +119,8 @@ extern size_t http_content_type_table_len;
 typedef struct {
 	char const		*name;		//!< Section name.
 	char const		*uri;		//!< URI to send HTTP request to.
+	xlat_exp_t		*uri_host;	//!< Tokenized <scheme>://<server>/ part of the URI.
+	xlat_exp_t		*uri_path;	//!< Tokenized path part of the URI.
 
 	char const		*proxy;		//!< Send request via this proxy.
 
@@ -133,6 +135,7 @@ typedef struct {
 						//!< to force decoding as a particular type.
 
 	char const		*data;		//!< Custom body data (optional).
+	xlat_exp_t		*data_xlat;	//!< Tokenized custom body data.
 
 	bool			auth_is_set;	//!< Whether a value was provided for auth_str.
 
@@ -140,7 +143,9 @@ typedef struct {
 
 	bool			require_auth;	//!< Whether HTTP-Auth is required or not.
 	char const		*username;	//!< Username used for HTTP-Auth
+	xlat_exp_t		*username_xlat;	//!< Tokenized username.
 	char const		*password;	//!< Password used for HTTP-Auth
+	xlat_exp_t		*password_xlat;	//!< Tokenized password.
 
 	char const		*tls_certificate_file;
 	char const		*tls_private_key_file;
@@ -344,7 +349,8 @@ size_t rest_get_handle_data(char const **out, rlm_rest_handle_t *handle);
  *	Helper functions
  */
 size_t rest_uri_escape(UNUSED REQUEST *request, char *out, size_t outlen, char const *raw, UNUSED void *arg);
-ssize_t rest_uri_build(char **out, rlm_rest_t const *instance, REQUEST *request, char const *uri);
+int rest_uri_tokenize(TALLOC_CTX *ctx, rlm_rest_section_t *section, CONF_ITEM const *ci);
+ssize_t rest_uri_build(char **out, rlm_rest_t const *instance, REQUEST *request, rlm_rest_section_t const *section);
 ssize_t rest_uri_host_unescape(char **out, UNUSED rlm_rest_t const *mod_inst, REQUEST *request,
 			       void *handle, char const *uri);
 
@@ -213,7 +213,7 @@ static int rlm_rest_perform(rlm_rest_t const *instance, rlm_rest_thread_t *threa
 	 *  Build xlat'd URI, this allows REST servers to be specified by
 	 *  request attributes.
 	 */
-	uri_len = rest_uri_build(&uri, instance, request, section->uri);
+	uri_len = rest_uri_build(&uri, instance, request, section);
 	if (uri_len <= 0) return -1;
 
 	RDEBUG2("Sending HTTP %s to \"%s\"", fr_table_str_by_value(http_method_table, section->method, NULL), uri);
@@ -911,6 +911,16 @@ static int parse_sub_section(rlm_rest_t *inst, CONF_SECTION *parent, CONF_PARSER
 	}
 	config->method = fr_table_value_by_str(http_method_table, config->method_str, REST_HTTP_METHOD_CUSTOM);
 
+	/*
+	 *  Tokenize the expansions now, so they're not re-parsed for every request.
+	 */
+	if ((rest_uri_tokenize(inst, config, cf_section_to_item(cs)) < 0) ||
+	    (xlat_tokenize_conf(inst, &config->data_xlat, cf_section_to_item(cs), config->data) < 0) ||
+	    (xlat_tokenize_conf(inst, &config->username_xlat, cf_section_to_item(cs), config->username) < 0) ||
+	    (xlat_tokenize_conf(inst, &config->password_xlat, cf_section_to_item(cs), config->password) < 0)) {
+		return -1;
+	}
+
 	/*
 	 *  We don't have any custom user data, so we need to select the right encoder based
 	 *  on the body type.
@@ -1125,7 +1135,7 @@ static int mod_bootstrap(void *instance, CONF_SECTION *conf)
 	inst->xlat_name = cf_section_name2(conf);
 	if (!inst->xlat_name) inst->xlat_name = cf_section_name1(conf);
 
-	xlat = xlat_async_register(inst, inst->xlat_name, rest_xlat);
+	xlat = xlat_async_register(inst, inst->xlat_name, rest_xlat, false);
 	xlat_async_thread_instantiate_set(xlat, mod_xlat_thread_instantiate, rest_xlat_thread_inst_t, NULL, inst);
 
 	return 0;
@@ -633,20 +633,17 @@ int sql_set_user(rlm_sql_t const *inst, REQUEST *request, char const *username)
 {
 	char *expanded = NULL;
 	VALUE_PAIR *vp = NULL;
-	char const *sqluser;
 	ssize_t len;
 
 	rad_assert(request->packet != NULL);
 
 	if (username != NULL) {
-		sqluser = username;
+		len = xlat_aeval(request, &expanded, request, username, NULL, NULL);
 	} else if (inst->config->query_user[0] != '\0') {
-		sqluser = inst->config->query_user;
+		len = xlat_aeval_compiled(request, &expanded, request, inst->query_user, NULL, NULL);
 	} else {
 		return 0;
 	}
-
-	len = xlat_aeval(request, &expanded, request, sqluser, NULL, NULL);
 	if (len < 0) {
 		return -1;
 	}
@@ -680,8 +677,8 @@ static int sql_get_grouplist(rlm_sql_t const *inst, rlm_sql_handle_t **handle, R
 	entry = *phead = NULL;
 
 	if (!inst->config->groupmemb_query || !*inst->config->groupmemb_query) return 0;
-	if (xlat_aeval(request, &expanded, request, inst->config->groupmemb_query,
-			 inst->sql_escape_func, *handle) < 0) return -1;
+	if (xlat_aeval_compiled(request, &expanded, request, inst->groupmemb_query,
+				inst->sql_escape_func, *handle) < 0) return -1;
 
 	ret = rlm_sql_select_query(inst, request, handle, expanded);
 	talloc_free(expanded);
@@ -850,8 +847,8 @@ static rlm_rcode_t rlm_sql_process_groups(rlm_sql_t const *inst, REQUEST *reques
 			/*
 			 *	Expand the group query
 			 */
-			if (xlat_aeval(request, &expanded, request, inst->config->authorize_group_check_query,
-					 inst->sql_escape_func, *handle) < 0) {
+			if (xlat_aeval_compiled(request, &expanded, request, inst->authorize_group_check_query,
+						inst->sql_escape_func, *handle) < 0) {
 				REDEBUG("Error generating query");
 				rcode = RLM_MODULE_FAIL;
 				goto finish;
@@ -902,8 +899,8 @@ static rlm_rcode_t rlm_sql_process_groups(rlm_sql_t const *inst, REQUEST *reques
 			/*
 			 *	Now get the reply pairs since the paircmp matched
 			 */
-			if (xlat_aeval(request, &expanded, request, inst->config->authorize_group_reply_query,
-					 inst->sql_escape_func, *handle) < 0) {
+			if (xlat_aeval_compiled(request, &expanded, request, inst->authorize_group_reply_query,
+						inst->sql_escape_func, *handle) < 0) {
 				REDEBUG("Error generating query");
 				rcode = RLM_MODULE_FAIL;
 				goto finish;
@@ -1081,6 +1078,20 @@ static int mod_bootstrap(void *instance, CONF_SECTION *conf)
 	return 0;
 }
 
+/** Find the configuration item a query came from, for error messages
+ *
+ * The item may not exist if the default was used, in which case errors
+ * are reported against the module section.
+ */
+static CONF_ITEM const *sql_conf_item(CONF_SECTION const *cs, char const *name)
+{
+	CONF_PAIR *cp;
+
+	cp = cf_pair_find(cs, name);
+	if (!cp) return cf_section_to_item(cs);
+
+	return cf_pair_to_item(cp);
+}
 
 static int mod_instantiate(void *instance, CONF_SECTION *conf)
 {
@@ -1129,6 +1140,32 @@ static int mod_instantiate(void *instance, CONF_SECTION *conf)
 	inst->config->postauth.cs = cf_section_find(conf, "post-auth", NULL);
 	inst->config->postauth.reference_cp = (cf_pair_find(inst->config->postauth.cs, "reference") != NULL);
 
+	/*
+	 *	Tokenize the queries now, so they're not re-parsed
+	 *	every time they're used.
+	 */
+#define SQL_TOKENIZE(_x, _name) \
+	if (xlat_tokenize_conf(inst, &inst->_x, sql_conf_item(conf, _name), inst->config->_x) < 0) return -1
+
+	SQL_TOKENIZE(query_user, "sql_user_name");
+	SQL_TOKENIZE(authorize_check_query, "authorize_check_query");
+	SQL_TOKENIZE(authorize_reply_query, "authorize_reply_query");
+	SQL_TOKENIZE(authorize_group_check_query, "authorize_group_check_query");
+	SQL_TOKENIZE(authorize_group_reply_query, "authorize_group_reply_query");
+	SQL_TOKENIZE(groupmemb_query, "group_membership_query");
+
+	if (inst->config->accounting.reference_cp) {
+		if (xlat_tokenize_conf_section(inst->config->accounting.cs, false) < 0) return -1;
+		inst->config->accounting.reference_xlat =
+			xlat_from_conf_pair(cf_pair_find(inst->config->accounting.cs, "reference"));
+	}
+
+	if (inst->config->postauth.reference_cp) {
+		if (xlat_tokenize_conf_section(inst->config->postauth.cs, false) < 0) return -1;
+		inst->config->postauth.reference_xlat =
+			xlat_from_conf_pair(cf_pair_find(inst->config->postauth.cs, "reference"));
+	}
+
 	/*
 	 *	Cache the SQL-User-Name fr_dict_attr_t, so we can be slightly
 	 *	more efficient about creating SQL-User-Name attributes.
@@ -1222,8 +1259,8 @@ static rlm_rcode_t mod_authorize(void *instance, UNUSED void *thread, REQUEST *r
 		fr_cursor_t	cursor;
 		VALUE_PAIR	*vp;
 
-		if (xlat_aeval(request, &expanded, request, inst->config->authorize_check_query,
-				 inst->sql_escape_func, handle) < 0) {
+		if (xlat_aeval_compiled(request, &expanded, request, inst->authorize_check_query,
+					inst->sql_escape_func, handle) < 0) {
 			REDEBUG("Failed generating query");
 			rcode = RLM_MODULE_FAIL;
 
@@ -1277,8 +1314,8 @@ static rlm_rcode_t mod_authorize(void *instance, UNUSED void *thread, REQUEST *r
 		/*
 		 *	Now get the reply pairs since the paircmp matched
 		 */
-		if (xlat_aeval(request, &expanded, request, inst->config->authorize_reply_query,
-				 inst->sql_escape_func, handle) < 0) {
+		if (xlat_aeval_compiled(request, &expanded, request, inst->authorize_reply_query,
+					inst->sql_escape_func, handle) < 0) {
 			REDEBUG("Error generating query");
 			rcode = RLM_MODULE_FAIL;
 			goto error;
@@ -1432,6 +1469,8 @@ static int acct_redundant(rlm_sql_t const *inst, REQUEST *request, sql_acct_sect
 	CONF_PAIR 		*pair;
 	char const		*attr = NULL;
 	char const		*value;
+	xlat_exp_t const	*query;
+	ssize_t			slen;
 
 	char			path[FR_MAX_STRING_LEN];
 	char			*p = path;
@@ -1441,7 +1480,7 @@ static int acct_redundant(rlm_sql_t const *inst, REQUEST *request, sql_acct_sect
 
 	if (section->reference[0] != '.') *p++ = '.';
 
-	if (xlat_eval(p, sizeof(path) - (p - path), request, section->reference, NULL, NULL) < 0) {
+	if (xlat_eval_compiled(p, sizeof(path) - (p - path), request, section->reference_xlat, NULL, NULL) < 0) {
 		rcode = RLM_MODULE_FAIL;
 
 		goto finish;
@@ -1488,7 +1527,18 @@ static int acct_redundant(rlm_sql_t const *inst, REQUEST *request, sql_acct_sect
 			goto finish;
 		}
 
-		if (xlat_aeval(request, &expanded, request, value, inst->sql_escape_func, handle) < 0) {
+		/*
+		 *	Every pair in the section was tokenized when
+		 *	the module was instantiated, but the reference
+		 *	may point outside of it.
+		 */
+		query = xlat_from_conf_pair(pair);
+		if (query) {
+			slen = xlat_aeval_compiled(request, &expanded, request, query, inst->sql_escape_func, handle);
+		} else {
+			slen = xlat_aeval(request, &expanded, request, value, inst->sql_escape_func, handle);
+		}
+		if (slen < 0) {
 			rcode = RLM_MODULE_FAIL;
 
 			goto finish;
@@ -78,6 +78,7 @@ typedef struct {
 
 	char const		*reference;			//!< Reference string, expanded to point to
 								//!< a group of queries.
+	xlat_exp_t const	*reference_xlat;		//!< Tokenized reference string.
 	bool			reference_cp;
 
 	char const		*logfile;
@@ -234,6 +235,16 @@ struct sql_inst {
 
 	char const		*name;			//!< Module instance name.
 	fr_dict_attr_t const	*group_da;		//!< Group dictionary attribute.
+
+	/*
+	 *	Queries from the configuration, tokenized on instantiation.
+	 */
+	xlat_exp_t		*query_user;		//!< Tokenized query_user.
+	xlat_exp_t		*authorize_check_query;	//!< Tokenized authorize_check_query.
+	xlat_exp_t		*authorize_reply_query;	//!< Tokenized authorize_reply_query.
+	xlat_exp_t		*authorize_group_check_query;	//!< Tokenized authorize_group_check_query.
+	xlat_exp_t		*authorize_group_reply_query;	//!< Tokenized authorize_group_reply_query.
+	xlat_exp_t		*groupmemb_query;	//!< Tokenized group_membership_query.
 };
 
 typedef struct rlm_sql_grouplist_s rlm_sql_grouplist_t;
@@ -243,7 +254,7 @@ struct rlm_sql_grouplist_s {
 };
 
 void		*sql_mod_conn_create(TALLOC_CTX *ctx, void *instance, fr_time_delta_t timeout);
-int		sql_fr_pair_list_afrom_str(TALLOC_CTX *ctx, REQUEST *request, VALUE_PAIR **first_pair, rlm_sql_row_t row);
+int		sql_fr_pair_list_afrom_str(TALLOC_CTX *ctx, REQUEST *request, fr_cursor_t *out, rlm_sql_row_t row);
 int		sql_read_realms(rlm_sql_handle_t *handle);
 int		sql_getvpdata(TALLOC_CTX *ctx, rlm_sql_t const *inst, REQUEST *request, rlm_sql_handle_t **handle, VALUE_PAIR **pair, char const *query);
 int		sql_dict_init(rlm_sql_handle_t *handle);
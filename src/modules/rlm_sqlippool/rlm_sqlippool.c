@@ -94,6 +94,45 @@ typedef struct {
 						/* Reserved to handle 255.255.255.254 Requests */
 	char const	*defaultpool;		//!< Default Pool-Name if there is none in the check items.
 
+	/*
+	 *	Queries and messages, tokenized on instantiation.  NULL
+	 *	if not configured.  allocate_update is expanded at run
+	 *	time, as %I is the address being allocated.
+	 */
+	struct {
+		xlat_exp_t	*allocate_begin;
+		xlat_exp_t	*allocate_clear;
+		xlat_exp_t	*allocate_find;
+		xlat_exp_t	*allocate_commit;
+
+		xlat_exp_t	*pool_check;
+
+		xlat_exp_t	*start_begin;
+		xlat_exp_t	*start_update;
+		xlat_exp_t	*start_commit;
+
+		xlat_exp_t	*alive_begin;
+		xlat_exp_t	*alive_update;
+		xlat_exp_t	*alive_commit;
+
+		xlat_exp_t	*stop_begin;
+		xlat_exp_t	*stop_clear;
+		xlat_exp_t	*stop_commit;
+
+		xlat_exp_t	*on_begin;
+		xlat_exp_t	*on_clear;
+		xlat_exp_t	*on_commit;
+
+		xlat_exp_t	*off_begin;
+		xlat_exp_t	*off_clear;
+		xlat_exp_t	*off_commit;
+
+		xlat_exp_t	*log_exists;
+		xlat_exp_t	*log_success;
+		xlat_exp_t	*log_clear;
+		xlat_exp_t	*log_failed;
+		xlat_exp_t	*log_nopool;
+	} compiled;
 } rlm_sqlippool_t;
 
 static CONF_PARSER message_config[] = {
@@ -267,10 +306,101 @@ static int sqlippool_expand(char * out, int outlen, char const * fmt,
 	return strlen(out);
 }
 
+/** Find the configuration item a query or message came from, for error messages
+ *
+ * The item may not exist if the default was used, in which case errors
+ * are reported against the section.
+ */
+static CONF_ITEM const *sqlippool_conf_item(CONF_SECTION const *cs, char const *name)
+{
+	CONF_PAIR *cp;
+
+	cp = cf_pair_find(cs, name);
+	if (!cp) return cf_section_to_item(cs);
+
+	return cf_pair_to_item(cp);
+}
+
+/** Do the sqlippool substitutions, and tokenize a query or message
+ *
+ * Everything but %I is known when the module is instantiated.
+ *
+ * @param[in] inst	Instance of rlm_sqlippool.
+ * @param[out] out	Where to write the xlat tree.  NULL if fmt is empty.
+ * @param[in] ci	fmt came from.
+ * @param[in] fmt	to tokenize.
+ * @param[in] expand	Whether to do the sqlippool substitutions.
+ * @return
+ *	- 0 on success.
+ *	- -1 on failure.
+ */
+static int sqlippool_tokenize(rlm_sqlippool_t *inst, xlat_exp_t **out, CONF_ITEM const *ci,
+			      char const *fmt, bool expand)
+{
+	char query[MAX_QUERY_LEN];
+
+	*out = NULL;
+
+	if (!fmt || !*fmt) return 0;
+
+	if (expand) {
+		sqlippool_expand(query, sizeof(query), fmt, inst, NULL, 0);
+		fmt = query;
+	}
+
+	return xlat_tokenize_conf(inst, out, ci, fmt);
+}
+
 /** Perform a single sqlippool query
  *
- * Mostly wrapper around sql_query which does some special sqlippool sequence substitutions and expands
- * the format string.
+ * Mostly wrapper around sql_query which expands the query.
+ *
+ * @param xlat tokenized sql query to expand.
+ * @param handle sql connection handle.
+ * @param data Instance of rlm_sqlippool.
+ * @param request Current request.
+ * @return
+ *	- 0 on success.
+ *	- < 0 on error.
+ */
+static int sqlippool_command(xlat_exp_t const *xlat, rlm_sql_handle_t **handle,
+			     rlm_sqlippool_t *data, REQUEST *request)
+{
+	char *expanded = NULL;
+
+	int ret;
+
+	/*
+	 *	If we don't have a command, do nothing.
+	 */
+	if (!xlat) return 0;
+
+	/*
+	 *	No handle?  That's an error.
+	 */
+	if (!handle || !*handle) return -1;
+
+	if (xlat_aeval_compiled(request, &expanded, request, xlat,
+				data->sql_inst->sql_escape_func, *handle) < 0) return -1;
+
+	ret = data->sql_inst->sql_query(data->sql_inst, request, handle, expanded);
+	if (ret < 0){
+		talloc_free(expanded);
+		return -1;
+	}
+	talloc_free(expanded);
+
+	/*
+	 *	No handle, we can't continue.
+	 */
+	if (!*handle) return -1;
+
+	(data->sql_inst->driver->sql_finish_query)(*handle, data->sql_inst->config);
+
+	return 0;
+}
+
+/** Perform a single sqlippool query, substituting the address being allocated
  *
  * @param fmt sql query to expand.
  * @param handle sql connection handle.
@@ -282,9 +412,9 @@ static int sqlippool_expand(char * out, int outlen, char const * fmt,
  *	- 0 on success.
  *	- < 0 on error.
  */
-static int sqlippool_command(char const *fmt, rlm_sql_handle_t **handle,
-			     rlm_sqlippool_t *data, REQUEST *request,
-			     char *param, int param_len)
+static int sqlippool_command_param(char const *fmt, rlm_sql_handle_t **handle,
+				   rlm_sqlippool_t *data, REQUEST *request,
+				   char *param, int param_len)
 {
 	char query[MAX_QUERY_LEN];
 	char *expanded = NULL;
@@ -309,11 +439,8 @@ static int sqlippool_command(char const *fmt, rlm_sql_handle_t **handle,
 	if (xlat_aeval(request, &expanded, request, query, data->sql_inst->sql_escape_func, *handle) < 0) return -1;
 
 	ret = data->sql_inst->sql_query(data->sql_inst, request, handle, expanded);
-	if (ret < 0){
-		talloc_free(expanded);
-		return -1;
-	}
 	talloc_free(expanded);
+	if (ret < 0) return -1;
 
 	/*
 	 *	No handle, we can't continue.
@@ -329,43 +456,40 @@ static int sqlippool_command(char const *fmt, rlm_sql_handle_t **handle,
  *	Don't repeat yourself
  */
 #undef DO
-#define DO(_x) sqlippool_command(inst->_x, handle, inst, request, NULL, 0)
-#define DO_PART(_x) sqlippool_command(inst->_x, &handle, inst, request, NULL, 0)
+#define DO(_x) sqlippool_command(inst->compiled._x, handle, inst, request)
+#define DO_PART(_x) sqlippool_command(inst->compiled._x, &handle, inst, request)
 
 /*
  * Query the database expecting a single result row
  */
-static int CC_HINT(nonnull (1, 3, 4, 5)) sqlippool_query1(char *out, int outlen, char const *fmt,
-							  rlm_sql_handle_t **handle, rlm_sqlippool_t *data,
-							  REQUEST *request, char *param, int param_len)
+static int CC_HINT(nonnull (1, 4, 5, 6)) sqlippool_query1(char *out, int outlen, xlat_exp_t const *xlat,
+							     rlm_sql_handle_t **handle, rlm_sqlippool_t *data,
+							     REQUEST *request)
 {
-	char query[MAX_QUERY_LEN];
 	char *expanded = NULL;
 
 	int rlen, retval;
 
 	rlm_sql_row_t row;
 
-	/*
-	 *	@todo this needs to die (should just be done in xlat expansion)
-	 */
-	sqlippool_expand(query, sizeof(query), fmt, data, param, param_len);
-
 	*out = '\0';
 
+	if (!xlat) return 0;
+
 	/*
 	 *	Do an xlat on the provided string
 	 */
-	if (xlat_aeval(request, &expanded, request, query, data->sql_inst->sql_escape_func, *handle) < 0) {
+	if (xlat_aeval_compiled(request, &expanded, request, xlat, data->sql_inst->sql_escape_func, *handle) < 0) {
 		return 0;
 	}
 	retval = data->sql_inst->sql_select_query(data->sql_inst, request, handle, expanded);
-	talloc_free(expanded);
 
 	if ((retval != 0) || !*handle) {
-		REDEBUG("database query error on '%s'", query);
+		REDEBUG("database query error on '%s'", expanded);
+		talloc_free(expanded);
 		return 0;
 	}
+	talloc_free(expanded);
 
 	if (data->sql_inst->sql_fetch_row(&row, data->sql_inst, request, handle) < 0) {
 		REDEBUG("Failed fetching query result");
@@ -412,6 +536,7 @@ static int mod_instantiate(void *instance, CONF_SECTION *conf)
 	module_instance_t	*sql_inst;
 	rlm_sqlippool_t		*inst = instance;
 	char const		*pool_name = NULL;
+	CONF_SECTION		*messages;
 
 	pool_name = cf_section_name2(conf);
 	if (pool_name != NULL) {
@@ -452,6 +577,45 @@ static int mod_instantiate(void *instance, CONF_SECTION *conf)
 		return -1;
 	}
 
+	/*
+	 *	Tokenize the queries and messages now, so they're
+	 *	not re-parsed every time they're used.
+	 */
+	messages = cf_section_find(conf, "messages", NULL);
+	if (!messages) messages = conf;
+
+#define QUERY(_x) \
+	if (sqlippool_tokenize(inst, &inst->compiled._x, sqlippool_conf_item(conf, #_x), inst->_x, true) < 0) return -1
+#define MESSAGE(_x, _name) \
+	if (sqlippool_tokenize(inst, &inst->compiled._x, sqlippool_conf_item(messages, _name), inst->_x, false) < 0) return -1
+
+	QUERY(allocate_begin);
+	QUERY(allocate_clear);
+	QUERY(allocate_find);
+	QUERY(allocate_commit);
+	QUERY(pool_check);
+	QUERY(start_begin);
+	QUERY(start_update);
+	QUERY(start_commit);
+	QUERY(alive_begin);
+	QUERY(alive_update);
+	QUERY(alive_commit);
+	QUERY(stop_begin);
+	QUERY(stop_clear);
+	QUERY(stop_commit);
+	QUERY(on_begin);
+	QUERY(on_clear);
+	QUERY(on_commit);
+	QUERY(off_begin);
+	QUERY(off_clear);
+	QUERY(off_commit);
+
+	MESSAGE(log_exists, "exists");
+	MESSAGE(log_success, "success");
+	MESSAGE(log_clear, "clear");
+	MESSAGE(log_failed, "failed");
+	MESSAGE(log_nopool, "nopool");
+
 	return 0;
 }
 
@@ -460,14 +624,14 @@ static int mod_instantiate(void *instance, CONF_SECTION *conf)
  *	If we have something to log, then we log it.
  *	Otherwise we return the retcode as soon as possible
  */
-static int do_logging(rlm_sqlippool_t *inst, REQUEST *request, char const *str, int rcode)
+static int do_logging(rlm_sqlippool_t *inst, REQUEST *request, xlat_exp_t const *xlat, int rcode)
 {
 	char		*expanded = NULL;
 	VALUE_PAIR	*vp;
 
-	if (!str || !*str) return rcode;
+	if (!xlat) return rcode;
 
-	if (xlat_aeval(request, &expanded, request, str, NULL, NULL) < 0) return rcode;
+	if (xlat_aeval_compiled(request, &expanded, request, xlat, NULL, NULL) < 0) return rcode;
 
 	MEM(pair_add_request(&vp, attr_module_success_message) == 0);
 	fr_pair_value_strsteal(vp, expanded);
@@ -494,13 +658,13 @@ static rlm_rcode_t CC_HINT(nonnull) mod_post_auth(void *instance, UNUSED void *t
 	if (fr_pair_find_by_da(request->reply->vps, inst->framed_ip_address, TAG_ANY) != NULL) {
 		RDEBUG2("Framed-IP-Address already exists");
 
-		return do_logging(inst, request, inst->log_exists, RLM_MODULE_NOOP);
+		return do_logging(inst, request, inst->compiled.log_exists, RLM_MODULE_NOOP);
 	}
 
 	if (fr_pair_find_by_da(request->control, attr_pool_name, TAG_ANY) == NULL) {
 		RDEBUG2("No Pool-Name defined");
 
-		return do_logging(inst, request, inst->log_nopool, RLM_MODULE_NOOP);
+		return do_logging(inst, request, inst->compiled.log_nopool, RLM_MODULE_NOOP);
 	}
 
 	handle = fr_pool_connection_get(inst->sql_inst->pool, request);
@@ -532,8 +696,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_post_auth(void *instance, UNUSED void *t
 	DO_PART(allocate_begin);
 
 	allocation_len = sqlippool_query1(allocation, sizeof(allocation),
-					  inst->allocate_find, &handle,
-					  inst, request, (char *) NULL, 0);
+					  inst->compiled.allocate_find, &handle, inst, request);
 	if (!handle) return RLM_MODULE_FAIL;
 
 	/*
@@ -545,15 +708,14 @@ static rlm_rcode_t CC_HINT(nonnull) mod_post_auth(void *instance, UNUSED void *t
 		/*
 		 *Should we perform pool-check ?
 		 */
-		if (inst->pool_check && *inst->pool_check) {
+		if (inst->compiled.pool_check) {
 
 			/*
 			 *Ok, so the allocate-find query found nothing ...
 			 *Let's check if the pool exists at all
 			 */
 			allocation_len = sqlippool_query1(allocation, sizeof(allocation),
-							  inst->pool_check, &handle, inst, request,
-							  (char *) NULL, 0);
+							  inst->compiled.pool_check, &handle, inst, request);
 			if (!handle) return RLM_MODULE_FAIL;
 
 			fr_pool_connection_release(inst->sql_inst->pool, request, handle);
@@ -569,7 +731,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_post_auth(void *instance, UNUSED void *t
 				 *	NOTFOUND
 				 */
 				RDEBUG2("pool appears to be full");
-				return do_logging(inst, request, inst->log_failed, RLM_MODULE_NOTFOUND);
+				return do_logging(inst, request, inst->compiled.log_failed, RLM_MODULE_NOTFOUND);
 
 			}
 
@@ -587,7 +749,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_post_auth(void *instance, UNUSED void *t
 		fr_pool_connection_release(inst->sql_inst->pool, request, handle);
 
 		RDEBUG2("IP address could not be allocated");
-		return do_logging(inst, request, inst->log_failed, RLM_MODULE_NOOP);
+		return do_logging(inst, request, inst->compiled.log_failed, RLM_MODULE_NOOP);
 	}
 
 	/*
@@ -600,7 +762,7 @@ static rlm_rcode_t CC_HINT(nonnull) mod_post_auth(void *instance, UNUSED void *t
 
 		RDEBUG2("Invalid IP number [%s] returned from instbase query.", allocation);
 		fr_pool_connection_release(inst->sql_inst->pool, request, handle);
-		return do_logging(inst, request, inst->log_failed, RLM_MODULE_NOOP);
+		return do_logging(inst, request, inst->compiled.log_failed, RLM_MODULE_NOOP);
 	}
 
 	RDEBUG2("Allocated IP %s", allocation);
@@ -609,14 +771,14 @@ static rlm_rcode_t CC_HINT(nonnull) mod_post_auth(void *instance, UNUSED void *t
 	/*
 	 *	UPDATE
 	 */
-	sqlippool_command(inst->allocate_update, &handle, inst, request,
-			  allocation, allocation_len);
+	sqlippool_command_param(inst->allocate_update, &handle, inst, request,
+				allocation, allocation_len);
 
 	DO_PART(allocate_commit);
 
 	if (handle) fr_pool_connection_release(inst->sql_inst->pool, request, handle);
 
-	return do_logging(inst, request, inst->log_success, RLM_MODULE_OK);
+	return do_logging(inst, request, inst->compiled.log_success, RLM_MODULE_OK);
 }
 
 static int mod_accounting_start(rlm_sql_handle_t **handle,
@@ -645,7 +807,7 @@ static int mod_accounting_stop(rlm_sql_handle_t **handle,
 	DO(stop_clear);
 	DO(stop_commit);
 
-	return do_logging(inst, request, inst->log_clear, RLM_MODULE_OK);
+	return do_logging(inst, request, inst->compiled.log_clear, RLM_MODULE_OK);
 }
 
 static int mod_accounting_on(rlm_sql_handle_t **handle,
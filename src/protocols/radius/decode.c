@@ -387,7 +387,7 @@ static ssize_t decode_concat(TALLOC_CTX *ctx, fr_cursor_t *cursor,
 	 */
 	if (!total) return 2;
 
-	vp = fr_pair_afrom_da(ctx, parent);
+	vp = fr_pair_afrom_da_len(ctx, parent, total);
 	if (!vp) return -1;
 
 	p = talloc_array(vp, uint8_t, total);
@@ -417,7 +417,7 @@ ssize_t fr_radius_decode_tlv(TALLOC_CTX *ctx, fr_cursor_t *cursor, fr_dict_t con
 {
 	uint8_t const		*p = data, *end = data + data_len;
 	fr_dict_attr_t const	*child;
-	VALUE_PAIR		*head = NULL;
+	VALUE_PAIR		*head = NULL, *vp;
 	fr_cursor_t		tlv_cursor;
 	fr_radius_ctx_t		*packet_ctx = decoder_ctx;
 
@@ -461,9 +461,15 @@ ssize_t fr_radius_decode_tlv(TALLOC_CTX *ctx, fr_cursor_t *cursor, fr_dict_t con
 		if (tlv_len < 0) goto error;
 		p += p[1];
 	}
+	/*
+	 *	Append the new pairs using the cached tail of the
+	 *	caller's cursor.  Winding it to the tail with
+	 *	fr_cursor_tail() would re-walk every pair decoded
+	 *	so far, which is quadratic for packets with many
+	 *	TLVs or VSAs.
+	 */
 	fr_cursor_head(&tlv_cursor);
-	fr_cursor_tail(cursor);
-	fr_cursor_merge(cursor, &tlv_cursor);	/* Wind to the end of the new pairs */
+	while ((vp = fr_cursor_remove(&tlv_cursor))) fr_cursor_append(cursor, vp);
 
 	return data_len;
 }
@@ -845,7 +851,7 @@ static ssize_t decode_vsa(TALLOC_CTX *ctx, fr_cursor_t *cursor, fr_dict_t const
 	ssize_t			rcode;
 	uint32_t		vendor;
 	fr_dict_vendor_t const	*dv;
-	VALUE_PAIR		*head = NULL;
+	VALUE_PAIR		*head = NULL, *vp;
 	fr_dict_vendor_t	my_dv;
 	fr_dict_attr_t const	*vendor_da;
 	fr_cursor_t		tlv_cursor;
@@ -961,8 +967,7 @@ create_attrs:
 		total += vsa_len;
 	}
 	fr_cursor_head(&tlv_cursor);
-	fr_cursor_tail(cursor);
-	fr_cursor_merge(cursor, &tlv_cursor);
+	while ((vp = fr_cursor_remove(&tlv_cursor))) fr_cursor_append(cursor, vp);
 
 	/*
 	 *	When the unknown attributes were created by
@@ -1426,7 +1431,7 @@ ssize_t fr_radius_decode_pair_value(TALLOC_CTX *ctx, fr_cursor_t *cursor, fr_dic
 	 *	And now that we've verified the basic type
 	 *	information, decode the actual p.
 	 */
-	vp = fr_pair_afrom_da(ctx, parent);
+	vp = fr_pair_afrom_da_len(ctx, parent, data_len);
 	if (!vp) return -1;
 	vp->tag = tag;
 
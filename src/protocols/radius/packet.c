@@ -184,13 +184,17 @@ int fr_radius_packet_decode(RADIUS_PACKET *packet, RADIUS_PACKET *original,
 	 *	Loop over the attributes, decoding them into VPs.
 	 */
 	while (packet_length > 0) {
-		ssize_t my_len;
+		ssize_t		my_len;
+		VALUE_PAIR	*new = NULL, *vp;
+		fr_cursor_t	new_cursor;
 
 		/*
 		 *	This may return many VPs
 		 */
-		my_len = fr_radius_decode_pair(packet, &cursor, dict_radius, ptr, packet_length, &packet_ctx);
+		fr_cursor_init(&new_cursor, &new);
+		my_len = fr_radius_decode_pair(packet, &new_cursor, dict_radius, ptr, packet_length, &packet_ctx);
 		if (my_len < 0) {
+			fr_pair_list_free(&new);
 		fail:
 			talloc_free(packet_ctx.tmp_ctx);
 			fr_pair_list_free(&head);
@@ -198,14 +202,21 @@ int fr_radius_packet_decode(RADIUS_PACKET *packet, RADIUS_PACKET *original,
 		}
 
 		/*
-		 *	This should really be an assertion.
+		 *	Count the ones which were just added, and move
+		 *	them to the end of the list.  The append uses
+		 *	the cursor's cached tail, so this is linear in
+		 *	the number of attributes.
 		 */
-		if (my_len == 0) break;
+		fr_cursor_head(&new_cursor);
+		while ((vp = fr_cursor_remove(&new_cursor))) {
+			fr_cursor_append(&cursor, vp);
+			num_attributes++;
+		}
 
 		/*
-		 *	Count the ones which were just added
+		 *	This should really be an assertion.
 		 */
-		while (fr_cursor_next(&cursor)) num_attributes++;
+		if (my_len == 0) break;
 
 		/*
 		 *	VSA's may not have been counted properly in
@@ -1,4 +1,4 @@
-SUBMAKEFILES := ring_buffer_test.mk message_set_test.mk atomic_queue_test.mk 
+SUBMAKEFILES := ring_buffer_test.mk message_set_test.mk atomic_queue_test.mk event_test.mk pair_decode_test.mk pair_index_test.mk hash_test.mk timer_test.mk trie_rcu_test.mk xlat_test.mk
 
 #
 #  This uses an old API, and we don't have time to fix it.
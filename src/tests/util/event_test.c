@@ -0,0 +1,300 @@
+/*
+ * event_test.c	Benchmark for the event loop
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2020 The FreeRADIUS server project
+ */
+
+/*
+ *	A sender thread writes a timestamp to one of a set of pipes,
+ *	and waits for the event loop to read it before sending the
+ *	next one.  The event loop records how long it took to wake
+ *	up, and how late its timers fired.
+ *
+ *	To compare the kqueue and epoll backends, build the server
+ *	once with, and once without --with-epoll, and run each build
+ *	under:
+ *
+ *	    perf stat -e 'syscalls:sys_enter_*' ./event_test -m 100000
+ *
+ *	or "strace -c -f".  The number of loop iterations is printed
+ *	so that syscalls per iteration can be calculated.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/time.h>
+#include <freeradius-devel/util/strerror.h>
+#include <freeradius-devel/util/syserror.h>
+#include <freeradius-devel/server/rad_assert.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#undef MEM
+#define MEM(x) if (!(x)) { fprintf(stderr, "%s[%u] OUT OF MEMORY\n", __FILE__, __LINE__); _exit(EXIT_FAILURE); }
+#define MPRINT1 if (debug_lvl) printf
+
+#define MAX_PIPES	(1024)
+
+static int		debug_lvl = 0;
+static int		num_pipes = 16;
+static size_t		max_messages = 10000;
+static int		pipes[MAX_PIPES][2];
+static atomic_size_t	received;
+
+static fr_time_delta_t	*latency;
+static fr_time_delta_t	timer_late_max, timer_late_total;
+static size_t		timer_fired;
+static uint64_t		iterations;
+
+static fr_time_delta_t	timer_interval;
+static fr_event_timer_t const *timer_ev;
+
+/**********************************************************************/
+typedef struct fr_request_s REQUEST;
+REQUEST *request_alloc(UNUSED TALLOC_CTX *ctx);
+void request_verify(UNUSED char const *file, UNUSED int line, UNUSED REQUEST *request);
+int talloc_const_free(void const *ptr);
+
+REQUEST *request_alloc(UNUSED TALLOC_CTX *ctx)
+{
+	return NULL;
+}
+
+void request_verify(UNUSED char const *file, UNUSED int line, UNUSED REQUEST *request)
+{
+}
+
+int talloc_const_free(void const *ptr)
+{
+	void *tmp;
+	if (!ptr) return 0;
+
+	memcpy(&tmp, &ptr, sizeof(tmp));
+	return talloc_free(tmp);
+}
+/**********************************************************************/
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: event_test [OPTS]\n");
+	fprintf(stderr, "  -m <messages>	  Send number of messages.\n");
+	fprintf(stderr, "  -n <pipes>             Number of pipes to spread the messages over.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(EXIT_SUCCESS);
+}
+
+static int cmp_delta(void const *one, void const *two)
+{
+	fr_time_delta_t a = *(fr_time_delta_t const *) one;
+	fr_time_delta_t b = *(fr_time_delta_t const *) two;
+
+	return (a > b) - (a < b);
+}
+
+static void pipe_read(fr_event_list_t *el, int fd, UNUSED int flags, UNUSED void *uctx)
+{
+	fr_time_t	sent;
+	size_t		count;
+
+	while (read(fd, &sent, sizeof(sent)) == sizeof(sent)) {
+		count = atomic_load(&received);
+
+		latency[count] = fr_time() - sent;
+		MPRINT1("Received message %zu on FD %i\n", count, fd);
+
+		atomic_store(&received, count + 1);
+		if ((count + 1) == max_messages) fr_event_loop_exit(el, 1);
+	}
+}
+
+static void pipe_error(UNUSED fr_event_list_t *el, int fd, UNUSED int flags, int fd_errno, UNUSED void *uctx)
+{
+	fprintf(stderr, "event_test: Error on FD %i: %s\n", fd, fr_syserror(fd_errno));
+	exit(EXIT_FAILURE);
+}
+
+static void timer_fire(fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_time_t		when = *(fr_time_t *) uctx;
+	fr_time_delta_t		late = fr_time() - when;
+	static fr_time_t	next;
+
+	if (late > timer_late_max) timer_late_max = late;
+	timer_late_total += late;
+	timer_fired++;
+
+	if (fr_event_loop_exiting(el)) return;
+
+	next = now + timer_interval;
+	if (fr_event_timer_at(el, el, &timer_ev, next, timer_fire, &next) < 0) {
+		fprintf(stderr, "event_test: Failed inserting timer: %s\n", fr_strerror());
+		exit(EXIT_FAILURE);
+	}
+}
+
+static int count_iterations(UNUSED void *uctx, UNUSED fr_time_t wake)
+{
+	iterations++;
+	return 0;
+}
+
+static void *sender(UNUSED void *arg)
+{
+	size_t i;
+
+	MPRINT1("\tSender started.\n");
+
+	for (i = 0; i < max_messages; i++) {
+		fr_time_t now = fr_time();
+
+		if (write(pipes[i % num_pipes][1], &now, sizeof(now)) != sizeof(now)) {
+			fprintf(stderr, "event_test: Failed writing to pipe: %s\n", fr_syserror(errno));
+			exit(EXIT_FAILURE);
+		}
+
+		/*
+		 *	Wait for the event loop to read it, so that
+		 *	every message measures a wakeup.
+		 */
+		while (atomic_load(&received) <= i) usleep(10);
+	}
+
+	MPRINT1("\tSender exiting.\n");
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	int 			c, i;
+	TALLOC_CTX		*autofree = talloc_autofree_context();
+	fr_event_list_t		*el;
+	pthread_attr_t		attr;
+	pthread_t		sender_id;
+	fr_time_t		start, end, first;
+	fr_time_delta_t		total = 0;
+	size_t			j;
+
+	fr_time_start();
+
+	while ((c = getopt(argc, argv, "hm:n:x")) != -1) switch (c) {
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'm':
+			max_messages = atoi(optarg);
+			if (!max_messages) usage();
+			break;
+
+		case 'n':
+			num_pipes = atoi(optarg);
+			if ((num_pipes <= 0) || (num_pipes > MAX_PIPES)) usage();
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	MEM(latency = talloc_array(autofree, fr_time_delta_t, max_messages));
+
+	el = fr_event_list_alloc(autofree, count_iterations, NULL);
+	if (!el) {
+		fprintf(stderr, "event_test: Failed creating event list: %s\n", fr_strerror());
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < num_pipes; i++) {
+		if (pipe(pipes[i]) < 0) {
+			fprintf(stderr, "event_test: Failed opening pipe: %s\n", fr_syserror(errno));
+			exit(EXIT_FAILURE);
+		}
+		(void) fcntl(pipes[i][0], F_SETFL, O_NONBLOCK);
+
+		if (fr_event_fd_insert(autofree, el, pipes[i][0], pipe_read, NULL, pipe_error, NULL) < 0) {
+			fprintf(stderr, "event_test: Failed inserting FD: %s\n", fr_strerror());
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	/*
+	 *	A timer which keeps firing while the messages are
+	 *	being sent, so we exercise both timers and FDs.
+	 */
+	timer_interval = fr_time_delta_from_usec(500);
+	first = fr_time() + timer_interval;
+	if (fr_event_timer_at(el, el, &timer_ev, first, timer_fire, &first) < 0) {
+		fprintf(stderr, "event_test: Failed inserting timer: %s\n", fr_strerror());
+		exit(EXIT_FAILURE);
+	}
+
+	(void) pthread_attr_init(&attr);
+	(void) pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+	start = fr_time();
+	(void) pthread_create(&sender_id, &attr, sender, NULL);
+
+	(void) fr_event_loop(el);
+	end = fr_time();
+
+	(void) pthread_join(sender_id, NULL);
+
+	qsort(latency, max_messages, sizeof(*latency), cmp_delta);
+	for (j = 0; j < max_messages; j++) total += latency[j];
+
+	printf("messages	%zu\n", max_messages);
+	printf("pipes		%i\n", num_pipes);
+	printf("elapsed		%" PRIu64 "us\n", (uint64_t) fr_time_delta_to_usec(end - start));
+	printf("iterations	%" PRIu64 "\n", iterations);
+	printf("wakeup min	%" PRIu64 "ns\n", (uint64_t) latency[0]);
+	printf("wakeup avg	%" PRIu64 "ns\n", (uint64_t) (total / max_messages));
+	printf("wakeup p50	%" PRIu64 "ns\n", (uint64_t) latency[max_messages / 2]);
+	printf("wakeup p99	%" PRIu64 "ns\n", (uint64_t) latency[(max_messages * 99) / 100]);
+	printf("wakeup max	%" PRIu64 "ns\n", (uint64_t) latency[max_messages - 1]);
+	printf("timers		%zu\n", timer_fired);
+	if (timer_fired) {
+		printf("timer late avg	%" PRIu64 "ns\n", (uint64_t) (timer_late_total / timer_fired));
+		printf("timer late max	%" PRIu64 "ns\n", (uint64_t) timer_late_max);
+	}
+
+	talloc_free(el);
+
+	for (i = 0; i < num_pipes; i++) {
+		close(pipes[i][0]);
+		close(pipes[i][1]);
+	}
+
+	exit(EXIT_SUCCESS);
+}
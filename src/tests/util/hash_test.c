@@ -0,0 +1,423 @@
+/*
+ * hash_test.c	Benchmark for hash tables
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2020 The FreeRADIUS server project
+ */
+
+/*
+ *	Times inserting, finding and deleting a large number of
+ *	entries, first with fr_hash_table_t, and then with a copy of
+ *	the chained table which it replaced.
+ *
+ *	    ./hash_test -n 1000000
+ *
+ *	The program fails if either table loses an entry, or finds
+ *	one which isn't there.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/hash.h>
+#include <freeradius-devel/util/talloc.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#undef MEM
+#define MEM(x) if (!(x)) { fprintf(stderr, "%s[%u] OUT OF MEMORY\n", __FILE__, __LINE__); _exit(EXIT_FAILURE); }
+
+static int num_entries = 1024 * 1024;
+
+/*
+ *	The previous implementation: a chained table using
+ *	split-ordered lists, so that buckets are split lazily as
+ *	the table grows.  Only what's needed for the timings is
+ *	kept here.
+ */
+typedef struct chain_entry_s chain_entry_t;
+
+struct chain_entry_s {
+	chain_entry_t	*next;
+	uint32_t	reversed;
+	uint32_t	key;
+	void const	*data;
+};
+
+typedef struct {
+	int			num_elements;
+	int			num_buckets;
+	int			next_grow;
+	int			mask;
+
+	fr_hash_table_hash_t	hash;
+
+	chain_entry_t		null;
+
+	chain_entry_t		**buckets;
+} chain_table_t;
+
+static uint32_t chain_reverse(uint32_t key)
+{
+	key = ((key >> 1) & 0x55555555) | ((key & 0x55555555) << 1);
+	key = ((key >> 2) & 0x33333333) | ((key & 0x33333333) << 2);
+	key = ((key >> 4) & 0x0f0f0f0f) | ((key & 0x0f0f0f0f) << 4);
+
+	return __builtin_bswap32(key);
+}
+
+/*
+ *	Take the parent by discarding the highest bit that is set.
+ */
+static uint32_t chain_parent_of(uint32_t key)
+{
+	if (!key) return 0;
+
+	return key & ~(1U << (31 - __builtin_clz(key)));
+}
+
+static chain_table_t *chain_create(fr_hash_table_hash_t hash)
+{
+	chain_table_t *ct;
+
+	ct = talloc_zero(NULL, chain_table_t);
+	if (!ct) return NULL;
+
+	ct->hash = hash;
+	ct->num_buckets = 64;
+	ct->mask = ct->num_buckets - 1;
+	ct->next_grow = (ct->num_buckets << 1) + (ct->num_buckets >> 1);
+
+	ct->buckets = talloc_zero_array(ct, chain_entry_t *, ct->num_buckets);
+	if (!ct->buckets) {
+		talloc_free(ct);
+		return NULL;
+	}
+
+	ct->null.reversed = ~0;
+	ct->null.key = ~0;
+	ct->null.next = &ct->null;
+	ct->buckets[0] = &ct->null;
+
+	return ct;
+}
+
+static void chain_fixup(chain_table_t *ct, uint32_t entry)
+{
+	uint32_t	parent_entry, this;
+	chain_entry_t	**last, *cur;
+
+	parent_entry = chain_parent_of(entry);
+	if (!ct->buckets[parent_entry]) chain_fixup(ct, parent_entry);
+
+	last = &ct->buckets[parent_entry];
+	this = parent_entry;
+
+	for (cur = *last; cur != &ct->null; cur = cur->next) {
+		uint32_t real_entry;
+
+		real_entry = cur->key & ct->mask;
+		if (real_entry != this) {
+			*last = &ct->null;
+			ct->buckets[real_entry] = cur;
+			this = real_entry;
+		}
+
+		last = &(cur->next);
+	}
+
+	if (!ct->buckets[entry]) ct->buckets[entry] = &ct->null;
+}
+
+static chain_entry_t **chain_bucket(chain_table_t *ct, uint32_t key)
+{
+	uint32_t entry = key & ct->mask;
+
+	if (!ct->buckets[entry]) chain_fixup(ct, entry);
+
+	return &ct->buckets[entry];
+}
+
+/*
+ *	Entries are keyed on the hash alone, as hash_int() is
+ *	perfect for the test data.
+ */
+static int chain_insert(chain_table_t *ct, void const *data)
+{
+	uint32_t	key = ct->hash(data);
+	uint32_t	reversed = chain_reverse(key);
+	chain_entry_t	**last, *cur, *node;
+
+	last = chain_bucket(ct, key);
+	for (cur = *last; cur != &ct->null; cur = cur->next) {
+		if (cur->reversed > reversed) break;
+		if (cur->reversed == reversed) return 0;
+		last = &(cur->next);
+	}
+
+	node = talloc_zero(NULL, chain_entry_t);
+	if (!node) return 0;
+
+	node->reversed = reversed;
+	node->key = key;
+	node->data = data;
+	node->next = *last;
+	*last = node;
+
+	if (++ct->num_elements >= ct->next_grow) {
+		chain_entry_t **buckets;
+
+		buckets = talloc_zero_array(ct, chain_entry_t *, ct->num_buckets * 2);
+		if (!buckets) return 1;
+
+		memcpy(buckets, ct->buckets, sizeof(*buckets) * ct->num_buckets);
+		talloc_free(ct->buckets);
+
+		ct->buckets = buckets;
+		ct->num_buckets *= 2;
+		ct->next_grow *= 2;
+		ct->mask = ct->num_buckets - 1;
+	}
+
+	return 1;
+}
+
+static void *chain_finddata(chain_table_t *ct, void const *data)
+{
+	uint32_t	key = ct->hash(data);
+	uint32_t	reversed = chain_reverse(key);
+	chain_entry_t	*cur;
+
+	for (cur = *chain_bucket(ct, key); cur != &ct->null; cur = cur->next) {
+		if (cur->reversed == reversed) {
+			void *out;
+
+			memcpy(&out, &cur->data, sizeof(out));
+			return out;
+		}
+		if (cur->reversed > reversed) break;
+	}
+
+	return NULL;
+}
+
+static int chain_delete(chain_table_t *ct, void const *data)
+{
+	uint32_t	key = ct->hash(data);
+	uint32_t	reversed = chain_reverse(key);
+	chain_entry_t	**last, *cur;
+
+	for (last = chain_bucket(ct, key), cur = *last;
+	     cur != &ct->null;
+	     last = &(cur->next), cur = cur->next) {
+		if (cur->reversed > reversed) break;
+		if (cur->reversed != reversed) continue;
+
+		*last = cur->next;
+		talloc_free(cur);
+		ct->num_elements--;
+		return 1;
+	}
+
+	return 0;
+}
+
+static void chain_free(chain_table_t *ct)
+{
+	int		i;
+	chain_entry_t	*node, *next;
+
+	for (i = 0; i < ct->num_buckets; i++) {
+		if (!ct->buckets[i]) continue;
+
+		for (node = ct->buckets[i]; node != &ct->null; node = next) {
+			next = node->next;
+			talloc_free(node);
+		}
+	}
+
+	talloc_free(ct);
+}
+
+/*
+ *	So that the same timing loops can be run against both tables.
+ */
+typedef struct {
+	char const	*name;
+	void		*(*create)(fr_hash_table_hash_t hash);
+	int		(*insert)(void *table, void const *data);
+	void		*(*finddata)(void *table, void const *data);
+	int		(*delete)(void *table, void const *data);
+	int		(*num_elements)(void *table);
+	void		(*free)(void *table);
+} hash_test_table_t;
+
+static void *open_create(fr_hash_table_hash_t hash) { return fr_hash_table_create(NULL, hash, NULL, NULL); }
+static int open_insert(void *table, void const *data) { return fr_hash_table_insert(table, data); }
+static void *open_finddata(void *table, void const *data) { return fr_hash_table_finddata(table, data); }
+static int open_delete(void *table, void const *data) { return fr_hash_table_delete(table, data); }
+static int open_num_elements(void *table) { return fr_hash_table_num_elements(table); }
+static void open_free(void *table) { fr_hash_table_free(table); }
+
+static void *chained_create(fr_hash_table_hash_t hash) { return chain_create(hash); }
+static int chained_insert(void *table, void const *data) { return chain_insert(table, data); }
+static void *chained_finddata(void *table, void const *data) { return chain_finddata(table, data); }
+static int chained_delete(void *table, void const *data) { return chain_delete(table, data); }
+static int chained_num_elements(void *table) { return ((chain_table_t *)table)->num_elements; }
+static void chained_free(void *table) { chain_free(table); }
+
+static hash_test_table_t const hash_test_tables[] = {
+	{ "open", open_create, open_insert, open_finddata, open_delete, open_num_elements, open_free },
+	{ "chained", chained_create, chained_insert, chained_finddata, chained_delete, chained_num_elements, chained_free },
+};
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: hash_test [OPTS]\n");
+	fprintf(stderr, "  -n <entries>           Number of entries.\n");
+
+	exit(EXIT_SUCCESS);
+}
+
+static uint32_t hash_int(void const *data)
+{
+	return fr_hash((int const *) data, sizeof(int));
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static int hash_test(hash_test_table_t const *tt, int *array)
+{
+	int		i, k, *q;
+	void		*table;
+	uint64_t	start, insert_time, hit_time, miss_time, delete_time;
+
+	table = tt->create(hash_int);
+	if (!table) {
+		fprintf(stderr, "hash_test: Failed creating table\n");
+		return -1;
+	}
+
+	start = now_ns();
+	for (i = 0; i < num_entries; i++) {
+		if (!tt->insert(table, &array[i])) {
+			fprintf(stderr, "hash_test: Failed inserting %i\n", i);
+			return -1;
+		}
+	}
+	insert_time = now_ns() - start;
+
+	start = now_ns();
+	for (i = 0; i < num_entries; i++) {
+		q = tt->finddata(table, &i);
+		if (!q || (*q != i)) {
+			fprintf(stderr, "hash_test: Failed finding %i\n", i);
+			return -1;
+		}
+	}
+	hit_time = now_ns() - start;
+
+	start = now_ns();
+	for (i = num_entries; i < (num_entries * 2); i++) {
+		k = i;
+		if (tt->finddata(table, &k)) {
+			fprintf(stderr, "hash_test: Found missing %i\n", i);
+			return -1;
+		}
+	}
+	miss_time = now_ns() - start;
+
+	/*
+	 *	Delete every other entry, and check that the
+	 *	rest can still be found.
+	 */
+	start = now_ns();
+	for (i = 0; i < num_entries; i += 2) {
+		if (!tt->delete(table, &i)) {
+			fprintf(stderr, "hash_test: Failed deleting %i\n", i);
+			return -1;
+		}
+	}
+	delete_time = now_ns() - start;
+
+	for (i = 0; i < num_entries; i++) {
+		q = tt->finddata(table, &i);
+		if ((i & 1) ? (!q || (*q != i)) : (q != NULL)) {
+			fprintf(stderr, "hash_test: Bad lookup after delete %i\n", i);
+			return -1;
+		}
+	}
+
+	if (tt->num_elements(table) != (num_entries / 2)) {
+		fprintf(stderr, "hash_test: Expected %i entries, found %i\n",
+			num_entries / 2, tt->num_elements(table));
+		return -1;
+	}
+
+	printf("%-8s	insert %" PRIu64 "ns/op	find %" PRIu64 "ns/op	miss %" PRIu64 "ns/op	"
+	       "delete %" PRIu64 "ns/op\n",
+	       tt->name,
+	       insert_time / num_entries, hit_time / num_entries, miss_time / num_entries,
+	       delete_time / ((num_entries + 1) / 2));
+
+	tt->free(table);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i;
+	int			*array;
+
+	while ((c = getopt(argc, argv, "hn:")) != -1) switch (c) {
+		case 'n':
+			num_entries = atoi(optarg);
+			if (num_entries < 2) usage();
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	MEM(array = talloc_array(NULL, int, num_entries));
+	for (i = 0; i < num_entries; i++) array[i] = i;
+
+	printf("entries	%i\n", num_entries);
+
+	for (i = 0; i < (int)NUM_ELEMENTS(hash_test_tables); i++) {
+		if (hash_test(&hash_test_tables[i], array) < 0) exit(EXIT_FAILURE);
+	}
+
+	talloc_free(array);
+
+	exit(EXIT_SUCCESS);
+}
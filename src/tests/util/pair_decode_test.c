@@ -0,0 +1,268 @@
+/*
+ * pair_decode_test.c	Benchmark for decoding and building VALUE_PAIR lists
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2020 The FreeRADIUS server project
+ */
+
+/*
+ *	Builds an Accounting-Request made almost entirely of
+ *	Vendor-Specific attributes, then times how long it takes to
+ *	decode it, and to build a list of the same size by appending
+ *	one pair at a time.
+ *
+ *	Run it with increasing numbers of attributes:
+ *
+ *	    ./pair_decode_test -D share/dictionary -n 60
+ *	    ./pair_decode_test -D share/dictionary -n 240
+ *
+ *	The time per attribute should stay roughly constant.  If it
+ *	grows with -n, something on the decode or append path is
+ *	walking the list.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/util/cursor.h>
+#include <freeradius-devel/util/dict.h>
+#include <freeradius-devel/util/pair.h>
+#include <freeradius-devel/util/time.h>
+#include <freeradius-devel/util/strerror.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#undef MEM
+#define MEM(x) if (!(x)) { fprintf(stderr, "%s[%u] OUT OF MEMORY\n", __FILE__, __LINE__); _exit(EXIT_FAILURE); }
+
+#define VENDORPEC_CISCO	(9)
+
+static int		debug_lvl = 0;
+static int		num_vsas = 60;
+static int		num_subattrs = 1;
+static int		iterations = 10000;
+static char const	*secret = "testing123";
+
+/**********************************************************************/
+typedef struct fr_request_s REQUEST;
+REQUEST *request_alloc(UNUSED TALLOC_CTX *ctx);
+void request_verify(UNUSED char const *file, UNUSED int line, UNUSED REQUEST *request);
+
+REQUEST *request_alloc(UNUSED TALLOC_CTX *ctx)
+{
+	return NULL;
+}
+
+void request_verify(UNUSED char const *file, UNUSED int line, UNUSED REQUEST *request)
+{
+}
+/**********************************************************************/
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: pair_decode_test [OPTS]\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -i <iterations>        Number of times to decode the packet.\n");
+	fprintf(stderr, "  -n <vsas>              Number of Vendor-Specific attributes in the packet.\n");
+	fprintf(stderr, "  -s <subattrs>          Number of vendor attributes in each Vendor-Specific.\n");
+	fprintf(stderr, "  -x                     Debugging mode.\n");
+
+	exit(EXIT_SUCCESS);
+}
+
+/** Build an Accounting-Request full of Cisco-AVPair VSAs
+ *
+ * @return the length of the packet, or 0 if it doesn't fit.
+ */
+static size_t packet_build(uint8_t *packet, size_t packet_len)
+{
+	uint8_t	*p = packet + RADIUS_HEADER_LENGTH, *end = packet + packet_len;
+	int	i, j;
+
+	memset(packet, 0, RADIUS_HEADER_LENGTH);
+	packet[0] = FR_CODE_ACCOUNTING_REQUEST;
+	packet[1] = 1;
+
+	for (i = 0; i < num_vsas; i++) {
+		uint8_t *vsa = p;
+
+		if ((end - p) < 6) return 0;
+		*p++ = FR_VENDOR_SPECIFIC;
+		*p++ = 0;		/* filled in below */
+		*p++ = 0;
+		*p++ = 0;
+		*p++ = 0;
+		*p++ = VENDORPEC_CISCO;
+
+		for (j = 0; j < num_subattrs; j++) {
+			char	value[32];
+			size_t	len;
+
+			len = snprintf(value, sizeof(value), "attr-%i-%i=value", i, j);
+			if ((size_t)(end - p) < (len + 2)) return 0;
+			if (((p - vsa) + len + 2) > 255) return 0;
+
+			*p++ = 1;	/* Cisco-AVPair */
+			*p++ = len + 2;
+			memcpy(p, value, len);
+			p += len;
+		}
+		vsa[1] = p - vsa;
+	}
+
+	packet[2] = ((p - packet) >> 8) & 0xff;
+	packet[3] = (p - packet) & 0xff;
+
+	return p - packet;
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i;
+	TALLOC_CTX		*autofree = talloc_autofree_context();
+	char const		*dict_dir = DICTDIR;
+	uint8_t			packet[MAX_PACKET_LEN];
+	uint8_t			original[RADIUS_HEADER_LENGTH];
+	size_t			packet_len;
+	VALUE_PAIR		*vps = NULL, *vp;
+	fr_cursor_t		cursor;
+	size_t			num_vps = 0;
+	fr_time_t		start;
+	fr_time_delta_t		decode_time = 0, append_time = 0, add_time = 0;
+
+	fr_time_start();
+
+	while ((c = getopt(argc, argv, "D:hi:n:s:x")) != -1) switch (c) {
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'i':
+			iterations = atoi(optarg);
+			if (iterations <= 0) usage();
+			break;
+
+		case 'n':
+			num_vsas = atoi(optarg);
+			if (num_vsas <= 0) usage();
+			break;
+
+		case 's':
+			num_subattrs = atoi(optarg);
+			if (num_subattrs <= 0) usage();
+			break;
+
+		case 'x':
+			debug_lvl++;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (!fr_dict_global_ctx_init(autofree, dict_dir)) {
+		fr_perror("pair_decode_test");
+		exit(EXIT_FAILURE);
+	}
+
+	if (fr_radius_init() < 0) {
+		fr_perror("pair_decode_test");
+		exit(EXIT_FAILURE);
+	}
+
+	packet_len = packet_build(packet, sizeof(packet));
+	if (!packet_len) {
+		fprintf(stderr, "pair_decode_test: %i VSAs with %i attributes each don't fit in a packet\n",
+			num_vsas, num_subattrs);
+		exit(EXIT_FAILURE);
+	}
+	memset(original, 0, sizeof(original));
+
+	/*
+	 *	Decode it once to check it's sane, and to get a list
+	 *	of pairs to use for the append tests.
+	 */
+	if (fr_radius_decode(autofree, packet, packet_len, original,
+			     secret, strlen(secret), &vps) < 0) {
+		fr_perror("pair_decode_test: Failed decoding packet");
+		exit(EXIT_FAILURE);
+	}
+	for (vp = fr_cursor_init(&cursor, &vps); vp; vp = fr_cursor_next(&cursor)) {
+		if (debug_lvl) fr_pair_fprint(stdout, vp);
+		num_vps++;
+	}
+
+	for (i = 0; i < iterations; i++) {
+		TALLOC_CTX		*ctx;
+		VALUE_PAIR		*head = NULL, *copy;
+		fr_cursor_t		out;
+
+		MEM(ctx = talloc_pool(autofree, 64 * 1024));
+
+		start = fr_time();
+		(void) fr_radius_decode(ctx, packet, packet_len, original, secret, strlen(secret), &head);
+		decode_time += fr_time() - start;
+		fr_pair_list_free(&head);
+
+		/*
+		 *	The copies are made outside of the timed
+		 *	sections, so that we only measure the appends.
+		 */
+		fr_cursor_init(&out, &head);
+		for (vp = fr_cursor_head(&cursor); vp; vp = fr_cursor_next(&cursor)) {
+			MEM(copy = fr_pair_copy(ctx, vp));
+
+			start = fr_time();
+			fr_cursor_append(&out, copy);
+			append_time += fr_time() - start;
+		}
+		fr_pair_list_free(&head);
+
+		for (vp = fr_cursor_head(&cursor); vp; vp = fr_cursor_next(&cursor)) {
+			MEM(copy = fr_pair_copy(ctx, vp));
+
+			start = fr_time();
+			fr_pair_add(&head, copy);
+			add_time += fr_time() - start;
+		}
+		fr_pair_list_free(&head);
+
+		talloc_free(ctx);
+	}
+
+	printf("packet length	%zu\n", packet_len);
+	printf("attributes	%zu\n", num_vps);
+	printf("iterations	%i\n", iterations);
+	printf("decode		%" PRIu64 "ns/packet %" PRIu64 "ns/attr\n",
+	       (uint64_t) (decode_time / iterations), (uint64_t) (decode_time / (iterations * num_vps)));
+	printf("cursor append	%" PRIu64 "ns/list %" PRIu64 "ns/attr\n",
+	       (uint64_t) (append_time / iterations), (uint64_t) (append_time / (iterations * num_vps)));
+	printf("fr_pair_add	%" PRIu64 "ns/list %" PRIu64 "ns/attr\n",
+	       (uint64_t) (add_time / iterations), (uint64_t) (add_time / (iterations * num_vps)));
+
+	fr_pair_list_free(&vps);
+	fr_radius_free();
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,6 @@
+TARGET := pair_decode_test
+
+SOURCES		:= pair_decode_test.c
+
+TGT_PREREQS	:= libfreeradius-radius.a libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)
@@ -0,0 +1,234 @@
+/*
+ * pair_index_test.c	Tests for the VALUE_PAIR list attribute index
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2020 The FreeRADIUS server project
+ */
+
+/*
+ *	Builds lists of RADIUS attributes, indexes them with
+ *	fr_pair_list_index_alloc(), and checks that every lookup
+ *	returns the same pair as fr_pair_find_by_da().
+ *
+ *	    ./pair_index_test -D share/dictionary
+ *
+ *	The checks are:
+ *	    - lists shorter than the threshold aren't indexed.
+ *	    - attributes which appear more than once return the first
+ *	      instance.
+ *	    - pairs appended after the index was built are found, and
+ *	      the index grows to hold them.
+ *	    - tags are filtered the same way as fr_pair_find_by_da().
+ *
+ *	The program fails if any lookup differs.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/conf.h>
+#include <freeradius-devel/util/dict.h>
+#include <freeradius-devel/util/pair.h>
+#include <freeradius-devel/util/strerror.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#undef MEM
+#define MEM(x) if (!(x)) { fprintf(stderr, "%s[%u] OUT OF MEMORY\n", __FILE__, __LINE__); _exit(EXIT_FAILURE); }
+
+/*
+ *	Number of different attributes to put in the list.  Enough
+ *	that the index has to grow a few times after it's built.
+ */
+#define NUM_ATTRS	(120)
+
+static fr_dict_t	*dict_internal;
+static fr_dict_t	*dict_radius;
+static int		errors = 0;
+
+/**********************************************************************/
+typedef struct fr_request_s REQUEST;
+REQUEST *request_alloc(UNUSED TALLOC_CTX *ctx);
+void request_verify(UNUSED char const *file, UNUSED int line, UNUSED REQUEST *request);
+
+REQUEST *request_alloc(UNUSED TALLOC_CTX *ctx)
+{
+	return NULL;
+}
+
+void request_verify(UNUSED char const *file, UNUSED int line, UNUSED REQUEST *request)
+{
+}
+/**********************************************************************/
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: pair_index_test [OPTS]\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+
+	exit(EXIT_SUCCESS);
+}
+
+static VALUE_PAIR *pair_add(TALLOC_CTX *ctx, VALUE_PAIR **head, fr_dict_attr_t const *da, int8_t tag)
+{
+	VALUE_PAIR *vp;
+
+	MEM(vp = fr_pair_afrom_da(ctx, da));
+	vp->tag = tag;
+	fr_pair_add(head, vp);
+
+	return vp;
+}
+
+/** Check that the index and a linear search agree
+ *
+ */
+static void check_find(char const *what, fr_pair_list_index_t *idx, VALUE_PAIR *head,
+		       fr_dict_attr_t const *da, int8_t tag, VALUE_PAIR *expected)
+{
+	VALUE_PAIR *found, *scanned;
+
+	found = fr_pair_list_index_find(idx, da, tag);
+	scanned = fr_pair_find_by_da(head, da, tag);
+
+	if ((found != scanned) || (found != expected)) {
+		fprintf(stderr, "pair_index_test: %s - %s tag %i: index %p, scan %p, expected %p\n",
+			what, da->name, tag, found, scanned, expected);
+		errors++;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i;
+	TALLOC_CTX		*autofree = talloc_autofree_context();
+	char const		*dict_dir = DICTDIR;
+	fr_dict_attr_t const	*root, *tunnel_type, *da[NUM_ATTRS];
+	fr_pair_list_index_t	*idx;
+	VALUE_PAIR		*head = NULL, *first[NUM_ATTRS], *tagged[2];
+	int			num_attrs = 0;
+
+	while ((c = getopt(argc, argv, "D:h")) != -1) switch (c) {
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (!fr_dict_global_ctx_init(autofree, dict_dir) ||
+	    (fr_dict_internal_afrom_file(&dict_internal, FR_DICTIONARY_INTERNAL_DIR) < 0) ||
+	    (fr_dict_protocol_afrom_file(&dict_radius, "radius", NULL) < 0)) {
+		fr_perror("pair_index_test");
+		exit(EXIT_FAILURE);
+	}
+
+	root = fr_dict_root(dict_radius);
+	tunnel_type = fr_dict_attr_by_name(dict_radius, "Tunnel-Type");
+	if (!tunnel_type) {
+		fr_perror("pair_index_test");
+		exit(EXIT_FAILURE);
+	}
+
+	/*
+	 *	Any untagged RADIUS attributes will do.
+	 */
+	for (i = 1; (i < 256) && (num_attrs < NUM_ATTRS); i++) {
+		fr_dict_attr_t const *child;
+
+		child = fr_dict_attr_child_by_num(root, i);
+		if (!child || child->flags.has_tag || (child->type == FR_TYPE_VSA)) continue;
+
+		da[num_attrs++] = child;
+	}
+	if (num_attrs < 40) {
+		fprintf(stderr, "pair_index_test: Only found %i attributes in the dictionary\n", num_attrs);
+		exit(EXIT_FAILURE);
+	}
+
+	fr_pair_list_index_threshold = 16;
+
+	/*
+	 *	Short lists aren't indexed.
+	 */
+	for (i = 0; i < 8; i++) first[i] = pair_add(autofree, &head, da[i], TAG_NONE);
+
+	if (fr_pair_list_index_alloc(autofree, head) != NULL) {
+		fprintf(stderr, "pair_index_test: Indexed a list shorter than the threshold\n");
+		errors++;
+	}
+
+	/*
+	 *	Build an index just over the threshold.  Each
+	 *	attribute appears twice, so the second instance
+	 *	must never be returned.
+	 */
+	for (i = 8; i < 16; i++) first[i] = pair_add(autofree, &head, da[i], TAG_NONE);
+	for (i = 0; i < 16; i++) (void) pair_add(autofree, &head, da[i], TAG_NONE);
+
+	idx = fr_pair_list_index_alloc(autofree, head);
+	if (!idx) {
+		fprintf(stderr, "pair_index_test: Failed indexing a list of 32 pairs\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < 16; i++) check_find("duplicate", idx, head, da[i], TAG_ANY, first[i]);
+	for (i = 16; i < num_attrs; i++) check_find("missing", idx, head, da[i], TAG_ANY, NULL);
+
+	/*
+	 *	Append the rest of the attributes, again twice each.
+	 *	The index has to grow to hold them.
+	 */
+	for (i = 16; i < num_attrs; i++) first[i] = pair_add(autofree, &head, da[i], TAG_NONE);
+	for (i = 16; i < num_attrs; i++) (void) pair_add(autofree, &head, da[i], TAG_NONE);
+
+	for (i = 0; i < num_attrs; i++) check_find("appended", idx, head, da[i], TAG_ANY, first[i]);
+
+	/*
+	 *	Tagged attributes.  Only the first instance is in the
+	 *	index, so the others are found by scanning forward.
+	 */
+	tagged[0] = pair_add(autofree, &head, tunnel_type, 1);
+	tagged[1] = pair_add(autofree, &head, tunnel_type, 2);
+	(void) pair_add(autofree, &head, tunnel_type, 1);
+
+	check_find("tag", idx, head, tunnel_type, TAG_ANY, tagged[0]);
+	check_find("tag", idx, head, tunnel_type, 1, tagged[0]);
+	check_find("tag", idx, head, tunnel_type, 2, tagged[1]);
+	check_find("tag", idx, head, tunnel_type, 3, NULL);
+
+	talloc_free(idx);
+
+	if (errors) {
+		fprintf(stderr, "pair_index_test: %i lookups failed\n", errors);
+		exit(EXIT_FAILURE);
+	}
+
+	printf("pair_index_test: OK\n");
+
+	fr_dict_free(&dict_radius);
+	fr_dict_free(&dict_internal);
+
+	exit(EXIT_SUCCESS);
+}
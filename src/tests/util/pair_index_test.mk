@@ -0,0 +1,6 @@
+TARGET := pair_index_test
+
+SOURCES		:= pair_index_test.c
+
+TGT_PREREQS	:= libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)
@@ -0,0 +1,226 @@
+/*
+ * timer_test.c	Benchmark for event list timers
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2020 The FreeRADIUS server project
+ */
+
+/*
+ *	Times inserting, cancelling and firing a large number of timers,
+ *	first with the default timer heap, and then with a timer wheel.
+ *
+ *	The event list runs off a fake clock, so the numbers only
+ *	include the cost of managing the timers.  Timers are spread
+ *	randomly over the next -s seconds.  Half of them are cancelled,
+ *	and then the clock is stepped forward in increments of the
+ *	wheel resolution until the rest have fired.
+ *
+ *	    ./timer_test -n 1000000 -r 0.001
+ *
+ *	The program fails if any timer fires early, or if a timer
+ *	fires more than one clock step later than the heap would.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/event.h>
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/time.h>
+#include <freeradius-devel/util/strerror.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#undef MEM
+#define MEM(x) if (!(x)) { fprintf(stderr, "%s[%u] OUT OF MEMORY\n", __FILE__, __LINE__); _exit(EXIT_FAILURE); }
+
+static int		num_timers = 1000000;
+static fr_time_delta_t	resolution = NSEC / 1000;
+static fr_time_delta_t	spread = (fr_time_delta_t)NSEC * 10;
+
+static fr_time_t	fake_now;
+static fr_time_delta_t	max_late;
+static uint32_t		num_fired;
+static bool		fired_early;
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: timer_test [OPTS]\n");
+	fprintf(stderr, "  -n <timers>            Number of timers.\n");
+	fprintf(stderr, "  -r <seconds>           Resolution of the timer wheel.\n");
+	fprintf(stderr, "  -s <seconds>           Timers are spread over this many seconds.\n");
+
+	exit(EXIT_SUCCESS);
+}
+
+static fr_time_t fake_time(void)
+{
+	return fake_now;
+}
+
+static void timer_fire(UNUSED fr_event_list_t *el, fr_time_t now, void *uctx)
+{
+	fr_time_t when = *(fr_time_t *)uctx;
+
+	if (now < when) fired_early = true;
+	if ((now - when) > max_late) max_late = now - when;
+	num_fired++;
+}
+
+static fr_time_delta_t parse_seconds(char const *str)
+{
+	double seconds = atof(str);
+
+	if (seconds <= 0) usage();
+
+	return (fr_time_delta_t)(seconds * NSEC);
+}
+
+static int timer_test(TALLOC_CTX *ctx, fr_time_delta_t wheel)
+{
+	fr_event_list_t		*el;
+	fr_event_timer_t const	**ev;
+	fr_time_t		*when, start, end;
+	fr_time_delta_t		insert_time, cancel_time, fire_time;
+	int			i;
+
+	fake_now = NSEC;
+	max_late = 0;
+	num_fired = 0;
+	fired_early = false;
+
+	el = fr_event_list_alloc(ctx, NULL, NULL);
+	if (!el) {
+		fr_perror("timer_test");
+		exit(EXIT_FAILURE);
+	}
+	fr_event_list_set_time_func(el, fake_time);
+
+	if (wheel && (fr_event_list_set_timer_wheel(el, wheel) < 0)) {
+		fr_perror("timer_test");
+		exit(EXIT_FAILURE);
+	}
+
+	MEM(ev = talloc_zero_array(ctx, fr_event_timer_t const *, num_timers));
+	MEM(when = talloc_array(ctx, fr_time_t, num_timers));
+
+	for (i = 0; i < num_timers; i++) {
+		when[i] = fake_now + 1 + ((((uint64_t)fr_rand() << 32) | fr_rand()) % spread);
+	}
+
+	start = fr_time();
+	for (i = 0; i < num_timers; i++) {
+		if (fr_event_timer_at(el, el, &ev[i], when[i], timer_fire, &when[i]) < 0) {
+			fr_perror("timer_test");
+			exit(EXIT_FAILURE);
+		}
+	}
+	insert_time = fr_time() - start;
+
+	start = fr_time();
+	for (i = 0; i < num_timers; i += 2) (void) fr_event_timer_delete(el, &ev[i]);
+	cancel_time = fr_time() - start;
+
+	/*
+	 *	Step the clock forward, as the event loop would,
+	 *	and run everything which is due.
+	 */
+	end = fake_now + spread + (resolution * 2);
+	start = fr_time();
+	while (fake_now < end) {
+		fr_time_t now;
+
+		fake_now += resolution;
+
+		do {
+			now = fake_now;
+		} while (fr_event_timer_run(el, &now) == 1);
+	}
+	fire_time = fr_time() - start;
+
+	printf("%-6s	insert %" PRIu64 "ns/timer	cancel %" PRIu64 "ns/timer	fire %" PRIu64 "ns/timer	"
+	       "max late %" PRIu64 "us\n",
+	       wheel ? "wheel" : "heap",
+	       (uint64_t)(insert_time / num_timers), (uint64_t)(cancel_time / (num_timers / 2)),
+	       (uint64_t)(fire_time / (num_timers - (num_timers / 2))), (uint64_t)(max_late / 1000));
+
+	if (fired_early) {
+		fprintf(stderr, "timer_test: Timers fired early\n");
+		return -1;
+	}
+
+	if (num_fired != (uint32_t)(num_timers - (num_timers / 2))) {
+		fprintf(stderr, "timer_test: Expected %i timers to fire, %u did\n",
+			num_timers - (num_timers / 2), num_fired);
+		return -1;
+	}
+
+	/*
+	 *	The heap runs off the same clock steps, so it can
+	 *	also be up to one resolution late.  The wheel can
+	 *	be one more.
+	 */
+	if (max_late >= (resolution * 2)) {
+		fprintf(stderr, "timer_test: Timers fired too late\n");
+		return -1;
+	}
+
+	talloc_free(ev);
+	talloc_free(when);
+	talloc_free(el);
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int			c;
+	TALLOC_CTX		*autofree = talloc_autofree_context();
+
+	fr_time_start();
+
+	while ((c = getopt(argc, argv, "hn:r:s:")) != -1) switch (c) {
+		case 'n':
+			num_timers = atoi(optarg);
+			if (num_timers < 2) usage();
+			break;
+
+		case 'r':
+			resolution = parse_seconds(optarg);
+			break;
+
+		case 's':
+			spread = parse_seconds(optarg);
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	printf("timers	%i\n", num_timers);
+
+	if (timer_test(autofree, 0) < 0) exit(EXIT_FAILURE);
+	if (timer_test(autofree, resolution) < 0) exit(EXIT_FAILURE);
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,259 @@
+/*
+ * trie_rcu_test.c	Benchmark for longest prefix match on large tries
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2020 The FreeRADIUS server project
+ */
+
+/*
+ *	Fills a trie with random IPv4 prefixes, and times longest
+ *	prefix match lookups of random addresses:
+ *
+ *	    - with fr_trie_lookup() on a plain trie.
+ *	    - with fr_trie_rcu_lookup(), and no writer.
+ *	    - with fr_trie_rcu_lookup() from -t reader threads, while
+ *	      another thread keeps adding and removing prefixes.
+ *
+ *	    ./trie_rcu_test -n 100000 -t 4
+ *
+ *	Every lookup result is checked against the plain trie, so
+ *	the program fails if a reader ever sees a half-updated trie.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/util/rand.h>
+#include <freeradius-devel/util/time.h>
+#include <freeradius-devel/util/trie.h>
+#include <freeradius-devel/util/strerror.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef HAVE_STDATOMIC_H
+#  include <stdatomic.h>
+#else
+#  include <freeradius-devel/util/stdatomic.h>
+#endif
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#undef MEM
+#define MEM(x) if (!(x)) { fprintf(stderr, "%s[%u] OUT OF MEMORY\n", __FILE__, __LINE__); _exit(EXIT_FAILURE); }
+
+#define MAX_THREADS	(64)
+
+typedef struct {
+	uint32_t	addr;			//!< In network byte order.
+	size_t		prefix;
+} prefix_t;
+
+static int		num_prefixes = 100000;
+static int		num_lookups = 1000000;
+static int		num_threads = 4;
+
+static fr_trie_t	*plain;
+static fr_trie_rcu_t	*rcu;
+static uint32_t		*addrs;
+static void		**expected;
+
+static _Atomic(bool)	writer_done;
+static _Atomic(uint64_t)	num_updates;
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: trie_rcu_test [OPTS]\n");
+	fprintf(stderr, "  -l <lookups>           Number of lookups per thread.\n");
+	fprintf(stderr, "  -n <prefixes>          Number of prefixes in the trie.\n");
+	fprintf(stderr, "  -t <threads>           Number of reader threads.\n");
+
+	exit(EXIT_SUCCESS);
+}
+
+static void prefix_random(prefix_t *p)
+{
+	p->prefix = 16 + (fr_rand() % 17);
+
+	/*
+	 *	Nothing in 0/8, which is where the writer thread
+	 *	adds and removes its prefix.
+	 */
+	p->addr = htonl((fr_rand() | 0x01000000) & ~((p->prefix == 32) ? 0 : (UINT32_MAX >> p->prefix)));
+}
+
+/** Look up every address, and check the results
+ *
+ */
+static void *reader(void *uctx)
+{
+	intptr_t	errors = 0;
+	int		i;
+
+	for (i = 0; i < num_lookups; i++) {
+		if (fr_trie_rcu_lookup(rcu, &addrs[i], 32) != expected[i]) errors++;
+	}
+
+	if (uctx) *(fr_time_t *)uctx = fr_time();
+
+	return (void *)errors;
+}
+
+/** Keep adding and removing prefixes which are not in the plain trie
+ *
+ * These never change the result of the lookups, as the prefixes are
+ * longer than anything already there, and don't match any of the
+ * addresses looked up.
+ */
+static void *writer(UNUSED void *uctx)
+{
+	uint32_t	addr = htonl(0x00000001);	/* 0.0.0.1 is never looked up */
+	static int	value;
+
+	while (!atomic_load(&writer_done)) {
+		if (fr_trie_rcu_insert(rcu, &addr, 32, &value) < 0) {
+			fr_perror("trie_rcu_test");
+			exit(EXIT_FAILURE);
+		}
+		(void) fr_trie_rcu_remove(rcu, &addr, 32);
+		atomic_fetch_add(&num_updates, 2);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i, inserted = 0;
+	TALLOC_CTX		*autofree = talloc_autofree_context();
+	prefix_t		*prefixes;
+	pthread_t		readers[MAX_THREADS], writer_thread;
+	fr_time_t		start, end[MAX_THREADS];
+	fr_time_delta_t		elapsed;
+	intptr_t		errors = 0;
+
+	fr_time_start();
+
+	while ((c = getopt(argc, argv, "hl:n:t:")) != -1) switch (c) {
+		case 'l':
+			num_lookups = atoi(optarg);
+			if (num_lookups <= 0) usage();
+			break;
+
+		case 'n':
+			num_prefixes = atoi(optarg);
+			if (num_prefixes <= 0) usage();
+			break;
+
+		case 't':
+			num_threads = atoi(optarg);
+			if ((num_threads <= 0) || (num_threads > MAX_THREADS)) usage();
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	MEM(plain = fr_trie_alloc(autofree));
+	MEM(rcu = fr_trie_rcu_alloc(autofree));
+	MEM(prefixes = talloc_array(autofree, prefix_t, num_prefixes));
+	MEM(addrs = talloc_array(autofree, uint32_t, num_lookups));
+	MEM(expected = talloc_array(autofree, void *, num_lookups));
+
+	/*
+	 *	Duplicates are skipped, so the trie may end up with
+	 *	slightly fewer prefixes than asked for.
+	 */
+	start = fr_time();
+	for (i = 0; i < num_prefixes; i++) {
+		prefix_random(&prefixes[i]);
+		if (fr_trie_rcu_insert(rcu, &prefixes[i].addr, prefixes[i].prefix, &prefixes[i]) < 0) continue;
+		MEM(fr_trie_insert(plain, &prefixes[i].addr, prefixes[i].prefix, &prefixes[i]) == 0);
+		inserted++;
+	}
+	elapsed = fr_time() - start;
+
+	printf("prefixes	%i\n", inserted);
+	printf("rcu insert	%" PRIu64 "ns/prefix\n", (uint64_t)(elapsed / num_prefixes));
+
+	/*
+	 *	Half of the addresses are inside a prefix we added.
+	 */
+	for (i = 0; i < num_lookups; i++) {
+		prefix_t const *p = &prefixes[fr_rand() % num_prefixes];
+
+		if (i & 1) {
+			addrs[i] = p->addr | htonl(fr_rand() & ((p->prefix == 32) ? 0 : (UINT32_MAX >> p->prefix)));
+		} else {
+			addrs[i] = htonl(fr_rand() | 0x01000000);
+		}
+	}
+
+	start = fr_time();
+	for (i = 0; i < num_lookups; i++) expected[i] = fr_trie_lookup(plain, &addrs[i], 32);
+	elapsed = fr_time() - start;
+	printf("plain lookup	%" PRIu64 "ns/lookup\n", (uint64_t)(elapsed / num_lookups));
+
+	start = fr_time();
+	errors += (intptr_t)reader(NULL);
+	elapsed = fr_time() - start;
+	printf("rcu lookup	%" PRIu64 "ns/lookup\n", (uint64_t)(elapsed / num_lookups));
+
+	/*
+	 *	Now with concurrent readers and a writer.
+	 */
+	atomic_init(&writer_done, false);
+	atomic_init(&num_updates, 0);
+
+	if (pthread_create(&writer_thread, NULL, writer, NULL) != 0) {
+		fprintf(stderr, "trie_rcu_test: Failed creating writer thread\n");
+		exit(EXIT_FAILURE);
+	}
+
+	start = fr_time();
+	for (i = 0; i < num_threads; i++) {
+		if (pthread_create(&readers[i], NULL, reader, &end[i]) != 0) {
+			fprintf(stderr, "trie_rcu_test: Failed creating reader thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	elapsed = 0;
+	for (i = 0; i < num_threads; i++) {
+		void *ret;
+
+		pthread_join(readers[i], &ret);
+		errors += (intptr_t)ret;
+		if ((end[i] - start) > elapsed) elapsed = end[i] - start;
+	}
+	atomic_store(&writer_done, true);
+	pthread_join(writer_thread, NULL);
+
+	printf("rcu lookup with writer	%i threads	%" PRIu64 "ns/lookup	%" PRIu64 " updates\n",
+	       num_threads, (uint64_t)(elapsed / num_lookups), (uint64_t)atomic_load(&num_updates));
+
+	if (errors) {
+		fprintf(stderr, "trie_rcu_test: %" PRIiPTR " lookups returned the wrong result\n", errors);
+		exit(EXIT_FAILURE);
+	}
+
+	exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,6 @@
+TARGET := trie_rcu_test
+
+SOURCES		:= trie_rcu_test.c
+
+TGT_PREREQS	:= libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)
@@ -0,0 +1,218 @@
+/*
+ * xlat_test.c	Benchmark for expanding tokenized and untokenized xlat strings
+ *
+ * Version:	$Id$
+ *
+ *   This program is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ *
+ * @copyright 2020 The FreeRADIUS server project
+ */
+
+/*
+ *	Expands the rlm_sql accounting queries from the default MySQL
+ *	schema against an Accounting-Request, first with xlat_aeval(),
+ *	which tokenizes the query every time, and then with
+ *	xlat_aeval_compiled(), using queries tokenized once up front,
+ *	as the modules now do.
+ *
+ *	    ./xlat_test -D share/dictionary -i 100000
+ *
+ *	The program fails if the two ever produce different output.
+ */
+RCSID("$Id$")
+
+#include <freeradius-devel/server/base.h>
+#include <freeradius-devel/radius/radius.h>
+#include <freeradius-devel/util/time.h>
+#include <freeradius-devel/util/strerror.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_GETOPT_H
+#  include <getopt.h>
+#endif
+
+#undef MEM
+#define MEM(x) if (!(x)) { fprintf(stderr, "%s[%u] OUT OF MEMORY\n", __FILE__, __LINE__); _exit(EXIT_FAILURE); }
+
+static int		iterations = 10000;
+
+#define EVENT_TIMESTAMP "FROM_UNIXTIME(%l)"
+
+/*
+ *	The start, interim-update and stop queries from
+ *	raddb/mods-config/sql/main/mysql/queries.conf, with the
+ *	configuration references already expanded.
+ */
+static char const *queries[] = {
+	"INSERT INTO radacct (acctsessionid, acctuniqueid, username, realm, nasipaddress, nasportid, "
+	"nasporttype, acctstarttime, acctupdatetime, acctstoptime, acctsessiontime, acctauthentic, "
+	"connectinfo_start, connectinfo_stop, acctinputoctets, acctoutputoctets, calledstationid, "
+	"callingstationid, acctterminatecause, servicetype, framedprotocol, framedipaddress, "
+	"framedipv6address, framedipv6prefix, framedinterfaceid, delegatedipv6prefix) "
+	"VALUES ('%{Acct-Session-Id}', '%{Acct-Unique-Session-Id}', '%{User-Name}', '%{Realm}', "
+	"'%{NAS-IP-Address}', '%{%{NAS-Port-ID}:-%{NAS-Port}}', '%{NAS-Port-Type}', "
+	EVENT_TIMESTAMP ", " EVENT_TIMESTAMP ", NULL, '0', '%{Acct-Authentic}', '%{Connect-Info}', '', "
+	"'0', '0', '%{Called-Station-Id}', '%{Calling-Station-Id}', '', '%{Service-Type}', "
+	"'%{Framed-Protocol}', '%{Framed-IP-Address}', '%{Framed-IPv6-Address}', '%{Framed-IPv6-Prefix}', "
+	"'%{Framed-Interface-Id}', '%{Delegated-IPv6-Prefix}')",
+
+	"UPDATE radacct SET acctupdatetime = (@acctupdatetime_old:=acctupdatetime), "
+	"acctupdatetime = " EVENT_TIMESTAMP ", acctinterval = %l - UNIX_TIMESTAMP(@acctupdatetime_old), "
+	"framedipaddress = '%{Framed-IP-Address}', framedipv6address = '%{Framed-IPv6-Address}', "
+	"framedipv6prefix = '%{Framed-IPv6-Prefix}', framedinterfaceid = '%{Framed-Interface-Id}', "
+	"delegatedipv6prefix = '%{Delegated-IPv6-Prefix}', acctsessiontime = %{%{Acct-Session-Time}:-NULL}, "
+	"acctinputoctets = '%{%{Acct-Input-Gigawords}:-0}' << 32 | '%{%{Acct-Input-Octets}:-0}', "
+	"acctoutputoctets = '%{%{Acct-Output-Gigawords}:-0}' << 32 | '%{%{Acct-Output-Octets}:-0}' "
+	"WHERE acctuniqueid = '%{Acct-Unique-Session-Id}'",
+
+	"UPDATE radacct SET acctstoptime = " EVENT_TIMESTAMP ", "
+	"acctsessiontime = %{%{Acct-Session-Time}:-NULL}, "
+	"acctinputoctets = '%{%{Acct-Input-Gigawords}:-0}' << 32 | '%{%{Acct-Input-Octets}:-0}', "
+	"acctoutputoctets = '%{%{Acct-Output-Gigawords}:-0}' << 32 | '%{%{Acct-Output-Octets}:-0}', "
+	"acctterminatecause = '%{Acct-Terminate-Cause}', connectinfo_stop = '%{Connect-Info}' "
+	"WHERE acctuniqueid = '%{Acct-Unique-Session-Id}'"
+};
+
+#define NUM_QUERIES (sizeof(queries) / sizeof(*queries))
+
+static char const *packet_vps =
+	"User-Name = \"bob\", Acct-Session-Id = \"0123456789\", "
+	"Acct-Unique-Session-Id = \"abcdef0123456789\", NAS-IP-Address = 192.0.2.1, NAS-Port = 17, "
+	"NAS-Port-Type = Ethernet, Acct-Authentic = RADIUS, Called-Station-Id = \"00-11-22-33-44-55\", "
+	"Calling-Station-Id = \"66-77-88-99-aa-bb\", Service-Type = Framed-User, Framed-Protocol = PPP, "
+	"Framed-IP-Address = 198.51.100.7, Acct-Session-Time = 3600, Acct-Input-Octets = 123456, "
+	"Acct-Output-Octets = 654321, Acct-Terminate-Cause = User-Request";
+
+static void NEVER_RETURNS usage(void)
+{
+	fprintf(stderr, "usage: xlat_test [OPTS]\n");
+	fprintf(stderr, "  -D <dictdir>           Set main dictionary directory (defaults to " DICTDIR ").\n");
+	fprintf(stderr, "  -i <iterations>        Number of times to expand each query.\n");
+
+	exit(EXIT_SUCCESS);
+}
+
+int main(int argc, char *argv[])
+{
+	int			c, i;
+	size_t			q;
+	TALLOC_CTX		*autofree = talloc_autofree_context();
+	char const		*dict_dir = DICTDIR;
+	fr_dict_t		*dict_internal, *dict_radius;
+	REQUEST			*request;
+	xlat_exp_t		*compiled[NUM_QUERIES];
+	fr_time_t		start;
+	fr_time_delta_t		eval_time, compiled_time;
+
+	fr_time_start();
+
+	while ((c = getopt(argc, argv, "D:hi:")) != -1) switch (c) {
+		case 'D':
+			dict_dir = optarg;
+			break;
+
+		case 'i':
+			iterations = atoi(optarg);
+			if (iterations <= 0) usage();
+			break;
+
+		case 'h':
+		default:
+			usage();
+	}
+
+	if (!fr_dict_global_ctx_init(autofree, dict_dir) ||
+	    (fr_dict_internal_afrom_file(&dict_internal, FR_DICTIONARY_INTERNAL_DIR) < 0) ||
+	    (fr_dict_protocol_afrom_file(&dict_radius, "radius", NULL) < 0) ||
+	    (xlat_init() < 0)) {
+		fr_perror("xlat_test");
+		exit(EXIT_FAILURE);
+	}
+
+	MEM(request = request_alloc(autofree));
+	MEM(request->packet = fr_radius_alloc(request, false));
+	MEM(request->reply = fr_radius_alloc(request, false));
+	if (fr_pair_list_afrom_str(request->packet, dict_radius, packet_vps, &request->packet->vps) == T_INVALID) {
+		fr_perror("xlat_test");
+		exit(EXIT_FAILURE);
+	}
+
+	for (q = 0; q < NUM_QUERIES; q++) {
+		char *tokens;
+
+		MEM(tokens = talloc_typed_strdup(autofree, queries[q]));
+		if (xlat_tokenize(autofree, &compiled[q], tokens, NULL) < 0) {
+			fr_perror("xlat_test");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if ((xlat_instantiate() < 0) || (xlat_thread_instantiate(autofree) < 0)) {
+		fr_perror("xlat_test");
+		exit(EXIT_FAILURE);
+	}
+
+	for (q = 0; q < NUM_QUERIES; q++) {
+		char *a, *b;
+
+		if ((xlat_aeval(request, &a, request, queries[q], NULL, NULL) < 0) ||
+		    (xlat_aeval_compiled(request, &b, request, compiled[q], NULL, NULL) < 0)) {
+			fr_perror("xlat_test");
+			exit(EXIT_FAILURE);
+		}
+
+		if (strcmp(a, b) != 0) {
+			fprintf(stderr, "xlat_test: Expansions differ\n%s\n%s\n", a, b);
+			exit(EXIT_FAILURE);
+		}
+
+		talloc_free(a);
+		talloc_free(b);
+	}
+
+	start = fr_time();
+	for (i = 0; i < iterations; i++) {
+		for (q = 0; q < NUM_QUERIES; q++) {
+			char *out;
+
+			(void) xlat_aeval(request, &out, request, queries[q], NULL, NULL);
+			talloc_free(out);
+		}
+	}
+	eval_time = fr_time() - start;
+
+	start = fr_time();
+	for (i = 0; i < iterations; i++) {
+		for (q = 0; q < NUM_QUERIES; q++) {
+			char *out;
+
+			(void) xlat_aeval_compiled(request, &out, request, compiled[q], NULL, NULL);
+			talloc_free(out);
+		}
+	}
+	compiled_time = fr_time() - start;
+
+	printf("queries			%zu\n", NUM_QUERIES);
+	printf("iterations		%i\n", iterations);
+	printf("xlat_aeval		%" PRIu64 "ns/query\n", (uint64_t)(eval_time / (iterations * NUM_QUERIES)));
+	printf("xlat_aeval_compiled	%" PRIu64 "ns/query\n", (uint64_t)(compiled_time / (iterations * NUM_QUERIES)));
+
+	talloc_free(request);
+
+	exit(EXIT_SUCCESS);
+}
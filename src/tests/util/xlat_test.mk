@@ -0,0 +1,6 @@
+TARGET := xlat_test
+
+SOURCES		:= xlat_test.c
+
+TGT_PREREQS	:= $(LIBFREERADIUS_SERVER) libfreeradius-radius.a libfreeradius-io.a libfreeradius-util.a
+TGT_LDLIBS	:= $(LIBS)